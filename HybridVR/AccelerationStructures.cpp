@@ -0,0 +1,590 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "AccelerationStructures.h"
+#include "GraphicsCore.h"
+#include "CommandContext.h"
+#include "CommandListManager.h"
+#include "GpuBuffer.h"
+#include "DynamicUploadBuffer.h"
+#include <algorithm>
+#include <atlbase.h>
+#include <cstring>
+#include <map>
+#include <memory>
+
+using namespace Graphics;
+
+extern CComPtr<ID3D12Device5> g_pRaytracingDevice;
+
+void AccelerationStructures::Scheduler::SetBottomLevelCount( uint32_t Count )
+{
+    if (Count != m_Slots.size())
+        m_TopLevelDirty = true;
+    m_Slots.resize(Count);
+}
+
+void AccelerationStructures::Scheduler::MarkDirty( uint32_t Index )
+{
+    ASSERT(Index < m_Slots.size());
+    m_Slots[Index].Dirty = true;
+}
+
+bool AccelerationStructures::Scheduler::IsUpToDate( void ) const
+{
+    if (IsBuilding() || m_TopLevelDirty)
+        return false;
+
+    for (const Slot& BottomLevel : m_Slots)
+    {
+        if (BottomLevel.Dirty)
+            return false;
+    }
+    return true;
+}
+
+bool AccelerationStructures::Scheduler::Update( void )
+{
+    bool Swapped = false;
+    if (m_PendingFence != 0 && m_Builder.IsComplete(m_PendingFence))
+    {
+        m_Builder.MakeCurrent(m_PendingFence);
+
+        // Builds the new top level still instances stay, everything else goes
+        for (const BottomLevelRef& Current : m_CurrentInstances)
+        {
+            if (Current.Index >= m_PendingInstances.size() || m_PendingInstances[Current.Index].Version != Current.Version)
+                m_Builder.Retire(Current);
+        }
+
+        m_CurrentInstances.swap(m_PendingInstances);
+        m_PendingInstances.clear();
+        m_PendingFence = 0;
+        ++m_Generation;
+        Swapped = true;
+    }
+
+    if (m_PendingFence == 0 && !IsUpToDate())
+    {
+        BuildJob Job;
+        Job.Instances.reserve(m_Slots.size());
+        for (uint32_t i = 0; i < m_Slots.size(); ++i)
+        {
+            Slot& BottomLevel = m_Slots[i];
+            if (BottomLevel.Dirty)
+            {
+                BottomLevel.Dirty = false;
+                BottomLevel.NewestVersion = m_NextVersion++;
+                Job.BottomLevels.push_back({ i, BottomLevel.NewestVersion });
+            }
+            Job.Instances.push_back({ i, BottomLevel.NewestVersion });
+        }
+
+        m_PendingInstances = Job.Instances;
+        m_TopLevelDirty = false;
+        m_PendingFence = m_Builder.Submit(Job);
+    }
+
+    return Swapped;
+}
+
+void AccelerationStructures::Scheduler::Flush( void )
+{
+    Update();
+    while (IsBuilding())
+    {
+        m_Builder.Wait(m_PendingFence);
+        Update();
+    }
+}
+
+namespace AccelerationStructures
+{
+    // Bottom level builds of one job share the scratch buffer side by side up to this size.  Past it they
+    // are split into batches separated by UAV barriers, which reuse the same scratch memory.
+    const UINT64 kMaxScratchBatchBytes = 64 * 1024 * 1024;
+
+    const D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS kBuildFlags =
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+
+    uint64_t MakeKey( const BottomLevelRef& BottomLevel )
+    {
+        return (uint64_t)BottomLevel.Index << 32 | BottomLevel.Version;
+    }
+
+    class D3D12Builder : public Builder
+    {
+    public:
+        void SetBottomLevelCount( uint32_t Count );
+
+        // Return true when the bottom level or only its instance needs a new build
+        bool SetGeometries( uint32_t Index, const std::vector<D3D12_RAYTRACING_GEOMETRY_DESC>& Geometries );
+        bool SetFirstHitGroup( uint32_t Index, uint32_t FirstHitGroup );
+
+        uint64_t Submit( const BuildJob& Job ) override;
+        bool IsComplete( uint64_t Fence ) override { return g_CommandManager.IsFenceComplete(Fence); }
+        void Wait( uint64_t Fence ) override { g_CommandManager.WaitForFence(Fence); }
+        void MakeCurrent( uint64_t Fence ) override;
+        void Retire( const BottomLevelRef& BottomLevel ) override;
+
+        D3D12_GPU_VIRTUAL_ADDRESS GetTopLevel( void ) const;
+        void ReleaseRetired( void );
+        void Destroy( void );
+
+    private:
+        CComPtr<ID3D12Resource> CreateStorage( UINT64 Size, const wchar_t* Name );
+        void RetireResource( CComPtr<ID3D12Resource>& Resource );
+
+        struct RetiredResource
+        {
+            CComPtr<ID3D12Resource> Resource;
+            uint64_t Fence;     // Of the graphics queue, after which no frame can still read it
+        };
+
+        std::vector<std::vector<D3D12_RAYTRACING_GEOMETRY_DESC>> m_Geometries;
+        std::vector<D3D12_RAYTRACING_INSTANCE_DESC> m_InstanceDescs;
+        std::map<uint64_t, CComPtr<ID3D12Resource>> m_BottomLevels;
+        CComPtr<ID3D12Resource> m_TopLevel;
+        CComPtr<ID3D12Resource> m_PendingTopLevel;
+        std::unique_ptr<DynamicUploadBuffer> m_PendingInstanceDescs;
+        ByteAddressBuffer m_Scratch;
+        UINT64 m_ScratchSize = 0;
+        std::vector<RetiredResource> m_Retired;
+    };
+
+    D3D12Builder m_Builder;
+    Scheduler m_Scheduler(m_Builder);
+}
+
+void AccelerationStructures::D3D12Builder::SetBottomLevelCount( uint32_t Count )
+{
+    const size_t OldCount = m_InstanceDescs.size();
+    m_Geometries.resize(Count);
+    m_InstanceDescs.resize(Count);
+
+    for (size_t i = OldCount; i < Count; ++i)
+    {
+        D3D12_RAYTRACING_INSTANCE_DESC& Desc = m_InstanceDescs[i];
+        Desc = {};
+        DirectX::XMStoreFloat3x4((DirectX::XMFLOAT3X4*)Desc.Transform, DirectX::XMMatrixIdentity());
+        Desc.InstanceMask = 1;
+    }
+}
+
+bool AccelerationStructures::D3D12Builder::SetGeometries( uint32_t Index,
+    const std::vector<D3D12_RAYTRACING_GEOMETRY_DESC>& Geometries )
+{
+    std::vector<D3D12_RAYTRACING_GEOMETRY_DESC>& Current = m_Geometries[Index];
+    if (Current.size() == Geometries.size() &&
+        memcmp(Current.data(), Geometries.data(), Geometries.size() * sizeof(Geometries[0])) == 0)
+    {
+        return false;
+    }
+
+    Current = Geometries;
+    return true;
+}
+
+bool AccelerationStructures::D3D12Builder::SetFirstHitGroup( uint32_t Index, uint32_t FirstHitGroup )
+{
+    D3D12_RAYTRACING_INSTANCE_DESC& Desc = m_InstanceDescs[Index];
+    if (Desc.InstanceContributionToHitGroupIndex == FirstHitGroup)
+        return false;
+
+    Desc.InstanceContributionToHitGroupIndex = FirstHitGroup;
+    return true;
+}
+
+CComPtr<ID3D12Resource> AccelerationStructures::D3D12Builder::CreateStorage( UINT64 Size, const wchar_t* Name )
+{
+    D3D12_HEAP_PROPERTIES HeapProps = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+    D3D12_RESOURCE_DESC Desc = CD3DX12_RESOURCE_DESC::Buffer(Size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+    CComPtr<ID3D12Resource> Resource;
+    ASSERT_SUCCEEDED(g_Device->CreateCommittedResource(&HeapProps, D3D12_HEAP_FLAG_NONE, &Desc,
+        D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE, nullptr, IID_PPV_ARGS(&Resource)));
+    Resource->SetName(Name);
+    return Resource;
+}
+
+uint64_t AccelerationStructures::D3D12Builder::Submit( const BuildJob& Job )
+{
+    const UINT64 Alignment = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT;
+
+    // Bottom levels, with scratch offsets that restart at every batch
+    std::vector<D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC> BottomLevelDescs(Job.BottomLevels.size());
+    std::vector<bool> StartsBatch(Job.BottomLevels.size());
+    UINT64 ScratchOffset = 0;
+    UINT64 ScratchSize = 0;
+    for (size_t i = 0; i < Job.BottomLevels.size(); ++i)
+    {
+        const std::vector<D3D12_RAYTRACING_GEOMETRY_DESC>& Geometries = m_Geometries[Job.BottomLevels[i].Index];
+
+        D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC& Desc = BottomLevelDescs[i];
+        Desc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+        Desc.Inputs.Flags = kBuildFlags;
+        Desc.Inputs.NumDescs = (UINT)Geometries.size();
+        Desc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+        Desc.Inputs.pGeometryDescs = Geometries.data();
+
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO PrebuildInfo;
+        g_pRaytracingDevice->GetRaytracingAccelerationStructurePrebuildInfo(&Desc.Inputs, &PrebuildInfo);
+
+        const UINT64 BuildScratch = Math::AlignUp(PrebuildInfo.ScratchDataSizeInBytes, Alignment);
+        if (ScratchOffset > 0 && ScratchOffset + BuildScratch > kMaxScratchBatchBytes)
+        {
+            StartsBatch[i] = true;
+            ScratchOffset = 0;
+        }
+
+        CComPtr<ID3D12Resource>& Storage = m_BottomLevels[MakeKey(Job.BottomLevels[i])];
+        Storage = CreateStorage(PrebuildInfo.ResultDataMaxSizeInBytes, L"Bottom Level Acceleration Structure");
+        Desc.DestAccelerationStructureData = Storage->GetGPUVirtualAddress();
+        Desc.ScratchAccelerationStructureData = ScratchOffset;
+
+        ScratchOffset += BuildScratch;
+        ScratchSize = std::max(ScratchSize, ScratchOffset);
+    }
+
+    // The top level, from the cached instance descs
+    for (const BottomLevelRef& Instance : Job.Instances)
+        m_InstanceDescs[Instance.Index].AccelerationStructure = m_BottomLevels[MakeKey(Instance)]->GetGPUVirtualAddress();
+
+    m_PendingInstanceDescs.reset(new DynamicUploadBuffer);
+    m_PendingInstanceDescs->Create(L"Instance Descs", (uint32_t)std::max<size_t>(m_InstanceDescs.size(), 1),
+        sizeof(D3D12_RAYTRACING_INSTANCE_DESC));
+    memcpy(m_PendingInstanceDescs->Map(), m_InstanceDescs.data(), m_InstanceDescs.size() * sizeof(D3D12_RAYTRACING_INSTANCE_DESC));
+
+    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC TopLevelDesc = {};
+    TopLevelDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+    TopLevelDesc.Inputs.Flags = kBuildFlags;
+    TopLevelDesc.Inputs.NumDescs = (UINT)m_InstanceDescs.size();
+    TopLevelDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+    TopLevelDesc.Inputs.InstanceDescs = m_PendingInstanceDescs->GetGpuPointer();
+
+    D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO TopLevelPrebuildInfo;
+    g_pRaytracingDevice->GetRaytracingAccelerationStructurePrebuildInfo(&TopLevelDesc.Inputs, &TopLevelPrebuildInfo);
+    ScratchSize = std::max(ScratchSize, TopLevelPrebuildInfo.ScratchDataSizeInBytes);
+
+    m_PendingTopLevel = CreateStorage(TopLevelPrebuildInfo.ResultDataMaxSizeInBytes, L"Top Level Acceleration Structure");
+    TopLevelDesc.DestAccelerationStructureData = m_PendingTopLevel->GetGPUVirtualAddress();
+
+    // The previous job has completed, so its scratch buffer is free to replace
+    if (ScratchSize > m_ScratchSize)
+    {
+        m_ScratchSize = Math::AlignUp(ScratchSize, Alignment);
+        m_Scratch.Create(L"Acceleration Structure Scratch Buffer", (uint32_t)m_ScratchSize, 1);
+    }
+    TopLevelDesc.ScratchAccelerationStructureData = m_Scratch.GetGpuVirtualAddress();
+
+    ComputeContext& Context = ComputeContext::Begin(L"Build Acceleration Structures", true);
+    CComPtr<ID3D12GraphicsCommandList4> pCommandList;
+    Context.GetCommandList()->QueryInterface(IID_PPV_ARGS(&pCommandList));
+
+    const D3D12_RESOURCE_BARRIER UavBarrier = CD3DX12_RESOURCE_BARRIER::UAV(nullptr);
+    for (size_t i = 0; i < BottomLevelDescs.size(); ++i)
+    {
+        if (StartsBatch[i])
+            pCommandList->ResourceBarrier(1, &UavBarrier);
+
+        BottomLevelDescs[i].ScratchAccelerationStructureData += m_Scratch.GetGpuVirtualAddress();
+        pCommandList->BuildRaytracingAccelerationStructure(&BottomLevelDescs[i], 0, nullptr);
+    }
+    pCommandList->ResourceBarrier(1, &UavBarrier);
+    pCommandList->BuildRaytracingAccelerationStructure(&TopLevelDesc, 0, nullptr);
+
+    return Context.Finish();
+}
+
+void AccelerationStructures::D3D12Builder::RetireResource( CComPtr<ID3D12Resource>& Resource )
+{
+    if (Resource == nullptr)
+        return;
+
+    // Frames recorded from now on trace the new top level
+    m_Retired.push_back({ Resource, g_CommandManager.GetGraphicsQueue().GetNextFenceValue() });
+    Resource.Release();
+}
+
+void AccelerationStructures::D3D12Builder::MakeCurrent( uint64_t )
+{
+    RetireResource(m_TopLevel);
+    m_TopLevel = m_PendingTopLevel;
+    m_PendingTopLevel.Release();
+    m_PendingInstanceDescs.reset();
+}
+
+void AccelerationStructures::D3D12Builder::Retire( const BottomLevelRef& BottomLevel )
+{
+    auto Iter = m_BottomLevels.find(MakeKey(BottomLevel));
+    ASSERT(Iter != m_BottomLevels.end());
+    RetireResource(Iter->second);
+    m_BottomLevels.erase(Iter);
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS AccelerationStructures::D3D12Builder::GetTopLevel( void ) const
+{
+    return m_TopLevel != nullptr ? m_TopLevel->GetGPUVirtualAddress() : 0;
+}
+
+void AccelerationStructures::D3D12Builder::ReleaseRetired( void )
+{
+    CommandQueue& GraphicsQueue = g_CommandManager.GetGraphicsQueue();
+    m_Retired.erase(std::remove_if(m_Retired.begin(), m_Retired.end(),
+        [&GraphicsQueue]( const RetiredResource& Retired ) { return GraphicsQueue.IsFenceComplete(Retired.Fence); }),
+        m_Retired.end());
+}
+
+void AccelerationStructures::D3D12Builder::Destroy( void )
+{
+    m_Retired.clear();
+    m_BottomLevels.clear();
+    m_TopLevel.Release();
+    m_PendingTopLevel.Release();
+    m_PendingInstanceDescs.reset();
+    m_Scratch.Destroy();
+    m_ScratchSize = 0;
+}
+
+void AccelerationStructures::Shutdown( void )
+{
+    m_Scheduler.Flush();
+    g_CommandManager.IdleGPU();
+    m_Builder.Destroy();
+}
+
+void AccelerationStructures::SetBottomLevelCount( uint32_t Count )
+{
+    m_Builder.SetBottomLevelCount(Count);
+    m_Scheduler.SetBottomLevelCount(Count);
+}
+
+void AccelerationStructures::SetBottomLevel( uint32_t Index, const std::vector<D3D12_RAYTRACING_GEOMETRY_DESC>& Geometries,
+    uint32_t FirstHitGroup )
+{
+    if (m_Builder.SetGeometries(Index, Geometries))
+        m_Scheduler.MarkDirty(Index);
+    if (m_Builder.SetFirstHitGroup(Index, FirstHitGroup))
+        m_Scheduler.MarkTopLevelDirty();
+}
+
+void AccelerationStructures::Update( void )
+{
+    m_Scheduler.Update();
+    m_Builder.ReleaseRetired();
+}
+
+void AccelerationStructures::Flush( void )
+{
+    m_Scheduler.Flush();
+    m_Builder.ReleaseRetired();
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS AccelerationStructures::GetTopLevel( void )
+{
+    ASSERT(m_Scheduler.HasTopLevel(), "No acceleration structure was built yet");
+    return m_Builder.GetTopLevel();
+}
+
+namespace AccelerationStructures
+{
+    // Stands in for the GPU builder.  A bottom level build stores the content of its slot instead of a BVH, and a
+    // job completes a fixed number of ticks after it was submitted, as if the compute queue ran behind the frames.
+    //
+    // The Scheduler only hands out build references and fences, so what a build contains cannot change what it
+    // does.  BuildRaytracingAccelerationStructureOnCpu() of the fallback layer (CpuBVH2Builder.cpp) builds real
+    // BVHs, but it returns with the build done, so it could never leave a job in flight across frames, which is
+    // what the swap and release checks need.  HybridVR does not link the fallback layer either.
+    class CpuBuilder : public Builder
+    {
+    public:
+        explicit CpuBuilder( uint32_t Latency ) : m_Latency(Latency) {}
+
+        // What each bottom level should contain, read when a job is submitted like geometry descs are
+        std::vector<uint32_t> Content;
+
+        uint64_t Submit( const BuildJob& Job ) override
+        {
+            ASSERT(m_PendingFence == 0, "A job was submitted while another one was in flight");
+            for (const BottomLevelRef& BottomLevel : Job.BottomLevels)
+            {
+                ASSERT(m_Storage.count(MakeKey(BottomLevel)) == 0, "A live build was overwritten");
+                m_Storage[MakeKey(BottomLevel)] = Content[BottomLevel.Index];
+            }
+            BottomLevelBuilds += (uint32_t)Job.BottomLevels.size();
+
+            m_PendingTopLevel = Job.Instances;
+            m_PendingFence = ++m_LastFence;
+            m_CompleteAtTick = m_Tick + m_Latency;
+            return m_PendingFence;
+        }
+
+        bool IsComplete( uint64_t Fence ) override
+        {
+            return Fence != m_PendingFence || m_Tick >= m_CompleteAtTick;
+        }
+
+        void Wait( uint64_t ) override
+        {
+            m_Tick = std::max(m_Tick, m_CompleteAtTick);
+        }
+
+        void MakeCurrent( uint64_t Fence ) override
+        {
+            ASSERT(Fence == m_PendingFence && m_Tick >= m_CompleteAtTick, "A job was made current before it completed");
+            m_TopLevel.swap(m_PendingTopLevel);
+            m_PendingTopLevel.clear();
+            m_PendingFence = 0;
+        }
+
+        void Retire( const BottomLevelRef& BottomLevel ) override
+        {
+            for (const BottomLevelRef& Instance : m_TopLevel)
+                ASSERT(MakeKey(Instance) != MakeKey(BottomLevel), "A build was retired while it was still instanced");
+            const size_t Erased = m_Storage.erase(MakeKey(BottomLevel));
+            ASSERT(Erased == 1, "A build was retired twice");
+        }
+
+        void Tick( void ) { ++m_Tick; }
+
+        // True when every instance of the current top level has live storage holding the given content
+        bool TopLevelMatches( const std::vector<uint32_t>& Expected ) const
+        {
+            if (m_TopLevel.size() != Expected.size())
+                return false;
+            for (size_t i = 0; i < m_TopLevel.size(); ++i)
+            {
+                auto Iter = m_Storage.find(MakeKey(m_TopLevel[i]));
+                if (m_TopLevel[i].Index != i || Iter == m_Storage.end() || Iter->second != Expected[i])
+                    return false;
+            }
+            return true;
+        }
+
+        bool TopLevelIsLive( void ) const
+        {
+            for (const BottomLevelRef& Instance : m_TopLevel)
+            {
+                if (m_Storage.count(MakeKey(Instance)) == 0)
+                    return false;
+            }
+            return true;
+        }
+
+        size_t GetLiveBuilds( void ) const { return m_Storage.size(); }
+
+        uint32_t BottomLevelBuilds = 0;
+
+    private:
+        uint32_t m_Latency;
+        uint32_t m_Tick = 0;
+        uint32_t m_CompleteAtTick = 0;
+        uint64_t m_LastFence = 0;
+        uint64_t m_PendingFence = 0;
+        std::map<uint64_t, uint32_t> m_Storage;
+        std::vector<BottomLevelRef> m_TopLevel;
+        std::vector<BottomLevelRef> m_PendingTopLevel;
+    };
+}
+
+bool AccelerationStructures::RunSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, float Value )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("Acceleration structure self test failed:  %s (%f)\n", Name, Value);
+            Passed = false;
+        }
+    };
+
+    const uint32_t kBottomLevels = 8;
+    const uint32_t kLatency = 3;
+
+    CpuBuilder Cpu(kLatency);
+    Scheduler Jobs(Cpu);
+
+    Cpu.Content.resize(kBottomLevels);
+    for (uint32_t i = 0; i < kBottomLevels; ++i)
+        Cpu.Content[i] = 100 + i;
+    Jobs.SetBottomLevelCount(kBottomLevels);
+    Jobs.Flush();
+
+    Expect(Jobs.GetGeneration() == 1, "one generation after the first flush", (float)Jobs.GetGeneration());
+    Expect(Cpu.BottomLevelBuilds == kBottomLevels, "every bottom level built once", (float)Cpu.BottomLevelBuilds);
+    Expect(Cpu.TopLevelMatches(Cpu.Content), "first top level matches the scene", 0.0f);
+
+    // Runs frames until the scene is current.  Every frame must trace a top level whose storage is live,
+    // and until the first swap it must still be the one built from Before.
+    auto RunFrames = [&]( uint32_t MaxFrames, const std::vector<uint32_t>& Before ) -> uint32_t
+    {
+        const uint32_t FirstGeneration = Jobs.GetGeneration();
+        uint32_t Frames = 0;
+        for (; Frames < MaxFrames && !Jobs.IsUpToDate(); ++Frames)
+        {
+            Jobs.Update();
+            Expect(Cpu.TopLevelIsLive(), "frames trace live storage", (float)Frames);
+            if (Jobs.GetGeneration() == FirstGeneration)
+                Expect(Cpu.TopLevelMatches(Before), "the old top level serves until the swap", (float)Frames);
+            Cpu.Tick();
+        }
+        return Frames;
+    };
+
+    // One edit rebuilds one bottom level, and an edit during the build waits for the next job
+    std::vector<uint32_t> Before = Cpu.Content;
+    uint32_t BuildsBefore = Cpu.BottomLevelBuilds;
+    Cpu.Content[3] = 200;
+    Jobs.MarkDirty(3);
+    Jobs.Update();
+    Cpu.Tick();
+    Cpu.Content[5] = 300;
+    Jobs.MarkDirty(5);
+    uint32_t Frames = RunFrames(32, Before);
+    Expect(Jobs.IsUpToDate(), "edits become current", (float)Frames);
+    Expect(Cpu.BottomLevelBuilds - BuildsBefore == 2, "only the edited bottom levels rebuilt", (float)(Cpu.BottomLevelBuilds - BuildsBefore));
+    Expect(Jobs.GetGeneration() == 3, "two more generations", (float)Jobs.GetGeneration());
+    Expect(Cpu.TopLevelMatches(Cpu.Content), "top level matches the edits", 0.0f);
+    Expect(Cpu.GetLiveBuilds() == kBottomLevels, "replaced builds were released", (float)Cpu.GetLiveBuilds());
+
+    // Editing the same bottom level twice before a job starts builds it once
+    Before = Cpu.Content;
+    BuildsBefore = Cpu.BottomLevelBuilds;
+    Cpu.Content[1] = 400;
+    Jobs.MarkDirty(1);
+    Jobs.MarkDirty(1);
+    RunFrames(32, Before);
+    Expect(Cpu.BottomLevelBuilds - BuildsBefore == 1, "repeated edits rebuild once", (float)(Cpu.BottomLevelBuilds - BuildsBefore));
+
+    // Instance changes rebuild the top level only
+    BuildsBefore = Cpu.BottomLevelBuilds;
+    const uint32_t GenerationBefore = Jobs.GetGeneration();
+    Jobs.MarkTopLevelDirty();
+    RunFrames(32, Cpu.Content);
+    Expect(Cpu.BottomLevelBuilds == BuildsBefore, "top level only", (float)(Cpu.BottomLevelBuilds - BuildsBefore));
+    Expect(Jobs.GetGeneration() == GenerationBefore + 1, "top level only swaps", (float)Jobs.GetGeneration());
+
+    // Shrinking releases the dropped bottom levels at the swap and growing builds only the new ones
+    Before = Cpu.Content;
+    Cpu.Content.resize(5);
+    Jobs.SetBottomLevelCount(5);
+    RunFrames(32, Before);
+    Expect(Cpu.TopLevelMatches(Cpu.Content), "top level matches after shrinking", 0.0f);
+    Expect(Cpu.GetLiveBuilds() == 5, "dropped bottom levels released", (float)Cpu.GetLiveBuilds());
+
+    BuildsBefore = Cpu.BottomLevelBuilds;
+    Cpu.Content.push_back(500);
+    Jobs.SetBottomLevelCount(6);
+    Jobs.Flush();
+    Expect(Cpu.BottomLevelBuilds - BuildsBefore == 1, "growing builds only the new bottom level", (float)(Cpu.BottomLevelBuilds - BuildsBefore));
+    Expect(Cpu.TopLevelMatches(Cpu.Content), "top level matches after growing", 0.0f);
+
+    return Passed;
+}
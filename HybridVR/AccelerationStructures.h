@@ -0,0 +1,125 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// Keeps the ray tracing acceleration structures up to date without stalling the frame.  The scene is split
+// into several bottom level structures.  Each one remembers the geometry descs it was built from and is
+// rebuilt only when they change.  The top level is rebuilt from the cached instance descs whenever any
+// bottom level or instance changes.
+//
+// Builds run on the async compute queue into new storage.  The ray tracing passes keep reading the previous
+// generation until the build's fence has passed, and the storage it replaced is released once the graphics
+// queue is done with it.
+//
+// Scheduler holds the dirty tracking and the swap logic apart from D3D12, so that RunSelfTest() can drive it
+// with a stand-in builder that completes jobs late.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace AccelerationStructures
+{
+    // One build of one bottom level structure
+    struct BottomLevelRef
+    {
+        uint32_t Index;
+        uint32_t Version;
+    };
+
+    struct BuildJob
+    {
+        std::vector<BottomLevelRef> BottomLevels;   // To build, each into new storage
+        std::vector<BottomLevelRef> Instances;      // What the new top level instances, one per bottom level
+    };
+
+    // Does the work a Scheduler asks for
+    class Builder
+    {
+    public:
+        virtual ~Builder() {}
+
+        // Starts building a job and returns the fence value that signals its completion
+        virtual uint64_t Submit( const BuildJob& Job ) = 0;
+        virtual bool IsComplete( uint64_t Fence ) = 0;
+        virtual void Wait( uint64_t Fence ) = 0;
+
+        // The top level of the completed job is the one to trace from now on
+        virtual void MakeCurrent( uint64_t Fence ) = 0;
+
+        // The current top level no longer instances this build
+        virtual void Retire( const BottomLevelRef& BottomLevel ) = 0;
+    };
+
+    // At most one job is in flight.  Whatever is marked dirty while it runs goes into the next one.
+    class Scheduler
+    {
+    public:
+        explicit Scheduler( Builder& Builder ) : m_Builder(Builder) {}
+
+        // Bottom levels beyond the old count start dirty, those beyond the new one are retired at the next swap
+        void SetBottomLevelCount( uint32_t Count );
+        uint32_t GetBottomLevelCount( void ) const { return (uint32_t)m_Slots.size(); }
+
+        void MarkDirty( uint32_t Index );
+        void MarkTopLevelDirty( void ) { m_TopLevelDirty = true; }
+
+        // Swaps in the job that completed, then submits the next one if anything is dirty.  Returns true on a swap.
+        bool Update( void );
+
+        // Waits until everything marked dirty so far is current
+        void Flush( void );
+
+        bool IsBuilding( void ) const { return m_PendingFence != 0; }
+        bool HasTopLevel( void ) const { return m_Generation > 0; }
+        bool IsUpToDate( void ) const;
+        uint32_t GetGeneration( void ) const { return m_Generation; }
+
+        // The builds the current top level instances
+        const std::vector<BottomLevelRef>& GetCurrentInstances( void ) const { return m_CurrentInstances; }
+
+    private:
+        struct Slot
+        {
+            uint32_t NewestVersion = 0;     // Submitted most recently, current or pending
+            bool Dirty = true;
+        };
+
+        Builder& m_Builder;
+        std::vector<Slot> m_Slots;
+        std::vector<BottomLevelRef> m_CurrentInstances;
+        std::vector<BottomLevelRef> m_PendingInstances;
+        uint64_t m_PendingFence = 0;
+        uint32_t m_NextVersion = 1;     // Shared by all bottom levels so a resized slot never reuses a live version
+        uint32_t m_Generation = 0;
+        bool m_TopLevelDirty = false;
+    };
+
+    // The scene's structures, built with the async compute queue
+
+    void Shutdown( void );
+
+    // Replaces the geometries of one bottom level structure and the hit group its instance starts at.
+    // The bottom level is only rebuilt when the geometries differ from the last ones.
+    void SetBottomLevelCount( uint32_t Count );
+    void SetBottomLevel( uint32_t Index, const std::vector<D3D12_RAYTRACING_GEOMETRY_DESC>& Geometries,
+        uint32_t FirstHitGroup );
+
+    // Once a frame, before any ray tracing is recorded
+    void Update( void );
+
+    // Blocks until the current top level reflects every change so far
+    void Flush( void );
+
+    D3D12_GPU_VIRTUAL_ADDRESS GetTopLevel( void );
+
+    // Drives a Scheduler with a stand-in builder whose jobs complete out of step with the frames, and checks
+    // that only dirty bottom levels are rebuilt and that nothing is released while it is still instanced
+    bool RunSelfTest( void );
+}
@@ -14,6 +14,7 @@
 #define HLSL
 #include "ModelViewerRaytracing.h"
 #include "RayTracingHlslCompat.h"
+#include "HitAttributes.hlsli"
 
 cbuffer Material : register(b3)
 {
@@ -22,7 +23,7 @@ cbuffer Material : register(b3)
 
 StructuredBuffer<RayTraceMeshInfo> g_meshInfo : register(t1);
 ByteAddressBuffer g_indices : register(t2);
-ByteAddressBuffer g_attributes : register(t3);
+ByteAddressBuffer g_attributes : register(t3); // Packed hit attributes, see HitAttributes.h
 Texture2D<float> texShadow : register(t4);
 Texture2D<float> texSSAO : register(t5);
 SamplerState      g_s0 : register(s0);
@@ -79,9 +80,10 @@ float GetShadow(float3 ShadowCoord)
     return result * result;
 }
 
-float2 GetUVAttribute(uint byteOffset)
+float2 GetUVAttribute(RayTraceMeshInfo info, uint vertexIndex)
 {
-    return asfloat(g_attributes.Load2(byteOffset));
+    const uint packedUV = g_attributes.Load(info.m_vertexOffsetBytes + vertexIndex * PACKED_VERTEX_STRIDE + 8);
+    return UnpackUV(packedUV, info.m_uvOffset, info.m_uvScale);
 }
 
 void AntiAliasSpecular(inout float3 texNormal, inout float gloss)
@@ -222,74 +224,23 @@ void CalculateUVDerivatives(float3 normal, float3 dpdu, float3 dpdv, float3 p, f
 [shader("anyhit")]
 void AnyHit(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes attr)
 {
-    payload.RayHitT = RayTCurrent();
-    if (payload.SkipShading)
-    {
-        return;
-    }
-
-    uint materialID = MaterialID;
-    uint triangleID = PrimitiveIndex();
-
-    RayTraceMeshInfo info = g_meshInfo[materialID];
+    // Only triangles classified as partially covered reach this shader (see TriangleOpacity.h).  The
+    // classification assumes the top mip level, so sample it here regardless of the ray's footprint.
+    RayTraceMeshInfo info = g_meshInfo[MaterialID];
 
     const uint3 ii = Load3x16BitIndices(info.m_indexOffsetBytes + PrimitiveIndex() * 3 * 2);
-    const float2 uv0 = GetUVAttribute(info.m_uvAttributeOffsetBytes + ii.x * info.m_attributeStrideBytes);
-    const float2 uv1 = GetUVAttribute(info.m_uvAttributeOffsetBytes + ii.y * info.m_attributeStrideBytes);
-    const float2 uv2 = GetUVAttribute(info.m_uvAttributeOffsetBytes + ii.z * info.m_attributeStrideBytes);
+    const float2 uv0 = GetUVAttribute(info, ii.x);
+    const float2 uv1 = GetUVAttribute(info, ii.y);
+    const float2 uv2 = GetUVAttribute(info, ii.z);
 
     float3 bary = float3(1.0 - attr.barycentrics.x - attr.barycentrics.y, attr.barycentrics.x, attr.barycentrics.y);
     float2 uv = bary.x * uv0 + bary.y * uv1 + bary.z * uv2;
 
-    const float3 normal0 = asfloat(g_attributes.Load3(info.m_normalAttributeOffsetBytes + ii.x * info.m_attributeStrideBytes));
-    const float3 normal1 = asfloat(g_attributes.Load3(info.m_normalAttributeOffsetBytes + ii.y * info.m_attributeStrideBytes));
-    const float3 normal2 = asfloat(g_attributes.Load3(info.m_normalAttributeOffsetBytes + ii.z * info.m_attributeStrideBytes));
-    float3 vsNormal = normalize(normal0 * bary.x + normal1 * bary.y + normal2 * bary.z);
-    
-    const float3 tangent0 = asfloat(g_attributes.Load3(info.m_tangentAttributeOffsetBytes + ii.x * info.m_attributeStrideBytes));
-    const float3 tangent1 = asfloat(g_attributes.Load3(info.m_tangentAttributeOffsetBytes + ii.y * info.m_attributeStrideBytes));
-    const float3 tangent2 = asfloat(g_attributes.Load3(info.m_tangentAttributeOffsetBytes + ii.z * info.m_attributeStrideBytes));
-    float3 vsTangent = normalize(tangent0 * bary.x + tangent1 * bary.y + tangent2 * bary.z);
-
-    // Reintroduced the bitangent because we aren't storing the handedness of the tangent frame anywhere.  Assuming the space
-    // is right-handed causes normal maps to invert for some surfaces.  The Sponza mesh has all three axes of the tangent frame.
-    //float3 vsBitangent = normalize(cross(vsNormal, vsTangent)) * (isRightHanded ? 1.0 : -1.0);
-    const float3 bitangent0 = asfloat(g_attributes.Load3(info.m_bitangentAttributeOffsetBytes + ii.x * info.m_attributeStrideBytes));
-    const float3 bitangent1 = asfloat(g_attributes.Load3(info.m_bitangentAttributeOffsetBytes + ii.y * info.m_attributeStrideBytes));
-    const float3 bitangent2 = asfloat(g_attributes.Load3(info.m_bitangentAttributeOffsetBytes + ii.z * info.m_attributeStrideBytes));
-    float3 vsBitangent = normalize(bitangent0 * bary.x + bitangent1 * bary.y + bitangent2 * bary.z);
-
-    // TODO: Should just store uv partial derivatives in here rather than loading position and caculating it per pixel
-    const float3 p0 = asfloat(g_attributes.Load3(info.m_positionAttributeOffsetBytes + ii.x * info.m_attributeStrideBytes));
-    const float3 p1 = asfloat(g_attributes.Load3(info.m_positionAttributeOffsetBytes + ii.y * info.m_attributeStrideBytes));
-    const float3 p2 = asfloat(g_attributes.Load3(info.m_positionAttributeOffsetBytes + ii.z * info.m_attributeStrideBytes));
-
-    float3 worldPosition = WorldRayOrigin() + WorldRayDirection() * RayTCurrent();
-
-    uint2 threadID = DispatchRaysIndex().xy;
-    float3 ddxOrigin, ddxDir, ddyOrigin, ddyDir;
-    GenerateCameraRay(uint2(threadID.x + 1, threadID.y), ddxOrigin, ddxDir);
-    GenerateCameraRay(uint2(threadID.x, threadID.y + 1), ddyOrigin, ddyDir);
-
-    float3 triangleNormal = normalize(cross(p2 - p0, p1 - p0));
-    float3 xOffsetPoint = RayPlaneIntersection(worldPosition, triangleNormal, ddxOrigin, ddxDir);
-    float3 yOffsetPoint = RayPlaneIntersection(worldPosition, triangleNormal, ddyOrigin, ddyDir);
-
-    float3 dpdu, dpdv;
-    CalculateTrianglePartialDerivatives(uv0, uv1, uv2, p0, p1, p2, dpdu, dpdv);
-    float2 ddx, ddy;
-    CalculateUVDerivatives(triangleNormal, dpdu, dpdv, worldPosition, xOffsetPoint, yOffsetPoint, ddx, ddy);
-    
-    const float3 viewDir = normalize(-WorldRayDirection());
-    uint materialInstanceId = info.m_materialInstanceId;
-
-    const float4 textureSample = g_localTexture.SampleGrad(g_s0, uv, ddx, ddy);
-
-
-    if(textureSample.a == 1)
+    // Same cutoff as DepthViewerPS
+    if (g_localTexture.SampleLevel(g_s0, uv, 0).a < 0.5)
     {
-	    /*g_screenOutput[int3(DispatchRaysIndex().xy, g_dynamic.curCam)] = float4(1,0,0, 1);
-        AcceptHitAndEndSearch();*/
         IgnoreHit();
     }
+
+    payload.RayHitT = RayTCurrent();
 }
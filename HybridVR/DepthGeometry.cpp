@@ -0,0 +1,337 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "DepthGeometry.h"
+#include "MeshletCulling.h"
+#include "TestMeshes.h"
+#include "Model.h"
+#include "CommandContext.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Settings
+{
+    BoolVar DepthGeometry_Merge("Application/Merged Depth Geometry", true);
+}
+
+namespace
+{
+    // m_RootSig[6] in ModelViewer.cpp, the meshes of DepthOnlyVS.hlsl
+    const uint32_t kMeshRootIndex = 6;
+
+    // The indices of a level of a mesh in the model's index data.  Level 0 is the mesh itself, the same as
+    // RenderObjects() draws it.
+    const uint16_t* GetLevelIndices( const Model& Model, uint32_t MeshIndex, uint32_t Level, uint32_t& Count )
+    {
+        const Model::Mesh& Mesh = Model.m_pMesh[MeshIndex];
+        uint32_t ByteOffset = Mesh.indexDataByteOffset;
+        Count = Mesh.indexCount;
+        if (Level > 0)
+        {
+            const Model::LodLevel& Lod = Model.GetLod(MeshIndex, Level);
+            ByteOffset = Lod.indexDataByteOffset;
+            Count = Lod.indexCount;
+        }
+        return (const uint16_t*)(Model.m_pIndexData + ByteOffset);
+    }
+
+    const int16_t* GetPosition( const Model& Model, const Model::Mesh& Mesh, uint32_t VertexIndex )
+    {
+        return ((const Model::QuantizedVertex*)(Model.m_pVertexData + Mesh.vertexDataByteOffset) + VertexIndex)->position;
+    }
+
+    uint64_t GetPositionKey( const int16_t Position[3] )
+    {
+        return (uint64_t)(uint16_t)Position[0] | (uint64_t)(uint16_t)Position[1] << 16 | (uint64_t)(uint16_t)Position[2] << 32;
+    }
+}
+
+void DepthGeometry::Build( const Model& Model, const std::vector<bool>& CutoutMaterials, Geometry& Geometry )
+{
+    ASSERT(Model.IsQuantized(), "The merged depth geometry keeps the quantized positions");
+
+    const uint32_t MeshCount = Model.m_Header.meshCount;
+    Geometry.LevelCount = std::max(Model.m_LodCount, 1u);
+    Geometry.Vertices.clear();
+    Geometry.Indices.clear();
+    Geometry.Meshes.resize(MeshCount);
+    Geometry.Ranges.assign(MeshCount * Geometry.LevelCount, Range{ 0, 0 });
+
+    // Each merged mesh's vertex for each of the model's vertices, numbered by first use over its levels
+    std::vector<std::vector<uint32_t>> Remap(MeshCount);
+    std::unordered_map<uint64_t, uint32_t> Unique;
+    for (uint32_t m = 0; m < MeshCount; ++m)
+    {
+        const Model::Mesh& Mesh = Model.m_pMesh[m];
+        Model::GetPositionDequantization(Mesh, Geometry.Meshes[m].PositionScale, Geometry.Meshes[m].PositionOffset);
+        if (Mesh.materialIndex < CutoutMaterials.size() && CutoutMaterials[Mesh.materialIndex])
+            continue;
+
+        Remap[m].assign(Mesh.vertexCount, UINT32_MAX);
+        Unique.clear();
+        for (uint32_t Level = 0; Level < Geometry.LevelCount; ++Level)
+        {
+            uint32_t Count;
+            const uint16_t* Indices = GetLevelIndices(Model, m, Level, Count);
+            for (uint32_t i = 0; i < Count; ++i)
+            {
+                uint32_t& Merged = Remap[m][Indices[i]];
+                if (Merged != UINT32_MAX)
+                    continue;
+
+                const int16_t* Position = GetPosition(Model, Mesh, Indices[i]);
+                const auto Inserted = Unique.emplace(GetPositionKey(Position), (uint32_t)Geometry.Vertices.size());
+                if (Inserted.second)
+                {
+                    Vertex NewVertex = { { Position[0], Position[1], Position[2], Position[3] }, m };
+                    Geometry.Vertices.push_back(NewVertex);
+                }
+                Merged = Inserted.first->second;
+            }
+        }
+    }
+
+    for (uint32_t Level = 0; Level < Geometry.LevelCount; ++Level)
+    {
+        for (uint32_t m = 0; m < MeshCount; ++m)
+        {
+            if (Remap[m].empty())
+                continue;
+
+            uint32_t Count;
+            const uint16_t* Indices = GetLevelIndices(Model, m, Level, Count);
+            Geometry.Ranges[m * Geometry.LevelCount + Level] = { (uint32_t)Geometry.Indices.size(), Count };
+            for (uint32_t i = 0; i < Count; ++i)
+                Geometry.Indices.push_back(Remap[m][Indices[i]]);
+        }
+    }
+}
+
+void DepthGeometry::GatherDraws( const Geometry& Geometry, const uint32_t* Levels, const MeshletCulling::Result* Culled,
+    std::vector<Range>& Draws )
+{
+    Draws.clear();
+    for (uint32_t m = 0; m < (uint32_t)Geometry.Meshes.size(); ++m)
+    {
+        if (Culled && Culled->Draws[m].IndexCount == 0)
+            continue;
+
+        const uint32_t Level = Levels ? std::min(Levels[m], Geometry.LevelCount - 1) : 0;
+        const Range& Mesh = Geometry.Ranges[m * Geometry.LevelCount + Level];
+        if (Mesh.IndexCount == 0)
+            continue;
+
+        if (!Draws.empty() && Draws.back().StartIndex + Draws.back().IndexCount == Mesh.StartIndex)
+            Draws.back().IndexCount += Mesh.IndexCount;
+        else
+            Draws.push_back(Mesh);
+    }
+}
+
+namespace
+{
+    DepthGeometry::Geometry m_Geometry;
+    StructuredBuffer m_VertexBuffer;
+    ByteAddressBuffer m_IndexBuffer;
+    StructuredBuffer m_MeshBuffer;
+    std::vector<DepthGeometry::Range> m_Draws;
+}
+
+void DepthGeometry::Initialize( const Model& Model, const std::vector<bool>& CutoutMaterials )
+{
+    Build(Model, CutoutMaterials, m_Geometry);
+    m_Draws.clear();
+    if (m_Geometry.Indices.empty())
+        return;
+
+    m_VertexBuffer.Create(L"Depth Geometry Vertex Buffer", (uint32_t)m_Geometry.Vertices.size(), sizeof(Vertex),
+        m_Geometry.Vertices.data());
+    m_IndexBuffer.Create(L"Depth Geometry Index Buffer", (uint32_t)m_Geometry.Indices.size(), sizeof(uint32_t),
+        m_Geometry.Indices.data());
+    m_MeshBuffer.Create(L"Depth Geometry Mesh Buffer", (uint32_t)m_Geometry.Meshes.size(), sizeof(MeshDequantization),
+        m_Geometry.Meshes.data());
+
+    // Only the ranges are needed to draw
+    std::vector<Vertex>().swap(m_Geometry.Vertices);
+    std::vector<uint32_t>().swap(m_Geometry.Indices);
+}
+
+void DepthGeometry::Draw( GraphicsContext& Context, const uint32_t* Levels, const MeshletCulling::Result* Culled )
+{
+    GatherDraws(m_Geometry, Levels, Culled, m_Draws);
+    if (m_Draws.empty())
+        return;
+
+    Context.SetVertexBuffer(0, m_VertexBuffer.VertexBufferView());
+    Context.SetIndexBuffer(m_IndexBuffer.IndexBufferView());
+    Context.SetBufferSRV(kMeshRootIndex, m_MeshBuffer);
+    for (const Range& Draw : m_Draws)
+        Context.DrawIndexed(Draw.IndexCount, Draw.StartIndex, 0);
+}
+
+uint32_t DepthGeometry::GetDrawCount( void )
+{
+    return (uint32_t)m_Draws.size();
+}
+
+namespace
+{
+    // Gives the self test the loader's quantization
+    class QuantizedTestModel : public Model
+    {
+    public:
+        using Model::QuantizeVertexData;
+    };
+}
+
+bool DepthGeometry::RunSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, float Value )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("Depth geometry self test failed:  %s (%f)\n", Name, Value);
+            Passed = false;
+        }
+    };
+
+    // Mesh 0 is a square of two grids that share an edge, so its positions repeat.  Mesh 1 is cutout and
+    // mesh 2 a sphere, whose poles and seam repeat positions too.
+    const float kPi = 3.14159265f;
+    std::vector<TestMeshes::Mesh> Meshes(3);
+    Meshes[0].Material = 0;
+    TestMeshes::AddGrid(Meshes[0], 16, 16,
+        []( float U, float V ) { return XMFLOAT3(U - 1.0f, 0.0f, V); },
+        []( const XMFLOAT3& ) { return XMFLOAT3(0.0f, 1.0f, 0.0f); });
+    TestMeshes::AddGrid(Meshes[0], 16, 16,
+        []( float U, float V ) { return XMFLOAT3(U, 0.0f, V); },
+        []( const XMFLOAT3& ) { return XMFLOAT3(0.0f, 1.0f, 0.0f); });
+    Meshes[1].Material = 1;
+    TestMeshes::AddGrid(Meshes[1], 8, 8,
+        []( float U, float V ) { return XMFLOAT3(U, 1.0f, V); },
+        []( const XMFLOAT3& ) { return XMFLOAT3(0.0f, 1.0f, 0.0f); });
+    Meshes[2].Material = 0;
+    TestMeshes::AddGrid(Meshes[2], 24, 48,
+        [&]( float U, float V )
+        {
+            const float Ring = U > 0.0f && U < 1.0f ? std::sin(U * kPi) : 0.0f;
+            return XMFLOAT3(Ring * std::cos(V * 2.0f * kPi), 3.0f + std::cos(U * kPi), Ring * std::sin(V * 2.0f * kPi));
+        },
+        []( const XMFLOAT3& P ) { return XMFLOAT3(P.x, P.y - 3.0f, P.z); });
+    const std::vector<bool> Cutout = { false, true };
+
+    QuantizedTestModel TestModel;
+    TestMeshes::MakeModel(TestModel, Meshes);
+    TestModel.QuantizeVertexData();
+    TestModel.BuildMeshlets();
+    TestModel.BuildLods();
+
+    Geometry Merged;
+    Build(TestModel, Cutout, Merged);
+    Expect(Merged.LevelCount == std::max(TestModel.m_LodCount, 1u), "level count", (float)Merged.LevelCount);
+
+    // Every level of every opaque mesh has the model's triangles in the same order, the same positions
+    // and the mesh's dequantization, so it rasterizes to the same depth
+    for (uint32_t m = 0; m < Meshes.size(); ++m)
+    {
+        const Model::Mesh& Mesh = TestModel.m_pMesh[m];
+        float Scale[3], Offset[3];
+        Model::GetPositionDequantization(Mesh, Scale, Offset);
+        Expect(std::equal(Scale, Scale + 3, Merged.Meshes[m].PositionScale) &&
+            std::equal(Offset, Offset + 3, Merged.Meshes[m].PositionOffset), "mesh dequantization", (float)m);
+
+        for (uint32_t Level = 0; Level < Merged.LevelCount; ++Level)
+        {
+            const Range& MeshRange = Merged.Ranges[m * Merged.LevelCount + Level];
+            if (Cutout[Meshes[m].Material])
+            {
+                Expect(MeshRange.IndexCount == 0, "cutout meshes are left out", (float)m);
+                continue;
+            }
+
+            uint32_t Count;
+            const uint16_t* Indices = GetLevelIndices(TestModel, m, Level, Count);
+            Expect(MeshRange.IndexCount == Count && MeshRange.StartIndex + Count <= Merged.Indices.size(), "level range",
+                (float)Level);
+            for (uint32_t i = 0; i < Count && i < MeshRange.IndexCount; ++i)
+            {
+                const Vertex& V = Merged.Vertices[Merged.Indices[MeshRange.StartIndex + i]];
+                const int16_t* Position = GetPosition(TestModel, Mesh, Indices[i]);
+                Expect(V.MeshIndex == m && std::equal(Position, Position + 3, V.Position), "same vertex as the model",
+                    (float)i);
+            }
+        }
+    }
+
+    // No mesh repeats a position, and the level 0 indices number the vertices by first use
+    std::unordered_set<uint64_t> Positions;
+    for (const Vertex& V : Merged.Vertices)
+        Expect(Positions.insert(GetPositionKey(V.Position) ^ (uint64_t)V.MeshIndex << 48).second, "unique positions",
+            (float)V.MeshIndex);
+    size_t UniquePositions = 0;
+    for (uint32_t m = 0; m < Meshes.size(); ++m)
+    {
+        if (Cutout[Meshes[m].Material])
+            continue;
+        Positions.clear();
+        for (uint32_t v = 0; v < TestModel.m_pMesh[m].vertexCount; ++v)
+            Positions.insert(GetPositionKey(GetPosition(TestModel, TestModel.m_pMesh[m], v)));
+        UniquePositions += Positions.size();
+    }
+    Expect(Merged.Vertices.size() == UniquePositions, "repeated positions merged", (float)Merged.Vertices.size());
+    uint32_t NextVertex = 0;
+    for (uint32_t m = 0; m < Meshes.size(); ++m)
+    {
+        const Range& Mesh = Merged.Ranges[m * Merged.LevelCount];
+        for (uint32_t i = 0; i < Mesh.IndexCount; ++i)
+        {
+            const uint32_t Index = Merged.Indices[Mesh.StartIndex + i];
+            Expect(Index <= NextVertex, "vertices in first use order", (float)Index);
+            NextVertex = std::max(NextVertex, Index + 1);
+        }
+    }
+
+    // Draws cover the ranges of the levels asked for, in as few draws as the layout allows
+    std::vector<Range> Draws;
+    auto CoveredIndices = [&]( void )
+    {
+        uint32_t Covered = 0;
+        for (const Range& Draw : Draws)
+            Covered += Draw.IndexCount;
+        return Covered;
+    };
+    GatherDraws(Merged, nullptr, nullptr, Draws);
+    Expect(Draws.size() == 1, "one draw at level 0", (float)Draws.size());
+    Expect(CoveredIndices() == Merged.Ranges[0].IndexCount + Merged.Ranges[2 * Merged.LevelCount].IndexCount,
+        "level 0 covered", (float)CoveredIndices());
+
+    const uint32_t Last = Merged.LevelCount - 1;
+    const uint32_t SameLevels[3] = { Last, 0, Last };
+    GatherDraws(Merged, SameLevels, nullptr, Draws);
+    Expect(Draws.size() == 1 && Draws[0].StartIndex == Merged.Ranges[Last].StartIndex, "one draw at the last level",
+        (float)Draws.size());
+
+    const uint32_t MixedLevels[3] = { 0, 0, Last };
+    GatherDraws(Merged, MixedLevels, nullptr, Draws);
+    Expect(Draws.size() == (Last > 0 ? 2u : 1u), "one draw per level", (float)Draws.size());
+    Expect(CoveredIndices() == Merged.Ranges[0].IndexCount + Merged.Ranges[2 * Merged.LevelCount + Last].IndexCount,
+        "mixed levels covered", (float)CoveredIndices());
+
+    MeshletCulling::Result Culled;
+    Culled.Draws.assign(Meshes.size(), MeshletCulling::MeshDraw{ 0, 1 });
+    Culled.Draws[0].IndexCount = 0;
+    GatherDraws(Merged, nullptr, &Culled, Draws);
+    Expect(Draws.size() == 1 && Draws[0].StartIndex == Merged.Ranges[2 * Merged.LevelCount].StartIndex &&
+        CoveredIndices() == Merged.Ranges[2 * Merged.LevelCount].IndexCount, "culled meshes left out", (float)Draws.size());
+
+    return Passed;
+}
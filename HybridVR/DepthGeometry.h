@@ -0,0 +1,83 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// The opaque meshes merged into one position-only vertex buffer and one 32-bit index buffer, so that the
+// Z prepass and the shadow maps draw them without a draw, root constants and descriptor table per mesh.
+// Every vertex keeps the quantized position of the main vertex stream and the index of its mesh, which
+// DepthOnlyVS dequantizes with the mesh's own scale and offset, so the prepass writes exactly the depth the
+// color pass tests for equality.  Vertices are unique per mesh and numbered in the order the triangles
+// first use them, and the triangles keep the order and winding of the model's index data.
+//
+// The indices hold every level of detail:  level 0 of every opaque mesh in mesh order, then level 1 of
+// every mesh, and so on.  When all meshes are drawn at one level they take a single draw, and otherwise one
+// draw per run of meshes at the same level.  Meshes the meshlet culler dropped whole are left out.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class Model;
+class GraphicsContext;
+namespace MeshletCulling
+{
+    struct Result;
+}
+
+namespace DepthGeometry
+{
+    // Matches DepthOnlyVS.hlsl
+    struct Vertex
+    {
+        int16_t Position[4];        // As Model::QuantizedVertex stores it
+        uint32_t MeshIndex;
+    };
+
+    struct MeshDequantization
+    {
+        float PositionScale[3];
+        float PositionOffset[3];
+    };
+
+    struct Range
+    {
+        uint32_t StartIndex;
+        uint32_t IndexCount;
+    };
+
+    struct Geometry
+    {
+        std::vector<Vertex> Vertices;
+        std::vector<uint32_t> Indices;
+        std::vector<MeshDequantization> Meshes;     // Every mesh of the model, merged or not
+        std::vector<Range> Ranges;                  // LevelCount per mesh in turn, empty for meshes not merged
+        uint32_t LevelCount;
+    };
+
+    // The model must be quantized, and its index data in its final order
+    void Build( const Model& Model, const std::vector<bool>& CutoutMaterials, Geometry& Geometry );
+
+    // The ranges to draw, as few as the levels allow.  Levels holds each mesh's level of detail, or is
+    // null to draw every mesh in full, and Culled is null to draw every merged mesh.
+    void GatherDraws( const Geometry& Geometry, const uint32_t* Levels, const MeshletCulling::Result* Culled,
+        std::vector<Range>& Draws );
+
+    void Initialize( const Model& Model, const std::vector<bool>& CutoutMaterials );
+
+    // Binds the merged buffers and draws the opaque meshes.  The caller sets a pipeline state with the
+    // depth-only input layout and the model to projection constant buffer.
+    void Draw( GraphicsContext& Context, const uint32_t* Levels, const MeshletCulling::Result* Culled );
+
+    // Draws of the last call to Draw()
+    uint32_t GetDrawCount( void );
+
+    // Merges synthetic meshes with levels of detail and checks the triangles against the model's, the
+    // vertices for duplicates and the draws for coverage
+    bool RunSelfTest( void );
+}
@@ -14,6 +14,8 @@
 #define HLSL
 #include "ModelViewerRaytracing.h"
 #include "RayTracingHlslCompat.h"
+#include "HitAttributes.hlsli"
+#include "RayCones.hlsli"
 //#include "LightGrid.hlsli" // dxc does not like this :(
 
 struct LightData
@@ -38,7 +40,7 @@ cbuffer Material : register(b3)
 
 StructuredBuffer<RayTraceMeshInfo> g_meshInfo : register(t1);
 ByteAddressBuffer g_indices : register(t2);
-ByteAddressBuffer g_attributes : register(t3);
+ByteAddressBuffer g_attributes : register(t3); // Packed hit attributes, see HitAttributes.h
 Texture2D<float> texShadow : register(t4);
 Texture2D<float> texSSAO : register(t5);
 SamplerState      g_s0 : register(s0);
@@ -50,6 +52,9 @@ Texture2D<float4> g_localSpecular : register(t8);
 
 Texture2DArray<float4> normals : register(t13);
 StructuredBuffer<LightData> lightBuffer : register(t14);
+// Per cell (first, count) into lightClusterIndices, see Lighting::BuildLightClusters
+StructuredBuffer<uint2> lightClusterCells : register(t15);
+StructuredBuffer<uint> lightClusterIndices : register(t16);
 
 uint3 Load3x16BitIndices(
     uint offsetBytes)
@@ -97,11 +102,6 @@ float GetShadow(float3 ShadowCoord)
     return result * result;
 }
 
-float2 GetUVAttribute(uint byteOffset)
-{
-    return asfloat(g_attributes.Load2(byteOffset));
-}
-
 void AntiAliasSpecular(inout float3 texNormal, inout float gloss)
 {
     float normalLenSq = dot(texNormal, texNormal);
@@ -221,9 +221,17 @@ float3 ApplySceneLights(
 	float3 normal, float3 viewDir, float3 pos)
 {
 	float3 colorSum = 0;
-	for (int pointLightIndex = 0; pointLightIndex < 128; pointLightIndex++)
+
+	// Only the lights whose sphere touches the world-space cell of the hit point can contribute
+	int3 cell = (int3)floor((pos - g_dynamic.lightClusterMin) * g_dynamic.lightClusterInvCellSize);
+	uint3 dim = uint3(g_dynamic.lightClusterDimX, g_dynamic.lightClusterDimY, g_dynamic.lightClusterDimZ);
+	if (any(cell < 0) || any((uint3)cell >= dim))
+		return colorSum;
+
+	uint2 range = lightClusterCells[(cell.z * dim.y + cell.y) * dim.x + cell.x];
+	for (uint clusterLight = 0; clusterLight < range.y; clusterLight++)
 	{
-		LightData lightData = lightBuffer[pointLightIndex];
+		LightData lightData = lightBuffer[lightClusterIndices[range.x + clusterLight]];
 		if (lightData.type == 0)
 		{
 			colorSum += ApplyPointLight(
@@ -258,104 +266,6 @@ float3 ApplySceneLights(
 	return colorSum;
 }
 
-float3 RayPlaneIntersection(float3 planeOrigin, float3 planeNormal, float3 rayOrigin, float3 rayDirection)
-{
-    float t = dot(-planeNormal, rayOrigin - planeOrigin) / dot(planeNormal, rayDirection);
-    return rayOrigin + rayDirection * t;
-}
-
-bool Inverse2x2(float2x2 mat, out float2x2 inverse)
-{
-    float determinant = mat[0][0] * mat[1][1] - mat[1][0] * mat[0][1];
-
-    float rcpDeterminant = rcp(determinant);
-    inverse[0][0] = mat[1][1];
-    inverse[1][1] = mat[0][0];
-    inverse[1][0] = -mat[0][1];
-    inverse[0][1] = -mat[1][0];
-    inverse = rcpDeterminant * inverse;
-
-    return abs(determinant) > 0.00000001;
-}
-
-
-/* TODO: Could be precalculated per triangle
- Using implementation described in PBRT, finding the partial derivative of the (change in position)/(change in UV coordinates) 
- a.k.a dp/du and dp/dv
- 
- Given the 3 UV and 3 triangle points, this can be represented as a linear equation:
-
- (uv0.u - uv2.u, uv0.v - uv2.v)   (dp/du)   =     (p0 - p2)
- (uv1.u - uv2.u, uv1.v - uv2.v)   (dp/dv)   =     (p1 - p2)
-
- To solve for dp/du, we invert the 2x2 matrix on the left side to get
-
- (dp/du)   = (uv0.u - uv2.u, uv0.v - uv2.v)^-1  (p0 - p2)
- (dp/dv)   = (uv1.u - uv2.u, uv1.v - uv2.v)     (p1 - p2)
-*/
-void CalculateTrianglePartialDerivatives(float2 uv0, float2 uv1, float2 uv2, float3 p0, float3 p1, float3 p2, out float3 dpdu, out float3 dpdv)
-{
-    float2x2 linearEquation;
-    linearEquation[0] = uv0 - uv2;
-    linearEquation[1] = uv1 - uv2;
-
-    float2x3 pointVector;
-    pointVector[0] = p0 - p2;
-    pointVector[1] = p1 - p2;
-    float2x2 inverse;
-    Inverse2x2(linearEquation, inverse);
-    dpdu = pointVector[0] * inverse[0][0] + pointVector[1] * inverse[0][1];
-    dpdv = pointVector[0] * inverse[1][0] + pointVector[1] * inverse[1][1];
-}
-
-/*
-Using implementation described in PBRT, finding the derivative for the UVs (dU, dV)  in both the x and y directions
-
-Given the original point and the offset points (pX and pY) + the partial derivatives, the linear equation can be formed:
-Note described only with pX, but the same is also applied to pY
-
-( dpdu.x, dpdv.x)          =   (pX.x - p.x)
-( dpdu.y, dpdv.y)   (dU)   =   (pX.y - p.y)
-( dpdu.z, dpdv.z)   (dV)   =   (pX.z - p.z)
-
-Because the problem is over-constrained (3 equations and only 2 unknowns), we pick 2 channels, and solve for dU, dV by inverting the matrix
-
-dU    =   ( dpdu.x, dpdv.x)^-1  (pX.x - p.x)
-dV    =   ( dpdu.y, dpdv.y)     (pX.y - p.y)
-*/
-
-void CalculateUVDerivatives(float3 normal, float3 dpdu, float3 dpdv, float3 p, float3 pX, float3 pY, float bounces, out float2 ddX, out float2 ddY)
-{
-    int2 indices;
-    float3 absNormal = abs(normal);
-    if (absNormal.x > absNormal.y && absNormal.x > absNormal.z)
-    {
-        indices = int2(1, 2);
-    }
-    else if (absNormal.y > absNormal.z)
-    {
-        indices = int2(0, 2);
-    }
-    else
-    {
-        indices = int2(0, 1);
-    }
-
-    float2x2 linearEquation;
-    linearEquation[0] = float2(dpdu[indices.x], dpdv[indices.x]);
-    linearEquation[1] = float2(dpdu[indices.y], dpdv[indices.y]);
-
-	float dampen = (IsReflection || bounces == 1) ? 50.0f : 2.0f;
-    
-    float2x2 inverse;
-    Inverse2x2(linearEquation, inverse);
-    float2 pointOffset = float2(pX[indices.x] - p[indices.x], pX[indices.y] - p[indices.y]);
-	ddX = abs(mul(inverse, pointOffset)) / dampen;
-
-    pointOffset = float2(pY[indices.x] - p[indices.x], pY[indices.y] - p[indices.y]);
-	ddY = abs(mul(inverse, pointOffset)) / dampen;
-}
-
 float3 ApplySRGBCurve(float3 x)
 {
     // Approximately pow(x, 1.0 / 2.2)
@@ -377,59 +287,53 @@ void Hit(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes attr
 	RayTraceMeshInfo info = g_meshInfo[materialID];
 
 	const uint3 ii = Load3x16BitIndices(info.m_indexOffsetBytes + PrimitiveIndex() * 3 * 2);
-	const float2 uv0 = GetUVAttribute(info.m_uvAttributeOffsetBytes + ii.x * info.m_attributeStrideBytes);
-	const float2 uv1 = GetUVAttribute(info.m_uvAttributeOffsetBytes + ii.y * info.m_attributeStrideBytes);
-	const float2 uv2 = GetUVAttribute(info.m_uvAttributeOffsetBytes + ii.z * info.m_attributeStrideBytes);
+	const uint3 v0 = g_attributes.Load3(info.m_vertexOffsetBytes + ii.x * PACKED_VERTEX_STRIDE);
+	const uint3 v1 = g_attributes.Load3(info.m_vertexOffsetBytes + ii.y * PACKED_VERTEX_STRIDE);
+	const uint3 v2 = g_attributes.Load3(info.m_vertexOffsetBytes + ii.z * PACKED_VERTEX_STRIDE);
 
 	float3 bary = float3(1.0 - attr.barycentrics.x - attr.barycentrics.y, attr.barycentrics.x, attr.barycentrics.y);
+	const float2 uv0 = UnpackUV(v0.z, info.m_uvOffset, info.m_uvScale);
+	const float2 uv1 = UnpackUV(v1.z, info.m_uvOffset, info.m_uvScale);
+	const float2 uv2 = UnpackUV(v2.z, info.m_uvOffset, info.m_uvScale);
 	float2 uv = bary.x * uv0 + bary.y * uv1 + bary.z * uv2;
 
-	const float3 normal0 = asfloat(g_attributes.Load3(info.m_normalAttributeOffsetBytes + ii.x * info.m_attributeStrideBytes));
-	const float3 normal1 = asfloat(g_attributes.Load3(info.m_normalAttributeOffsetBytes + ii.y * info.m_attributeStrideBytes));
-	const float3 normal2 = asfloat(g_attributes.Load3(info.m_normalAttributeOffsetBytes + ii.z * info.m_attributeStrideBytes));
-	float3 vsNormal = normalize(normal0 * bary.x + normal1 * bary.y + normal2 * bary.z);
-    
-	const float3 tangent0 = asfloat(g_attributes.Load3(info.m_tangentAttributeOffsetBytes + ii.x * info.m_attributeStrideBytes));
-	const float3 tangent1 = asfloat(g_attributes.Load3(info.m_tangentAttributeOffsetBytes + ii.y * info.m_attributeStrideBytes));
-	const float3 tangent2 = asfloat(g_attributes.Load3(info.m_tangentAttributeOffsetBytes + ii.z * info.m_attributeStrideBytes));
-	float3 vsTangent = normalize(tangent0 * bary.x + tangent1 * bary.y + tangent2 * bary.z);
-
-    // Reintroduced the bitangent because we aren't storing the handedness of the tangent frame anywhere.  Assuming the space
-    // is right-handed causes normal maps to invert for some surfaces.  The Sponza mesh has all three axes of the tangent frame.
-    //float3 vsBitangent = normalize(cross(vsNormal, vsTangent)) * (isRightHanded ? 1.0 : -1.0);
-	const float3 bitangent0 = asfloat(g_attributes.Load3(info.m_bitangentAttributeOffsetBytes + ii.x * info.m_attributeStrideBytes));
-	const float3 bitangent1 = asfloat(g_attributes.Load3(info.m_bitangentAttributeOffsetBytes + ii.y * info.m_attributeStrideBytes));
-	const float3 bitangent2 = asfloat(g_attributes.Load3(info.m_bitangentAttributeOffsetBytes + ii.z * info.m_attributeStrideBytes));
-	float3 vsBitangent = normalize(bitangent0 * bary.x + bitangent1 * bary.y + bitangent2 * bary.z);
-
-    // TODO: Should just store uv partial derivatives in here rather than loading position and caculating it per pixel
-	const float3 p0 = asfloat(g_attributes.Load3(info.m_positionAttributeOffsetBytes + ii.x * info.m_attributeStrideBytes));
-	const float3 p1 = asfloat(g_attributes.Load3(info.m_positionAttributeOffsetBytes + ii.y * info.m_attributeStrideBytes));
-	const float3 p2 = asfloat(g_attributes.Load3(info.m_positionAttributeOffsetBytes + ii.z * info.m_attributeStrideBytes));
+	const float3 n0 = UnpackOctahedral(v0.x);
+	const float3 n1 = UnpackOctahedral(v1.x);
+	const float3 n2 = UnpackOctahedral(v2.x);
+	float3 vsNormal = normalize(n0 * bary.x + n1 * bary.y + n2 * bary.z);
+	float3 vsTangent = normalize(UnpackOctahedral(v0.y) * bary.x + UnpackOctahedral(v1.y) * bary.y + UnpackOctahedral(v2.y) * bary.z);
 
-	float3 worldPosition = WorldRayOrigin() + WorldRayDirection() * RayTCurrent();
+	// The handedness of the tangent frame is stored with the tangent, so the bitangent no longer has to be
+	float handedness = dot(bary, float3(UnpackTangentHandedness(v0.y), UnpackTangentHandedness(v1.y), UnpackTangentHandedness(v2.y)));
+	float3 vsBitangent = normalize(cross(vsNormal, vsTangent)) * (handedness >= 0.0 ? 1.0 : -1.0);
 
-	uint2 threadID = DispatchRaysIndex().xy;
-	float3 ddxOrigin, ddxDir, ddyOrigin, ddyDir;
-	GenerateCameraRay(uint2(threadID.x + 1, threadID.y), ddxOrigin, ddxDir);
-	GenerateCameraRay(uint2(threadID.x, threadID.y + 1), ddyOrigin, ddyDir);
+	// dp/du and dp/dv only depend on the triangle, so they are solved once when the model is loaded
+	const uint4 triangle0 = g_attributes.Load4(info.m_triangleOffsetBytes + PrimitiveIndex() * PACKED_TRIANGLE_STRIDE);
+	const uint4 triangle1 = g_attributes.Load4(info.m_triangleOffsetBytes + PrimitiveIndex() * PACKED_TRIANGLE_STRIDE + 16);
+	const float3 dpdu = asfloat(triangle0.xyz);
+	const float3 dpdv = asfloat(triangle1.xyz);
+
+	float3 worldPosition = WorldRayOrigin() + WorldRayDirection() * RayTCurrent();
 
-	float3 triangleNormal = normalize(cross(p2 - p0, p1 - p0));
-	float3 xOffsetPoint = RayPlaneIntersection(worldPosition, triangleNormal, ddxOrigin, ddxDir);
-	float3 yOffsetPoint = RayPlaneIntersection(worldPosition, triangleNormal, ddyOrigin, ddyDir);
+	uint2 threadID = UnpackRayPixel(payload.Pixel);
 
-	float3 dpdu, dpdv;
-	CalculateTrianglePartialDerivatives(uv0, uv1, uv2, p0, p1, p2, dpdu, dpdv);
-	float2 ddx, ddy;
-	CalculateUVDerivatives(triangleNormal, dpdu, dpdv, worldPosition, xOffsetPoint, yOffsetPoint, payload.Bounces, ddx, ddy);
+	// The footprint of the ray's cone on the triangle picks the mip level, which holds after any number of
+	// reflections (see RayCones.h)
+	float3 triangleNormal = UnpackOctahedral(triangle0.w);
+	const float coneWidth = PropagateRayCone(payload.ConeWidth, payload.ConeSpread, RayTCurrent());
+	const float triangleLod = GetTriangleLod(dpdu, dpdv);
+	const float cosTheta = dot(triangleNormal, WorldRayDirection());
 
-	const float3 diffuseColor = g_localTexture.SampleGrad(g_s0, uv, ddx, ddy).rgb; //g_localTexture.SampleLevel(g_s0, uv, 0).rgb;
+	const float3 diffuseColor = g_localTexture.SampleLevel(g_s0, uv,
+		ComputeTextureLod(triangleLod, GetTextureSizeLod(g_localTexture), coneWidth, cosTheta)).rgb;
 	float3 normal;
 	float3 specularAlbedo = float3(0.56, 0.56, 0.56);
-	float specularMask = g_localSpecular.SampleGrad(g_s0, uv, ddx, ddy).g; //g_localSpecular.SampleLevel(g_s0, uv, 0).g;
+	float specularMask = g_localSpecular.SampleLevel(g_s0, uv,
+		ComputeTextureLod(triangleLod, GetTextureSizeLod(g_localSpecular), coneWidth, cosTheta)).g;
 	float gloss = 128.0;
     {
-		normal = g_localNormal.SampleGrad(g_s0, uv, ddx, ddy).rgb * 2.0 - 1.0; //g_localNormal.SampleLevel(g_s0, uv, 0).rgb * 2.0 - 1.0;
+		normal = g_localNormal.SampleLevel(g_s0, uv,
+			ComputeTextureLod(triangleLod, GetTextureSizeLod(g_localNormal), coneWidth, cosTheta)).rgb * 2.0 - 1.0;
 		AntiAliasSpecular(normal, gloss);
 		float3x3 tbn = float3x3(
 			FlipNormals * vsTangent, 
@@ -438,7 +342,7 @@ void Hit(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes attr
 		normal = normalize(mul(normal, tbn));
     }
     
-	float3 outputColor = AmbientColor * diffuseColor * texSSAO[DispatchRaysIndex().xy];
+	float3 outputColor = AmbientColor * diffuseColor * texSSAO[threadID];
 
 	float shadow = 1.0;
 	if (UseShadowRays)
@@ -456,6 +360,9 @@ void Hit(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes attr
 		shadowPayload.SkipShading = true;
 		shadowPayload.RayHitT = FLT_MAX;
 		shadowPayload.Bounces = payload.Bounces + 1;
+		shadowPayload.Pixel = payload.Pixel;
+		shadowPayload.ConeWidth = coneWidth;
+		shadowPayload.ConeSpread = payload.ConeSpread;
 		TraceRay(g_accel, RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH, ~0, 0, 1, 0, rayDesc, shadowPayload);
 		if (shadowPayload.RayHitT < FLT_MAX)
 		{
@@ -492,10 +399,10 @@ void Hit(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes attr
     
 	if (payload.Bounces > 0)
 	{
-		outputColor = g_screenOutput[int3(DispatchRaysIndex().xy, g_dynamic.curCam)].rgb * (1 - payload.Reflectivity) + payload.Reflectivity * outputColor;
+		outputColor = g_screenOutput[int3(threadID, g_dynamic.curCam)].rgb * (1 - payload.Reflectivity) + payload.Reflectivity * outputColor;
 	}
     
-	g_screenOutput[int3(DispatchRaysIndex().xy, g_dynamic.curCam)] = float4(outputColor, 1);
+	g_screenOutput[int3(threadID, g_dynamic.curCam)] = float4(outputColor, 1);
     
 	float reflectivity =
         specularMask * pow(1.0 - saturate(dot(-viewDir, normal)), 5.0);
@@ -516,6 +423,10 @@ void Hit(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes attr
 		reflectionPayload.RayHitT = FLT_MAX;
 		reflectionPayload.Bounces = payload.Bounces + 1;
 		reflectionPayload.Reflectivity = reflectivity * payload.Reflectivity;
+		reflectionPayload.Pixel = payload.Pixel;
+		reflectionPayload.ConeWidth = coneWidth;
+		reflectionPayload.ConeSpread = ReflectRayCone(coneWidth, payload.ConeSpread,
+			EstimateCurvature(n0, n1, n2, uv0, uv1, uv2, dpdu, dpdv));
 		TraceRay(g_accel, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, ~0, 0, 1, 0, rayDesc, reflectionPayload);
 	}
 }
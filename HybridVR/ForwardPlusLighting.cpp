@@ -18,6 +18,9 @@
 #include "CommandContext.h"
 #include "Camera.h"
 #include "BufferManager.h"
+#include "Math/Random.h"
+#include <algorithm>
+#include <cfloat>
 
 #include "CompiledShaders/FillLightGridCS_8.h"
 #include "CompiledShaders/FillLightGridCS_16.h"
@@ -43,6 +46,9 @@ struct LightData
 
 enum { kMinLightGridDim = 8 };
 
+// The light cluster grid gets roughly this many cells, shaped to the bounds of the lights
+enum { kLightClusterTargetCells = 16384, kMaxLightClusterDim = 64 };
+
 namespace Settings
 {
     IntVar LightGridDim("Application/Forward+/Light Grid Dim", 16, kMinLightGridDim, 32, 8);
@@ -70,6 +76,10 @@ namespace Lighting
     ShadowBuffer m_LightShadowTempBuffer;
     Matrix4 m_LightShadowMatrix[MaxLights];
 
+    StructuredBuffer m_LightClusterCells;
+    StructuredBuffer m_LightClusterIndices;
+    LightClusterGrid m_LightClusterGrid;
+
     void InitializeResources(void);
     void CreateRandomLights(const Vector3 minBound, const Vector3 maxBound);
     void FillLightGrid(GraphicsContext& gfxContext, const Camera& camera);
@@ -245,6 +255,8 @@ void Lighting::CreateRandomLights( const Vector3 minBound, const Vector3 maxBoun
     }
     m_LightBuffer.Create(L"m_LightBuffer", MaxLights, sizeof(LightData), m_LightData);
 
+    BuildLightClusters();
+
     // todo: assumes max resolution of 1920x1080
     uint32_t lightGridCells = Math::DivideByMultiple(1920, kMinLightGridDim) * Math::DivideByMultiple(1080, kMinLightGridDim);
     uint32_t lightGridSizeBytes = lightGridCells * (4 + MaxLights * 4);
@@ -319,3 +331,255 @@ void Lighting::FillLightGrid(GraphicsContext& gfxContext, const Camera& camera)
     Context.TransitionResource(m_LightGrid, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
     Context.TransitionResource(m_LightGridBitMask, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 }
+
+// Bins the lights into a grid over the bounds of their spheres.  cells holds the first entry in indices and the
+// light count of each cell.
+static void BuildLightClusterLists( const LightData* lights, uint32_t count, Lighting::LightClusterGrid& grid,
+    std::vector<uint32_t>& cells, std::vector<uint32_t>& indices )
+{
+    // Bound the light spheres.  Points outside of the grid receive no light at all.
+    float minBound[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float maxBound[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (uint32_t n = 0; n < count; n++)
+    {
+        const float radius = sqrt(lights[n].radiusSq);
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            minBound[axis] = std::min(minBound[axis], lights[n].pos[axis] - radius);
+            maxBound[axis] = std::max(maxBound[axis], lights[n].pos[axis] + radius);
+        }
+    }
+
+    const float extent[3] = { maxBound[0] - minBound[0], maxBound[1] - minBound[1], maxBound[2] - minBound[2] };
+    const float targetCellSize = pow(extent[0] * extent[1] * extent[2] / kLightClusterTargetCells, 1.0f / 3.0f);
+
+    float cellSize[3];
+    for (uint32_t axis = 0; axis < 3; axis++)
+    {
+        grid.Dim[axis] = std::max(1u, std::min((uint32_t)kMaxLightClusterDim, (uint32_t)ceil(extent[axis] / targetCellSize)));
+        grid.Min[axis] = minBound[axis];
+        grid.InvCellSize[axis] = grid.Dim[axis] / extent[axis];
+        cellSize[axis] = extent[axis] / grid.Dim[axis];
+    }
+
+    const uint32_t numCells = grid.Dim[0] * grid.Dim[1] * grid.Dim[2];
+    std::vector<std::vector<uint32_t>> cellLights(numCells);
+
+    for (uint32_t n = 0; n < count; n++)
+    {
+        const LightData& light = lights[n];
+
+        // Pad the radius so that rounding when a hit position is mapped to its cell can never drop a light
+        // with a non-zero contribution
+        const float radius = sqrt(light.radiusSq) * 1.001f;
+
+        uint32_t firstCell[3], lastCell[3];
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            const float lo = (light.pos[axis] - radius - grid.Min[axis]) * grid.InvCellSize[axis];
+            const float hi = (light.pos[axis] + radius - grid.Min[axis]) * grid.InvCellSize[axis];
+            firstCell[axis] = (uint32_t)std::max(0.0f, floor(lo));
+            lastCell[axis] = std::min(grid.Dim[axis] - 1, (uint32_t)std::max(0.0f, floor(hi)));
+        }
+
+        for (uint32_t z = firstCell[2]; z <= lastCell[2]; z++)
+        {
+            for (uint32_t y = firstCell[1]; y <= lastCell[1]; y++)
+            {
+                for (uint32_t x = firstCell[0]; x <= lastCell[0]; x++)
+                {
+                    // Squared distance from the light to the closest point of the cell
+                    const uint32_t cell[3] = { x, y, z };
+                    float distSq = 0.0f;
+                    for (uint32_t axis = 0; axis < 3; axis++)
+                    {
+                        const float cellMin = grid.Min[axis] + cell[axis] * cellSize[axis];
+                        const float cellMax = cellMin + cellSize[axis];
+                        const float d = std::max(std::max(cellMin - light.pos[axis], light.pos[axis] - cellMax), 0.0f);
+                        distSq += d * d;
+                    }
+
+                    if (distSq <= radius * radius)
+                        cellLights[(z * grid.Dim[1] + y) * grid.Dim[0] + x].push_back(n);
+                }
+            }
+        }
+    }
+
+    cells.assign(numCells * 2, 0);
+    indices.clear();
+    for (uint32_t c = 0; c < numCells; c++)
+    {
+        cells[c * 2 + 0] = (uint32_t)indices.size();
+        cells[c * 2 + 1] = (uint32_t)cellLights[c].size();
+        indices.insert(indices.end(), cellLights[c].begin(), cellLights[c].end());
+    }
+
+    // Buffers cannot be empty
+    if (indices.empty())
+        indices.push_back(0);
+}
+
+void Lighting::BuildLightClusters( void )
+{
+    std::vector<uint32_t> cells;
+    std::vector<uint32_t> indices;
+    BuildLightClusterLists(m_LightData, MaxLights, m_LightClusterGrid, cells, indices);
+
+    const LightClusterGrid& grid = m_LightClusterGrid;
+    const uint32_t numCells = grid.Dim[0] * grid.Dim[1] * grid.Dim[2];
+    m_LightClusterCells.Create(L"m_LightClusterCells", numCells, sizeof(uint32_t) * 2, cells.data());
+    m_LightClusterIndices.Create(L"m_LightClusterIndices", (uint32_t)indices.size(), sizeof(uint32_t), indices.data());
+
+    Utility::Printf("Light clusters:  %ux%ux%u cells, %.1f lights per cell on average (%u total)\n",
+        grid.Dim[0], grid.Dim[1], grid.Dim[2], (float)indices.size() / numCells, MaxLights);
+}
+
+// CPU versions of the hit shader lighting functions (DiffuseHitShaderLib.hlsl).  rsqrt is replaced by
+// 1 / sqrt, so the results are close to the GPU but not bit-exact with it.
+namespace
+{
+    Vector3 ApplyLightCommonCPU( Vector3 diffuseColor, Vector3 specularColor, float specularMask, float gloss,
+        Vector3 normal, Vector3 viewDir, Vector3 lightDir, Vector3 lightColor )
+    {
+        Vector3 halfVec = Normalize(lightDir - viewDir);
+        float nDotH = Clamp((float)Dot(halfVec, normal), 0.0f, 1.0f);
+
+        // FSchlick
+        float fresnel = pow(1.0f - Clamp((float)Dot(lightDir, halfVec), 0.0f, 1.0f), 5.0f);
+        specularColor = specularColor + (Vector3(kIdentity) - specularColor) * fresnel;
+        diffuseColor = diffuseColor - diffuseColor * fresnel;
+
+        float specularFactor = specularMask * pow(nDotH, gloss) * (gloss + 2) / 8;
+
+        float nDotL = Clamp((float)Dot(normal, lightDir), 0.0f, 1.0f);
+
+        return nDotL * lightColor * (diffuseColor + specularFactor * specularColor);
+    }
+
+    Vector3 ApplySceneLightCPU( const LightData& light, Vector3 diffuse, Vector3 specular, float specularMask, float gloss,
+        Vector3 normal, Vector3 viewDir, Vector3 pos )
+    {
+        if (light.type > 2)
+            return Vector3(kZero);
+
+        Vector3 lightDir = Vector3(light.pos[0], light.pos[1], light.pos[2]) - pos;
+        float lightDistSq = (float)Dot(lightDir, lightDir);
+        float invLightDist = 1.0f / sqrt(lightDistSq);
+        lightDir = lightDir * invLightDist;
+
+        float distanceFalloff = light.radiusSq * (invLightDist * invLightDist);
+        distanceFalloff = std::max(0.0f, distanceFalloff - 1.0f / sqrt(distanceFalloff));
+
+        if (light.type == 1 || light.type == 2)
+        {
+            Vector3 coneDir(light.coneDir[0], light.coneDir[1], light.coneDir[2]);
+            float coneFalloff = (float)Dot(-lightDir, coneDir);
+            distanceFalloff *= Clamp((coneFalloff - light.coneAngles[1]) * light.coneAngles[0], 0.0f, 1.0f);
+        }
+
+        return distanceFalloff * ApplyLightCommonCPU(diffuse, specular, specularMask, gloss, normal, viewDir, lightDir,
+            Vector3(light.color[0], light.color[1], light.color[2]));
+    }
+}
+
+bool Lighting::RunSelfTest( void )
+{
+    RandomNumberGenerator rng;
+    rng.SetSeed(1);
+
+    // Lights spread like CreateRandomLights() places them over a scene of about Sponza's size, a third of them
+    // points and the rest cones
+    const float pi = 3.14159265359f;
+    const uint32_t kLightCount = MaxLights;
+    std::vector<LightData> lights(kLightCount);
+    for (uint32_t n = 0; n < kLightCount; n++)
+    {
+        LightData& light = lights[n];
+        std::memset(&light, 0, sizeof(light));
+
+        const float radius = rng.NextFloat(200.0f, 1000.0f);
+        light.pos[0] = rng.NextFloat(-1900.0f, 1800.0f);
+        light.pos[1] = rng.NextFloat(-100.0f, 1300.0f);
+        light.pos[2] = rng.NextFloat(-1100.0f, 1100.0f);
+        light.radiusSq = radius * radius;
+        light.color[0] = rng.NextFloat();
+        light.color[1] = rng.NextFloat();
+        light.color[2] = rng.NextFloat();
+        light.type = n < kLightCount / 3 ? 0 : 1 + n % 2;
+
+        const Vector3 coneDir = Normalize(Vector3(rng.NextFloat(-1.0f, 1.0f), rng.NextFloat(-1.0f, 1.0f), rng.NextFloat(-1.0f, 1.0f)));
+        const float coneInner = rng.NextFloat(0.025f, 0.225f) * pi;
+        const float coneOuter = coneInner + rng.NextFloat(0.1f) * pi;
+        light.coneDir[0] = coneDir.GetX();
+        light.coneDir[1] = coneDir.GetY();
+        light.coneDir[2] = coneDir.GetZ();
+        light.coneAngles[0] = 1.0f / (cos(coneInner) - cos(coneOuter));
+        light.coneAngles[1] = cos(coneOuter);
+    }
+
+    LightClusterGrid grid;
+    std::vector<uint32_t> cells;
+    std::vector<uint32_t> indices;
+    BuildLightClusterLists(lights.data(), kLightCount, grid, cells, indices);
+
+    uint32_t mismatches = 0;
+    uint32_t totalEvaluated = 0;
+
+    const uint32_t kSamples = 4096;
+    for (uint32_t i = 0; i < kSamples; i++)
+    {
+        // Random hit positions inside the grid and random surface and view directions
+        float p[3];
+        for (uint32_t axis = 0; axis < 3; axis++)
+            p[axis] = grid.Min[axis] + rng.NextFloat(grid.Dim[axis] / grid.InvCellSize[axis]);
+        const Vector3 pos(p[0], p[1], p[2]);
+        const Vector3 normal = Normalize(Vector3(rng.NextFloat(-1.0f, 1.0f), rng.NextFloat(-1.0f, 1.0f), rng.NextFloat(-1.0f, 1.0f)));
+        const Vector3 viewDir = Normalize(Vector3(rng.NextFloat(-1.0f, 1.0f), rng.NextFloat(-1.0f, 1.0f), rng.NextFloat(-1.0f, 1.0f)));
+        const Vector3 diffuse(rng.NextFloat(), rng.NextFloat(), rng.NextFloat());
+        const Vector3 specular(0.56f, 0.56f, 0.56f);
+        const float specularMask = rng.NextFloat();
+        const float gloss = rng.NextFloat(1.0f, 128.0f);
+
+        // Reference: every light, as before the clusters existed
+        Vector3 reference(kZero);
+        for (uint32_t n = 0; n < kLightCount; n++)
+            reference += ApplySceneLightCPU(lights[n], diffuse, specular, specularMask, gloss, normal, viewDir, pos);
+
+        // Clustered: the cell lookup performed by the hit shaders
+        Vector3 clustered(kZero);
+        uint32_t cell[3];
+        for (uint32_t axis = 0; axis < 3; axis++)
+            cell[axis] = std::min(grid.Dim[axis] - 1, (uint32_t)std::max(0.0f, floor((p[axis] - grid.Min[axis]) * grid.InvCellSize[axis])));
+        const uint32_t cellIndex = (cell[2] * grid.Dim[1] + cell[1]) * grid.Dim[0] + cell[0];
+
+        const uint32_t first = cells[cellIndex * 2 + 0];
+        const uint32_t count = cells[cellIndex * 2 + 1];
+        for (uint32_t n = 0; n < count; n++)
+        {
+            const LightData& light = lights[indices[first + n]];
+            clustered += ApplySceneLightCPU(light, diffuse, specular, specularMask, gloss, normal, viewDir, pos);
+        }
+
+        totalEvaluated += count;
+
+        // Lights that were skipped contribute exactly zero, so the sums must match bit for bit
+        if (reference.GetX() != clustered.GetX() || reference.GetY() != clustered.GetY() || reference.GetZ() != clustered.GetZ())
+            mismatches++;
+    }
+
+    bool passed = true;
+    if (mismatches != 0)
+    {
+        Utility::Printf("Light cluster self test failed:  %u of %u samples differ from shading with every light\n",
+            mismatches, kSamples);
+        passed = false;
+    }
+    if (totalEvaluated >= kSamples * kLightCount / 2)
+    {
+        Utility::Printf("Light cluster self test failed:  %.1f lights evaluated per hit on average, of %u\n",
+            (float)totalEvaluated / kSamples, kLightCount);
+        passed = false;
+    }
+    return passed;
+}
@@ -46,7 +46,29 @@ namespace Lighting
     extern ShadowBuffer m_LightShadowTempBuffer;
     extern Math::Matrix4 m_LightShadowMatrix[MaxLights];
 
+    // World-space grid over the light volumes for shading ray hits, where the screen-space light grid does
+    // not apply.  Each cell lists, in ascending order, the lights whose radius reaches into it.  Lighting is
+    // zero beyond a light's radius, so skipping the other lights does not change the result.
+    struct LightClusterGrid
+    {
+        float Min[3];
+        float InvCellSize[3];
+        std::uint32_t Dim[3];
+    };
+
+    extern StructuredBuffer m_LightClusterCells;    // uint2 per cell:  first entry in m_LightClusterIndices, light count
+    extern StructuredBuffer m_LightClusterIndices;
+    extern LightClusterGrid m_LightClusterGrid;
+
     void InitializeResources(void);
     void CreateRandomLights(const Math::Vector3 minBound, const Math::Vector3 maxBound);
     void FillLightGrid(GraphicsContext& gfxContext, const Math::Camera& camera);
+
+    // Called by CreateRandomLights()
+    void BuildLightClusters(void);
+
+    // Clusters a set of synthetic lights and shades random points with a CPU port of the hit shaders' scene
+    // lighting, once with every light and once with the cluster lists.  Passes if the results are identical
+    // and the lists skip most lights.
+    bool RunSelfTest(void);
 }
@@ -0,0 +1,483 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "HitAttributes.h"
+#include "Model.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+namespace
+{
+    float SignNotZero( float x )
+    {
+        return x >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    float Dot3( const float A[3], const float B[3] )
+    {
+        return A[0] * B[0] + A[1] * B[1] + A[2] * B[2];
+    }
+
+    void Cross3( const float A[3], const float B[3], float Result[3] )
+    {
+        Result[0] = A[1] * B[2] - A[2] * B[1];
+        Result[1] = A[2] * B[0] - A[0] * B[2];
+        Result[2] = A[0] * B[1] - A[1] * B[0];
+    }
+
+    void Normalize3( float V[3] )
+    {
+        const float LengthSq = Dot3(V, V);
+        if (LengthSq > 0.0f)
+        {
+            const float InvLength = 1.0f / std::sqrt(LengthSq);
+            V[0] *= InvLength;
+            V[1] *= InvLength;
+            V[2] *= InvLength;
+        }
+    }
+
+    // Angle between unit vectors, accurate for the tiny angles that acos() of a float dot product cannot resolve
+    float AngleBetween( const float A[3], const float B[3] )
+    {
+        float AxB[3];
+        Cross3(A, B, AxB);
+        return std::atan2(std::sqrt(Dot3(AxB, AxB)), Dot3(A, B));
+    }
+
+    uint32_t PackSnorm16x2( int32_t X, int32_t Y )
+    {
+        return (uint32_t)(uint16_t)(int16_t)X | (uint32_t)(uint16_t)(int16_t)Y << 16;
+    }
+
+    // Projects onto the octahedron and unfolds the lower half, giving a point in [-1, 1]^2
+    void OctahedralProject( const float V[3], float& X, float& Y )
+    {
+        const float L1 = std::fabs(V[0]) + std::fabs(V[1]) + std::fabs(V[2]);
+        if (L1 <= 0.0f)
+        {
+            X = Y = 0.0f;
+            return;
+        }
+
+        X = V[0] / L1;
+        Y = V[1] / L1;
+        if (V[2] < 0.0f)
+        {
+            const float FoldedX = (1.0f - std::fabs(Y)) * SignNotZero(X);
+            Y = (1.0f - std::fabs(X)) * SignNotZero(Y);
+            X = FoldedX;
+        }
+    }
+
+    // Rounding each coordinate to nearest is not the closest direction once decoded, so try the four
+    // corners of the cell around the projected point.  Step constrains X to every other code, which
+    // frees its lowest bit for the tangent handedness.
+    uint32_t PackOctahedral( const float V[3], uint32_t XStep, uint32_t XParity )
+    {
+        float X, Y;
+        OctahedralProject(V, X, Y);
+
+        float Unit[3] = { V[0], V[1], V[2] };
+        Normalize3(Unit);
+
+        const int32_t FloorY = (int32_t)std::floor(Y * 32767.0f);
+        int32_t FloorX = (int32_t)std::floor(X * 32767.0f);
+        if (XStep == 2 && (uint32_t)(FloorX & 1) != XParity)
+            FloorX -= 1;
+
+        uint32_t Best = PackSnorm16x2(0, 0);
+        float BestError = 4.0f;
+        for (int32_t dy = 0; dy <= 1; ++dy)
+        {
+            for (int32_t dx = 0; dx <= 1; ++dx)
+            {
+                const int32_t QX = std::max(-32767, std::min(32767, FloorX + dx * (int32_t)XStep));
+                const int32_t QY = std::max(-32767, std::min(32767, FloorY + dy));
+                if ((uint32_t)(QX & 1) != XParity && XStep == 2)
+                    continue;
+
+                const uint32_t Candidate = PackSnorm16x2(QX, QY);
+                float Decoded[3];
+                HitAttributes::UnpackUnitVector(Candidate, Decoded);
+                const float Error = AngleBetween(Decoded, Unit);
+                if (Error < BestError)
+                {
+                    BestError = Error;
+                    Best = Candidate;
+                }
+            }
+        }
+        return Best;
+    }
+
+    void ReadFloats( const uint8_t* Source, float* Values, uint32_t Count )
+    {
+        std::memcpy(Values, Source, Count * sizeof(float));
+    }
+}
+
+namespace HitAttributes
+{
+    uint32_t PackUnitVector( const float V[3] )
+    {
+        return PackOctahedral(V, 1, 0);
+    }
+
+    void UnpackUnitVector( uint32_t Packed, float V[3] )
+    {
+        const float X = std::max((float)(int16_t)(Packed & 0xFFFF) / 32767.0f, -1.0f);
+        const float Y = std::max((float)(int16_t)(Packed >> 16) / 32767.0f, -1.0f);
+
+        V[0] = X;
+        V[1] = Y;
+        V[2] = 1.0f - std::fabs(X) - std::fabs(Y);
+        const float Fold = std::max(-V[2], 0.0f);
+        V[0] += V[0] >= 0.0f ? -Fold : Fold;
+        V[1] += V[1] >= 0.0f ? -Fold : Fold;
+        Normalize3(V);
+    }
+
+    uint32_t PackTangent( const float T[3], float Handedness )
+    {
+        return PackOctahedral(T, 2, Handedness < 0.0f ? 1 : 0);
+    }
+
+    void UnpackTangent( uint32_t Packed, float T[3], float& Handedness )
+    {
+        UnpackUnitVector(Packed, T);
+        Handedness = (Packed & 1) ? -1.0f : 1.0f;
+    }
+
+    uint32_t PackUV( const float UV[2], const float UVOffset[2], const float UVScale[2] )
+    {
+        uint32_t Packed = 0;
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            const float Code = UVScale[i] > 0.0f ? (UV[i] - UVOffset[i]) / UVScale[i] : 0.0f;
+            const uint32_t Q = (uint32_t)std::max(0.0f, std::min(65535.0f, std::floor(Code + 0.5f)));
+            Packed |= Q << (i * 16);
+        }
+        return Packed;
+    }
+
+    void UnpackUV( uint32_t Packed, const float UVOffset[2], const float UVScale[2], float UV[2] )
+    {
+        UV[0] = (float)(Packed & 0xFFFF) * UVScale[0] + UVOffset[0];
+        UV[1] = (float)(Packed >> 16) * UVScale[1] + UVOffset[1];
+    }
+
+    // Following PBRT, the triangle edges in terms of the partial derivatives are
+    //
+    //   (uv0.u - uv2.u, uv0.v - uv2.v) (dp/du)   (p0 - p2)
+    //   (uv1.u - uv2.u, uv1.v - uv2.v) (dp/dv) = (p1 - p2)
+    //
+    // and inverting the 2x2 matrix gives dp/du and dp/dv.
+    void ComputePartialDerivatives( const float P0[3], const float P1[3], const float P2[3],
+        const float UV0[2], const float UV1[2], const float UV2[2], float Dpdu[3], float Dpdv[3] )
+    {
+        const float Du02 = UV0[0] - UV2[0], Dv02 = UV0[1] - UV2[1];
+        const float Du12 = UV1[0] - UV2[0], Dv12 = UV1[1] - UV2[1];
+        const float Determinant = Du02 * Dv12 - Dv02 * Du12;
+
+        if (std::fabs(Determinant) <= 1e-8f)
+        {
+            Dpdu[0] = Dpdu[1] = Dpdu[2] = 0.0f;
+            Dpdv[0] = Dpdv[1] = Dpdv[2] = 0.0f;
+            return;
+        }
+
+        const float InvDeterminant = 1.0f / Determinant;
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            const float Dp02 = P0[i] - P2[i];
+            const float Dp12 = P1[i] - P2[i];
+            Dpdu[i] = (Dv12 * Dp02 - Dv02 * Dp12) * InvDeterminant;
+            Dpdv[i] = (Du02 * Dp12 - Du12 * Dp02) * InvDeterminant;
+        }
+    }
+
+    void PackMesh( const uint8_t* Vertices, uint32_t VertexCount, const VertexLayout& Layout,
+        const uint16_t* Indices, uint32_t IndexCount, std::vector<PackedVertex>& PackedVertices,
+        std::vector<PackedTriangle>& PackedTriangles, float UVOffset[2], float UVScale[2] )
+    {
+        float UVMin[2] = { 0.0f, 0.0f };
+        float UVMax[2] = { 0.0f, 0.0f };
+        for (uint32_t v = 0; v < VertexCount; ++v)
+        {
+            float UV[2];
+            ReadFloats(Vertices + v * Layout.Stride + Layout.UV, UV, 2);
+            for (uint32_t i = 0; i < 2; ++i)
+            {
+                UVMin[i] = v == 0 ? UV[i] : std::min(UVMin[i], UV[i]);
+                UVMax[i] = v == 0 ? UV[i] : std::max(UVMax[i], UV[i]);
+            }
+        }
+
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            UVOffset[i] = UVMin[i];
+            UVScale[i] = (UVMax[i] - UVMin[i]) / 65535.0f;
+        }
+
+        PackedVertices.reserve(PackedVertices.size() + VertexCount);
+        for (uint32_t v = 0; v < VertexCount; ++v)
+        {
+            const uint8_t* Vertex = Vertices + v * Layout.Stride;
+            float UV[2], Normal[3], Tangent[3], Bitangent[3];
+            ReadFloats(Vertex + Layout.UV, UV, 2);
+            ReadFloats(Vertex + Layout.Normal, Normal, 3);
+            ReadFloats(Vertex + Layout.Tangent, Tangent, 3);
+            ReadFloats(Vertex + Layout.Bitangent, Bitangent, 3);
+
+            float NxT[3];
+            Cross3(Normal, Tangent, NxT);
+            const float Handedness = Dot3(NxT, Bitangent) < 0.0f ? -1.0f : 1.0f;
+
+            PackedVertex Packed;
+            Packed.Normal = PackUnitVector(Normal);
+            Packed.Tangent = PackTangent(Tangent, Handedness);
+            Packed.UV = PackUV(UV, UVOffset, UVScale);
+            PackedVertices.push_back(Packed);
+        }
+
+        PackedTriangles.reserve(PackedTriangles.size() + IndexCount / 3);
+        for (uint32_t t = 0; t + 2 < IndexCount; t += 3)
+        {
+            float P[3][3], UV[3][2];
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                const uint8_t* Vertex = Vertices + Indices[t + c] * Layout.Stride;
+                ReadFloats(Vertex + Layout.Position, P[c], 3);
+                ReadFloats(Vertex + Layout.UV, UV[c], 2);
+            }
+
+            PackedTriangle Packed;
+            ComputePartialDerivatives(P[0], P[1], P[2], UV[0], UV[1], UV[2], Packed.Dpdu, Packed.Dpdv);
+
+            const float E20[3] = { P[2][0] - P[0][0], P[2][1] - P[0][1], P[2][2] - P[0][2] };
+            const float E10[3] = { P[1][0] - P[0][0], P[1][1] - P[0][1], P[1][2] - P[0][2] };
+            float FaceNormal[3];
+            Cross3(E20, E10, FaceNormal);
+            Packed.FaceNormal = PackUnitVector(FaceNormal);
+            Packed.Reserved = 0;
+            PackedTriangles.push_back(Packed);
+        }
+    }
+
+    void Build( const Model& model, std::vector<uint8_t>& Buffer, std::vector<MeshRange>& Meshes )
+    {
+        ASSERT(model.m_pVertexData != nullptr && model.m_pIndexData != nullptr, "Hit attributes need the CPU geometry");
+
+        std::vector<PackedVertex> Vertices;
+        std::vector<PackedTriangle> Triangles;
+        std::vector<Model::FloatVertex> Expanded;
+        size_t SourceBytes = 0;
+        Meshes.resize(model.m_Header.meshCount);
+
+        // PackMesh() reads floats, so each mesh is expanded from whatever layout the model is in
+        VertexLayout Layout;
+        Layout.Stride = sizeof(Model::FloatVertex);
+        Layout.Position = offsetof(Model::FloatVertex, position);
+        Layout.UV = offsetof(Model::FloatVertex, texcoord0);
+        Layout.Normal = offsetof(Model::FloatVertex, normal);
+        Layout.Tangent = offsetof(Model::FloatVertex, tangent);
+        Layout.Bitangent = offsetof(Model::FloatVertex, bitangent);
+
+        for (uint32_t i = 0; i < model.m_Header.meshCount; ++i)
+        {
+            const Model::Mesh& Mesh = model.m_pMesh[i];
+
+            Expanded.resize(Mesh.vertexCount);
+            for (uint32_t v = 0; v < Mesh.vertexCount; ++v)
+                model.DecodeVertex(Mesh, v, Expanded[v]);
+
+            // Triangle offsets are finished below, once the size of the vertex section is known
+            MeshRange& Range = Meshes[i];
+            Range.VertexOffsetBytes = (uint32_t)(Vertices.size() * sizeof(PackedVertex));
+            Range.TriangleOffsetBytes = (uint32_t)(Triangles.size() * sizeof(PackedTriangle));
+
+            SourceBytes += (size_t)Mesh.vertexCount * Mesh.vertexStride;
+            PackMesh((const uint8_t*)Expanded.data(), Mesh.vertexCount, Layout,
+                (const uint16_t*)(model.m_pIndexData + Mesh.indexDataByteOffset), Mesh.indexCount,
+                Vertices, Triangles, Range.UVOffset, Range.UVScale);
+        }
+
+        // Keep the triangles 16-byte aligned so each one is two aligned loads
+        const size_t VertexBytes = (Vertices.size() * sizeof(PackedVertex) + 15) & ~(size_t)15;
+        const size_t TriangleBytes = Triangles.size() * sizeof(PackedTriangle);
+
+        Buffer.assign(VertexBytes + TriangleBytes, 0);
+        if (!Vertices.empty())
+            std::memcpy(Buffer.data(), Vertices.data(), Vertices.size() * sizeof(PackedVertex));
+        if (!Triangles.empty())
+            std::memcpy(Buffer.data() + VertexBytes, Triangles.data(), TriangleBytes);
+
+        for (MeshRange& Range : Meshes)
+            Range.TriangleOffsetBytes += (uint32_t)VertexBytes;
+
+        Utility::Printf("Hit attributes:  %u vertices and %u triangles in %u KB (vertex data alone was %u KB)\n",
+            (uint32_t)Vertices.size(), (uint32_t)Triangles.size(), (uint32_t)(Buffer.size() / 1024), (uint32_t)(SourceBytes / 1024));
+    }
+
+    bool RunSelfTest( void )
+    {
+        bool Passed = true;
+        auto Expect = [&Passed]( bool Condition, const char* Name, float Value )
+        {
+            if (!Condition)
+            {
+                Utility::Printf("Hit attribute self test failed:  %s (%g)\n", Name, Value);
+                Passed = false;
+            }
+        };
+
+        // Directions spread evenly over the sphere plus the axes and the folds of the octahedron
+        std::vector<float> Directions;
+        const uint32_t kSphereSamples = 20000;
+        for (uint32_t i = 0; i < kSphereSamples; ++i)
+        {
+            const float Z = 1.0f - 2.0f * (i + 0.5f) / kSphereSamples;
+            const float R = std::sqrt(std::max(0.0f, 1.0f - Z * Z));
+            const float Phi = 2.39996323f * i;
+            Directions.insert(Directions.end(), { R * std::cos(Phi), R * std::sin(Phi), Z });
+        }
+        const float kSpecial[][3] =
+        {
+            { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+            { 0.7071068f, 0.7071068f, 0 }, { -0.7071068f, 0, -0.7071068f }, { 0.5773503f, -0.5773503f, -0.5773503f },
+        };
+        for (const float* V : kSpecial)
+            Directions.insert(Directions.end(), V, V + 3);
+
+        // snorm16 octahedral codes stay well within a hundredth of a degree; the tangent gives up one bit of X
+        const float kMaxNormalError = 0.0001f;
+        const float kMaxTangentError = 0.0002f;
+        float WorstNormalError = 0.0f;
+        float WorstTangentError = 0.0f;
+        bool HandednessKept = true;
+
+        for (size_t i = 0; i < Directions.size(); i += 3)
+        {
+            const float* V = &Directions[i];
+            float Decoded[3];
+            UnpackUnitVector(PackUnitVector(V), Decoded);
+            WorstNormalError = std::max(WorstNormalError, AngleBetween(Decoded, V));
+
+            for (float Handedness = -1.0f; Handedness <= 1.0f; Handedness += 2.0f)
+            {
+                float DecodedHandedness;
+                UnpackTangent(PackTangent(V, Handedness), Decoded, DecodedHandedness);
+                WorstTangentError = std::max(WorstTangentError, AngleBetween(Decoded, V));
+                HandednessKept = HandednessKept && DecodedHandedness == Handedness;
+            }
+        }
+        Expect(WorstNormalError <= kMaxNormalError, "normal angular error", WorstNormalError);
+        Expect(WorstTangentError <= kMaxTangentError, "tangent angular error", WorstTangentError);
+        Expect(HandednessKept, "tangent handedness", 0.0f);
+
+        // A zero vector must decode to something finite rather than NaN
+        {
+            const float Zero[3] = { 0, 0, 0 };
+            float Decoded[3];
+            UnpackUnitVector(PackUnitVector(Zero), Decoded);
+            Expect(std::fabs(Dot3(Decoded, Decoded) - 1.0f) < 1e-5f, "zero vector", Decoded[2]);
+        }
+
+        // UVs are off by at most half a code, plus float rounding of the expansion
+        {
+            const float UVOffset[2] = { -3.0f, 0.25f };
+            const float UVScale[2] = { 19.0f / 65535.0f, 1.0f / 65535.0f };
+            float WorstError[2] = { 0.0f, 0.0f };
+            for (uint32_t i = 0; i <= 1000; ++i)
+            {
+                const float UV[2] = { UVOffset[0] + 19.0f * i / 1000.0f, UVOffset[1] + (float)((i * 7919) % 1001) / 1000.0f };
+                float Decoded[2];
+                UnpackUV(PackUV(UV, UVOffset, UVScale), UVOffset, UVScale, Decoded);
+                for (uint32_t c = 0; c < 2; ++c)
+                    WorstError[c] = std::max(WorstError[c], std::fabs(Decoded[c] - UV[c]));
+            }
+            Expect(WorstError[0] <= 0.5f * UVScale[0] + 4e-6f, "wide UV error", WorstError[0]);
+            Expect(WorstError[1] <= 0.5f * UVScale[1] + 1e-6f, "unit UV error", WorstError[1]);
+        }
+
+        // The derivatives must reproduce both edges of the triangle they were solved from
+        {
+            float WorstError = 0.0f;
+            uint32_t Seed = 12345;
+            auto Random = [&Seed]() { Seed = Seed * 1664525u + 1013904223u; return (float)(Seed >> 8) / 16777216.0f * 2.0f - 1.0f; };
+            for (uint32_t i = 0; i < 1000; ++i)
+            {
+                float P[3][3], UV[3][2];
+                for (uint32_t c = 0; c < 3; ++c)
+                {
+                    P[c][0] = Random() * 100.0f; P[c][1] = Random() * 100.0f; P[c][2] = Random() * 100.0f;
+                    UV[c][0] = Random() * 4.0f; UV[c][1] = Random() * 4.0f;
+                }
+
+                const float Du02 = UV[0][0] - UV[2][0], Dv02 = UV[0][1] - UV[2][1];
+                const float Du12 = UV[1][0] - UV[2][0], Dv12 = UV[1][1] - UV[2][1];
+                if (std::fabs(Du02 * Dv12 - Dv02 * Du12) < 0.05f)
+                    continue;
+
+                float Dpdu[3], Dpdv[3];
+                ComputePartialDerivatives(P[0], P[1], P[2], UV[0], UV[1], UV[2], Dpdu, Dpdv);
+                for (uint32_t c = 0; c < 3; ++c)
+                {
+                    WorstError = std::max(WorstError, std::fabs(Dpdu[c] * Du02 + Dpdv[c] * Dv02 - (P[0][c] - P[2][c])));
+                    WorstError = std::max(WorstError, std::fabs(Dpdu[c] * Du12 + Dpdv[c] * Dv12 - (P[1][c] - P[2][c])));
+                }
+            }
+            Expect(WorstError < 0.01f, "partial derivative residual", WorstError);
+
+            const float P0[3] = { 0, 0, 0 }, UV0[2] = { 0.5f, 0.5f };
+            float Dpdu[3], Dpdv[3];
+            ComputePartialDerivatives(P0, P0, P0, UV0, UV0, UV0, Dpdu, Dpdv);
+            Expect(Dot3(Dpdu, Dpdu) == 0.0f && Dot3(Dpdv, Dpdv) == 0.0f, "degenerate UVs", Dpdu[0]);
+        }
+
+        // A left handed quad goes through the whole mesh path
+        {
+            struct SourceVertex { float Position[3]; float UV[2]; float Normal[3]; float Tangent[3]; float Bitangent[3]; };
+            const SourceVertex Quad[4] =
+            {
+                { { 0, 0, 0 }, { 1, 0 }, { 0, 0, 1 }, { -1, 0, 0 }, { 0, 1, 0 } },
+                { { 2, 0, 0 }, { 0, 0 }, { 0, 0, 1 }, { -1, 0, 0 }, { 0, 1, 0 } },
+                { { 2, 2, 0 }, { 0, 1 }, { 0, 0, 1 }, { -1, 0, 0 }, { 0, 1, 0 } },
+                { { 0, 2, 0 }, { 1, 1 }, { 0, 0, 1 }, { -1, 0, 0 }, { 0, 1, 0 } },
+            };
+            const uint16_t QuadIndices[6] = { 0, 1, 2, 0, 2, 3 };
+            const VertexLayout Layout = { (uint32_t)sizeof(SourceVertex), 0, 12, 20, 32, 44 };
+
+            std::vector<PackedVertex> Vertices;
+            std::vector<PackedTriangle> Triangles;
+            float UVOffset[2], UVScale[2];
+            PackMesh((const uint8_t*)Quad, 4, Layout, QuadIndices, 6, Vertices, Triangles, UVOffset, UVScale);
+            Expect(Vertices.size() == 4 && Triangles.size() == 2, "quad element count", (float)Vertices.size());
+
+            float Tangent[3], Handedness, UV[2];
+            UnpackTangent(Vertices[2].Tangent, Tangent, Handedness);
+            UnpackUV(Vertices[2].UV, UVOffset, UVScale, UV);
+            Expect(Handedness < 0.0f && Tangent[0] < -0.9999f, "quad tangent frame", Handedness);
+            Expect(UV[0] == 0.0f && std::fabs(UV[1] - 1.0f) < 1e-6f, "quad UV", UV[1]);
+
+            // u runs against x at two units per UV, v along y
+            Expect(std::fabs(Triangles[1].Dpdu[0] + 2.0f) < 1e-5f && std::fabs(Triangles[1].Dpdv[1] - 2.0f) < 1e-5f,
+                "quad partial derivatives", Triangles[1].Dpdu[0]);
+
+            float FaceNormal[3];
+            UnpackUnitVector(Triangles[0].FaceNormal, FaceNormal);
+            Expect(FaceNormal[2] < -0.9999f, "quad face normal", FaceNormal[2]);
+        }
+
+        return Passed;
+    }
+}
@@ -0,0 +1,88 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// Compact vertex and triangle attributes read by the hit shaders in place of the model's vertex buffer.
+//
+// Every vertex packs into 12 bytes:  an octahedral normal, an octahedral tangent whose lowest bit holds
+// the handedness of the tangent frame, and a UV quantized to the UV bounds of its mesh.  The bitangent is
+// rebuilt from the cross product.  Every triangle packs into 32 bytes:  dp/du and dp/dv, which used to be
+// solved per hit, and the geometric normal.  Positions are no longer read at all.
+//
+// The decoders mirror HitAttributes.hlsli exactly so the round trip error can be checked on the CPU.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class Model;
+
+namespace HitAttributes
+{
+    struct PackedVertex
+    {
+        uint32_t Normal;    // Octahedral snorm16x2
+        uint32_t Tangent;   // Octahedral snorm16x2, bit 0 set for a left handed frame
+        uint32_t UV;        // unorm16x2 within the UV bounds of the mesh
+    };
+
+    struct PackedTriangle
+    {
+        float Dpdu[3];
+        uint32_t FaceNormal; // Octahedral snorm16x2 of cross(p2 - p0, p1 - p0)
+        float Dpdv[3];
+        uint32_t Reserved;
+    };
+
+    // Where a mesh lives in the packed buffer and how to expand its UVs
+    struct MeshRange
+    {
+        uint32_t VertexOffsetBytes;
+        uint32_t TriangleOffsetBytes;
+        float UVOffset[2];
+        float UVScale[2];
+    };
+
+    // Byte offsets of the attributes within one vertex of the source layout
+    struct VertexLayout
+    {
+        uint32_t Stride;
+        uint32_t Position;
+        uint32_t UV;
+        uint32_t Normal;
+        uint32_t Tangent;
+        uint32_t Bitangent;
+    };
+
+    uint32_t PackUnitVector( const float V[3] );
+    void UnpackUnitVector( uint32_t Packed, float V[3] );
+
+    // Handedness is the sign of dot(cross(N, T), B)
+    uint32_t PackTangent( const float T[3], float Handedness );
+    void UnpackTangent( uint32_t Packed, float T[3], float& Handedness );
+
+    uint32_t PackUV( const float UV[2], const float UVOffset[2], const float UVScale[2] );
+    void UnpackUV( uint32_t Packed, const float UVOffset[2], const float UVScale[2], float UV[2] );
+
+    // Same solution as the hit shader used to find per hit.  Degenerate UVs yield zero vectors.
+    void ComputePartialDerivatives( const float P0[3], const float P1[3], const float P2[3],
+        const float UV0[2], const float UV1[2], const float UV2[2], float Dpdu[3], float Dpdv[3] );
+
+    // Appends the vertices and triangles of one mesh.  Triangles follow the order of the index buffer.
+    void PackMesh( const uint8_t* Vertices, uint32_t VertexCount, const VertexLayout& Layout,
+        const uint16_t* Indices, uint32_t IndexCount, std::vector<PackedVertex>& PackedVertices,
+        std::vector<PackedTriangle>& PackedTriangles, float UVOffset[2], float UVScale[2] );
+
+    // Packs every mesh into one buffer, all vertices first, then all triangles.  The model must still
+    // hold its CPU geometry, and the triangles keep whatever order its index buffer has at this point.
+    void Build( const Model& model, std::vector<uint8_t>& Buffer, std::vector<MeshRange>& Meshes );
+
+    // Checks the round trip error of every encoding against fixed bounds
+    bool RunSelfTest( void );
+}
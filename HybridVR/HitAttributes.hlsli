@@ -0,0 +1,40 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Decoders for the packed hit attributes built by HitAttributes.cpp, which mirrors them on the CPU.
+// A packed vertex is 12 bytes (normal, tangent, UV) and a packed triangle is 32 bytes (dp/du with the
+// face normal in .w, then dp/dv).
+//
+
+#ifndef HIT_ATTRIBUTES_HLSLI_INCLUDED
+#define HIT_ATTRIBUTES_HLSLI_INCLUDED
+
+#define PACKED_VERTEX_STRIDE 12
+#define PACKED_TRIANGLE_STRIDE 32
+
+float3 UnpackOctahedral(uint packed)
+{
+    float2 e = max(float2(int2(packed << 16, packed) >> 16) / 32767.0, -1.0);
+    float3 n = float3(e, 1.0 - abs(e.x) - abs(e.y));
+    float fold = saturate(-n.z);
+    n.xy += n.xy >= 0.0 ? -fold : fold;
+    return normalize(n);
+}
+
+// The lowest bit of the tangent is set when the tangent frame is left handed
+float UnpackTangentHandedness(uint packed)
+{
+    return (packed & 1) ? -1.0 : 1.0;
+}
+
+float2 UnpackUV(uint packed, float2 uvOffset, float2 uvScale)
+{
+    return float2(packed & 0xffff, packed >> 16) * uvScale + uvOffset;
+}
+
+#endif // HIT_ATTRIBUTES_HLSLI_INCLUDED
@@ -0,0 +1,426 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "InterleavedRays.h"
+#include "PipelineState.h"
+#include "RootSignature.h"
+#include "CommandContext.h"
+#include "BufferManager.h"
+#include "TemporalEffects.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "CompiledShaders/InterleavedReconstructCS.h"
+
+using namespace Graphics;
+
+extern ColorBuffer g_SceneNormalBuffer;
+
+namespace Settings
+{
+    const char* InterleavedRays_RateLabels[] = { "Off", "1/2", "1/4" };
+    EnumVar InterleavedRays_Shadows("Application/Raytracing/Interleave Shadow Rays", 0, 3, InterleavedRays_RateLabels);
+    EnumVar InterleavedRays_Diffuse("Application/Raytracing/Interleave Diffuse Rays", 0, 3, InterleavedRays_RateLabels);
+    EnumVar InterleavedRays_Reflections("Application/Raytracing/Interleave Reflection Rays", 0, 3, InterleavedRays_RateLabels);
+    NumVar InterleavedRays_MaxVelocity("Application/Raytracing/Interleave Max Velocity", 16.0f, 1.0f, 128.0f, 1.0f);
+    NumVar InterleavedRays_DepthTolerance("Application/Raytracing/Interleave Depth Tolerance", 0.05f, 0.001f, 0.5f, 0.001f);
+}
+
+namespace InterleavedRays
+{
+    // The pixel of each 2x2 quad traced in each phase, as x | y << 1.  Must match
+    // InterleavedReconstructCS.hlsl and CompactRaysCS.hlsl.
+    const uint32_t kQuadOrder[4] = { 0, 3, 1, 2 };
+
+    RootSignature m_RootSig;
+    ComputePSO m_ReconstructCS;
+
+    // Ping-ponged so a frame reads the last frame's history while writing its own
+    ColorBuffer m_History[2];
+
+    uint32_t m_Width;
+    uint32_t m_Height;
+    uint32_t m_Frame[2];
+    uint64_t m_LastFrame[2];
+    uint32_t m_LastRate[2];
+    int32_t m_LastMode[2];
+    bool m_HasHistory[2];
+
+    // Must match InterleavedReconstructCS.hlsl
+    __declspec(align(16)) struct CSConstants
+    {
+        uint32_t Resolution[2];
+        uint32_t Slice;
+        uint32_t Rate;
+        uint32_t Phase;
+        uint32_t RequireReflective;
+        float MaxVelocity;
+        float DepthTolerance;
+    };
+
+    ReconstructionParams GetParams( void )
+    {
+        ReconstructionParams Params;
+        Params.MaxVelocity = Settings::InterleavedRays_MaxVelocity;
+        Params.DepthTolerance = Settings::InterleavedRays_DepthTolerance;
+        return Params;
+    }
+}
+
+void InterleavedRays::Initialize( uint32_t Width, uint32_t Height )
+{
+    m_RootSig.Reset(3, 0);
+    m_RootSig[0].InitAsConstantBuffer(0);
+    m_RootSig[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, 4);
+    m_RootSig[2].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 0, 2);
+    m_RootSig.Finalize(L"InterleavedRaysRS");
+
+    m_ReconstructCS.SetRootSignature(m_RootSig);
+    m_ReconstructCS.SetComputeShader(g_pInterleavedReconstructCS, sizeof(g_pInterleavedReconstructCS));
+    m_ReconstructCS.Finalize();
+
+    m_Width = Width;
+    m_Height = Height;
+    m_History[0].CreateArray(L"Interleaved Ray History 0", Width, Height, 2, DXGI_FORMAT_R16G16B16A16_FLOAT);
+    m_History[1].CreateArray(L"Interleaved Ray History 1", Width, Height, 2, DXGI_FORMAT_R16G16B16A16_FLOAT);
+
+    for (uint32_t Eye = 0; Eye < 2; ++Eye)
+    {
+        m_Frame[Eye] = 0;
+        m_HasHistory[Eye] = false;
+    }
+}
+
+InterleavedRays::FrameParams InterleavedRays::BeginFrame( uint32_t Eye, uint32_t Rate, int32_t RayTracingMode )
+{
+    FrameParams Frame = {};
+    Frame.Rate = 1;
+
+    const uint64_t FrameCount = Graphics::GetFrameCount();
+    if (Rate <= 1)
+    {
+        m_HasHistory[Eye] = false;
+        return Frame;
+    }
+
+    if (Rate != m_LastRate[Eye] || RayTracingMode != m_LastMode[Eye] || FrameCount != m_LastFrame[Eye] + 1)
+        m_HasHistory[Eye] = false;
+
+    // The first frame traces everything to fill the history
+    Frame.Active = true;
+    Frame.Rate = m_HasHistory[Eye] ? Rate : 1;
+    Frame.Phase = m_Frame[Eye] % Rate;
+
+    m_LastRate[Eye] = Rate;
+    m_LastMode[Eye] = RayTracingMode;
+    m_LastFrame[Eye] = FrameCount;
+    return Frame;
+}
+
+void InterleavedRays::Reconstruct( ComputeContext& Context, uint32_t Eye, const FrameParams& Frame, bool RequireReflective )
+{
+    ScopedTimer _prof(L"Interleaved Reconstruct", Context);
+
+    const ReconstructionParams Params = GetParams();
+    ColorBuffer& History = m_History[(m_Frame[Eye] + 1) & 1];
+    ColorBuffer& NewHistory = m_History[m_Frame[Eye] & 1];
+    ColorBuffer& LinearDepth = g_LinearDepth[TemporalEffects::GetFrameIndexMod2()];
+
+    CSConstants csConstants;
+    csConstants.Resolution[0] = m_Width;
+    csConstants.Resolution[1] = m_Height;
+    csConstants.Slice = Eye;
+    csConstants.Rate = Frame.Rate;
+    csConstants.Phase = Frame.Phase;
+    csConstants.RequireReflective = RequireReflective ? 1 : 0;
+    csConstants.MaxVelocity = Params.MaxVelocity;
+    csConstants.DepthTolerance = Params.DepthTolerance;
+
+    Context.SetRootSignature(m_RootSig);
+    Context.SetPipelineState(m_ReconstructCS);
+
+    Context.TransitionResource(LinearDepth, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(g_VelocityBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(g_SceneNormalBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(History, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(NewHistory, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    Context.TransitionResource(g_SceneColorBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, true);
+
+    Context.SetDynamicConstantBufferView(0, sizeof(CSConstants), &csConstants);
+    Context.SetDynamicDescriptor(1, 0, LinearDepth.GetSRV());
+    Context.SetDynamicDescriptor(1, 1, g_VelocityBuffer.GetSRV());
+    Context.SetDynamicDescriptor(1, 2, g_SceneNormalBuffer.GetSRV());
+    Context.SetDynamicDescriptor(1, 3, History.GetSRV());
+    Context.SetDynamicDescriptor(2, 0, g_SceneColorBuffer.GetUAV());
+    Context.SetDynamicDescriptor(2, 1, NewHistory.GetUAV());
+
+    Context.Dispatch2D(m_Width, m_Height, 8, 8);
+    Context.InsertUAVBarrier(g_SceneColorBuffer);
+
+    ++m_Frame[Eye];
+    m_HasHistory[Eye] = true;
+}
+
+bool InterleavedRays::IsTracedPixel( uint32_t x, uint32_t y, uint32_t Rate, uint32_t Phase )
+{
+    switch (Rate)
+    {
+    case 2:     return ((x + y + Phase) & 1) == 0;
+    case 4:     return ((x & 1) | (y & 1) << 1) == kQuadOrder[Phase & 3];
+    default:    return true;
+    }
+}
+
+void InterleavedRays::ReconstructReference( uint32_t Width, uint32_t Height, uint32_t Rate, uint32_t Phase,
+    const float* LinearDepth, const float* Velocity, const float* Reflectivity, const float* History,
+    const ReconstructionParams& Params, float* Color, float* NewHistory )
+{
+    auto NeedsColor = [&]( int32_t x, int32_t y ) -> bool
+    {
+        return Reflectivity == nullptr || Reflectivity[y * Width + x] != 0.0f;
+    };
+
+    // Every pixel is classified before any is written, as the GPU only reads traced pixels of Color
+    std::vector<float> Traced(Color, Color + (size_t)Width * Height * 4);
+
+    for (int32_t y = 0; y < (int32_t)Height; ++y)
+    {
+        for (int32_t x = 0; x < (int32_t)Width; ++x)
+        {
+            const size_t i = (size_t)y * Width + x;
+            const float Depth = LinearDepth[i];
+
+            if (!IsTracedPixel(x, y, Rate, Phase) && NeedsColor(x, y))
+            {
+                float Result[3] = {};
+                bool Reprojected = false;
+
+                // Bilinear history from where the velocity says the surface was, skipping taps of other surfaces
+                const float* v = Velocity + i * 3;
+                if (std::sqrt(v[0] * v[0] + v[1] * v[1]) <= Params.MaxVelocity)
+                {
+                    const float PrevX = x + v[0];
+                    const float PrevY = y + v[1];
+                    const float ExpectedDepth = std::max(Depth + v[2], 1e-4f);
+                    const int32_t BaseX = (int32_t)std::floor(PrevX);
+                    const int32_t BaseY = (int32_t)std::floor(PrevY);
+                    const float fx = PrevX - BaseX;
+                    const float fy = PrevY - BaseY;
+
+                    float Sum[3] = {};
+                    float TotalWeight = 0.0f;
+                    for (int32_t Tap = 0; Tap < 4; ++Tap)
+                    {
+                        const int32_t tx = BaseX + (Tap & 1);
+                        const int32_t ty = BaseY + (Tap >> 1);
+                        if (tx < 0 || ty < 0 || tx >= (int32_t)Width || ty >= (int32_t)Height)
+                            continue;
+
+                        const float* h = History + ((size_t)ty * Width + tx) * 4;
+                        if (std::abs(h[3] - ExpectedDepth) > Params.DepthTolerance * ExpectedDepth)
+                            continue;
+
+                        const float Weight = ((Tap & 1) ? fx : 1.0f - fx) * ((Tap >> 1) ? fy : 1.0f - fy);
+                        for (uint32_t c = 0; c < 3; ++c)
+                            Sum[c] += Weight * h[c];
+                        TotalWeight += Weight;
+                    }
+
+                    if (TotalWeight > 0.01f)
+                    {
+                        for (uint32_t c = 0; c < 3; ++c)
+                            Result[c] = Sum[c] / TotalWeight;
+                        Reprojected = true;
+                    }
+                }
+
+                // Otherwise fill from traced neighbours on the same surface
+                if (!Reprojected)
+                {
+                    float Sum[3] = {};
+                    float TotalWeight = 0.0f;
+                    float BestWeight = -1.0f;
+                    size_t Best = i;
+                    for (int32_t dy = -1; dy <= 1; ++dy)
+                    {
+                        for (int32_t dx = -1; dx <= 1; ++dx)
+                        {
+                            const int32_t sx = x + dx;
+                            const int32_t sy = y + dy;
+                            if ((dx == 0 && dy == 0) || sx < 0 || sy < 0 || sx >= (int32_t)Width || sy >= (int32_t)Height)
+                                continue;
+                            if (!IsTracedPixel(sx, sy, Rate, Phase) || !NeedsColor(sx, sy))
+                                continue;
+
+                            const size_t s = (size_t)sy * Width + sx;
+                            const float Weight = (dx != 0 && dy != 0 ? 0.5f : 1.0f) *
+                                std::exp2(-std::abs(LinearDepth[s] - Depth) / (std::max(Depth, 1e-4f) * Params.DepthTolerance));
+                            for (uint32_t c = 0; c < 3; ++c)
+                                Sum[c] += Weight * Traced[s * 4 + c];
+                            TotalWeight += Weight;
+                            if (Weight > BestWeight)
+                            {
+                                BestWeight = Weight;
+                                Best = s;
+                            }
+                        }
+                    }
+
+                    for (uint32_t c = 0; c < 3; ++c)
+                        Result[c] = TotalWeight > 1e-4f ? Sum[c] / TotalWeight : Traced[Best * 4 + c];
+                }
+
+                for (uint32_t c = 0; c < 3; ++c)
+                    Color[i * 4 + c] = Result[c];
+            }
+
+            for (uint32_t c = 0; c < 3; ++c)
+                NewHistory[i * 4 + c] = Color[i * 4 + c];
+            NewHistory[i * 4 + 3] = Depth;
+        }
+    }
+}
+
+bool InterleavedRays::RunSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, float Value )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("Interleaved rays self test failed:  %s (%f)\n", Name, Value);
+            Passed = false;
+        }
+    };
+
+    // Over a cycle every pixel is traced exactly once
+    const uint32_t kRates[] = { 2, 4 };
+    for (uint32_t Rate : kRates)
+    {
+        for (uint32_t y = 0; y < 8; ++y)
+        {
+            for (uint32_t x = 0; x < 8; ++x)
+            {
+                uint32_t TracedCount = 0;
+                for (uint32_t Phase = 0; Phase < Rate; ++Phase)
+                    TracedCount += IsTracedPixel(x, y, Rate, Phase) ? 1 : 0;
+                Expect(TracedCount == 1, "pixel traced once per cycle", (float)(y * 8 + x));
+            }
+        }
+    }
+
+    // A background panning one pixel per frame behind a screen locked square, so the square's trailing
+    // edge disoccludes background every frame
+    const uint32_t kWidth = 64;
+    const uint32_t kHeight = 48;
+    const uint32_t kPixels = kWidth * kHeight;
+    const uint32_t kSquareMin = 20;
+    const uint32_t kSquareMax = 30;
+    const float kBackDepth = 0.8f;
+    const float kSquareDepth = 0.3f;
+    const float kGarbage = -100.0f;
+
+    auto InSquare = [=]( uint32_t x, uint32_t y ) { return x >= kSquareMin && x < kSquareMax && y >= kSquareMin && y < kSquareMax; };
+    auto Shade = [=]( uint32_t x, uint32_t y, uint32_t Frame, float* Rgb )
+    {
+        const bool Square = InSquare(x, y);
+        const float u = Square ? (float)x : (float)(x + Frame);
+        Rgb[0] = 0.5f + 0.5f * std::sin(u * 0.2f);
+        Rgb[1] = 0.5f + 0.5f * std::cos(y * 0.15f);
+        Rgb[2] = Square ? 0.9f : 0.2f;
+    };
+
+    std::vector<float> Depth(kPixels);
+    std::vector<float> Velocity(kPixels * 3);
+    for (uint32_t y = 0; y < kHeight; ++y)
+    {
+        for (uint32_t x = 0; x < kWidth; ++x)
+        {
+            const uint32_t i = y * kWidth + x;
+            const bool Square = InSquare(x, y);
+            Depth[i] = Square ? kSquareDepth : kBackDepth;
+            Velocity[i * 3 + 0] = Square ? 0.0f : 1.0f;
+            Velocity[i * 3 + 1] = 0.0f;
+            Velocity[i * 3 + 2] = 0.0f;
+        }
+    }
+
+    ReconstructionParams Params = { 16.0f, 0.05f };
+    for (uint32_t Rate : kRates)
+    {
+        // The first frame traces everything, as BeginFrame() does without history
+        std::vector<float> History(kPixels * 4);
+        std::vector<float> NewHistory(kPixels * 4);
+        std::vector<float> Color(kPixels * 4);
+
+        float MaxError = 0.0f;
+        double TotalError = 0.0;
+        uint32_t Reconstructed = 0;
+        for (uint32_t Frame = 0; Frame < 12; ++Frame)
+        {
+            const uint32_t FrameRate = Frame == 0 ? 1 : Rate;
+            const uint32_t Phase = Frame % Rate;
+
+            std::vector<float> Expected(kPixels * 4);
+            for (uint32_t y = 0; y < kHeight; ++y)
+            {
+                for (uint32_t x = 0; x < kWidth; ++x)
+                {
+                    const uint32_t i = y * kWidth + x;
+                    Shade(x, y, Frame, &Expected[i * 4]);
+                    Expected[i * 4 + 3] = 1.0f;
+
+                    const bool Traced = IsTracedPixel(x, y, FrameRate, Phase);
+                    for (uint32_t c = 0; c < 4; ++c)
+                        Color[i * 4 + c] = Traced || c == 3 ? Expected[i * 4 + c] : kGarbage;
+                }
+            }
+
+            ReconstructReference(kWidth, kHeight, FrameRate, Phase, Depth.data(), Velocity.data(), nullptr,
+                History.data(), Params, Color.data(), NewHistory.data());
+            History.swap(NewHistory);
+
+            for (uint32_t i = 0; i < kPixels; ++i)
+            {
+                for (uint32_t c = 0; c < 3; ++c)
+                {
+                    const float Error = std::abs(Color[i * 4 + c] - Expected[i * 4 + c]);
+                    MaxError = std::max(MaxError, Error);
+                    TotalError += Error;
+                }
+                Reconstructed += IsTracedPixel(i % kWidth, i / kWidth, FrameRate, Phase) ? 0 : 1;
+            }
+        }
+
+        const float MeanError = (float)(TotalError / std::max(Reconstructed * 3u, 1u));
+        Expect(MaxError < 0.15f, "reconstructed pixel error", MaxError);
+        Expect(MeanError < 0.01f, "mean reconstruction error", MeanError);
+    }
+
+    // With every reprojection rejected the neighbours still fill every pixel
+    {
+        Params.MaxVelocity = 0.5f;
+        std::vector<float> History(kPixels * 4, 0.0f);
+        std::vector<float> NewHistory(kPixels * 4);
+        std::vector<float> Color(kPixels * 4);
+        for (uint32_t i = 0; i < kPixels; ++i)
+        {
+            for (uint32_t c = 0; c < 4; ++c)
+                Color[i * 4 + c] = IsTracedPixel(i % kWidth, i / kWidth, 4, 1) ? 0.5f : kGarbage;
+        }
+
+        ReconstructReference(kWidth, kHeight, 4, 1, Depth.data(), Velocity.data(), nullptr,
+            History.data(), Params, Color.data(), NewHistory.data());
+        for (uint32_t i = 0; i < kPixels; ++i)
+            Expect(Color[i * 4] == 0.5f, "rejected pixel filled from neighbours", (float)i);
+    }
+
+    return Passed;
+}
@@ -0,0 +1,68 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// Interleaved ray tracing.  An eye traces 1/2 or 1/4 of its pixels each frame in a pattern that rotates from
+// frame to frame, so every pixel is traced once every Rate frames:
+//
+//     Rate 2      a checkerboard, flipped every frame
+//     Rate 4      one pixel of every 2x2 quad, top left, bottom right, top right, then bottom left
+//
+// The other pixels are reprojected from the eye's history with the camera velocity buffer.  History is
+// rejected when the pixel moves faster than a limit, when it comes from off screen, or when its depth does
+// not match where the velocity says the surface was.  Rejected pixels are filled from traced neighbours
+// on the same surface instead.
+//
+// The rate is chosen per ray tracing mode with the Interleave settings.  ReconstructReference() is a CPU
+// reference of InterleavedReconstructCS.hlsl.
+
+#pragma once
+
+#include <cstdint>
+
+class ComputeContext;
+
+namespace InterleavedRays
+{
+    struct FrameParams
+    {
+        bool Active;        // Reconstruct() must run after the rays are traced
+        uint32_t Rate;      // 1 while the eye has no history yet
+        uint32_t Phase;
+    };
+
+    void Initialize( uint32_t Width, uint32_t Height );
+
+    // Call once per eye and frame before the ray list is built, with the rate the ray tracing mode asks for.
+    // The history is dropped when the mode or rate changes or the eye skipped a frame.
+    FrameParams BeginFrame( uint32_t Eye, uint32_t Rate, int32_t RayTracingMode );
+
+    // Fills the pixels of one slice of g_SceneColorBuffer that were not traced and stores the result as the
+    // eye's history
+    void Reconstruct( ComputeContext& Context, uint32_t Eye, const FrameParams& Frame, bool RequireReflective );
+
+    bool IsTracedPixel( uint32_t x, uint32_t y, uint32_t Rate, uint32_t Phase );
+
+    struct ReconstructionParams
+    {
+        float MaxVelocity;      // In pixels per frame
+        float DepthTolerance;   // Relative to the depth the velocity predicts
+    };
+
+    // LinearDepth is normalized like g_LinearDepth, Velocity holds the x, y and z of the camera velocity
+    // buffer per pixel, and History and Color hold rgba with the linear depth of History in alpha.
+    // Reflectivity may be null, otherwise only pixels with reflectivity are reconstructed.  NewHistory gets
+    // every pixel of the reconstructed image.
+    void ReconstructReference( uint32_t Width, uint32_t Height, uint32_t Rate, uint32_t Phase,
+        const float* LinearDepth, const float* Velocity, const float* Reflectivity, const float* History,
+        const ReconstructionParams& Params, float* Color, float* NewHistory );
+
+    // Checks that every pixel is traced once per cycle, and reconstructs a panning synthetic scene with a
+    // disocclusion against its ground truth
+    bool RunSelfTest( void );
+}
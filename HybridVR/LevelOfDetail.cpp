@@ -0,0 +1,348 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "LevelOfDetail.h"
+#include "MeshletCulling.h"
+#include "TestMeshes.h"
+#include "Model.h"
+#include "Camera.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+using namespace Math;
+
+namespace Settings
+{
+    BoolVar LevelOfDetail_Enable("Application/Level of Detail/Enable", true);
+    NumVar LevelOfDetail_PixelError("Application/Level of Detail/Pixel Error", 1.0f, 0.25f, 8.0f, 0.25f);
+}
+
+float LevelOfDetail::GetProjectedError( float Error, float Distance, float PixelScale )
+{
+    if (Error == 0.0f)
+        return 0.0f;
+    return Distance > 0.0f ? Error * PixelScale / Distance : FLT_MAX;
+}
+
+uint32_t LevelOfDetail::SelectLevel( const Model& Model, uint32_t MeshIndex, const Eye* Eyes, uint32_t EyeCount, float PixelError )
+{
+    const Model::BoundingBox& Box = Model.m_pMesh[MeshIndex].boundingBox;
+    const float BoxMin[3] = { Box.min.GetX(), Box.min.GetY(), Box.min.GetZ() };
+    const float BoxMax[3] = { Box.max.GetX(), Box.max.GetY(), Box.max.GetZ() };
+
+    float Distances[2];
+    ASSERT(EyeCount <= _countof(Distances));
+    for (uint32_t e = 0; e < EyeCount; ++e)
+    {
+        float DistanceSquared = 0.0f;
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            const float Outside = std::max(std::max(BoxMin[k] - Eyes[e].Position[k], Eyes[e].Position[k] - BoxMax[k]), 0.0f);
+            DistanceSquared += Outside * Outside;
+        }
+        Distances[e] = std::sqrt(DistanceSquared);
+    }
+
+    for (uint32_t Level = Model.m_LodCount - 1; Level > 0 && Level < Model.m_LodCount; --Level)
+    {
+        const float Error = Model.GetLod(MeshIndex, Level).error;
+        bool Fine = true;
+        for (uint32_t e = 0; e < EyeCount && Fine; ++e)
+            Fine = GetProjectedError(Error, Distances[e], Eyes[e].PixelScale) <= PixelError;
+        if (Fine)
+            return Level;
+    }
+    return 0;
+}
+
+void LevelOfDetail::Select( const Model& Model, const Camera& Left, const Camera& Right, float Height,
+    std::vector<uint32_t>& Levels )
+{
+    Levels.assign(Model.m_Header.meshCount, 0);
+    if (!Settings::LevelOfDetail_Enable || Model.m_LodCount == 0)
+        return;
+
+    Eye Eyes[2];
+    const Camera* Cameras[2] = { &Left, &Right };
+    for (uint32_t e = 0; e < 2; ++e)
+    {
+        const Vector3 Position = Cameras[e]->GetPosition();
+        Eyes[e].Position[0] = Position.GetX();
+        Eyes[e].Position[1] = Position.GetY();
+        Eyes[e].Position[2] = Position.GetZ();
+        Eyes[e].PixelScale = Cameras[e]->GetProjMatrix().GetY().GetY() * Height * 0.5f;
+    }
+
+    for (uint32_t m = 0; m < Model.m_Header.meshCount; ++m)
+        Levels[m] = SelectLevel(Model, m, Eyes, 2, Settings::LevelOfDetail_PixelError);
+}
+
+namespace
+{
+    struct Float3
+    {
+        float x, y, z;
+    };
+
+    Float3 GetPosition( const Model& Model, const Model::Mesh& Mesh, uint32_t Index )
+    {
+        Model::FloatVertex Vertex;
+        Model.DecodeVertex(Mesh, Index, Vertex);
+        const Float3 Position = { Vertex.position.x, Vertex.position.y, Vertex.position.z };
+        return Position;
+    }
+
+    Float3 Sub( const Float3& A, const Float3& B ) { const Float3 R = { A.x - B.x, A.y - B.y, A.z - B.z }; return R; }
+    float Dot( const Float3& A, const Float3& B ) { return A.x * B.x + A.y * B.y + A.z * B.z; }
+    Float3 Cross( const Float3& A, const Float3& B )
+    {
+        const Float3 R = { A.y * B.z - A.z * B.y, A.z * B.x - A.x * B.z, A.x * B.y - A.y * B.x };
+        return R;
+    }
+
+    // Distance from P to triangle ABC, the nearest of the plane inside the triangle and its three edges
+    float DistanceToTriangle( const Float3& P, const Float3& A, const Float3& B, const Float3& C )
+    {
+        const Float3 Corners[3] = { A, B, C };
+        const Float3 Normal = Cross(Sub(B, A), Sub(C, A));
+        const float Area = Dot(Normal, Normal);
+        if (Area > 0.0f)
+        {
+            bool Inside = true;
+            for (uint32_t k = 0; k < 3; ++k)
+                Inside &= Dot(Cross(Sub(Corners[(k + 1) % 3], Corners[k]), Sub(P, Corners[k])), Normal) >= 0.0f;
+            if (Inside)
+                return std::abs(Dot(Sub(P, A), Normal)) / std::sqrt(Area);
+        }
+
+        float Nearest = FLT_MAX;
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            const Float3 Edge = Sub(Corners[(k + 1) % 3], Corners[k]);
+            const Float3 ToP = Sub(P, Corners[k]);
+            const float Length = Dot(Edge, Edge);
+            const float T = Length > 0.0f ? std::min(std::max(Dot(ToP, Edge) / Length, 0.0f), 1.0f) : 0.0f;
+            const Float3 Offset = { ToP.x - Edge.x * T, ToP.y - Edge.y * T, ToP.z - Edge.z * T };
+            Nearest = std::min(Nearest, std::sqrt(Dot(Offset, Offset)));
+        }
+        return Nearest;
+    }
+
+    // Largest distance from a vertex of the mesh to the nearest triangle of a level
+    float MeasureLevelError( const Model& Model, uint32_t MeshIndex, uint32_t Level )
+    {
+        const Model::Mesh& Mesh = Model.m_pMesh[MeshIndex];
+        const Model::LodLevel& Lod = Model.GetLod(MeshIndex, Level);
+        const uint16_t* Indices = (const uint16_t*)(Model.m_pIndexData + Lod.indexDataByteOffset);
+
+        std::vector<Float3> Corners(Lod.indexCount);
+        for (uint32_t i = 0; i < Lod.indexCount; ++i)
+            Corners[i] = GetPosition(Model, Mesh, Indices[i]);
+
+        float Error = 0.0f;
+        for (uint32_t v = 0; v < Mesh.vertexCount; ++v)
+        {
+            const Float3 P = GetPosition(Model, Mesh, v);
+            float Nearest = FLT_MAX;
+            for (uint32_t i = 0; i < Lod.indexCount; i += 3)
+                Nearest = std::min(Nearest, DistanceToTriangle(P, Corners[i], Corners[i + 1], Corners[i + 2]));
+            Error = std::max(Error, Nearest);
+        }
+        return Error;
+    }
+
+    // Area of a level projected onto the y = 0 plane, negative for triangles facing down
+    float GetAreaFacingUp( const Model& Model, uint32_t MeshIndex, uint32_t Level, bool (*Filter)( float X ) )
+    {
+        const Model::Mesh& Mesh = Model.m_pMesh[MeshIndex];
+        const Model::LodLevel& Lod = Model.GetLod(MeshIndex, Level);
+        const uint16_t* Indices = (const uint16_t*)(Model.m_pIndexData + Lod.indexDataByteOffset);
+        float Area = 0.0f;
+        for (uint32_t i = 0; i < Lod.indexCount; i += 3)
+        {
+            const Float3 A = GetPosition(Model, Mesh, Indices[i]);
+            const Float3 B = GetPosition(Model, Mesh, Indices[i + 1]);
+            const Float3 C = GetPosition(Model, Mesh, Indices[i + 2]);
+            if (Filter((A.x + B.x + C.x) / 3.0f))
+                Area += Cross(Sub(B, A), Sub(C, A)).y * 0.5f;
+        }
+        return Area;
+    }
+}
+
+bool LevelOfDetail::RunSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, float Value )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("Level of detail self test failed:  %s (%f)\n", Name, Value);
+            Passed = false;
+        }
+    };
+
+    // Mesh 0 is a flat square made of two grids whose texture coordinates do not meet, so their shared edge
+    // is a seam.  Mesh 1 is a unit sphere with a seam where its texture coordinates wrap and poles where many
+    // vertices share a position.
+    const float kPi = 3.14159265f;
+    const uint32_t kGrid = 24;
+    std::vector<TestMeshes::Mesh> Meshes(2);
+    Meshes[0].Material = 0;
+    TestMeshes::AddGrid(Meshes[0], kGrid, kGrid * 2,
+        []( float U, float V ) { return XMFLOAT3(U - 1.0f, 0.0f, V * 2.0f - 1.0f); },
+        []( const XMFLOAT3& ) { return XMFLOAT3(0.0f, 1.0f, 0.0f); });
+    const uint32_t LeftVertices = (uint32_t)Meshes[0].Vertices.size();
+    TestMeshes::AddGrid(Meshes[0], kGrid, kGrid * 2,
+        []( float U, float V ) { return XMFLOAT3(U, 0.0f, V * 2.0f - 1.0f); },
+        []( const XMFLOAT3& ) { return XMFLOAT3(0.0f, 1.0f, 0.0f); });
+    Meshes[1].Material = 0;
+    TestMeshes::AddGrid(Meshes[1], 32, 64,
+        [&]( float U, float V )
+        {
+            // Exactly 0 at the poles, so that their vertices share a position instead of leaving a tiny hole
+            const float Ring = U > 0.0f && U < 1.0f ? std::sin(U * kPi) : 0.0f;
+            return XMFLOAT3(Ring * std::cos(V * 2.0f * kPi), std::cos(U * kPi), Ring * std::sin(V * 2.0f * kPi));
+        },
+        []( const XMFLOAT3& P ) { return P; });
+
+    Model TestModel;
+    TestMeshes::MakeModel(TestModel, Meshes);
+    for (uint32_t m = 0; m < Meshes.size(); ++m)
+    {
+        Model::BoundingBox& Box = TestModel.m_pMesh[m].boundingBox;
+        Box.min = Vector3(FLT_MAX, FLT_MAX, FLT_MAX);
+        Box.max = Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (const Model::FloatVertex& Vertex : Meshes[m].Vertices)
+        {
+            Box.min = Min(Box.min, Vector3(Vertex.position));
+            Box.max = Max(Box.max, Vector3(Vertex.position));
+        }
+    }
+    TestModel.BuildMeshlets();
+
+    TestModel.BuildLods();
+    Expect(TestModel.m_LodCount == Model::maxLods, "level count", (float)TestModel.m_LodCount);
+
+    // Deterministic:  the same meshes give the same levels, byte for byte
+    Model SecondModel;
+    TestMeshes::MakeModel(SecondModel, Meshes);
+    SecondModel.BuildMeshlets();
+    SecondModel.BuildLods();
+    Expect(SecondModel.m_LodIndexDataByteSize == TestModel.m_LodIndexDataByteSize &&
+        std::memcmp(SecondModel.m_pIndexData, TestModel.m_pIndexData,
+            TestModel.m_Header.indexDataByteSize + TestModel.m_LodIndexDataByteSize) == 0 &&
+        std::memcmp(SecondModel.m_pLod, TestModel.m_pLod, sizeof(Model::LodLevel) * Meshes.size() * Model::maxLods) == 0,
+        "simplification is deterministic", 0.0f);
+
+    for (uint32_t m = 0; m < Meshes.size(); ++m)
+    {
+        const Model::Mesh& Mesh = TestModel.m_pMesh[m];
+        const Model::LodLevel& Full = TestModel.GetLod(m, 0);
+        Expect(Full.indexDataByteOffset == Mesh.indexDataByteOffset && Full.indexCount == Mesh.indexCount && Full.error == 0.0f,
+            "level 0 is the mesh", (float)m);
+
+        for (uint32_t Level = 1; Level < Model::maxLods; ++Level)
+        {
+            const Model::LodLevel& Lod = TestModel.GetLod(m, Level);
+            const uint32_t Target = (Mesh.indexCount / 3) >> Level;
+            Expect(Lod.indexCount / 3 <= Target, "triangles halve with every level", (float)(Lod.indexCount / 3));
+            Expect(Lod.error >= TestModel.GetLod(m, Level - 1).error, "errors grow with the level", Lod.error);
+            Expect(Lod.indexDataByteOffset >= TestModel.m_Header.indexDataByteSize, "levels follow the mesh indices", (float)Level);
+
+            const float Measured = MeasureLevelError(TestModel, m, Level);
+            Expect(Measured <= Lod.error + 1e-5f, "stored error bounds the distance to the level", Measured - Lod.error);
+
+            const uint16_t* Indices = (const uint16_t*)(TestModel.m_pIndexData + Lod.indexDataByteOffset);
+            for (uint32_t i = 0; i < Lod.indexCount; i += 3)
+            {
+                Model::FloatVertex V[3];
+                for (uint32_t k = 0; k < 3; ++k)
+                    TestModel.DecodeVertex(Mesh, Indices[i + k], V[k]);
+                if (m == 0)
+                {
+                    const bool Left = Indices[i] < LeftVertices;
+                    Expect(Left == (Indices[i + 1] < LeftVertices) && Left == (Indices[i + 2] < LeftVertices),
+                        "triangle crosses the seam of the square", (float)i);
+                }
+                else
+                {
+                    const float Wrap = std::max(std::abs(V[0].texcoord0.y - V[1].texcoord0.y),
+                        std::max(std::abs(V[0].texcoord0.y - V[2].texcoord0.y), std::abs(V[1].texcoord0.y - V[2].texcoord0.y)));
+                    Expect(Wrap < 0.5f, "triangle crosses the seam of the sphere", Wrap);
+                }
+            }
+        }
+    }
+
+    // The square is flat:  every level is exact, keeps both halves and faces up
+    for (uint32_t Level = 1; Level < Model::maxLods; ++Level)
+    {
+        Expect(TestModel.GetLod(0, Level).error <= 1e-5f, "flat square loses nothing", TestModel.GetLod(0, Level).error);
+        const float LeftArea = GetAreaFacingUp(TestModel, 0, Level, []( float X ) { return X < 0.0f; });
+        const float RightArea = GetAreaFacingUp(TestModel, 0, Level, []( float X ) { return X >= 0.0f; });
+        Expect(std::abs(LeftArea - 2.0f) < 1e-3f && std::abs(RightArea - 2.0f) < 1e-3f, "square keeps its halves",
+            LeftArea + RightArea);
+    }
+
+    // The sphere's coarsest level is still within 5% of its radius
+    Expect(TestModel.GetLod(1, Model::maxLods - 1).error < 0.05f, "sphere error", TestModel.GetLod(1, Model::maxLods - 1).error);
+
+    // Selection:  level 0 from inside the box, coarser with distance, and what the nearer eye needs
+    const Eye Inside = { { 0.0f, 0.0f, 0.0f }, 1000.0f };
+    Expect(SelectLevel(TestModel, 1, &Inside, 1, 1.0f) == 0, "full detail from inside", 0.0f);
+    uint32_t Previous = 0;
+    for (float Distance = 1.5f; Distance < 10000.0f; Distance *= 1.5f)
+    {
+        const Eye Far = { { 0.0f, 0.0f, Distance }, 1000.0f };
+        const uint32_t Level = SelectLevel(TestModel, 1, &Far, 1, 1.0f);
+        Expect(Level >= Previous, "coarser with distance", Distance);
+        Previous = Level;
+
+        const float Projected = GetProjectedError(TestModel.GetLod(1, Level).error, Distance - 1.0f, Far.PixelScale);
+        Expect(Projected <= 1.0f, "selected level within the pixel error", Projected);
+        if (Level + 1 < Model::maxLods)
+        {
+            const float Coarser = GetProjectedError(TestModel.GetLod(1, Level + 1).error, Distance - 1.0f, Far.PixelScale);
+            Expect(Coarser > 1.0f, "coarsest level that fits", Coarser);
+        }
+
+        const Eye Pair[2] = { Far, { { 0.0f, 0.0f, Distance * 3.0f }, 1000.0f } };
+        Expect(SelectLevel(TestModel, 1, Pair, 2, 1.0f) == Level, "the nearer eye decides", Distance);
+    }
+    Expect(Previous == Model::maxLods - 1, "coarsest level from afar", (float)Previous);
+
+    // Culling a mesh drawn at a level writes that level's indices, or nothing once it leaves the frustum
+    MeshletCulling::Culler TestCuller;
+    TestCuller.Initialize(TestModel, std::vector<bool>());
+    const uint32_t Levels[2] = { 0, 2 };
+    MeshletCulling::View EverythingView = {};
+    const float kBox = 100.0f;
+    const float BoxViewProj[16] = { 1 / kBox, 0, 0, 0,  0, 1 / kBox, 0, 0,  0, 0, 0.5f / kBox, 0,  0, 0, 0.5f, 1 };
+    std::memcpy(EverythingView.ViewProj, BoxViewProj, sizeof(BoxViewProj));
+    EverythingView.Eye[1] = 50.0f;
+    MeshletCulling::Result Culled;
+    TestCuller.Cull(EverythingView, Levels, Culled);
+    std::vector<uint16_t> Written(Culled.IndexCount);
+    TestCuller.WriteIndices(Culled, Written.data());
+    const Model::LodLevel& Sphere = TestModel.GetLod(1, 2);
+    Expect(Culled.Draws[1].IndexCount == Sphere.indexCount, "level drawn whole", (float)Culled.Draws[1].IndexCount);
+    Expect(Culled.Draws[1].IndexCount == 0 || std::memcmp(Written.data() + Culled.Draws[1].StartIndex,
+        TestModel.m_pIndexData + Sphere.indexDataByteOffset, Sphere.indexCount * sizeof(uint16_t)) == 0,
+        "level indices written", 0.0f);
+
+    MeshletCulling::View AwayView = EverythingView;
+    AwayView.ViewProj[12] = 10.0f;
+    TestCuller.Cull(AwayView, Levels, Culled);
+    Expect(Culled.Draws[1].IndexCount == 0, "level outside the frustum culled", (float)Culled.Draws[1].IndexCount);
+
+    return Passed;
+}
@@ -0,0 +1,48 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// Picks a level of detail for every mesh once per frame.  Model::BuildLods() stores how far each level's
+// surface may be from the mesh, and a level is used when that distance projects to fewer pixels than the
+// threshold in both eyes, from the point of the mesh's bounding box closest to each eye.  Both eyes, the
+// prepass and the shadow maps draw the same level, so the eyes see the same surface and the shadows match
+// it.  Ray tracing keeps the full meshes, whose triangles the hit attributes are indexed by.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class Model;
+namespace Math
+{
+    class Camera;
+}
+
+namespace LevelOfDetail
+{
+    struct Eye
+    {
+        float Position[3];
+        float PixelScale;   // Pixels that one unit covers one unit away:  the projection's y scale times half the height
+    };
+
+    // Pixels that an error covers at a distance
+    float GetProjectedError( float Error, float Distance, float PixelScale );
+
+    // The coarsest level of the mesh whose error projects to at most PixelError pixels in every eye
+    uint32_t SelectLevel( const Model& Model, uint32_t MeshIndex, const Eye* Eyes, uint32_t EyeCount, float PixelError );
+
+    // One level per mesh, all 0 when LODs are off or the model has none
+    void Select( const Model& Model, const Math::Camera& Left, const Math::Camera& Right, float Height,
+        std::vector<uint32_t>& Levels );
+
+    // Simplifies synthetic meshes and checks the triangle counts, seams and error bounds of their levels,
+    // then the selection and the culling of meshes drawn at a level
+    bool RunSelfTest( void );
+}
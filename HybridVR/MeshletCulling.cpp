@@ -0,0 +1,507 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "MeshletCulling.h"
+#include "TestMeshes.h"
+#include "Model.h"
+#include "CommandContext.h"
+#include "Camera.h"
+#include "SystemTime.h"
+#include <ppl.h>
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace Math;
+
+namespace Settings
+{
+    BoolVar MeshletCulling_Enable("Application/Meshlet Culling", true);
+}
+
+namespace
+{
+    // Meshlets per task
+    const uint32_t kChunkSize = 256;
+
+    // Inside is where every plane is positive, the same as 0 <= z <= w and |x|, |y| <= w in clip space
+    void GetFrustumPlanes( const float ViewProj[16], float Planes[6][4] )
+    {
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            const float* Row = ViewProj + i * 4;
+            Planes[0][i] = Row[3] + Row[0];
+            Planes[1][i] = Row[3] - Row[0];
+            Planes[2][i] = Row[3] + Row[1];
+            Planes[3][i] = Row[3] - Row[1];
+            Planes[4][i] = Row[2];
+            Planes[5][i] = Row[3] - Row[2];
+        }
+
+        // An infinite far plane comes out as a constant, which needs no normalizing
+        for (uint32_t p = 0; p < 6; ++p)
+        {
+            const float Length = std::sqrt(Planes[p][0] * Planes[p][0] + Planes[p][1] * Planes[p][1] + Planes[p][2] * Planes[p][2]);
+            if (Length > 0.0f)
+            {
+                for (uint32_t i = 0; i < 4; ++i)
+                    Planes[p][i] /= Length;
+            }
+        }
+    }
+
+    uint32_t GetChunkCount( uint32_t MeshletCount )
+    {
+        return (MeshletCount + kChunkSize - 1) / kChunkSize;
+    }
+
+    bool InFrustum( const float Planes[6][4], const float Center[3], float Radius )
+    {
+        for (uint32_t p = 0; p < 6; ++p)
+        {
+            if (Planes[p][0] * Center[0] + Planes[p][1] * Center[1] + Planes[p][2] * Center[2] + Planes[p][3] < -Radius)
+                return false;
+        }
+        return true;
+    }
+}
+
+void MeshletCulling::Culler::Initialize( const Model& Model, const std::vector<bool>& TwoSidedMaterials )
+{
+    ASSERT(Model.m_pMeshlet != nullptr && Model.m_pMeshletFirst != nullptr, "The model has no meshlets");
+    ASSERT(Model.m_pIndexData != nullptr, "Meshlet culling needs the CPU index data");
+
+    const uint16_t* Indices = (const uint16_t*)Model.m_pIndexData;
+    m_Indices.assign(Indices, Indices + (Model.m_Header.indexDataByteSize + Model.m_LodIndexDataByteSize) / sizeof(uint16_t));
+    m_IndexCount = Model.m_Header.indexDataByteSize / sizeof(uint16_t);
+    m_MeshFirstMeshlet.assign(Model.m_pMeshletFirst, Model.m_pMeshletFirst + Model.m_Header.meshCount + 1);
+
+    m_LodCount = Model.m_LodCount;
+    m_Lods.resize(Model.m_Header.meshCount * m_LodCount);
+    for (uint32_t i = 0; i < m_Lods.size(); ++i)
+    {
+        m_Lods[i].StartIndex = Model.m_pLod[i].indexDataByteOffset / sizeof(uint16_t);
+        m_Lods[i].IndexCount = Model.m_pLod[i].indexCount;
+    }
+
+    m_Meshlets.resize(Model.m_MeshletCount);
+    for (uint32_t i = 0; i < Model.m_MeshletCount; ++i)
+    {
+        const Model::Meshlet& Source = Model.m_pMeshlet[i];
+        Bounds& Meshlet = m_Meshlets[i];
+        std::memcpy(Meshlet.Center, Source.center, sizeof(Meshlet.Center));
+        Meshlet.Radius = Source.radius;
+        std::memcpy(Meshlet.ConeApex, Source.coneApex, sizeof(Meshlet.ConeApex));
+        std::memcpy(Meshlet.ConeAxis, Source.coneAxis, sizeof(Meshlet.ConeAxis));
+        Meshlet.ConeCutoff = Source.coneCutoff;
+        Meshlet.StartIndex = Source.indexDataByteOffset / sizeof(uint16_t);
+        Meshlet.IndexCount = Source.indexCount;
+        Meshlet.MeshIndex = Source.meshIndex;
+
+        const uint32_t Material = Model.m_pMesh[Source.meshIndex].materialIndex;
+        if (Material < TwoSidedMaterials.size() && TwoSidedMaterials[Material])
+            Meshlet.ConeCutoff = 2.0f;
+    }
+
+    // A sphere around the meshlets' spheres holds every vertex of the mesh, and so every level of it
+    m_MeshBounds.resize(Model.m_Header.meshCount);
+    for (uint32_t m = 0; m < Model.m_Header.meshCount; ++m)
+    {
+        float BoxMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float BoxMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (uint32_t i = m_MeshFirstMeshlet[m]; i < m_MeshFirstMeshlet[m + 1]; ++i)
+        {
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                BoxMin[k] = std::min(BoxMin[k], m_Meshlets[i].Center[k] - m_Meshlets[i].Radius);
+                BoxMax[k] = std::max(BoxMax[k], m_Meshlets[i].Center[k] + m_Meshlets[i].Radius);
+            }
+        }
+
+        Sphere& MeshSphere = m_MeshBounds[m];
+        MeshSphere.Radius = 0.0f;
+        for (uint32_t k = 0; k < 3; ++k)
+            MeshSphere.Center[k] = (BoxMin[k] + BoxMax[k]) * 0.5f;
+        for (uint32_t i = m_MeshFirstMeshlet[m]; i < m_MeshFirstMeshlet[m + 1]; ++i)
+        {
+            const float D[3] = { m_Meshlets[i].Center[0] - MeshSphere.Center[0], m_Meshlets[i].Center[1] - MeshSphere.Center[1],
+                m_Meshlets[i].Center[2] - MeshSphere.Center[2] };
+            MeshSphere.Radius = std::max(MeshSphere.Radius, std::sqrt(D[0] * D[0] + D[1] * D[1] + D[2] * D[2]) + m_Meshlets[i].Radius);
+        }
+    }
+}
+
+void MeshletCulling::Culler::Cull( const View& View, const uint32_t* Levels, Result& Result ) const
+{
+    float Planes[6][4];
+    GetFrustumPlanes(View.ViewProj, Planes);
+
+    const uint32_t MeshCount = (uint32_t)m_MeshFirstMeshlet.size() - 1;
+    Result.Levels.assign(MeshCount, 0);
+    if (Levels != nullptr && m_LodCount > 0)
+    {
+        for (uint32_t m = 0; m < MeshCount; ++m)
+            Result.Levels[m] = std::min(Levels[m], m_LodCount - 1);
+    }
+    const uint32_t* MeshLevels = Result.Levels.data();
+
+    const uint32_t MeshletCount = (uint32_t)m_Meshlets.size();
+    Result.MeshletOffsets.resize(MeshletCount + 1);
+    uint32_t* Offsets = Result.MeshletOffsets.data();
+
+    // Each meshlet's index count if it is kept, 0 if not
+    concurrency::parallel_for(0u, GetChunkCount(MeshletCount), [&]( uint32_t Chunk )
+    {
+        const uint32_t End = std::min(MeshletCount, (Chunk + 1) * kChunkSize);
+        for (uint32_t i = Chunk * kChunkSize; i < End; ++i)
+        {
+            const Bounds& Meshlet = m_Meshlets[i];
+            const uint32_t Mesh = Meshlet.MeshIndex;
+            if (MeshLevels[Mesh] > 0)
+            {
+                // The mesh's first meshlet stands for the whole of its level
+                const bool Visible = i == m_MeshFirstMeshlet[Mesh] && InFrustum(Planes, m_MeshBounds[Mesh].Center, m_MeshBounds[Mesh].Radius);
+                Offsets[i] = Visible ? m_Lods[Mesh * m_LodCount + MeshLevels[Mesh]].IndexCount : 0;
+                continue;
+            }
+
+            bool Visible = InFrustum(Planes, Meshlet.Center, Meshlet.Radius);
+            if (Visible)
+            {
+                const float ToApex[3] = { Meshlet.ConeApex[0] - View.Eye[0], Meshlet.ConeApex[1] - View.Eye[1],
+                    Meshlet.ConeApex[2] - View.Eye[2] };
+                const float Along = ToApex[0] * Meshlet.ConeAxis[0] + ToApex[1] * Meshlet.ConeAxis[1] +
+                    ToApex[2] * Meshlet.ConeAxis[2];
+                const float Length = std::sqrt(ToApex[0] * ToApex[0] + ToApex[1] * ToApex[1] + ToApex[2] * ToApex[2]);
+                Visible = Along <= Meshlet.ConeCutoff * Length;
+            }
+
+            Offsets[i] = Visible ? Meshlet.IndexCount : 0;
+        }
+    });
+
+    Result.VisibleMeshlets = 0;
+    uint32_t Total = 0;
+    for (uint32_t i = 0; i < MeshletCount; ++i)
+    {
+        const uint32_t Count = Offsets[i];
+        Offsets[i] = Total;
+        Total += Count;
+        Result.VisibleMeshlets += Count > 0;
+    }
+    Offsets[MeshletCount] = Total;
+    Result.IndexCount = Total;
+
+    Result.Draws.resize(MeshCount);
+    for (uint32_t m = 0; m < MeshCount; ++m)
+    {
+        Result.Draws[m].StartIndex = Offsets[m_MeshFirstMeshlet[m]];
+        Result.Draws[m].IndexCount = Offsets[m_MeshFirstMeshlet[m + 1]] - Result.Draws[m].StartIndex;
+    }
+}
+
+void MeshletCulling::Culler::WriteIndices( const Result& Result, uint16_t* Indices ) const
+{
+    const uint32_t MeshletCount = (uint32_t)m_Meshlets.size();
+    ASSERT(Result.MeshletOffsets.size() == MeshletCount + 1);
+    const uint32_t* Offsets = Result.MeshletOffsets.data();
+
+    concurrency::parallel_for(0u, GetChunkCount(MeshletCount), [&]( uint32_t Chunk )
+    {
+        const uint32_t End = std::min(MeshletCount, (Chunk + 1) * kChunkSize);
+        for (uint32_t i = Chunk * kChunkSize; i < End; ++i)
+        {
+            const uint32_t Count = Offsets[i + 1] - Offsets[i];
+            if (Count == 0)
+                continue;
+
+            const uint32_t Mesh = m_Meshlets[i].MeshIndex;
+            const uint32_t Level = Result.Levels[Mesh];
+            const uint32_t Start = Level > 0 ? m_Lods[Mesh * m_LodCount + Level].StartIndex : m_Meshlets[i].StartIndex;
+            std::memcpy(Indices + Offsets[i], m_Indices.data() + Start, Count * sizeof(uint16_t));
+        }
+    });
+}
+
+namespace MeshletCulling
+{
+    Culler m_Culler;
+    DrawList m_DrawLists[2];
+    Stats m_Stats[2];
+}
+
+void MeshletCulling::Initialize( const Model& Model, const std::vector<bool>& TwoSidedMaterials )
+{
+    m_Culler.Initialize(Model, TwoSidedMaterials);
+}
+
+const MeshletCulling::DrawList& MeshletCulling::CullEye( CommandContext& Context, uint32_t Eye, const Camera& Camera,
+    const uint32_t* Levels )
+{
+    ASSERT(Eye < 2);
+    const int64_t Start = SystemTime::GetCurrentTick();
+
+    View EyeView;
+    std::memcpy(EyeView.ViewProj, &Camera.GetViewProjMatrix(), sizeof(EyeView.ViewProj));
+    const Vector3 Position = Camera.GetPosition();
+    EyeView.Eye[0] = Position.GetX();
+    EyeView.Eye[1] = Position.GetY();
+    EyeView.Eye[2] = Position.GetZ();
+
+    DrawList& List = m_DrawLists[Eye];
+    m_Culler.Cull(EyeView, Levels, List.Culled);
+
+    // Never empty, so the view is valid even when everything was culled
+    const uint32_t Bytes = std::max(List.Culled.IndexCount, 2u) * sizeof(uint16_t);
+    DynAlloc Indices = Context.ReserveUploadMemory(Bytes);
+    m_Culler.WriteIndices(List.Culled, (uint16_t*)Indices.DataPtr);
+    List.IndexBuffer.BufferLocation = Indices.GpuAddress;
+    List.IndexBuffer.SizeInBytes = Bytes;
+    List.IndexBuffer.Format = DXGI_FORMAT_R16_UINT;
+
+    Stats& EyeStats = m_Stats[Eye];
+    EyeStats.Meshlets = m_Culler.GetMeshletCount();
+    EyeStats.VisibleMeshlets = List.Culled.VisibleMeshlets;
+    EyeStats.Triangles = m_Culler.GetIndexCount() / 3;
+    EyeStats.VisibleTriangles = List.Culled.IndexCount / 3;
+    EyeStats.Milliseconds = (float)(SystemTime::TimeBetweenTicks(Start, SystemTime::GetCurrentTick()) * 1000.0);
+    return List;
+}
+
+MeshletCulling::Stats MeshletCulling::GetStats( uint32_t Eye )
+{
+    ASSERT(Eye < 2);
+    return m_Stats[Eye];
+}
+
+namespace
+{
+    // Facing of a triangle to the eye, positive when front facing
+    float GetFacing( const Model& Model, const Model::Mesh& Mesh, const uint16_t* Triangle, const float Eye[3] )
+    {
+        Model::FloatVertex V[3];
+        for (uint32_t k = 0; k < 3; ++k)
+            Model.DecodeVertex(Mesh, Triangle[k], V[k]);
+        const float E1[3] = { V[1].position.x - V[0].position.x, V[1].position.y - V[0].position.y, V[1].position.z - V[0].position.z };
+        const float E2[3] = { V[2].position.x - V[0].position.x, V[2].position.y - V[0].position.y, V[2].position.z - V[0].position.z };
+        const float Face[3] = { E1[1] * E2[2] - E1[2] * E2[1], E1[2] * E2[0] - E1[0] * E2[2], E1[0] * E2[1] - E1[1] * E2[0] };
+        const float ToEye[3] = { Eye[0] - V[0].position.x, Eye[1] - V[0].position.y, Eye[2] - V[0].position.z };
+        const float FaceLength = std::sqrt(Face[0] * Face[0] + Face[1] * Face[1] + Face[2] * Face[2]);
+        const float EyeLength = std::sqrt(ToEye[0] * ToEye[0] + ToEye[1] * ToEye[1] + ToEye[2] * ToEye[2]);
+        if (FaceLength == 0.0f || EyeLength == 0.0f)
+            return 0.0f;
+        return (Face[0] * ToEye[0] + Face[1] * ToEye[1] + Face[2] * ToEye[2]) / (FaceLength * EyeLength);
+    }
+
+    // A reverse Z perspective like Camera::UpdateProjMatrix() with the eye at Eye looking down -z
+    void MakePerspective( float Scale, float NearClip, float FarClip, const float Eye[3], float ViewProj[16] )
+    {
+        const float Q1 = NearClip / (FarClip - NearClip);
+        const float Q2 = Q1 * FarClip;
+        const float Proj[16] = { Scale, 0, 0, 0,  0, Scale, 0, 0,  0, 0, Q1, -1,  0, 0, Q2, 0 };
+        std::memcpy(ViewProj, Proj, sizeof(Proj));
+        for (uint32_t j = 0; j < 4; ++j)
+            ViewProj[12 + j] = Proj[12 + j] - Eye[0] * Proj[j] - Eye[1] * Proj[4 + j] - Eye[2] * Proj[8 + j];
+    }
+}
+
+bool MeshletCulling::RunSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, float Value )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("Meshlet culling self test failed:  %s (%f)\n", Name, Value);
+            Passed = false;
+        }
+    };
+
+    // A sphere of radius 2, poles included, and a two sided wavy ground below it
+    const float kPi = 3.14159265f;
+    std::vector<TestMeshes::Mesh> Meshes(2);
+    Meshes[0].Material = 0;
+    TestMeshes::AddGrid(Meshes[0], 48, 96,
+        [&]( float U, float V ) { return XMFLOAT3(2.0f * std::sin(U * kPi) * std::cos(V * 2.0f * kPi), 2.0f * std::cos(U * kPi),
+            2.0f * std::sin(U * kPi) * std::sin(V * 2.0f * kPi)); },
+        []( const XMFLOAT3& P ) { return XMFLOAT3(P.x * 0.5f, P.y * 0.5f, P.z * 0.5f); });
+    Meshes[1].Material = 1;
+    TestMeshes::AddGrid(Meshes[1], 80, 80,
+        []( float U, float V ) { const float X = U * 20.0f - 10.0f, Z = V * 20.0f - 10.0f;
+            return XMFLOAT3(X, -3.0f + 0.3f * std::sin(X) * std::sin(Z), Z); },
+        []( const XMFLOAT3& ) { return XMFLOAT3(0.0f, 1.0f, 0.0f); });
+    const std::vector<bool> TwoSided = { false, true };
+
+    Model TestModel;
+    TestMeshes::MakeModel(TestModel, Meshes);
+
+    TestModel.BuildMeshlets();
+
+    // Meshlets cover each mesh's indices in order, within the limits, and hold the same triangles as before
+    for (uint32_t m = 0; m < Meshes.size(); ++m)
+    {
+        const Model::Mesh& Mesh = TestModel.m_pMesh[m];
+        uint32_t Expected = Mesh.indexDataByteOffset;
+        for (uint32_t i = TestModel.m_pMeshletFirst[m]; i < TestModel.m_pMeshletFirst[m + 1]; ++i)
+        {
+            const Model::Meshlet& Meshlet = TestModel.m_pMeshlet[i];
+            Expect(Meshlet.meshIndex == m, "meshlet belongs to its mesh", (float)i);
+            Expect(Meshlet.indexDataByteOffset == Expected, "meshlets are contiguous", (float)i);
+            Expect(Meshlet.indexCount > 0 && Meshlet.indexCount <= Model::maxMeshletTriangles * 3, "meshlet triangle limit",
+                (float)Meshlet.indexCount);
+            Expected += Meshlet.indexCount * sizeof(uint16_t);
+
+            const uint16_t* Indices = (const uint16_t*)(TestModel.m_pIndexData + Meshlet.indexDataByteOffset);
+            std::vector<uint16_t> Vertices(Indices, Indices + Meshlet.indexCount);
+            std::sort(Vertices.begin(), Vertices.end());
+            const size_t VertexCount = std::unique(Vertices.begin(), Vertices.end()) - Vertices.begin();
+            Expect(VertexCount <= Model::maxMeshletVertices, "meshlet vertex limit", (float)VertexCount);
+
+            for (uint32_t k = 0; k < Meshlet.indexCount; ++k)
+            {
+                Model::FloatVertex Vertex;
+                TestModel.DecodeVertex(Mesh, Indices[k], Vertex);
+                const float D[3] = { Vertex.position.x - Meshlet.center[0], Vertex.position.y - Meshlet.center[1],
+                    Vertex.position.z - Meshlet.center[2] };
+                const float Distance = std::sqrt(D[0] * D[0] + D[1] * D[1] + D[2] * D[2]);
+                Expect(Distance <= Meshlet.radius, "vertex inside the bounding sphere", Distance - Meshlet.radius);
+            }
+        }
+        Expect(Expected == Mesh.indexDataByteOffset + Mesh.indexCount * sizeof(uint16_t), "meshlets cover the mesh", (float)m);
+
+        auto SortedTriangles = [&]( const uint16_t* Indices )
+        {
+            std::vector<std::array<uint16_t, 3>> Triangles(Mesh.indexCount / 3);
+            for (uint32_t t = 0; t < Triangles.size(); ++t)
+                Triangles[t] = { Indices[t * 3], Indices[t * 3 + 1], Indices[t * 3 + 2] };
+            std::sort(Triangles.begin(), Triangles.end());
+            return Triangles;
+        };
+        Expect(SortedTriangles((const uint16_t*)(TestModel.m_pIndexData + Mesh.indexDataByteOffset)) ==
+            SortedTriangles(Meshes[m].Indices.data()), "same triangles after reordering", (float)m);
+    }
+
+    Culler TestCuller;
+    TestCuller.Initialize(TestModel, TwoSided);
+    Result Culled;
+    std::vector<uint16_t> Written(TestCuller.GetIndexCount());
+
+    // Checks the draws and the written indices against the meshlets Cull() kept
+    auto CheckOutput = [&]()
+    {
+        TestCuller.WriteIndices(Culled, Written.data());
+        for (uint32_t m = 0; m < Meshes.size(); ++m)
+        {
+            const uint32_t First = TestModel.m_pMeshletFirst[m];
+            const uint32_t End = TestModel.m_pMeshletFirst[m + 1];
+            Expect(Culled.Draws[m].StartIndex == Culled.MeshletOffsets[First], "draw starts at its first meshlet", (float)m);
+            Expect(Culled.Draws[m].IndexCount == Culled.MeshletOffsets[End] - Culled.MeshletOffsets[First],
+                "draw covers its meshlets", (float)m);
+        }
+        for (uint32_t i = 0; i < TestModel.m_MeshletCount; ++i)
+        {
+            const uint32_t Count = Culled.MeshletOffsets[i + 1] - Culled.MeshletOffsets[i];
+            const Model::Meshlet& Meshlet = TestModel.m_pMeshlet[i];
+            Expect(Count == 0 || Count == Meshlet.indexCount, "meshlet kept whole or not at all", (float)i);
+            if (Count > 0)
+            {
+                Expect(std::memcmp(Written.data() + Culled.MeshletOffsets[i], TestModel.m_pIndexData + Meshlet.indexDataByteOffset,
+                    Count * sizeof(uint16_t)) == 0, "written indices match the meshlet", (float)i);
+            }
+        }
+    };
+
+    // Back facing:  with a box around everything as the frustum, whatever is culled must face away from the eye
+    const float kBox = 100.0f;
+    View BoxView = {};
+    const float BoxViewProj[16] = { 1 / kBox, 0, 0, 0,  0, 1 / kBox, 0, 0,  0, 0, 0.5f / kBox, 0,  0, 0, 0.5f, 1 };
+    std::memcpy(BoxView.ViewProj, BoxViewProj, sizeof(BoxViewProj));
+
+    std::mt19937 Random(7);
+    std::uniform_real_distribution<float> Direction(-1.0f, 1.0f);
+    const uint32_t kEyes = 64;
+    uint32_t SphereCulled = 0;
+    for (uint32_t e = 0; e < kEyes; ++e)
+    {
+        // Half the eyes far away, half just off the surface
+        float D[3] = { Direction(Random), Direction(Random), Direction(Random) };
+        const float Length = std::sqrt(D[0] * D[0] + D[1] * D[1] + D[2] * D[2]) + 1e-6f;
+        const float Distance = e % 2 ? 20.0f : 2.2f;
+        for (uint32_t k = 0; k < 3; ++k)
+            BoxView.Eye[k] = D[k] / Length * Distance;
+
+        TestCuller.Cull(BoxView, nullptr, Culled);
+        CheckOutput();
+
+        for (uint32_t i = 0; i < TestModel.m_MeshletCount; ++i)
+        {
+            const Model::Meshlet& Meshlet = TestModel.m_pMeshlet[i];
+            if (Culled.MeshletOffsets[i + 1] != Culled.MeshletOffsets[i])
+                continue;
+
+            Expect(!TwoSided[TestModel.m_pMesh[Meshlet.meshIndex].materialIndex], "two sided meshlet culled", (float)i);
+            SphereCulled += e % 2;
+            const uint16_t* Indices = (const uint16_t*)(TestModel.m_pIndexData + Meshlet.indexDataByteOffset);
+            for (uint32_t t = 0; t < Meshlet.indexCount; t += 3)
+            {
+                const float Facing = GetFacing(TestModel, TestModel.m_pMesh[Meshlet.meshIndex], Indices + t, BoxView.Eye);
+                Expect(Facing <= 1e-4f, "culled triangle faces the eye", Facing);
+            }
+        }
+    }
+
+    // From afar about half the sphere faces away, and its meshlets are small enough for most of that to go
+    const uint32_t SphereMeshlets = TestModel.m_pMeshletFirst[1];
+    const float CulledShare = (float)SphereCulled / (SphereMeshlets * (kEyes / 2));
+    Expect(CulledShare > 0.25f, "share of the sphere culled as back facing", CulledShare);
+
+    // Frustum:  every front facing triangle with a corner in view keeps its meshlet
+    View EyeView;
+    const float Eye[3] = { 4.0f, 0.0f, 8.0f };
+    std::memcpy(EyeView.Eye, Eye, sizeof(Eye));
+    MakePerspective(2.5f, 0.5f, 50.0f, Eye, EyeView.ViewProj);
+    TestCuller.Cull(EyeView, nullptr, Culled);
+    CheckOutput();
+    Expect(Culled.VisibleMeshlets > 0 && Culled.VisibleMeshlets < TestModel.m_MeshletCount, "frustum keeps part of the scene",
+        (float)Culled.VisibleMeshlets);
+
+    for (uint32_t i = 0; i < TestModel.m_MeshletCount; ++i)
+    {
+        const Model::Meshlet& Meshlet = TestModel.m_pMeshlet[i];
+        const Model::Mesh& Mesh = TestModel.m_pMesh[Meshlet.meshIndex];
+        const bool Kept = Culled.MeshletOffsets[i + 1] != Culled.MeshletOffsets[i];
+        const uint16_t* Indices = (const uint16_t*)(TestModel.m_pIndexData + Meshlet.indexDataByteOffset);
+        for (uint32_t t = 0; t < Meshlet.indexCount && !Kept; t += 3)
+        {
+            if (!TwoSided[Mesh.materialIndex] && GetFacing(TestModel, Mesh, Indices + t, Eye) <= 0.0f)
+                continue;
+
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                Model::FloatVertex Vertex;
+                TestModel.DecodeVertex(Mesh, Indices[t + k], Vertex);
+                const float P[4] = { Vertex.position.x, Vertex.position.y, Vertex.position.z, 1.0f };
+                float Clip[4] = {};
+                for (uint32_t r = 0; r < 4; ++r)
+                {
+                    for (uint32_t c = 0; c < 4; ++c)
+                        Clip[c] += P[r] * EyeView.ViewProj[r * 4 + c];
+                }
+                const bool Inside = Clip[3] > 0.0f && std::abs(Clip[0]) <= Clip[3] && std::abs(Clip[1]) <= Clip[3] &&
+                    Clip[2] >= 0.0f && Clip[2] <= Clip[3];
+                Expect(!Inside, "meshlet with a visible triangle culled", (float)i);
+            }
+        }
+    }
+
+    return Passed;
+}
@@ -0,0 +1,124 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// Culls the model's meshlets for each eye on the CPU and rasterizes what is left from a compacted index
+// buffer, so the merged Bistro meshes no longer draw in full whenever a corner of them is in view.  A meshlet
+// is kept when its bounding sphere touches the eye's frustum and, unless its material is two sided, when its
+// normal cone allows a triangle to face the eye.  Model::BuildMeshlets() makes the meshlets.  A mesh drawn at
+// a coarser level of detail is kept or culled whole, by the bounds of its meshlets, and its level's indices
+// take the place of its meshlets'.
+//
+// Culler works on copies of the meshlets and the index data and runs on the concurrency runtime's threads.
+// It keeps no state per view, so both eyes can be culled at once, and RunSelfTest() can check it against a
+// brute force answer.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class Model;
+class CommandContext;
+namespace Math
+{
+    class Camera;
+}
+
+namespace MeshletCulling
+{
+    struct MeshDraw
+    {
+        uint32_t StartIndex;
+        uint32_t IndexCount;
+    };
+
+    struct View
+    {
+        float ViewProj[16];     // As Math::Matrix4 stores it, model to clip space
+        float Eye[3];
+    };
+
+    struct Result
+    {
+        std::vector<uint32_t> MeshletOffsets;   // Where each meshlet's indices go in the compacted indices, plus the total
+        std::vector<MeshDraw> Draws;            // One per mesh, into the compacted indices
+        std::vector<uint32_t> Levels;           // Of detail, one per mesh
+        uint32_t VisibleMeshlets;
+        uint32_t IndexCount;
+    };
+
+    class Culler
+    {
+    public:
+        // The model's index data must still be in the order Model::BuildMeshlets() left it
+        void Initialize( const Model& Model, const std::vector<bool>& TwoSidedMaterials );
+
+        // Levels holds each mesh's level of detail, or is null to draw every mesh in full
+        void Cull( const View& View, const uint32_t* Levels, Result& Result ) const;
+
+        // Copies the indices of the meshlets Cull() kept, Result.IndexCount of them
+        void WriteIndices( const Result& Result, uint16_t* Indices ) const;
+
+        uint32_t GetMeshletCount( void ) const { return (uint32_t)m_Meshlets.size(); }
+        uint32_t GetIndexCount( void ) const { return m_IndexCount; }
+
+    private:
+        struct Bounds
+        {
+            float Center[3];
+            float Radius;
+            float ConeApex[3];
+            float ConeCutoff;       // Above 1 when the meshlet is two sided or its normals spread too far
+            float ConeAxis[3];
+            uint32_t StartIndex;
+            uint32_t IndexCount;
+            uint32_t MeshIndex;
+        };
+
+        struct Sphere
+        {
+            float Center[3];
+            float Radius;
+        };
+
+        std::vector<Bounds> m_Meshlets;
+        std::vector<uint32_t> m_MeshFirstMeshlet;
+        std::vector<Sphere> m_MeshBounds;
+        std::vector<MeshDraw> m_Lods;           // Model::m_LodCount of each mesh in turn
+        uint32_t m_LodCount;
+        uint32_t m_IndexCount;                  // Of the meshes themselves, without their levels
+        std::vector<uint16_t> m_Indices;
+    };
+
+    struct DrawList
+    {
+        D3D12_INDEX_BUFFER_VIEW IndexBuffer;
+        Result Culled;
+    };
+
+    struct Stats
+    {
+        uint32_t Meshlets;
+        uint32_t VisibleMeshlets;
+        uint32_t Triangles;
+        uint32_t VisibleTriangles;
+        float Milliseconds;     // Culling and writing the indices
+    };
+
+    void Initialize( const Model& Model, const std::vector<bool>& TwoSidedMaterials );
+
+    // Culls against an eye's camera and uploads the indices that are left.  The list is valid for the
+    // commands Context records until the next call for the same eye.
+    const DrawList& CullEye( CommandContext& Context, uint32_t Eye, const Math::Camera& Camera, const uint32_t* Levels );
+
+    Stats GetStats( uint32_t Eye );
+
+    // Checks the meshlets of two synthetic meshes and what survives culling them against brute force
+    bool RunSelfTest( void );
+}
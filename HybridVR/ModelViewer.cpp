@@ -36,7 +36,23 @@
 #include "ShadowCamera.h"
 #include "ParticleEffectManager.h"
 #include "GameInput.h"
+#include "TriangleOpacity.h"
+#include "FileUtility.h"
+#include "SceneArchive.h"
 #include "./ForwardPlusLighting.h"
+#include "./HitAttributes.h"
+#include "./StereoReuse.h"
+#include "./RayCompaction.h"
+#include "./RayDensity.h"
+#include "./InterleavedRays.h"
+#include "./RayCones.h"
+#include "./ShadowRayCulling.h"
+#include "./AccelerationStructures.h"
+#include "./MeshletCulling.h"
+#include "./LevelOfDetail.h"
+#include "./DepthGeometry.h"
+#include "./ShadowCasterCulling.h"
+#include "./SelfTests.h"
 #include <atlbase.h>
 #include "DXSampleHelper.h"
 #include "Settings.h"
@@ -47,6 +63,7 @@
 // Shaders
 #include "CompiledShaders/DepthViewerVS.h"
 #include "CompiledShaders/DepthViewerPS.h"
+#include "CompiledShaders/DepthOnlyVS.h"
 #include "CompiledShaders/ModelViewerVS.h"
 #include "CompiledShaders/ModelViewerPS.h"
 #include "CompiledShaders/WaveTileCountPS.h"
@@ -118,6 +135,9 @@ __declspec(align(16)) struct PSConstants
 ByteAddressBuffer g_hitConstantBuffer;
 ByteAddressBuffer g_dynamicConstantBuffer;
 
+// Ray generation threads to launch over the ray list, or zero for one thread per pixel
+UINT g_RayListLaunchCount = 0;
+
 D3D12_GPU_DESCRIPTOR_HANDLE *g_GpuSceneMaterialSrvs;
 D3D12_CPU_DESCRIPTOR_HANDLE g_SceneMeshInfo;
 D3D12_CPU_DESCRIPTOR_HANDLE g_SceneIndices;
@@ -126,9 +146,6 @@ D3D12_GPU_DESCRIPTOR_HANDLE g_OutputUAV;
 D3D12_GPU_DESCRIPTOR_HANDLE g_DepthNormalsAndLightsTable;
 D3D12_GPU_DESCRIPTOR_HANDLE g_SceneSrvs;
 
-std::vector<CComPtr<ID3D12Resource>> g_bvh_bottomLevelAccelerationStructures;
-CComPtr<ID3D12Resource> g_bvh_topLevelAccelerationStructure;
-
 CComPtr<ID3D12RootSignature> g_GlobalRaytracingRootSignature;
 CComPtr<ID3D12RootSignature> g_LocalRaytracingRootSignature;
 
@@ -316,20 +333,24 @@ private:
 		bool SkipShadowMap
 	);
 	
-	void CreateRayTraceAccelerationStructures(UINT numMeshes);
+	void UpdateRayTraceAccelerationStructures(UINT numGeometries);
 
 	void RenderLightShadows(GraphicsContext& gfxContext, UINT curCam);
 
 	enum eObjectFilter { kOpaque = 0x1, kCutout = 0x2, kTransparent = 0x4, kAll = 0xF, kNone = 0x0 };
-	void RenderObjects(GraphicsContext& Context, UINT CurCam, const Matrix4& ViewProjMat, eObjectFilter Filter = kAll);
+	void RenderObjects(GraphicsContext& Context, UINT CurCam, const Matrix4& ViewProjMat, eObjectFilter Filter = kAll,
+	                   const MeshletCulling::DrawList* Culled = nullptr);
+	// The opaque objects with PSO, or with MergedPSO from the merged depth-only geometry
+	void RenderOpaqueDepth(GraphicsContext& Context, UINT CurCam, const Matrix4& ViewProjMat, const GraphicsPSO& PSO,
+	                       const GraphicsPSO& MergedPSO, const MeshletCulling::DrawList* Culled = nullptr);
 	void RaytraceDiffuse(GraphicsContext& context,  ColorBuffer& colorTarget);
 	void RaytraceShadows(GraphicsContext& context, ColorBuffer& colorTarget,
 	                     DepthBuffer& depth);
 	void RaytraceReflections(GraphicsContext& context, ColorBuffer& colorTarget,
 	                         DepthBuffer& depth, ColorBuffer& normals);
 
-	void InitializeStateObjects(const Model& model, UINT numMeshes);
-	void InitializeRaytracingStateObjects(const Model& model, UINT numMeshes);
+	void InitializeStateObjects(const Model& model, UINT numGeometries);
+	void InitializeRaytracingStateObjects(const Model& model, UINT numGeometries);
 
 	void SaveCamPos();
 	void LoadCamPos();
@@ -357,17 +378,24 @@ private:
 	GraphicsPSO m_CutoutModelPSO[1];
 	GraphicsPSO m_ShadowPSO;
 	GraphicsPSO m_CutoutShadowPSO;
+	GraphicsPSO m_MergedDepthPSO;
+	GraphicsPSO m_MergedShadowPSO;
 	GraphicsPSO m_WaveTileCountPSO;
 
 	D3D12_CPU_DESCRIPTOR_HANDLE m_DefaultSampler;
 	D3D12_CPU_DESCRIPTOR_HANDLE m_ShadowSampler;
 	D3D12_CPU_DESCRIPTOR_HANDLE m_BiasedDefaultSampler;
 
-	D3D12_CPU_DESCRIPTOR_HANDLE m_ExtraTextures[6];
 	Model m_Model;
 	std::vector<bool> m_pMaterialIsCutout;
 	std::vector<bool> m_pMaterialIsReflective;
 
+	// What is left of the model for the eye being rendered, null to draw it all
+	const MeshletCulling::DrawList* m_CulledDraws = nullptr;
+
+	// Level of detail of each mesh this frame, shared by both eyes and the shadow map
+	std::vector<uint32_t> m_MeshLods;
+
 	Vector3 m_SunDirection;
 	ShadowCamera m_SunShadow;
 	
@@ -388,6 +416,9 @@ private:
 
 int wmain(int argc, wchar_t** argv)
 {
+	if (SelfTests::Requested(argc, argv))
+		return SelfTests::Run() ? 0 : 1;
+
 	g_CreateScene(Scene::kBistroExterior);
 	
 #if _DEBUG
@@ -469,6 +500,131 @@ namespace Settings
 std::unique_ptr<DescriptorHeapStack> g_pRaytracingDescriptorHeap;
 
 StructuredBuffer g_hitShaderMeshInfoBuffer;
+ByteAddressBuffer g_hitAttributeBuffer;
+std::vector<HitAttributes::MeshRange> g_HitAttributeMeshes;
+
+// One geometry of the bottom level acceleration structure.  Meshes with a cutout material are split
+// into an opaque part and an alpha tested part, and their fully transparent triangles are left out.
+struct RayTracingGeometry
+{
+	UINT meshIndex;
+	UINT meshInfoIndex; // Entry of g_meshInfo selected by the MaterialID root constant
+	UINT indexDataByteOffset;
+	UINT indexCount;
+	bool opaque;
+};
+
+std::vector<RayTracingGeometry> g_RayTracingGeometries;
+
+// Sorts the triangles of every cutout mesh into opaque, mixed and transparent runs based on the alpha
+// channel of its diffuse texture, and builds g_RayTracingGeometries so that only the mixed run invokes
+// the any-hit shader.  Rasterization draws the whole mesh as before, so only the triangle order changes.
+static
+void ClassifyCutoutTriangles(
+	Model& model,
+	const std::vector<bool>& cutout)
+{
+	const float alphaCutoff = 0.5f; // Matches DepthViewerPS and AlphaTransparencyAnyHit
+
+	// Texture lookup follows Model::LoadTextures
+	std::vector<TriangleOpacity::AlphaMipChain> alphaChains(model.m_Header.materialCount);
+	std::vector<bool> alphaChainLoaded(model.m_Header.materialCount);
+	auto get_alpha_chain = [&](UINT materialIndex) -> const TriangleOpacity::AlphaMipChain&
+	{
+		if (!alphaChainLoaded[materialIndex])
+		{
+			const std::wstring path = g_Scene.TextureFolderPath + MakeWStr(model.m_pMaterial[materialIndex].texDiffusePath);
+			if (!alphaChains[materialIndex].LoadFromDDSFile(path + L".dds"))
+				alphaChains[materialIndex].LoadFromDDSFile(path + L"_diffuse.dds");
+			alphaChainLoaded[materialIndex] = true;
+		}
+		return alphaChains[materialIndex];
+	};
+
+	g_RayTracingGeometries.clear();
+	UINT nextMeshInfoIndex = model.m_Header.meshCount;
+	UINT triangleCounts[3] = {};
+	bool reordered = false;
+
+	for (UINT i = 0; i < model.m_Header.meshCount; ++i)
+	{
+		const Model::Mesh& mesh = model.m_pMesh[i];
+
+		if (!cutout[mesh.materialIndex])
+		{
+			g_RayTracingGeometries.push_back({ i, i, mesh.indexDataByteOffset, mesh.indexCount, true });
+			continue;
+		}
+
+		const TriangleOpacity::AlphaMipChain& alpha = get_alpha_chain(mesh.materialIndex);
+		if (!alpha.IsValid())
+		{
+			g_RayTracingGeometries.push_back({ i, i, mesh.indexDataByteOffset, mesh.indexCount, false });
+			triangleCounts[TriangleOpacity::kMixed] += mesh.indexCount / 3;
+			continue;
+		}
+
+		uint16_t* indices = (uint16_t*)(model.m_pIndexData + mesh.indexDataByteOffset);
+		// The UVs are half floats in the vertex buffer
+		std::vector<XMFLOAT2> uvs(mesh.vertexCount);
+		for (UINT v = 0; v < mesh.vertexCount; ++v)
+		{
+			Model::FloatVertex vertex;
+			model.DecodeVertex(mesh, v, vertex);
+			uvs[v] = vertex.texcoord0;
+		}
+
+		std::vector<uint16_t> sorted[3];
+		for (UINT t = 0; t < mesh.indexCount / 3; ++t)
+		{
+			const uint16_t* tri = indices + t * 3;
+			const float* uv0 = &uvs[tri[0]].x;
+			const float* uv1 = &uvs[tri[1]].x;
+			const float* uv2 = &uvs[tri[2]].x;
+
+			const TriangleOpacity::Class triangleClass = alpha.Classify(uv0, uv1, uv2, alphaCutoff);
+			sorted[triangleClass].insert(sorted[triangleClass].end(), tri, tri + 3);
+		}
+
+		const UINT opaqueIndices = (UINT)sorted[TriangleOpacity::kOpaque].size();
+		const UINT mixedIndices = (UINT)sorted[TriangleOpacity::kMixed].size();
+		std::copy(sorted[TriangleOpacity::kOpaque].begin(), sorted[TriangleOpacity::kOpaque].end(), indices);
+		std::copy(sorted[TriangleOpacity::kMixed].begin(), sorted[TriangleOpacity::kMixed].end(), indices + opaqueIndices);
+		std::copy(sorted[TriangleOpacity::kTransparent].begin(), sorted[TriangleOpacity::kTransparent].end(),
+		          indices + opaqueIndices + mixedIndices);
+		reordered = true;
+
+		for (UINT c = 0; c < 3; ++c)
+			triangleCounts[c] += (UINT)sorted[c].size() / 3;
+
+		// The opaque run starts the mesh, so it keeps the mesh's own g_meshInfo entry
+		if (opaqueIndices > 0)
+			g_RayTracingGeometries.push_back({ i, i, mesh.indexDataByteOffset, opaqueIndices, true });
+		if (mixedIndices > 0)
+		{
+			g_RayTracingGeometries.push_back({
+				i, nextMeshInfoIndex++, mesh.indexDataByteOffset + opaqueIndices * (UINT)sizeof(uint16_t), mixedIndices, false });
+		}
+	}
+
+	if (reordered)
+		model.UpdateIndexBuffer();
+
+	Utility::Printf("Cutout triangles:  %u opaque, %u alpha tested, %u removed\n",
+		triangleCounts[TriangleOpacity::kOpaque], triangleCounts[TriangleOpacity::kMixed],
+		triangleCounts[TriangleOpacity::kTransparent]);
+}
+
+// Packs the attributes read by the hit shaders (see HitAttributes.h).  Runs after the cutout triangles
+// are reordered, because the packed triangles follow the order of the index buffer.
+static
+void BuildHitAttributes(
+	const Model& model)
+{
+	std::vector<uint8_t> packed;
+	HitAttributes::Build(model, packed, g_HitAttributeMeshes);
+	g_hitAttributeBuffer.Create(L"Hit Attributes", (UINT)packed.size() / 4, 4, packed.data());
+}
 
 static
 void InitializeSceneInfo(
@@ -477,30 +633,41 @@ void InitializeSceneInfo(
 	//
 	// Mesh info
 	//
-	std::vector<RayTraceMeshInfo> meshInfoData(model.m_Header.meshCount);
+	UINT meshInfoCount = model.m_Header.meshCount;
+	for (const RayTracingGeometry& geometry : g_RayTracingGeometries)
+		meshInfoCount = std::max(meshInfoCount, geometry.meshInfoIndex + 1);
+
+	std::vector<RayTraceMeshInfo> meshInfoData(meshInfoCount);
 	for (UINT i = 0; i < model.m_Header.meshCount; ++i)
 	{
 		RayTraceMeshInfo& data = meshInfoData[i];
 		Model::Mesh& mesh = model.m_pMesh[i];
 		
-		data.m_indexOffsetBytes = mesh.indexDataByteOffset;
-
-		const auto offset = [&](const int att) -> uint
-		{
-			return mesh.vertexDataByteOffset + mesh.attrib[att].offset;
-		};
+		const HitAttributes::MeshRange& range = g_HitAttributeMeshes[i];
 		
-		data.m_positionAttributeOffsetBytes = offset(Model::attrib_position);
-		data.m_normalAttributeOffsetBytes = offset(Model::attrib_normal);
-		data.m_tangentAttributeOffsetBytes = offset(Model::attrib_tangent);
-		data.m_bitangentAttributeOffsetBytes = offset(Model::attrib_bitangent);
-		data.m_uvAttributeOffsetBytes = offset(Model::attrib_texcoord0);
+		data.m_indexOffsetBytes = mesh.indexDataByteOffset;
+		data.m_vertexOffsetBytes = range.VertexOffsetBytes;
+		data.m_triangleOffsetBytes = range.TriangleOffsetBytes;
+		data.m_uvOffset = { range.UVOffset[0], range.UVOffset[1] };
+		data.m_uvScale = { range.UVScale[0], range.UVScale[1] };
 
 		data.m_materialInstanceId = mesh.materialIndex;
-		data.m_attributeStrideBytes = mesh.vertexStride;
 		ASSERT(data.m_materialInstanceId < model.m_Header.materialCount);
 	}
 
+	// Split meshes address the triangles of their second run with an extra entry
+	for (const RayTracingGeometry& geometry : g_RayTracingGeometries)
+	{
+		if (geometry.meshInfoIndex >= model.m_Header.meshCount)
+		{
+			const UINT firstTriangle = (geometry.indexDataByteOffset - model.m_pMesh[geometry.meshIndex].indexDataByteOffset) / (3 * sizeof(uint16_t));
+			meshInfoData[geometry.meshInfoIndex] = meshInfoData[geometry.meshIndex];
+			meshInfoData[geometry.meshInfoIndex].m_indexOffsetBytes = geometry.indexDataByteOffset;
+			meshInfoData[geometry.meshInfoIndex].m_triangleOffsetBytes +=
+				firstTriangle * (UINT)sizeof(HitAttributes::PackedTriangle);
+		}
+	}
+
 	g_hitShaderMeshInfoBuffer.Create(L"RayTraceMeshInfo",
 	                                 (UINT)meshInfoData.size(),
 	                                 sizeof(meshInfoData[0]),
@@ -537,6 +704,18 @@ void InitializeViews(const Model& model)
 		g_pRaytracingDescriptorHeap->AllocateDescriptor(srvHandle, unused);
 		Graphics::g_Device->CopyDescriptorsSimple(1, srvHandle, Lighting::m_LightBuffer.GetSRV(),
 		                                          D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+		g_pRaytracingDescriptorHeap->AllocateDescriptor(srvHandle, unused);
+		Graphics::g_Device->CopyDescriptorsSimple(1, srvHandle, Lighting::m_LightClusterCells.GetSRV(),
+		                                          D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+		g_pRaytracingDescriptorHeap->AllocateDescriptor(srvHandle, unused);
+		Graphics::g_Device->CopyDescriptorsSimple(1, srvHandle, Lighting::m_LightClusterIndices.GetSRV(),
+		                                          D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+		g_pRaytracingDescriptorHeap->AllocateDescriptor(srvHandle, unused);
+		Graphics::g_Device->CopyDescriptorsSimple(1, srvHandle, RayCompaction::m_RayList.GetSRV(),
+		                                          D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 	}
 
 	{
@@ -551,8 +730,9 @@ void InitializeViews(const Model& model)
 		g_pRaytracingDescriptorHeap->AllocateDescriptor(srvHandle, unused);
 		Graphics::g_Device->CopyDescriptorsSimple(1, srvHandle, g_SceneIndices, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
-		g_pRaytracingDescriptorHeap->
-			AllocateBufferSrv(*const_cast<ID3D12Resource*>(model.m_VertexBuffer.GetResource()));
+		g_pRaytracingDescriptorHeap->AllocateDescriptor(srvHandle, unused);
+		Graphics::g_Device->CopyDescriptorsSimple(1, srvHandle, g_hitAttributeBuffer.GetSRV(),
+		                                          D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
 		g_pRaytracingDescriptorHeap->AllocateDescriptor(srvHandle, unused);
 		Graphics::g_Device->CopyDescriptorsSimple(1, srvHandle, g_ShadowBuffer.GetSRV(),
@@ -618,7 +798,7 @@ void SetPipelineStateStackSize(
 }
 
 void D3D12RaytracingMiniEngineSample::InitializeRaytracingStateObjects(
-	const Model& model, UINT numMeshes)
+	const Model& model, UINT numGeometries)
 {
 	// Initialize subobject list
 	// ----------------------------------------------------------------//
@@ -732,7 +912,7 @@ void D3D12RaytracingMiniEngineSample::InitializeRaytracingStateObjects(
 
 	D3D12_RAYTRACING_SHADER_CONFIG shaderConfig;
 	shaderConfig.MaxAttributeSizeInBytes = 8;
-	shaderConfig.MaxPayloadSizeInBytes = 16;
+	shaderConfig.MaxPayloadSizeInBytes = 28;
 	shaderConfigStateObject.pDesc = &shaderConfig;
 	shaderConfigStateObject.Type =
 		D3D12_STATE_SUBOBJECT_TYPE_RAYTRACING_SHADER_CONFIG;
@@ -772,7 +952,7 @@ void D3D12RaytracingMiniEngineSample::InitializeRaytracingStateObjects(
 		offsetToMaterialConstants + sizeof(MaterialRootConstant));
 	// -----------------//
 
-	std::vector<byte> pHitShaderTable(shaderRecordSizeInBytes * numMeshes);
+	std::vector<byte> pHitShaderTable(shaderRecordSizeInBytes * numGeometries);
 
 	auto GetShaderTable = [=](const Model& model,
 	                          ID3D12StateObject* pPSO,
@@ -782,19 +962,20 @@ void D3D12RaytracingMiniEngineSample::InitializeRaytracingStateObjects(
 		ThrowIfFailed(pPSO->QueryInterface(IID_PPV_ARGS(&stateObjectProperties)));
 		void* pHitGroupIdentifierData = stateObjectProperties->
 			GetShaderIdentifier(hitGroupExportName);
-		for (UINT i = 0; i < numMeshes; i++)
+		for (UINT i = 0; i < numGeometries; i++)
 		{
 			byte* pShaderRecord = i * shaderRecordSizeInBytes + pShaderTable;
 			memcpy(pShaderRecord, pHitGroupIdentifierData, shaderRecordSizeInBytes);
 
-			UINT materialIndex = model.m_pMesh[i].materialIndex;
+			const RayTracingGeometry& geometry = g_RayTracingGeometries[i];
+			UINT materialIndex = model.m_pMesh[geometry.meshIndex].materialIndex;
 			memcpy(pShaderRecord + offsetToDescriptorHandle,
 			       &g_GpuSceneMaterialSrvs[materialIndex].ptr,
 			       sizeof(g_GpuSceneMaterialSrvs[materialIndex].ptr));
 
 			MaterialRootConstant material;
-			material.MaterialID = i;
-			const Model::Mesh & mesh = m_Model.m_pMesh[i];
+			material.MaterialID = geometry.meshInfoIndex;
+			const Model::Mesh & mesh = m_Model.m_pMesh[geometry.meshIndex];
 			material.Reflective = m_pMaterialIsReflective[mesh.materialIndex];
 			memcpy(pShaderRecord + offsetToMaterialConstants,
 			       &material,
@@ -921,7 +1102,7 @@ void D3D12RaytracingMiniEngineSample::InitializeRaytracingStateObjects(
 }
 
 void D3D12RaytracingMiniEngineSample::InitializeStateObjects(
-	const Model& model, UINT numMeshes)
+	const Model& model, UINT numGeometries)
 {
 	D3D12_STATIC_SAMPLER_DESC staticSamplerDescs[2] = {};
 	D3D12_STATIC_SAMPLER_DESC& defaultSampler = staticSamplerDescs[0];
@@ -956,7 +1137,7 @@ void D3D12RaytracingMiniEngineSample::InitializeStateObjects(
 
 	D3D12_DESCRIPTOR_RANGE1 srvDescriptorRange = {};
 	srvDescriptorRange.BaseShaderRegister = 12;
-	srvDescriptorRange.NumDescriptors = 3;
+	srvDescriptorRange.NumDescriptors = 6;
 	srvDescriptorRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
 	srvDescriptorRange.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_NONE;
 
@@ -1012,7 +1193,7 @@ void D3D12RaytracingMiniEngineSample::InitializeStateObjects(
 
 	if (g_RayTraceSupport)
 	{
-		InitializeRaytracingStateObjects(model, numMeshes);
+		InitializeRaytracingStateObjects(model, numGeometries);
 	}
 }
 
@@ -1072,15 +1253,16 @@ void D3D12RaytracingMiniEngineSample::Startup(void)
 	SamplerDesc DefaultSamplerDesc;
 	DefaultSamplerDesc.MaxAnisotropy = 8;
 
-	m_RootSig.Reset(6, 2);
+	m_RootSig.Reset(7, 2);
 	m_RootSig.InitStaticSampler(0, DefaultSamplerDesc, D3D12_SHADER_VISIBILITY_PIXEL);
 	m_RootSig.InitStaticSampler(1, SamplerShadowDesc, D3D12_SHADER_VISIBILITY_PIXEL);
 	m_RootSig[0].InitAsConstantBuffer(0, D3D12_SHADER_VISIBILITY_VERTEX);
 	m_RootSig[1].InitAsConstantBuffer(0, D3D12_SHADER_VISIBILITY_PIXEL);
 	m_RootSig[2].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, 6, D3D12_SHADER_VISIBILITY_PIXEL);
 	m_RootSig[3].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 64, 6, D3D12_SHADER_VISIBILITY_PIXEL);
-	m_RootSig[4].InitAsConstants(1, 2, D3D12_SHADER_VISIBILITY_VERTEX);
+	m_RootSig[4].InitAsConstants(1, 8, D3D12_SHADER_VISIBILITY_VERTEX);
 	m_RootSig[5].InitAsConstants(1, 1, D3D12_SHADER_VISIBILITY_PIXEL);
+	m_RootSig[6].InitAsBufferSRV(0, D3D12_SHADER_VISIBILITY_VERTEX);
 	m_RootSig.Finalize(L"D3D12RaytracingMiniEngineSample",
 	                   D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
@@ -1098,11 +1280,11 @@ void D3D12RaytracingMiniEngineSample::Startup(void)
 	};
 	D3D12_INPUT_ELEMENT_DESC vertElem[] =
 	{
-		makeVertexInputElement("POSITION", DXGI_FORMAT_R32G32B32_FLOAT),
-		makeVertexInputElement("TEXCOORD", DXGI_FORMAT_R32G32_FLOAT),
-		makeVertexInputElement("NORMAL", DXGI_FORMAT_R32G32B32_FLOAT),
-		makeVertexInputElement("TANGENT", DXGI_FORMAT_R32G32B32_FLOAT),
-		makeVertexInputElement("BITANGENT", DXGI_FORMAT_R32G32B32_FLOAT)
+		// Model::QuantizedVertex
+		makeVertexInputElement("POSITION", DXGI_FORMAT_R16G16B16A16_SNORM),
+		makeVertexInputElement("TEXCOORD", DXGI_FORMAT_R16G16_FLOAT),
+		makeVertexInputElement("NORMAL", DXGI_FORMAT_R16G16B16A16_SNORM),
+		makeVertexInputElement("TANGENT", DXGI_FORMAT_R16G16B16A16_SNORM)
 	};
 
 	// Depth-only (2x rate)
@@ -1139,6 +1321,23 @@ void D3D12RaytracingMiniEngineSample::Startup(void)
 	m_CutoutShadowPSO.SetRasterizerState(RasterizerShadowTwoSided);
 	m_CutoutShadowPSO.Finalize();
 
+	// Depth-only and shadows from the merged opaque geometry
+	D3D12_INPUT_ELEMENT_DESC depthElem[] =
+	{
+		// DepthGeometry::Vertex
+		makeVertexInputElement("POSITION", DXGI_FORMAT_R16G16B16A16_SNORM),
+		makeVertexInputElement("MESHINDEX", DXGI_FORMAT_R32_UINT)
+	};
+	m_MergedDepthPSO = m_DepthPSO[0];
+	m_MergedDepthPSO.SetInputLayout(_countof(depthElem), depthElem);
+	m_MergedDepthPSO.SetVertexShader(g_pDepthOnlyVS, sizeof(g_pDepthOnlyVS));
+	m_MergedDepthPSO.Finalize();
+
+	m_MergedShadowPSO = m_ShadowPSO;
+	m_MergedShadowPSO.SetInputLayout(_countof(depthElem), depthElem);
+	m_MergedShadowPSO.SetVertexShader(g_pDepthOnlyVS, sizeof(g_pDepthOnlyVS));
+	m_MergedShadowPSO.Finalize();
+
 	// Full color pass
 	m_ModelPSO[0] = m_DepthPSO[0];
 	m_ModelPSO[0].SetRasterizerState(RasterizerDefault);
@@ -1161,20 +1360,35 @@ void D3D12RaytracingMiniEngineSample::Startup(void)
 
 	Lighting::InitializeResources();
 
-	m_ExtraTextures[0] = g_SSAOFullScreen.GetSRV();
-	m_ExtraTextures[1] = g_ShadowBuffer.GetSRV();
-
-
+	RayCompaction::Initialize(g_SceneColorBuffer.GetWidth(), g_SceneColorBuffer.GetHeight());
+	RayDensity::Initialize(g_SceneColorBuffer.GetWidth(), g_SceneColorBuffer.GetHeight());
+	InterleavedRays::Initialize(g_SceneColorBuffer.GetWidth(), g_SceneColorBuffer.GetHeight());
+	StereoReuse::Initialize();
+	ShadowRayCulling::Initialize();
 	
+	// A scene archive next to the model, packed by model_convert -scene, stands in for the files of its directory
+	const std::string archivePath = g_Scene.ModelPath.substr(0, g_Scene.ModelPath.find_last_of('.')) + ".scene";
+	if (SceneArchive::Mount(MakeWStr(archivePath)))
+		Utility::Printf("Loading the scene from %s\n", archivePath.c_str());
+
 	TextureManager::Initialize(g_Scene.TextureFolderPath);
 	bool bModelLoadSuccess = m_Model.Load(g_Scene.ModelPath.c_str(), g_Scene.Matrix, g_Scene.InvMatrix, g_Scene.flipUvY, g_Scene.BuildBoundingBox);
 	ASSERT(bModelLoadSuccess, "Failed to load model");
 	ASSERT(m_Model.m_Header.meshCount > 0, "Model contains no meshes");
+	ASSERT(m_Model.IsQuantized(), "The input layout expects quantized vertices");
 
 	set_hard_coded_material_properties(
 		m_Model, m_pMaterialIsCutout, m_pMaterialIsReflective
 	);
 
+	// Before ClassifyCutoutTriangles() reorders the cutout meshes' indices
+	MeshletCulling::Initialize(m_Model, m_pMaterialIsCutout);
+	ShadowCasterCulling::Initialize(m_Model);
+	ClassifyCutoutTriangles(m_Model, m_pMaterialIsCutout);
+	DepthGeometry::Initialize(m_Model, m_pMaterialIsCutout);
+	BuildHitAttributes(m_Model);
+	m_Model.ReleaseCpuGeometry();
+
 
 	g_hitConstantBuffer.Create(L"Hit Constant Buffer", 1, sizeof(HitShaderConstants));
 	g_dynamicConstantBuffer.Create(L"Dynamic Constant Buffer", 1, sizeof(DynamicCB));
@@ -1183,11 +1397,12 @@ void D3D12RaytracingMiniEngineSample::Startup(void)
 
 	InitializeSceneInfo(m_Model);
 	InitializeViews(m_Model);
-	UINT numMeshes = m_Model.m_Header.meshCount;
+	UINT numGeometries = (UINT)g_RayTracingGeometries.size();
 
 	if (g_RayTraceSupport)
 	{
-		CreateRayTraceAccelerationStructures(numMeshes);
+		UpdateRayTraceAccelerationStructures(numGeometries);
+		AccelerationStructures::Flush();
 		Settings::RayTracingMode = Settings::RTM_REFLECTIONS;
 		OutputDebugStringW(L"DXR support present on Device");
 	}
@@ -1197,7 +1412,7 @@ void D3D12RaytracingMiniEngineSample::Startup(void)
 		OutputDebugStringW(L"DXR support not present on Device");
 	}
 
-	InitializeStateObjects(m_Model, numMeshes);
+	InitializeStateObjects(m_Model, numGeometries);
 
 	float modelRadius = Length(m_Model.m_Header.boundingBox.max - m_Model.m_Header.boundingBox.min) * .5f;
 	const Vector3 eye = (m_Model.m_Header.boundingBox.min + m_Model.m_Header.boundingBox.max) * .5f + Vector3(
@@ -1246,11 +1461,6 @@ void D3D12RaytracingMiniEngineSample::Startup(void)
 	Settings::EnableAdaptation = false;//true;
     Settings::SSAO_Enable = true;
 
-    m_ExtraTextures[2] = Lighting::m_LightBuffer.GetSRV();
-    m_ExtraTextures[3] = Lighting::m_LightShadowArray.GetSRV();
-    m_ExtraTextures[4] = Lighting::m_LightGrid.GetSRV();
-    m_ExtraTextures[5] = Lighting::m_LightGridBitMask.GetSRV();
-
 	if (g_Scene.UseCustom)
 	{
 		Settings::AmbientIntensity = exp2f(g_Scene.AmbientIntensity);
@@ -1267,6 +1477,8 @@ void D3D12RaytracingMiniEngineSample::Startup(void)
 
 void D3D12RaytracingMiniEngineSample::Cleanup(void)
 {
+	if (g_RayTraceSupport)
+		AccelerationStructures::Shutdown();
 	m_Model.Clear();
 }
 
@@ -1274,6 +1486,10 @@ void D3D12RaytracingMiniEngineSample::Update(float deltaT)
 {
 	ScopedTimer _prof(L"Update State");
 
+	// Swaps in acceleration structures whose build finished and starts the next one
+	if (g_RayTraceSupport)
+		AccelerationStructures::Update();
+
 	if (GameInput::IsFirstPressed(GameInput::kLShoulder))
 		Settings::DebugZoom.Decrement();
 	else if (GameInput::IsFirstPressed(GameInput::kRShoulder))
@@ -1379,7 +1595,7 @@ void D3D12RaytracingMiniEngineSample::Update(float deltaT)
 }
 
 void D3D12RaytracingMiniEngineSample::RenderObjects(GraphicsContext& gfxContext, UINT curCam, const Matrix4& ViewProjMat,
-                                                    eObjectFilter Filter)
+                                                    eObjectFilter Filter, const MeshletCulling::DrawList* Culled)
 {
 	struct VSConstants
 	{
@@ -1403,6 +1619,10 @@ void D3D12RaytracingMiniEngineSample::RenderObjects(GraphicsContext& gfxContext,
 
 	uint32_t VertexStride = m_Model.m_VertexStride;
 
+	// The merged depth geometry may have replaced both
+	gfxContext.SetIndexBuffer(Culled ? Culled->IndexBuffer : m_Model.m_IndexBuffer.IndexBufferView());
+	gfxContext.SetVertexBuffer(0, m_Model.m_VertexBuffer.VertexBufferView());
+
 	for (uint32_t meshIndex = 0; meshIndex < m_Model.m_Header.meshCount; meshIndex++)
 	{
 		const Model::Mesh& mesh = m_Model.m_pMesh[meshIndex];
@@ -1411,6 +1631,20 @@ void D3D12RaytracingMiniEngineSample::RenderObjects(GraphicsContext& gfxContext,
 		uint32_t startIndex = mesh.indexDataByteOffset / sizeof(uint16_t);
 		uint32_t baseVertex = mesh.vertexDataByteOffset / VertexStride;
 
+		if (Culled)
+		{
+			indexCount = Culled->Culled.Draws[meshIndex].IndexCount;
+			startIndex = Culled->Culled.Draws[meshIndex].StartIndex;
+			if (indexCount == 0)
+				continue;
+		}
+		else if (meshIndex < m_MeshLods.size() && m_MeshLods[meshIndex] > 0)
+		{
+			const Model::LodLevel& lod = m_Model.GetLod(meshIndex, m_MeshLods[meshIndex]);
+			indexCount = lod.indexCount;
+			startIndex = lod.indexDataByteOffset / sizeof(uint16_t);
+		}
+
 		if (mesh.materialIndex != materialIdx)
 		{
 			if (m_pMaterialIsCutout[mesh.materialIndex] && !(Filter & kCutout) ||
@@ -1422,13 +1656,41 @@ void D3D12RaytracingMiniEngineSample::RenderObjects(GraphicsContext& gfxContext,
 		}
 		uint32_t areNormalsNeeded = m_pMaterialIsReflective[mesh.materialIndex];
 		// (RayTracingMode != RTM_REFLECTIONS) || m_pMaterialIsReflective[mesh.materialIndex];
-		gfxContext.SetConstants(4, baseVertex, materialIdx);
+		// Matches StartVertex in ModelViewerVS.hlsl
+		struct
+		{
+			float positionScale[3];
+			uint32_t baseVertex;
+			float positionOffset[3];
+			uint32_t materialIdx;
+		} vertexConstants;
+		Model::GetPositionDequantization(mesh, vertexConstants.positionScale, vertexConstants.positionOffset);
+		vertexConstants.baseVertex = baseVertex;
+		vertexConstants.materialIdx = materialIdx;
+		gfxContext.SetConstantArray(4, 8, &vertexConstants);
 		gfxContext.SetConstants(5, areNormalsNeeded);
 
 		gfxContext.DrawIndexed(indexCount, startIndex, baseVertex);
 	}
 }
 
+void D3D12RaytracingMiniEngineSample::RenderOpaqueDepth(GraphicsContext& gfxContext, UINT curCam, const Matrix4& ViewProjMat,
+                                                        const GraphicsPSO& PSO, const GraphicsPSO& MergedPSO,
+                                                        const MeshletCulling::DrawList* Culled)
+{
+	if (!Settings::DepthGeometry_Merge)
+	{
+		gfxContext.SetPipelineState(PSO);
+		RenderObjects(gfxContext, curCam, ViewProjMat, kOpaque, Culled);
+		return;
+	}
+
+	// Matches VSConstants in DepthOnlyVS.hlsl
+	gfxContext.SetPipelineState(MergedPSO);
+	gfxContext.SetDynamicConstantBufferView(0, sizeof(ViewProjMat), &ViewProjMat);
+	DepthGeometry::Draw(gfxContext, m_MeshLods.empty() ? nullptr : m_MeshLods.data(), Culled ? &Culled->Culled : nullptr);
+}
+
 
 void D3D12RaytracingMiniEngineSample::SetCameraToPredefinedPosition(int cameraPosition)
 {
@@ -1518,147 +1780,91 @@ void D3D12RaytracingMiniEngineSample::GoToAnimation()
 	SetCameraPosition(camPos);
 }
 
-void D3D12RaytracingMiniEngineSample::CreateRayTraceAccelerationStructures(UINT numMeshes)
-{
-	const UINT numBottomLevels = 1;
-
-	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO topLevelPrebuildInfo;
-	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC topLevelAccelerationStructureDesc = {};
-	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& topLevelInputs = topLevelAccelerationStructureDesc.Inputs;
-	topLevelInputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
-	topLevelInputs.NumDescs = numBottomLevels;
-	topLevelInputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
-	topLevelInputs.pGeometryDescs = nullptr;
-	topLevelInputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-	g_pRaytracingDevice->GetRaytracingAccelerationStructurePrebuildInfo(&topLevelInputs, &topLevelPrebuildInfo);
-
-	const D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlag =
-		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
-	std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geometryDescs(m_Model.m_Header.meshCount);
-	UINT64 scratchBufferSizeNeeded = topLevelPrebuildInfo.ScratchDataSizeInBytes;
-	for (UINT i = 0; i < numMeshes; i++)
-	{
-		auto& mesh = m_Model.m_pMesh[i];
-
-		D3D12_RAYTRACING_GEOMETRY_DESC& desc = geometryDescs[i];
-		desc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
-		desc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
-
-		D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC& trianglesDesc = desc.Triangles;
-		trianglesDesc.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
-		trianglesDesc.VertexCount = mesh.vertexCount;
-		trianglesDesc.VertexBuffer.StartAddress = m_Model.m_VertexBuffer.GetGpuVirtualAddress() + (mesh.
-			vertexDataByteOffset + mesh.attrib[Model::attrib_position].offset);
-		trianglesDesc.IndexBuffer = m_Model.m_IndexBuffer.GetGpuVirtualAddress() + mesh.indexDataByteOffset;
-		trianglesDesc.VertexBuffer.StrideInBytes = mesh.vertexStride;
-		trianglesDesc.IndexCount = mesh.indexCount;
-		trianglesDesc.IndexFormat = DXGI_FORMAT_R16_UINT;
-		trianglesDesc.Transform3x4 = 0;
-	}
-
-	std::vector<UINT64> bottomLevelAccelerationStructureSize(numBottomLevels);
-	std::vector<D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC> bottomLevelAccelerationStructureDescs(
-		numBottomLevels);
-	for (UINT i = 0; i < numBottomLevels; i++)
-	{
-		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC& bottomLevelAccelerationStructureDesc =
-			bottomLevelAccelerationStructureDescs[i];
-		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& bottomLevelInputs = bottomLevelAccelerationStructureDesc.
-			Inputs;
-		bottomLevelInputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
-		bottomLevelInputs.NumDescs = numMeshes;
-		bottomLevelInputs.pGeometryDescs = &geometryDescs[i];
-		bottomLevelInputs.Flags = buildFlag;
-		bottomLevelInputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-
-		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO bottomLevelprebuildInfo;
-		g_pRaytracingDevice->GetRaytracingAccelerationStructurePrebuildInfo(
-			&bottomLevelInputs, &bottomLevelprebuildInfo);
-
-		bottomLevelAccelerationStructureSize[i] = bottomLevelprebuildInfo.ResultDataMaxSizeInBytes;
-		scratchBufferSizeNeeded = std::max(bottomLevelprebuildInfo.ScratchDataSizeInBytes, scratchBufferSizeNeeded);
-	}
-
-	ByteAddressBuffer scratchBuffer;
-	scratchBuffer.Create(L"Acceleration Structure Scratch Buffer", (UINT)scratchBufferSizeNeeded, 1);
-
-	D3D12_HEAP_PROPERTIES defaultHeapDesc = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-	auto topLevelDesc = CD3DX12_RESOURCE_DESC::Buffer(topLevelPrebuildInfo.ResultDataMaxSizeInBytes,
-	                                                  D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-	g_Device->CreateCommittedResource(
-		&defaultHeapDesc,
-		D3D12_HEAP_FLAG_NONE,
-		&topLevelDesc,
-		D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
-		nullptr,
-		IID_PPV_ARGS(&g_bvh_topLevelAccelerationStructure));
-
-	topLevelAccelerationStructureDesc.DestAccelerationStructureData = g_bvh_topLevelAccelerationStructure->
-		GetGPUVirtualAddress();
-	topLevelAccelerationStructureDesc.ScratchAccelerationStructureData = scratchBuffer.GetGpuVirtualAddress();
-
-	std::vector<D3D12_RAYTRACING_INSTANCE_DESC> instanceDescs(numBottomLevels);
-	g_bvh_bottomLevelAccelerationStructures.resize(numBottomLevels);
-	for (UINT i = 0; i < bottomLevelAccelerationStructureDescs.size(); i++)
-	{
-		auto& bottomLevelStructure = g_bvh_bottomLevelAccelerationStructures[i];
-
-		auto bottomLevelDesc = CD3DX12_RESOURCE_DESC::Buffer(bottomLevelAccelerationStructureSize[i],
-		                                                     D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
-		g_Device->CreateCommittedResource(
-			&defaultHeapDesc,
-			D3D12_HEAP_FLAG_NONE,
-			&bottomLevelDesc,
-			D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
-			nullptr,
-			IID_PPV_ARGS(&bottomLevelStructure));
-
-		bottomLevelAccelerationStructureDescs[i].DestAccelerationStructureData = bottomLevelStructure->
-			GetGPUVirtualAddress();
-		bottomLevelAccelerationStructureDescs[i].ScratchAccelerationStructureData = scratchBuffer.
-			GetGpuVirtualAddress();
-
-		D3D12_RAYTRACING_INSTANCE_DESC& instanceDesc = instanceDescs[i];
-		UINT descriptorIndex = g_pRaytracingDescriptorHeap->AllocateBufferUav(*bottomLevelStructure);
+// Consecutive meshes share a bottom level structure up to this many triangles, so that a change to one
+// mesh rebuilds a fraction of the scene
+static const UINT c_MaxBottomLevelTriangles = 256 * 1024;
 
-		XMMatrixIdentity();
-		XMStoreFloat3x4((XMFLOAT3X4 *)instanceDesc.Transform, XMMatrixIdentity());
+// One 3x4 row-major matrix per mesh that takes its quantized positions into model space
+static ByteAddressBuffer g_MeshPositionTransforms;
 
-		instanceDesc.AccelerationStructure = g_bvh_bottomLevelAccelerationStructures[i]->GetGPUVirtualAddress();
-		instanceDesc.Flags = 0;
-		instanceDesc.InstanceID = 0;
-		instanceDesc.InstanceMask = 1;
-		instanceDesc.InstanceContributionToHitGroupIndex = i;
+// Hands the geometries of g_RayTracingGeometries to AccelerationStructures.  Only the bottom levels whose
+// geometries changed since the last call are rebuilt, in the background, so this can be called again
+// whenever the cutout classification or the scene's meshes change.
+void D3D12RaytracingMiniEngineSample::UpdateRayTraceAccelerationStructures(UINT numGeometries)
+{
+	// Grouped by full index count, which the cutout classification does not change
+	std::vector<UINT> firstMeshes;
+	UINT groupTriangles = 0;
+	for (UINT i = 0; i < m_Model.m_Header.meshCount; i++)
+	{
+		const UINT meshTriangles = m_Model.m_pMesh[i].indexCount / 3;
+		if (firstMeshes.empty() || groupTriangles > 0 && groupTriangles + meshTriangles > c_MaxBottomLevelTriangles)
+		{
+			firstMeshes.push_back(i);
+			groupTriangles = 0;
+		}
+		groupTriangles += meshTriangles;
 	}
-	
-	ByteAddressBuffer instanceDataBuffer;
-	instanceDataBuffer.Create(L"Instance Data Buffer", numBottomLevels, sizeof(D3D12_RAYTRACING_INSTANCE_DESC),
-	                          instanceDescs.data());
-
-	topLevelInputs.InstanceDescs = instanceDataBuffer.GetGpuVirtualAddress();
-	topLevelInputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
 
+	if (g_MeshPositionTransforms.GetResource() == nullptr)
+	{
+		std::vector<float> transforms(m_Model.m_Header.meshCount * 12, 0.0f);
+		for (UINT i = 0; i < m_Model.m_Header.meshCount; i++)
+		{
+			float scale[3], offset[3];
+			Model::GetPositionDequantization(m_Model.m_pMesh[i], scale, offset);
+			float* transform = &transforms[i * 12];
+			for (UINT row = 0; row < 3; row++)
+			{
+				transform[row * 4 + row] = scale[row];
+				transform[row * 4 + 3] = offset[row];
+			}
+		}
+		g_MeshPositionTransforms.Create(L"Mesh Position Transforms", (UINT)transforms.size(), sizeof(float),
+			transforms.data());
+	}
 
-	GraphicsContext& gfxContext = GraphicsContext::Begin(L"Create Acceleration Structure");
-	ID3D12GraphicsCommandList* pCommandList = gfxContext.GetCommandList();
+	const UINT numBottomLevels = (UINT)firstMeshes.size();
+	AccelerationStructures::SetBottomLevelCount(numBottomLevels);
 
-	CComPtr<ID3D12GraphicsCommandList4> pRaytracingCommandList;
-	pCommandList->QueryInterface(IID_PPV_ARGS(&pRaytracingCommandList));
+	// The geometries are in mesh order and each one has the hit group of its index, so an instance starts
+	// at the hit group of its first geometry
+	UINT geometryIndex = 0;
+	for (UINT b = 0; b < numBottomLevels; b++)
+	{
+		const UINT endMesh = b + 1 < numBottomLevels ? firstMeshes[b + 1] : m_Model.m_Header.meshCount;
+		const UINT firstHitGroup = geometryIndex;
 
-	ID3D12DescriptorHeap* descriptorHeaps[] = {&g_pRaytracingDescriptorHeap->GetDescriptorHeap()};
-	pRaytracingCommandList->SetDescriptorHeaps(ARRAYSIZE(descriptorHeaps), descriptorHeaps);
+		std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geometryDescs;
+		for (; geometryIndex < numGeometries && g_RayTracingGeometries[geometryIndex].meshIndex < endMesh; geometryIndex++)
+		{
+			const RayTracingGeometry& geometry = g_RayTracingGeometries[geometryIndex];
+			auto& mesh = m_Model.m_pMesh[geometry.meshIndex];
+
+			D3D12_RAYTRACING_GEOMETRY_DESC desc = {};
+			desc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+			desc.Flags = geometry.opaque ? D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE : D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
+
+			D3D12_RAYTRACING_GEOMETRY_TRIANGLES_DESC& trianglesDesc = desc.Triangles;
+			trianglesDesc.VertexFormat = DXGI_FORMAT_R16G16B16A16_SNORM;
+			trianglesDesc.VertexCount = mesh.vertexCount;
+			trianglesDesc.VertexBuffer.StartAddress = m_Model.m_VertexBuffer.GetGpuVirtualAddress() + (mesh.
+				vertexDataByteOffset + mesh.attrib[Model::attrib_position].offset);
+			trianglesDesc.IndexBuffer = m_Model.m_IndexBuffer.GetGpuVirtualAddress() + geometry.indexDataByteOffset;
+			trianglesDesc.VertexBuffer.StrideInBytes = mesh.vertexStride;
+			trianglesDesc.IndexCount = geometry.indexCount;
+			trianglesDesc.IndexFormat = DXGI_FORMAT_R16_UINT;
+			trianglesDesc.Transform3x4 = g_MeshPositionTransforms.GetGpuVirtualAddress() +
+				geometry.meshIndex * 12 * sizeof(float);
+			geometryDescs.push_back(desc);
+		}
 
-	auto uavBarrier = CD3DX12_RESOURCE_BARRIER::UAV(nullptr);
-	for (UINT i = 0; i < bottomLevelAccelerationStructureDescs.size(); i++)
-	{
-		pRaytracingCommandList->BuildRaytracingAccelerationStructure(&bottomLevelAccelerationStructureDescs[i], 0,
-		                                                             nullptr);
+		AccelerationStructures::SetBottomLevel(b, geometryDescs, firstHitGroup);
 	}
-	pCommandList->ResourceBarrier(1, &uavBarrier);
-
-	pRaytracingCommandList->BuildRaytracingAccelerationStructure(&topLevelAccelerationStructureDesc, 0, nullptr);
+	ASSERT(geometryIndex == numGeometries, "Ray tracing geometries are not in mesh order");
 
-	gfxContext.Finish(true);
+	// The instances are not transformed, so the model's bounds hold everything in the acceleration structure
+	ShadowRayCulling::SetSceneBounds(m_Model.GetBoundingBox().min, m_Model.GetBoundingBox().max);
 }
 
 void D3D12RaytracingMiniEngineSample::RenderColor(GraphicsContext& Ctx, Camera& Camera, Cam::CameraType CameraType,
@@ -1668,7 +1874,17 @@ void D3D12RaytracingMiniEngineSample::RenderColor(GraphicsContext& Ctx, Camera&
 
 	Ctx.TransitionResource(g_SSAOFullScreen, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 
-	Ctx.SetDynamicDescriptors(3, 0, ARRAYSIZE(m_ExtraTextures), m_ExtraTextures);
+	// Fetched at bind time, since re-creating a buffer frees its descriptors and allocates new ones
+	D3D12_CPU_DESCRIPTOR_HANDLE ExtraTextures[] =
+	{
+		g_SSAOFullScreen.GetSRV(),
+		g_ShadowBuffer.GetSRV(),
+		Lighting::m_LightBuffer.GetSRV(),
+		Lighting::m_LightShadowArray.GetSRV(),
+		Lighting::m_LightGrid.GetSRV(),
+		Lighting::m_LightGridBitMask.GetSRV(),
+	};
+	Ctx.SetDynamicDescriptors(3, 0, ARRAYSIZE(ExtraTextures), ExtraTextures);
 	Ctx.SetDynamicConstantBufferView(1, sizeof(Constants), &Constants);
 
 	bool RenderIDs = !Settings::TAA_Enable;
@@ -1691,12 +1907,12 @@ void D3D12RaytracingMiniEngineSample::RenderColor(GraphicsContext& Ctx, Camera&
 			m_MainViewport, m_MainScissor);
 	}
 
-	RenderObjects(Ctx, CameraType, m_Camera[CameraType]->GetViewProjMatrix(), kOpaque);
+	RenderObjects(Ctx, CameraType, m_Camera[CameraType]->GetViewProjMatrix(), kOpaque, m_CulledDraws);
 
 	if (!Settings::ShowWaveTileCounts)
 	{
 		Ctx.SetPipelineState(m_CutoutModelPSO[0]);
-		RenderObjects(Ctx, CameraType, m_Camera[CameraType]->GetViewProjMatrix(), kCutout);
+		RenderObjects(Ctx, CameraType, m_Camera[CameraType]->GetViewProjMatrix(), kCutout, m_CulledDraws);
 	}
 }
 
@@ -1712,12 +1928,17 @@ void D3D12RaytracingMiniEngineSample::RenderEye(Cam::CameraType eye, bool SkipDi
 	Camera& camera = *m_Camera[eye];
 
 	SetupGraphicsState(ctx);
+	if (Settings::MeshletCulling_Enable)
+		m_CulledDraws = &MeshletCulling::CullEye(ctx, eye, camera, m_MeshLods.data());
 	RenderPrepass(ctx, eye, camera, psConstants);
 
 	MainRender(ctx, eye, camera,
 		psConstants, SkipDiffusePass, SkipShadowMap);
+	m_CulledDraws = nullptr;
 
-	ctx.Finish();
+	const uint64_t fenceValue = ctx.Finish();
+	RayCompaction::SetReadbackFence(eye, fenceValue);
+	ShadowRayCulling::SetReadbackFence(eye, fenceValue);
 	Settings::g_EyeRenderTimer[eye].Stop();
 }
 
@@ -1754,13 +1975,13 @@ void D3D12RaytracingMiniEngineSample::RenderPrepass(GraphicsContext& Ctx, Cam::C
 					Ctx.ClearDepthAndStencil(g_SceneDepthBuffer);
 				}
 
-				Ctx.SetPipelineState(m_DepthPSO[0]);
 				Ctx.SetDepthStencilTarget(g_SceneDepthBuffer.GetSubDSV(CameraType));
 
 				Ctx.SetViewportAndScissor(m_MainViewport, m_MainScissor);
 			}
 
-			RenderObjects(Ctx, CameraType, m_Camera[CameraType]->GetViewProjMatrix(),  kOpaque);
+			RenderOpaqueDepth(Ctx, CameraType, m_Camera[CameraType]->GetViewProjMatrix(), m_DepthPSO[0], m_MergedDepthPSO,
+				m_CulledDraws);
 		}
 
 		{
@@ -1768,11 +1989,36 @@ void D3D12RaytracingMiniEngineSample::RenderPrepass(GraphicsContext& Ctx, Cam::C
 			{
 				Ctx.SetPipelineState(m_CutoutDepthPSO[0]);
 			}
-			RenderObjects(Ctx, CameraType, m_Camera[CameraType]->GetViewProjMatrix(), kCutout);
+			RenderObjects(Ctx, CameraType, m_Camera[CameraType]->GetViewProjMatrix(), kCutout, m_CulledDraws);
 		}
 	}
 }
 
+// The share of pixels traced per frame is 1 / rate
+UINT GetInterleaveRate()
+{
+	// Reconstruction reprojects through g_LinearDepth, which SSAO::Render() only writes when asked to
+	if (!Settings::SSAO_Enable && !Settings::ComputeLinearZ)
+		return 1;
+
+	switch (Settings::RayTracingMode)
+	{
+	case Settings::RTM_SHADOWS:
+		return 1u << Settings::InterleavedRays_Shadows;
+
+	case Settings::RTM_DIFFUSE_WITH_SHADOWMAPS:
+	case Settings::RTM_DIFFUSE_WITH_SHADOWRAYS:
+		return 1u << Settings::InterleavedRays_Diffuse;
+
+	case Settings::RTM_SSR:
+	case Settings::RTM_REFLECTIONS:
+		return 1u << Settings::InterleavedRays_Reflections;
+
+	default:
+		return 1;
+	}
+}
+
 void D3D12RaytracingMiniEngineSample::MainRender(GraphicsContext& Ctx, Cam::CameraType CameraType, Camera& Camera,
 	PSConstants& Constants, bool SkipDiffusePass, bool SkipShadowMap)
 {
@@ -1818,6 +2064,11 @@ void D3D12RaytracingMiniEngineSample::MainRender(GraphicsContext& Ctx, Cam::Came
 		else
 			MotionBlur::RenderObjectBlur(Ctx, g_VelocityBuffer, CameraType);
 	}
+	else if (GetInterleaveRate() > 1)
+	{
+		// The diffuse modes skip the pass above, but interleaved reconstruction still reprojects through the velocity buffer
+		MotionBlur::GenerateCameraVelocityBuffer(Ctx, *m_Camera[CameraType], true);
+	}
 
 	if (g_RayTraceSupport/* && RayTracingMode != RTM_OFF*/)
 	{
@@ -1840,8 +2091,7 @@ void D3D12RaytracingMiniEngineSample::RenderLightShadows(GraphicsContext& gfxCon
 
 	m_LightShadowTempBuffer.BeginRendering(gfxContext);
 	{
-		gfxContext.SetPipelineState(m_ShadowPSO);
-		RenderObjects(gfxContext, curCam, m_LightShadowMatrix[LightIndex], kOpaque);
+		RenderOpaqueDepth(gfxContext, curCam, m_LightShadowMatrix[LightIndex], m_ShadowPSO, m_MergedShadowPSO);
 		gfxContext.SetPipelineState(m_CutoutShadowPSO);
 		RenderObjects(gfxContext, curCam, m_LightShadowMatrix[LightIndex], kCutout);
 	}
@@ -1873,13 +2123,22 @@ void D3D12RaytracingMiniEngineSample::RenderShadowMap()
 				(uint32_t)g_ShadowBuffer.GetWidth(), 
 				(uint32_t)g_ShadowBuffer.GetHeight(), 16);
 
+			// Reflection rays look the shadow map up off screen, so only the shadow camera can cull for them
+			const MeshletCulling::DrawList* casters = nullptr;
+			if (Settings::ShadowCasterCulling_Enable)
+			{
+				Camera* eyes[] = { m_Camera[Cam::kLeft], m_Camera[Cam::kRight] };
+				uint32_t eyeCount = Settings::RayTracingMode == Settings::RTM_REFLECTIONS ? 0 : _countof(eyes);
+				casters = &ShadowCasterCulling::Cull(m_SunShadow.GetViewProjMatrix(), -m_SunDirection,
+					Settings::ShadowDimZ, eyes, eyeCount, m_MeshLods.empty() ? nullptr : m_MeshLods.data());
+			}
+
 			g_ShadowBuffer.BeginRendering(Ctx);
-			Ctx.SetPipelineState(m_ShadowPSO);
-			RenderObjects(
-				Ctx, 0, m_SunShadow.GetViewProjMatrix(),  kOpaque);
+			RenderOpaqueDepth(
+				Ctx, 0, m_SunShadow.GetViewProjMatrix(), m_ShadowPSO, m_MergedShadowPSO, casters);
 			Ctx.SetPipelineState(m_CutoutShadowPSO);
 			RenderObjects(
-				Ctx, 0, m_SunShadow.GetViewProjMatrix(),  kCutout);
+				Ctx, 0, m_SunShadow.GetViewProjMatrix(),  kCutout, casters);
 			g_ShadowBuffer.EndRendering(Ctx);
 		}
 
@@ -1931,6 +2190,9 @@ void D3D12RaytracingMiniEngineSample::RenderScene()
 	psConstants.FrameIndexMod2 = TemporalEffects::GetFrameIndexMod2();
 	psConstants.UseSceneLighting = Settings::UseSceneLighting;
 	psConstants.FlipNormals = g_Scene.FlipNormals;
+
+	LevelOfDetail::Select(m_Model, *m_Camera[Cam::kLeft], *m_Camera[Cam::kRight], (float)g_SceneColorBuffer.GetHeight(),
+		m_MeshLods);
 	
 	if(!skipShadowMap)
 	{
@@ -1953,13 +2215,22 @@ void g_initialize_dynamicCb(
 	VRCamera &Camera,
 	UINT CurCam,
 	const ColorBuffer &ColorTarget,
-	ByteAddressBuffer &Buffer)
+	ByteAddressBuffer &Buffer,
+	bool UseRayList = false)
 {
 	DynamicCB inputs = {};
 
 	inputs.curCam = CurCam;
+	inputs.useRayList = UseRayList;
 	inputs.useSceneLighting = Settings::UseSceneLighting;
 
+	const Lighting::LightClusterGrid& clusters = Lighting::m_LightClusterGrid;
+	memcpy(&inputs.lightClusterMin, clusters.Min, sizeof(inputs.lightClusterMin));
+	memcpy(&inputs.lightClusterInvCellSize, clusters.InvCellSize, sizeof(inputs.lightClusterInvCellSize));
+	inputs.lightClusterDimX = clusters.Dim[0];
+	inputs.lightClusterDimY = clusters.Dim[1];
+	inputs.lightClusterDimZ = clusters.Dim[2];
+
 	const Matrix4 mvp = Camera[CurCam]->GetViewProjMatrix();
 	const Matrix4 transInvMvp = Transpose(Invert(mvp));
 	memcpy(&inputs.cameraToWorld, &transInvMvp, sizeof(inputs.cameraToWorld));
@@ -1969,10 +2240,22 @@ void g_initialize_dynamicCb(
 	
 	inputs.resolution.x = (float)ColorTarget.GetWidth();
 	inputs.resolution.y = (float)ColorTarget.GetHeight();
+	inputs.pixelSpreadAngle = RayCones::GetPixelSpreadAngle(Camera[CurCam]->GetProjMatrix().GetY().GetY(), ColorTarget.GetHeight());
+	ShadowRayCulling::GetSceneBounds(&inputs.sceneBoundsMin.x, &inputs.sceneBoundsMax.x);
 
 	Context.WriteBuffer(Buffer, 0, &inputs, sizeof(inputs));
 }
 
+D3D12_DISPATCH_RAYS_DESC GetRayDispatchDesc(
+	RaytracingDispatchRayInputs& inputs,
+	const ColorBuffer& colorTarget)
+{
+	if (g_RayListLaunchCount > 0)
+		return inputs.GetDispatchRayDesc(g_RayListLaunchCount, 1);
+
+	return inputs.GetDispatchRayDesc(colorTarget.GetWidth(), colorTarget.GetHeight());
+}
+
 void Raytracebarycentrics(
 	CommandContext& context,
 	ColorBuffer& colorTarget)
@@ -1995,6 +2278,8 @@ void Raytracebarycentrics(
 	context.TransitionResource(g_SceneDepthBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	context.TransitionResource(g_SceneNormalBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	context.TransitionResource(Lighting::m_LightBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	context.TransitionResource(Lighting::m_LightClusterCells, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	context.TransitionResource(Lighting::m_LightClusterIndices, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	context.FlushResourceBarriers();
 
 	// Set bind resources
@@ -2012,10 +2297,10 @@ void Raytracebarycentrics(
 	pCmdList->SetComputeRootDescriptorTable(3, g_DepthNormalsAndLightsTable);
 	pCmdList->SetComputeRootDescriptorTable(4, g_OutputUAV);
 	pCmdList->SetComputeRootShaderResourceView(
-		7, g_bvh_topLevelAccelerationStructure->GetGPUVirtualAddress());
+		7, AccelerationStructures::GetTopLevel());
 
-	D3D12_DISPATCH_RAYS_DESC dispatchRaysDesc = g_RaytracingInputs[Primarybarycentric].GetDispatchRayDesc(
-		colorTarget.GetWidth(), colorTarget.GetHeight());
+	D3D12_DISPATCH_RAYS_DESC dispatchRaysDesc = GetRayDispatchDesc(
+		g_RaytracingInputs[Primarybarycentric], colorTarget);
 	pCmdList->SetPipelineState1(g_RaytracingInputs[Primarybarycentric].m_pPSO);
 	pCmdList->DispatchRays(&dispatchRaysDesc);
 }
@@ -2040,6 +2325,8 @@ void RaytracebarycentricsSSR(
 	ctx.TransitionResource(normals, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	ctx.TransitionResource(depth, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	ctx.TransitionResource(Lighting::m_LightBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	ctx.TransitionResource(Lighting::m_LightClusterCells, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	ctx.TransitionResource(Lighting::m_LightClusterIndices, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	ctx.TransitionResource(g_ShadowBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	ctx.TransitionResource(colorTarget, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 	ctx.FlushResourceBarriers();
@@ -2057,10 +2344,10 @@ void RaytracebarycentricsSSR(
 	pCmdList->SetComputeRootDescriptorTable(3, g_DepthNormalsAndLightsTable);
 	pCmdList->SetComputeRootDescriptorTable(4, g_OutputUAV);
 	pCmdList->SetComputeRootShaderResourceView(
-		7, g_bvh_topLevelAccelerationStructure->GetGPUVirtualAddress());
+		7, AccelerationStructures::GetTopLevel());
 
-	D3D12_DISPATCH_RAYS_DESC dispatchRaysDesc = g_RaytracingInputs[Reflectionbarycentric].GetDispatchRayDesc(
-		colorTarget.GetWidth(), colorTarget.GetHeight());
+	D3D12_DISPATCH_RAYS_DESC dispatchRaysDesc = GetRayDispatchDesc(
+		g_RaytracingInputs[Reflectionbarycentric], colorTarget);
 	pCmdList->SetPipelineState1(g_RaytracingInputs[Reflectionbarycentric].m_pPSO);
 	pCmdList->DispatchRays(&dispatchRaysDesc);
 }
@@ -2093,6 +2380,8 @@ void D3D12RaytracingMiniEngineSample::RaytraceShadows(
 	ctx.TransitionResource(g_hitConstantBuffer, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
 	ctx.TransitionResource(depth, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	ctx.TransitionResource(Lighting::m_LightBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	ctx.TransitionResource(Lighting::m_LightClusterCells, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	ctx.TransitionResource(Lighting::m_LightClusterIndices, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	ctx.TransitionResource(g_ShadowBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	ctx.TransitionResource(colorTarget, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 	ctx.FlushResourceBarriers();
@@ -2109,10 +2398,10 @@ void D3D12RaytracingMiniEngineSample::RaytraceShadows(
 	pCmdList->SetComputeRootDescriptorTable(3, g_DepthNormalsAndLightsTable);
 	pCmdList->SetComputeRootDescriptorTable(4, g_OutputUAV);
 	pCmdList->SetComputeRootShaderResourceView(
-		7, g_bvh_topLevelAccelerationStructure->GetGPUVirtualAddress());
+		7, AccelerationStructures::GetTopLevel());
 
-	D3D12_DISPATCH_RAYS_DESC dispatchRaysDesc = g_RaytracingInputs[Shadows].GetDispatchRayDesc(
-		colorTarget.GetWidth(), colorTarget.GetHeight());
+	D3D12_DISPATCH_RAYS_DESC dispatchRaysDesc = GetRayDispatchDesc(
+		g_RaytracingInputs[Shadows], colorTarget);
 	pCmdList->SetPipelineState1(g_RaytracingInputs[Shadows].m_pPSO);
 	pCmdList->DispatchRays(&dispatchRaysDesc);
 }
@@ -2143,6 +2432,8 @@ void D3D12RaytracingMiniEngineSample::RaytraceDiffuse(
 	context.TransitionResource(g_SceneDepthBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	context.TransitionResource(g_SceneNormalBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	context.TransitionResource(Lighting::m_LightBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	context.TransitionResource(Lighting::m_LightClusterCells, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	context.TransitionResource(Lighting::m_LightClusterIndices, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	context.FlushResourceBarriers();
 
 	ID3D12GraphicsCommandList* pCommandList = context.GetCommandList();
@@ -2160,10 +2451,10 @@ void D3D12RaytracingMiniEngineSample::RaytraceDiffuse(
 	pCommandList->SetComputeRootDescriptorTable(3, g_DepthNormalsAndLightsTable);
 	pCommandList->SetComputeRootDescriptorTable(4, g_OutputUAV);
 	pRaytracingCommandList->SetComputeRootShaderResourceView(
-		7, g_bvh_topLevelAccelerationStructure->GetGPUVirtualAddress());
+		7, AccelerationStructures::GetTopLevel());
 
-	D3D12_DISPATCH_RAYS_DESC dispatchRaysDesc = g_RaytracingInputs[DiffuseHitShader].GetDispatchRayDesc(
-		colorTarget.GetWidth(), colorTarget.GetHeight());
+	D3D12_DISPATCH_RAYS_DESC dispatchRaysDesc = GetRayDispatchDesc(
+		g_RaytracingInputs[DiffuseHitShader], colorTarget);
 	pRaytracingCommandList->SetPipelineState1(g_RaytracingInputs[DiffuseHitShader].m_pPSO);
 	pRaytracingCommandList->DispatchRays(&dispatchRaysDesc);
 }
@@ -2192,6 +2483,8 @@ void D3D12RaytracingMiniEngineSample::RaytraceReflections(
 	context.TransitionResource(g_SSAOFullScreen, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	context.TransitionResource(depth, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	context.TransitionResource(Lighting::m_LightBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	context.TransitionResource(Lighting::m_LightClusterCells, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	context.TransitionResource(Lighting::m_LightClusterIndices, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	context.TransitionResource(g_ShadowBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	context.TransitionResource(normals, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	context.TransitionResource(g_hitConstantBuffer, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
@@ -2213,10 +2506,10 @@ void D3D12RaytracingMiniEngineSample::RaytraceReflections(
 	pCommandList->SetComputeRootDescriptorTable(3, g_DepthNormalsAndLightsTable);
 	pCommandList->SetComputeRootDescriptorTable(4, g_OutputUAV);
 	pRaytracingCommandList->SetComputeRootShaderResourceView(
-		7, g_bvh_topLevelAccelerationStructure->GetGPUVirtualAddress());
+		7, AccelerationStructures::GetTopLevel());
 
-	D3D12_DISPATCH_RAYS_DESC dispatchRaysDesc = g_RaytracingInputs[Reflection].GetDispatchRayDesc(
-		colorTarget.GetWidth(), colorTarget.GetHeight());
+	D3D12_DISPATCH_RAYS_DESC dispatchRaysDesc = GetRayDispatchDesc(
+		g_RaytracingInputs[Reflection], colorTarget);
 	pRaytracingCommandList->SetPipelineState1(g_RaytracingInputs[Reflection].m_pPSO);
 	pRaytracingCommandList->DispatchRays(&dispatchRaysDesc);
 }
@@ -2244,6 +2537,65 @@ void D3D12RaytracingMiniEngineSample::RenderUI(class GraphicsContext& gfxContext
 	text.DrawFormattedString("\nCam rot: %f, %f",
 		m_CameraController.get()->GetCurrentHeading(),
 		m_CameraController.get()->GetCurrentPitch());
+
+	if (Settings::StereoReuse_Enable ||
+		Settings::FoveatedRays_Enable ||
+		GetInterleaveRate() > 1 ||
+		Settings::RayTracingMode == Settings::RTM_SSR ||
+		Settings::RayTracingMode == Settings::RTM_REFLECTIONS)
+	{
+		for (UINT eye = Cam::kLeft; eye <= Cam::kRight; ++eye)
+		{
+			const RayCompaction::RayCounters counters = RayCompaction::GetCounters(eye);
+			text.DrawFormattedString("\nRays %s: %u launched, %u useful",
+				eye == Cam::kLeft ? "left" : "right", counters.Launched, counters.Useful);
+		}
+	}
+
+	if (Settings::MeshletCulling_Enable)
+	{
+		for (UINT eye = Cam::kLeft; eye <= Cam::kRight; ++eye)
+		{
+			const MeshletCulling::Stats stats = MeshletCulling::GetStats(eye);
+			text.DrawFormattedString("\nMeshlets %s: %u of %u drawn, %u of %u triangles, culled in %.2f ms",
+				eye == Cam::kLeft ? "left" : "right", stats.VisibleMeshlets, stats.Meshlets,
+				stats.VisibleTriangles, stats.Triangles, stats.Milliseconds);
+		}
+	}
+
+	if (Settings::LevelOfDetail_Enable && m_Model.m_LodCount > 0)
+	{
+		uint32_t meshesPerLevel[Model::maxLods] = {};
+		for (uint32_t level : m_MeshLods)
+			++meshesPerLevel[level];
+		text.DrawFormattedString("\nMeshes per level of detail: %u, %u, %u, %u",
+			meshesPerLevel[0], meshesPerLevel[1], meshesPerLevel[2], meshesPerLevel[3]);
+	}
+
+	if (Settings::DepthGeometry_Merge)
+		text.DrawFormattedString("\nOpaque depth draws: %u", DepthGeometry::GetDrawCount());
+
+	if (Settings::ShadowCasterCulling_Enable)
+	{
+		ShadowCasterCulling::Stats stats = ShadowCasterCulling::GetStats();
+		text.DrawFormattedString("\nSun shadow casters: %u of %u, culled in %.2f ms",
+			stats.VisibleCasters, stats.Casters, stats.Milliseconds);
+	}
+
+	if (Settings::ShadowRayCulling_Enable && Settings::RayTracingMode == Settings::RTM_SHADOWS)
+	{
+		for (UINT eye = Cam::kLeft; eye <= Cam::kRight; ++eye)
+		{
+			const ShadowRayCulling::ClassCounters counters = ShadowRayCulling::GetCounters(eye);
+			text.DrawFormattedString("\nShadow rays %s: %u traced, skipped %u sky, %u back facing, %u leaving the scene and %u shadowed by the shadow map",
+				eye == Cam::kLeft ? "left" : "right",
+				counters.Pixels[ShadowRayCulling::kTrace],
+				counters.Pixels[ShadowRayCulling::kSky],
+				counters.Pixels[ShadowRayCulling::kBackFacing],
+				counters.Pixels[ShadowRayCulling::kLeavesScene],
+				counters.Pixels[ShadowRayCulling::kShadowMapShadowed]);
+		}
+	}
 	text.End();
 }
 
@@ -2253,7 +2605,74 @@ void D3D12RaytracingMiniEngineSample::Raytrace(class GraphicsContext& gfxContext
 
 	gfxContext.TransitionResource(g_SSAOFullScreen, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
-	g_initialize_dynamicCb(gfxContext, m_Camera, CurCam, g_SceneColorBuffer, g_dynamicConstantBuffer);
+	// The right eye copies what it can from the left eye and only traces the rest
+	const bool reuseLeftEye = Settings::StereoReuse_Enable && CurCam == Cam::kRight && (
+		Settings::RayTracingMode == Settings::RTM_SHADOWS ||
+		Settings::RayTracingMode == Settings::RTM_DIFFUSE_WITH_SHADOWMAPS ||
+		Settings::RayTracingMode == Settings::RTM_DIFFUSE_WITH_SHADOWRAYS ||
+		Settings::RayTracingMode == Settings::RTM_REFLECTIONS);
+
+	// Reflection rays are only launched for the reflective pixels
+	const bool reflectionMode =
+		Settings::RayTracingMode == Settings::RTM_SSR ||
+		Settings::RayTracingMode == Settings::RTM_REFLECTIONS;
+
+	// Interleaving traces a rotating share of the pixels and rebuilds the rest from the eye's history
+	const InterleavedRays::FrameParams interleave = InterleavedRays::BeginFrame(
+		CurCam, reuseLeftEye ? 1 : GetInterleaveRate(), Settings::RayTracingMode);
+
+	// Only the pixels the lens shows at full density are all traced, the rest are upsampled afterwards.
+	// The right eye traces every pixel stereo reuse could not copy instead, and interleaving takes over
+	// when both are on.
+	const bool foveated = Settings::FoveatedRays_Enable && !reuseLeftEye && !interleave.Active;
+
+	// Shadow rays are skipped wherever the answer is already known
+	const bool cullShadowRays = Settings::ShadowRayCulling_Enable && !reuseLeftEye &&
+		Settings::RayTracingMode == Settings::RTM_SHADOWS;
+
+	bool useRayList = false;
+	if (reuseLeftEye)
+	{
+		StereoReuse::BuildRayList(gfxContext.GetComputeContext(), *m_Camera[Cam::kLeft], *m_Camera[Cam::kRight],
+			Cam::kLeft, Cam::kRight, Settings::RayTracingMode == Settings::RTM_REFLECTIONS);
+		useRayList = true;
+	}
+	else if (cullShadowRays)
+	{
+		if (foveated)
+			RayDensity::Update(gfxContext.GetComputeContext());
+
+		ShadowRayCulling::BuildRayList(gfxContext.GetComputeContext(), CurCam, *m_Camera[CurCam], m_SunDirection,
+			m_SunShadow.GetShadowMatrix(), foveated, interleave.Rate, interleave.Phase);
+		useRayList = true;
+	}
+	else if (reflectionMode || foveated || interleave.Active)
+	{
+		if (foveated)
+			RayDensity::Update(gfxContext.GetComputeContext());
+
+		RayCompaction::BuildRayList(gfxContext.GetComputeContext(), CurCam, reflectionMode, foveated,
+			interleave.Rate, interleave.Phase);
+		useRayList = foveated || interleave.Active || Settings::CompactReflectionRays;
+	}
+	else
+	{
+		gfxContext.TransitionResource(RayCompaction::m_RayList, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	}
+
+	// The list is still built without compaction so the counters show what it would save
+	g_RayListLaunchCount = 0;
+	if (reuseLeftEye || reflectionMode || foveated || interleave.Active || cullShadowRays)
+	{
+		const UINT launchCount = RayCompaction::GetLaunchCount(CurCam);
+		if (useRayList)
+			g_RayListLaunchCount = launchCount;
+
+		RayCompaction::ReadbackRayCount(gfxContext, CurCam,
+			useRayList ? launchCount : g_SceneColorBuffer.GetWidth() * g_SceneColorBuffer.GetHeight());
+	}
+
+	g_initialize_dynamicCb(gfxContext, m_Camera, CurCam, g_SceneColorBuffer, g_dynamicConstantBuffer, useRayList);
 
 	switch (Settings::RayTracingMode)
 	{
@@ -2282,6 +2701,15 @@ void D3D12RaytracingMiniEngineSample::Raytrace(class GraphicsContext& gfxContext
 
 	// Clear the gfxContext's descriptor heap since ray tracing changes this underneath the sheets
 	gfxContext.SetDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, nullptr);
+
+	if (foveated)
+	{
+		RayDensity::Upsample(gfxContext.GetComputeContext(), CurCam, *m_Camera[CurCam], reflectionMode);
+	}
+	else if (interleave.Active)
+	{
+		InterleavedRays::Reconstruct(gfxContext.GetComputeContext(), CurCam, interleave, reflectionMode);
+	}
 }
 
 void D3D12RaytracingMiniEngineSample::TakeScreenshot()
@@ -9,6 +9,9 @@ struct RayPayload
     float RayHitT;
     float Bounces;
     float Reflectivity;
+    uint Pixel;     // Packed x | y << 16, since a ray generation thread may trace several pixels
+    float ConeWidth;    // Footprint width at the ray origin, see RayCones.hlsli
+    float ConeSpread;   // Angle at which the footprint grows
 };
 
 #endif
@@ -24,6 +27,17 @@ struct DynamicCB
 	uint     curCam;
     uint     padding2;
     uint     useSceneLighting;
+    float3   lightClusterMin;
+    float3   lightClusterInvCellSize;
+    uint     lightClusterDimX;
+    uint     lightClusterDimY;
+    uint     lightClusterDimZ;
+    uint     useRayList;
+    float    pixelSpreadAngle;  // Cone spread of a camera ray, see RayCones.h
+    float3   sceneBoundsMin;    // Shadow rays end where they leave the scene, see ShadowRayCulling.h
+    uint     padding3;
+    float3   sceneBoundsMax;
+    uint     padding4;
 };
 #ifdef HLSL
 #ifndef SINGLE
@@ -34,6 +48,9 @@ RaytracingAccelerationStructure g_accel : register(t0);
 
 RWTexture2DArray<float4> g_screenOutput : register(u2);
 
+// The pixels to trace when useRayList is set, see RayCompaction.h.  Dword 0 is the count.
+ByteAddressBuffer g_rayList : register(t17);
+
 cbuffer HitShaderConstants : register(b0)
 {
     float3 SunDirection;
@@ -51,6 +68,44 @@ cbuffer b1 : register(b1)
     DynamicCB g_dynamic;
 };
 
+// A ray list dispatch is sized from the count of an earlier frame, so ray generation shaders loop:
+//
+//     for (uint rayIndex = FirstRayIndex(); rayIndex < GetRayCount(); rayIndex += RayIndexStride())
+//
+// Without a ray list every thread runs once for the pixel at its dispatch index.
+inline uint FirstRayIndex()
+{
+    return DispatchRaysIndex().y * DispatchRaysDimensions().x + DispatchRaysIndex().x;
+}
+
+inline uint RayIndexStride()
+{
+    return DispatchRaysDimensions().x * DispatchRaysDimensions().y;
+}
+
+inline uint GetRayCount()
+{
+    return g_dynamic.useRayList ? g_rayList.Load(0) : RayIndexStride();
+}
+
+inline uint PackRayPixel(uint2 pixel)
+{
+    return pixel.x | pixel.y << 16;
+}
+
+inline uint2 UnpackRayPixel(uint packed)
+{
+    return uint2(packed & 0xffff, packed >> 16);
+}
+
+inline uint2 GetRayPixel(uint rayIndex)
+{
+    if (!g_dynamic.useRayList)
+        return DispatchRaysIndex().xy;
+
+    return UnpackRayPixel(g_rayList.Load(4 + rayIndex * 4));
+}
+
 inline void GenerateCameraRay(uint2 index, out float3 origin, out float3 direction)
 {
     float2 xy = index + 0.5; // center in the middle of the pixel
@@ -0,0 +1,300 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "RayCompaction.h"
+#include "RayDensity.h"
+#include "PipelineState.h"
+#include "RootSignature.h"
+#include "CommandContext.h"
+#include "CommandListManager.h"
+#include "ReadbackBuffer.h"
+#include "BufferManager.h"
+#include <algorithm>
+
+#include "CompiledShaders/CompactRaysCS.h"
+
+using namespace Graphics;
+
+extern ColorBuffer g_SceneNormalBuffer;
+
+namespace Settings
+{
+    BoolVar CompactReflectionRays("Application/Raytracing/Compact Reflection Rays", true);
+}
+
+namespace RayCompaction
+{
+    // Counts are looked at this many frames later, and only read once the fence of the frame that copied them
+    // has completed.  Until then the previous counters are kept.
+    enum { kReadbackFrames = 3 };
+
+    RootSignature m_RootSig;
+    ComputePSO m_CompactRaysCS;
+    ByteAddressBuffer m_RayList;
+
+    uint32_t m_Width;
+    uint32_t m_Height;
+    ReadbackBuffer m_CountReadback[2][kReadbackFrames];
+    uint32_t m_ReadbackLaunched[2][kReadbackFrames];
+    bool m_ReadbackPending[2][kReadbackFrames];
+    uint64_t m_ReadbackFence[2][kReadbackFrames];    // Zero until the copy has been submitted
+    RayCounters m_Counters[2];
+    bool m_HasCounters[2];
+
+    // Must match CompactRaysCS.hlsl
+    __declspec(align(16)) struct CSConstants
+    {
+        uint32_t Resolution[2];
+        uint32_t Slice;
+        uint32_t RequireReflective;
+        uint32_t UseDensityMap;
+        uint32_t TilesX;
+        uint32_t DensityMapOffset;
+        uint32_t InterleaveRate;
+        uint32_t InterleavePhase;
+    };
+}
+
+void RayCompaction::Initialize( uint32_t Width, uint32_t Height )
+{
+    m_RootSig.Reset(3, 0);
+    m_RootSig[0].InitAsConstantBuffer(0);
+    m_RootSig[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, 2);
+    m_RootSig[2].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 0, 1);
+    m_RootSig.Finalize(L"RayCompactionRS");
+
+    m_CompactRaysCS.SetRootSignature(m_RootSig);
+    m_CompactRaysCS.SetComputeShader(g_pCompactRaysCS, sizeof(g_pCompactRaysCS));
+    m_CompactRaysCS.Finalize();
+
+    m_Width = Width;
+    m_Height = Height;
+    m_RayList.Create(L"Ray List", Width * Height + 1, 4);
+
+    for (uint32_t Eye = 0; Eye < 2; ++Eye)
+    {
+        for (uint32_t Slot = 0; Slot < kReadbackFrames; ++Slot)
+        {
+            m_CountReadback[Eye][Slot].Create(L"Ray Count Readback", 1, 4);
+            m_ReadbackPending[Eye][Slot] = false;
+            m_ReadbackFence[Eye][Slot] = 0;
+        }
+        m_HasCounters[Eye] = false;
+    }
+}
+
+void RayCompaction::BuildRayList( ComputeContext& Context, uint32_t Slice, bool RequireReflective, bool UseDensityMap,
+    uint32_t InterleaveRate, uint32_t InterleavePhase )
+{
+    ScopedTimer _prof(L"Compact Rays", Context);
+
+    CSConstants csConstants;
+    csConstants.Resolution[0] = m_Width;
+    csConstants.Resolution[1] = m_Height;
+    csConstants.Slice = Slice;
+    csConstants.RequireReflective = RequireReflective ? 1 : 0;
+    csConstants.UseDensityMap = UseDensityMap ? 1 : 0;
+    csConstants.TilesX = RayDensity::GetTileCountX();
+    csConstants.DensityMapOffset = Slice * RayDensity::GetEyeStride();
+    csConstants.InterleaveRate = InterleaveRate;
+    csConstants.InterleavePhase = InterleavePhase;
+
+    // The count is bumped once per thread group, so it has to start from zero
+    Context.FillBuffer(m_RayList, 0, 0, sizeof(uint32_t));
+
+    Context.SetRootSignature(m_RootSig);
+    Context.SetPipelineState(m_CompactRaysCS);
+
+    Context.TransitionResource(g_SceneNormalBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(RayDensity::m_DensityMap, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(m_RayList, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, true);
+
+    Context.SetDynamicConstantBufferView(0, sizeof(CSConstants), &csConstants);
+    Context.SetDynamicDescriptor(1, 0, g_SceneNormalBuffer.GetSRV());
+    Context.SetDynamicDescriptor(1, 1, RayDensity::m_DensityMap.GetSRV());
+    Context.SetDynamicDescriptor(2, 0, m_RayList.GetUAV());
+
+    Context.Dispatch2D(m_Width, m_Height, 8, 8);
+
+    // The ray generation shaders read the list through the global root signature
+    Context.TransitionResource(m_RayList, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+}
+
+uint32_t RayCompaction::GetLaunchCount( uint32_t Eye )
+{
+    const uint32_t Slot = (uint32_t)(Graphics::GetFrameCount() % kReadbackFrames);
+    const uint64_t FenceValue = m_ReadbackFence[Eye][Slot];
+    if (m_ReadbackPending[Eye][Slot] && FenceValue != 0 && g_CommandManager.IsFenceComplete(FenceValue))
+    {
+        m_Counters[Eye].Launched = m_ReadbackLaunched[Eye][Slot];
+        m_Counters[Eye].Useful = *(const uint32_t*)m_CountReadback[Eye][Slot].Map();
+        m_CountReadback[Eye][Slot].Unmap();
+        m_ReadbackPending[Eye][Slot] = false;
+        m_HasCounters[Eye] = true;
+    }
+
+    if (!m_HasCounters[Eye])
+        return m_Width * m_Height;
+
+    return ComputeLaunchCount(m_Counters[Eye].Useful, m_Width, m_Height);
+}
+
+void RayCompaction::ReadbackRayCount( CommandContext& Context, uint32_t Eye, uint32_t Launched )
+{
+    const uint32_t Slot = (uint32_t)(Graphics::GetFrameCount() % kReadbackFrames);
+
+    Context.TransitionResource(m_RayList, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    Context.CopyBufferRegion(m_CountReadback[Eye][Slot], 0, m_RayList, 0, sizeof(uint32_t));
+    Context.TransitionResource(m_RayList, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+
+    // A copy still in flight from kReadbackFrames ago is replaced, and its count never read
+    m_ReadbackLaunched[Eye][Slot] = Launched;
+    m_ReadbackPending[Eye][Slot] = true;
+    m_ReadbackFence[Eye][Slot] = 0;
+}
+
+void RayCompaction::SetReadbackFence( uint32_t Eye, uint64_t FenceValue )
+{
+    const uint32_t Slot = (uint32_t)(Graphics::GetFrameCount() % kReadbackFrames);
+    if (m_ReadbackPending[Eye][Slot] && m_ReadbackFence[Eye][Slot] == 0)
+        m_ReadbackFence[Eye][Slot] = FenceValue;
+}
+
+RayCompaction::RayCounters RayCompaction::GetCounters( uint32_t Eye )
+{
+    if (!m_HasCounters[Eye])
+    {
+        RayCounters None = {};
+        return None;
+    }
+    return m_Counters[Eye];
+}
+
+uint32_t RayCompaction::ComputeLaunchCount( uint32_t PreviousRayCount, uint32_t Width, uint32_t Height )
+{
+    const uint32_t PixelCount = Width * Height;
+    const uint32_t MinLaunchCount = (PixelCount + kMinLaunchDivisor - 1) / kMinLaunchDivisor;
+    return std::min(PixelCount, std::max(PreviousRayCount, MinLaunchCount));
+}
+
+uint32_t RayCompaction::CompactReflectivePixels( const float* Reflectivity, uint32_t Width, uint32_t Height,
+    std::vector<uint32_t>& RayList )
+{
+    RayList.assign(1, 0);
+
+    for (uint32_t GroupY = 0; GroupY < Height; GroupY += 8)
+    {
+        for (uint32_t GroupX = 0; GroupX < Width; GroupX += 8)
+        {
+            for (uint32_t y = GroupY; y < std::min(GroupY + 8, Height); ++y)
+            {
+                for (uint32_t x = GroupX; x < std::min(GroupX + 8, Width); ++x)
+                {
+                    if (Reflectivity[y * Width + x] != 0.0f)
+                        RayList.push_back(x | y << 16);
+                }
+            }
+        }
+    }
+
+    RayList[0] = (uint32_t)RayList.size() - 1;
+    return RayList[0];
+}
+
+bool RayCompaction::RunSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, uint32_t Value )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("Ray compaction self test failed:  %s (%u)\n", Name, Value);
+            Passed = false;
+        }
+    };
+
+    uint32_t Seed = 12645;
+    auto Random = [&Seed]() -> uint32_t
+    {
+        Seed = Seed * 1664525u + 1013904223u;
+        return Seed >> 8;
+    };
+
+    // Sizes that are not a multiple of the group size, at a few densities of reflective pixels
+    const uint32_t kSizes[][2] = { { 64, 64 }, { 100, 75 }, { 1, 1 }, { 13, 200 } };
+    const uint32_t kPercentReflective[] = { 0, 30, 100 };
+    for (const uint32_t* Size : kSizes)
+    {
+        const uint32_t Width = Size[0];
+        const uint32_t Height = Size[1];
+        for (uint32_t Percent : kPercentReflective)
+        {
+            std::vector<float> Reflectivity(Width * Height);
+            uint32_t ReflectiveCount = 0;
+            for (float& Value : Reflectivity)
+            {
+                Value = Random() % 100 < Percent ? 0.25f : 0.0f;
+                ReflectiveCount += Value != 0.0f ? 1 : 0;
+            }
+
+            std::vector<uint32_t> RayList;
+            const uint32_t RayCount = CompactReflectivePixels(Reflectivity.data(), Width, Height, RayList);
+            Expect(RayCount == ReflectiveCount, "every reflective pixel listed", RayCount);
+            Expect(RayList.size() == RayCount + 1, "list length", (uint32_t)RayList.size());
+
+            std::vector<bool> Listed(Width * Height, false);
+            for (size_t i = 1; i < RayList.size(); ++i)
+            {
+                const uint32_t x = RayList[i] & 0xFFFF;
+                const uint32_t y = RayList[i] >> 16;
+                const bool InRange = x < Width && y < Height;
+                Expect(InRange, "pixel in range", RayList[i]);
+                if (!InRange)
+                    continue;
+                Expect(!Listed[y * Width + x], "pixel listed once", RayList[i]);
+                Expect(Reflectivity[y * Width + x] != 0.0f, "only reflective pixels listed", RayList[i]);
+                Listed[y * Width + x] = true;
+            }
+        }
+    }
+
+    // Whatever the count was when the dispatch was sized, the strided loop in the ray generation shaders
+    // must visit every entry once and no thread may loop more than kMinLaunchDivisor times
+    const uint32_t kWidth = 1280;
+    const uint32_t kHeight = 720;
+    const uint32_t kCounts[] = { 0, 1, 7, 1000, 200000, kWidth * kHeight };
+    for (uint32_t PreviousCount : kCounts)
+    {
+        const uint32_t Launched = ComputeLaunchCount(PreviousCount, kWidth, kHeight);
+        Expect(Launched > 0 && Launched <= kWidth * kHeight, "launch count", Launched);
+        if (Launched == 0)
+            continue;
+
+        for (uint32_t RayCount : kCounts)
+        {
+            std::vector<uint8_t> Visits(RayCount, 0);
+            uint32_t MaxIterations = 0;
+            for (uint32_t Thread = 0; Thread < Launched; ++Thread)
+            {
+                uint32_t Iterations = 0;
+                for (uint32_t RayIndex = Thread; RayIndex < RayCount; RayIndex += Launched)
+                {
+                    ++Visits[RayIndex];
+                    ++Iterations;
+                }
+                MaxIterations = std::max(MaxIterations, Iterations);
+            }
+            Expect(std::all_of(Visits.begin(), Visits.end(), []( uint8_t v ) { return v == 1; }),
+                "strided loop visits every ray once", RayCount);
+            Expect(MaxIterations <= kMinLaunchDivisor, "iterations per thread", MaxIterations);
+        }
+    }
+
+    return Passed;
+}
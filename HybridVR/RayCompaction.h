@@ -0,0 +1,73 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// A compacted list of the pixels that need a ray, so a dispatch only launches threads that do work.
+//
+// The list is filled on the GPU, either with the reflective pixels for the reflection passes, the pixels
+// the ray density map keeps (see RayDensity.h) and this frame's share of interleaved pixels (see
+// InterleavedRays.h), or with the pixels stereo reuse could not copy (see StereoReuse.h).  DispatchRays cannot take its size from a GPU
+// buffer before DXR 1.1, so the count is read back and the dispatch is sized from an earlier frame.  The
+// ray generation shaders stride over the list, which covers every entry however much the count grew.
+//
+// CompactReflectivePixels() is a CPU reference of CompactRaysCS.hlsl without the density map.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class ByteAddressBuffer;
+class CommandContext;
+class ComputeContext;
+
+namespace RayCompaction
+{
+    // Dword 0 holds the number of rays, followed by one pixel per ray packed as x | y << 16
+    extern ByteAddressBuffer m_RayList;
+
+    struct RayCounters
+    {
+        uint32_t Launched;  // Ray generation threads dispatched
+        uint32_t Useful;    // Pixels in the ray list
+    };
+
+    void Initialize( uint32_t Width, uint32_t Height );
+
+    // Fills m_RayList with the pixels of one slice that have any reflectivity in g_SceneNormalBuffer, when
+    // RequireReflective is set, that their tile's rate keeps, when UseDensityMap is set, and that are traced
+    // in this interleaving phase
+    void BuildRayList( ComputeContext& Context, uint32_t Slice, bool RequireReflective, bool UseDensityMap,
+        uint32_t InterleaveRate = 1, uint32_t InterleavePhase = 0 );
+
+    // Threads to launch over this frame's ray list for an eye.  Also picks up the counters copied
+    // kReadbackFrames ago if the GPU has finished with them, so call it once per eye and frame before
+    // ReadbackRayCount().  Otherwise the launch count stays that of the last counters read.
+    uint32_t GetLaunchCount( uint32_t Eye );
+
+    // Copies the count of the list just built to the CPU, along with the threads launched over it
+    void ReadbackRayCount( CommandContext& Context, uint32_t Eye, uint32_t Launched );
+
+    // The fence value returned by Finish() on the context ReadbackRayCount() recorded into this frame.
+    // The count is not read before the GPU has passed it.
+    void SetReadbackFence( uint32_t Eye, uint64_t FenceValue );
+
+    // The latest counters that came back for an eye
+    RayCounters GetCounters( uint32_t Eye );
+
+    // Never less than 1 / kMinLaunchDivisor of the screen, so no thread loops more than that many times
+    enum { kMinLaunchDivisor = 16 };
+    uint32_t ComputeLaunchCount( uint32_t PreviousRayCount, uint32_t Width, uint32_t Height );
+
+    // Fills RayList like the GPU does, one 8x8 group at a time.  Returns the number of rays.
+    uint32_t CompactReflectivePixels( const float* Reflectivity, uint32_t Width, uint32_t Height,
+        std::vector<uint32_t>& RayList );
+
+    // Checks the compaction and that the strided ray generation loop covers every entry exactly once
+    bool RunSelfTest( void );
+}
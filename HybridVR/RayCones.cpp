@@ -0,0 +1,189 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "RayCones.h"
+#include "HitAttributes.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Grazing hits and triangles without UV area would otherwise give an infinite LOD
+    const float kMinCosTheta = 1.0f / 1024.0f;
+    const float kMinUVJacobian = 1e-20f;
+
+    float Dot3( const float A[3], const float B[3] )
+    {
+        return A[0] * B[0] + A[1] * B[1] + A[2] * B[2];
+    }
+
+    void Cross3( const float A[3], const float B[3], float Result[3] )
+    {
+        Result[0] = A[1] * B[2] - A[2] * B[1];
+        Result[1] = A[2] * B[0] - A[0] * B[2];
+        Result[2] = A[0] * B[1] - A[1] * B[0];
+    }
+
+    // Normal change per world unit from vertex a to vertex b
+    float EdgeCurvature( const float Na[3], const float Nb[3], const float UVa[2], const float UVb[2],
+        const float Dpdu[3], const float Dpdv[3] )
+    {
+        const float Du = UVb[0] - UVa[0];
+        const float Dv = UVb[1] - UVa[1];
+        const float Edge[3] = { Dpdu[0] * Du + Dpdv[0] * Dv, Dpdu[1] * Du + Dpdv[1] * Dv, Dpdu[2] * Du + Dpdv[2] * Dv };
+        const float Dn[3] = { Nb[0] - Na[0], Nb[1] - Na[1], Nb[2] - Na[2] };
+        const float EdgeLengthSq = Dot3(Edge, Edge);
+        return EdgeLengthSq > 0.0f ? std::sqrt(Dot3(Dn, Dn) / EdgeLengthSq) : 0.0f;
+    }
+}
+
+namespace RayCones
+{
+    float GetPixelSpreadAngle( float ProjectionYScale, uint32_t Height )
+    {
+        return std::atan(2.0f / (std::fabs(ProjectionYScale) * (float)Height));
+    }
+
+    Cone Propagate( const Cone& Ray, float HitT )
+    {
+        return { Ray.Width + Ray.SpreadAngle * HitT, Ray.SpreadAngle };
+    }
+
+    Cone Reflect( const Cone& Hit, float Curvature )
+    {
+        return { Hit.Width, Hit.SpreadAngle + 2.0f * std::fabs(Curvature) * Hit.Width };
+    }
+
+    float EstimateCurvature( const float N0[3], const float N1[3], const float N2[3],
+        const float UV0[2], const float UV1[2], const float UV2[2], const float Dpdu[3], const float Dpdv[3] )
+    {
+        return std::max(EdgeCurvature(N0, N1, UV0, UV1, Dpdu, Dpdv),
+            std::max(EdgeCurvature(N1, N2, UV1, UV2, Dpdu, Dpdv), EdgeCurvature(N2, N0, UV2, UV0, Dpdu, Dpdv)));
+    }
+
+    float GetSurfaceSpreadAngle( const float DnDx[3], const float DnDy[3] )
+    {
+        return 2.0f * std::sqrt(Dot3(DnDx, DnDx) + Dot3(DnDy, DnDy));
+    }
+
+    float GetTriangleLod( const float Dpdu[3], const float Dpdv[3] )
+    {
+        // |dp/du x dp/dv| is the world area of one unit of UV area
+        float Jacobian[3];
+        Cross3(Dpdu, Dpdv, Jacobian);
+        return -0.5f * std::log2(std::max(std::sqrt(Dot3(Jacobian, Jacobian)), kMinUVJacobian));
+    }
+
+    float GetTextureSizeLod( uint32_t Width, uint32_t Height )
+    {
+        return 0.5f * std::log2((float)Width * (float)Height);
+    }
+
+    float ComputeTextureLod( float TriangleLod, float TextureSizeLod, float ConeWidth, float CosTheta )
+    {
+        return TriangleLod + TextureSizeLod + std::log2(std::fabs(ConeWidth) / std::max(std::fabs(CosTheta), kMinCosTheta));
+    }
+
+    bool RunSelfTest( void )
+    {
+        bool Passed = true;
+        auto Expect = [&Passed]( bool Condition, const char* Name, float Value )
+        {
+            if (!Condition)
+            {
+                Utility::Printf("Ray cone self test failed:  %s (%g)\n", Name, Value);
+                Passed = false;
+            }
+        };
+
+        // A 90 degree camera, 1000 pixels high, looking at a plane textured with 1024 texels per 4 units
+        const uint32_t kHeight = 1000;
+        const float kTexelsPerUV = 1024.0f;
+        const float kUnitsPerUV = 4.0f;
+        const float PixelSpread = GetPixelSpreadAngle(1.0f, kHeight);
+        const float TextureLod = GetTextureSizeLod((uint32_t)kTexelsPerUV, (uint32_t)kTexelsPerUV);
+        const float Dpdu[3] = { kUnitsPerUV, 0, 0 };
+        const float Dpdv[3] = { 0, kUnitsPerUV, 0 };
+        const float TriangleLod = GetTriangleLod(Dpdu, Dpdv);
+
+        // The rasterizer's LOD is log2 of the larger screen derivative in texels
+        auto RasterLod = [&]( float Distance, float CosTheta )
+        {
+            const float PixelWorldSize = Distance * 2.0f / kHeight;
+            return std::log2(PixelWorldSize / CosTheta * kTexelsPerUV / kUnitsPerUV);
+        };
+
+        auto CameraLod = [&]( float Distance, float CosTheta )
+        {
+            const Cone Hit = Propagate({ 0.0f, PixelSpread }, Distance);
+            return ComputeTextureLod(TriangleLod, TextureLod, Hit.Width, CosTheta);
+        };
+
+        float WorstError = 0.0f;
+        for (float Distance = 0.5f; Distance <= 512.0f; Distance *= 2.0f)
+        {
+            WorstError = std::max(WorstError, std::fabs(CameraLod(Distance, 1.0f) - RasterLod(Distance, 1.0f)));
+            WorstError = std::max(WorstError, std::fabs(CameraLod(Distance, 0.5f) - RasterLod(Distance, 0.5f)));
+            WorstError = std::max(WorstError, std::fabs(CameraLod(Distance * 2.0f, 1.0f) - CameraLod(Distance, 1.0f) - 1.0f));
+        }
+        Expect(WorstError < 0.01f, "LOD differs from raster", WorstError);
+
+        // A flat mirror shows the plane as if it was as far away as the whole path
+        {
+            const Cone Mirror = Reflect(Propagate({ 0.0f, PixelSpread }, 10.0f), 0.0f);
+            const Cone Hit = Propagate(Mirror, 30.0f);
+            const float Lod = ComputeTextureLod(TriangleLod, TextureLod, Hit.Width, 1.0f);
+            Expect(Mirror.SpreadAngle == PixelSpread, "flat mirror changed the spread", Mirror.SpreadAngle);
+            Expect(std::fabs(Lod - RasterLod(40.0f, 1.0f)) < 0.01f, "LOD after a flat mirror", Lod);
+        }
+
+        // A triangle on a sphere of radius 5 has a curvature of 1/5, and a mirror ball blurs the reflection
+        {
+            const float kRadius = 5.0f;
+            float P[3][3], N[3][3], UV[3][2];
+            const float Angles[3][2] = { { 0.0f, 0.0f }, { 0.05f, 0.0f }, { 0.0f, 0.05f } };
+            for (uint32_t i = 0; i < 3; ++i)
+            {
+                N[i][0] = std::sin(Angles[i][0]);
+                N[i][1] = std::sin(Angles[i][1]);
+                N[i][2] = std::sqrt(std::max(0.0f, 1.0f - N[i][0] * N[i][0] - N[i][1] * N[i][1]));
+                for (uint32_t c = 0; c < 3; ++c)
+                    P[i][c] = N[i][c] * kRadius;
+                UV[i][0] = P[i][0] * 0.1f;
+                UV[i][1] = P[i][1] * 0.1f;
+            }
+
+            float SphereDpdu[3], SphereDpdv[3];
+            HitAttributes::ComputePartialDerivatives(P[0], P[1], P[2], UV[0], UV[1], UV[2], SphereDpdu, SphereDpdv);
+            const float Curvature = EstimateCurvature(N[0], N[1], N[2], UV[0], UV[1], UV[2], SphereDpdu, SphereDpdv);
+            Expect(std::fabs(Curvature * kRadius - 1.0f) < 0.05f, "sphere curvature", Curvature);
+
+            const float Flat[3] = { 0, 0, 1 };
+            Expect(EstimateCurvature(Flat, Flat, Flat, UV[0], UV[1], UV[2], SphereDpdu, SphereDpdv) == 0.0f,
+                "flat triangle curvature", 0.0f);
+
+            const Cone Ball = Reflect(Propagate({ 0.0f, PixelSpread }, 10.0f), Curvature);
+            const float Lod = ComputeTextureLod(TriangleLod, TextureLod, Propagate(Ball, 30.0f).Width, 1.0f);
+            Expect(Lod > RasterLod(40.0f, 1.0f) + 1.0f, "LOD after a mirror ball", Lod);
+        }
+
+        // Grazing hits and triangles without UV area must not give NaN or infinity
+        {
+            const float Zero[3] = { 0, 0, 0 };
+            const float Lod = ComputeTextureLod(GetTriangleLod(Zero, Zero), TextureLod, 1.0f, 0.0f);
+            Expect(std::isfinite(Lod), "degenerate LOD", Lod);
+
+            const float DnDx[3] = { 0.01f, 0, 0 };
+            const float DnDy[3] = { 0, 0, 0 };
+            Expect(std::fabs(GetSurfaceSpreadAngle(DnDx, DnDy) - 0.02f) < 1e-6f, "G-buffer spread", GetSurfaceSpreadAngle(DnDx, DnDy));
+        }
+
+        return Passed;
+    }
+}
@@ -0,0 +1,62 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// Ray cone texture LOD.  Every ray carries a cone in its payload:  the width of its footprint where it
+// starts and the angle at which the footprint grows.  Camera rays start with zero width and the spread of
+// one pixel.  At a hit the width grows by the spread times the hit distance, and a reflection adds twice
+// the curvature of the surface over the footprint to the spread, so a convex mirror widens the cone and a
+// flat one keeps it.
+//
+// The texture LOD at a hit is the footprint projected onto the surface, measured in texels:
+//
+//     lod = 0.5 * log2(texels per uv area / world area per uv area) + log2(width / |cos(theta)|)
+//
+// which matches the LOD the rasterizer picks for a camera ray.  The functions mirror RayCones.hlsli exactly.
+
+#pragma once
+
+#include <cstdint>
+
+namespace RayCones
+{
+    struct Cone
+    {
+        float Width;
+        float SpreadAngle;
+    };
+
+    // ProjectionYScale is the [1][1] element of the projection matrix, 1 / tan(fovY / 2) when centred
+    float GetPixelSpreadAngle( float ProjectionYScale, uint32_t Height );
+
+    Cone Propagate( const Cone& Ray, float HitT );
+
+    // Curvature is in radians per world unit.  The sign is dropped, so a concave mirror is treated like a
+    // convex one and blurs rather than sharpens.
+    Cone Reflect( const Cone& Hit, float Curvature );
+
+    // Largest change of the vertex normals per world unit along the edges of a triangle.  The edges are
+    // rebuilt from the UVs and dp/du, dp/dv since the hit shaders do not read positions.
+    float EstimateCurvature( const float N0[3], const float N1[3], const float N2[3],
+        const float UV0[2], const float UV1[2], const float UV2[2], const float Dpdu[3], const float Dpdv[3] );
+
+    // Spread a G-buffer surface adds to a reflection, from the normal differences to the neighbouring pixels
+    float GetSurfaceSpreadAngle( const float DnDx[3], const float DnDy[3] );
+
+    // LOD offset of a triangle, without the size of the texture
+    float GetTriangleLod( const float Dpdu[3], const float Dpdv[3] );
+
+    // Offset for the texture's size
+    float GetTextureSizeLod( uint32_t Width, uint32_t Height );
+
+    float ComputeTextureLod( float TriangleLod, float TextureSizeLod, float ConeWidth, float CosTheta );
+
+    // Checks the LOD against the raster LOD of a plane facing the camera and tilted away from it, and
+    // checks that cones widen off curved mirrors and keep their spread off flat ones
+    bool RunSelfTest( void );
+}
@@ -0,0 +1,72 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Ray cone texture LOD, mirrored on the CPU by RayCones.cpp.  The cone travels in RayPayload as ConeWidth,
+// the footprint width where the ray starts, and ConeSpread, the angle at which it grows.
+//
+
+#ifndef RAY_CONES_HLSLI_INCLUDED
+#define RAY_CONES_HLSLI_INCLUDED
+
+// Grazing hits and triangles without UV area would otherwise give an infinite LOD
+#define RAY_CONE_MIN_COS_THETA (1.0 / 1024.0)
+#define RAY_CONE_MIN_UV_JACOBIAN 1e-20
+
+// Footprint width where a ray with a cone of (width, spread) hits at t
+float PropagateRayCone(float width, float spread, float t)
+{
+    return width + spread * t;
+}
+
+// Spread of a reflected cone.  The sign of the curvature is dropped, so concave mirrors blur like convex ones.
+float ReflectRayCone(float width, float spread, float curvature)
+{
+    return spread + 2.0 * abs(curvature) * width;
+}
+
+// Normal change per world unit from vertex a to vertex b, with the edge rebuilt from the UVs
+float EdgeCurvature(float3 na, float3 nb, float2 uva, float2 uvb, float3 dpdu, float3 dpdv)
+{
+    float2 duv = uvb - uva;
+    float3 edge = dpdu * duv.x + dpdv * duv.y;
+    float3 dn = nb - na;
+    float edgeLengthSq = dot(edge, edge);
+    return edgeLengthSq > 0.0 ? sqrt(dot(dn, dn) / edgeLengthSq) : 0.0;
+}
+
+float EstimateCurvature(float3 n0, float3 n1, float3 n2, float2 uv0, float2 uv1, float2 uv2, float3 dpdu, float3 dpdv)
+{
+    return max(EdgeCurvature(n0, n1, uv0, uv1, dpdu, dpdv),
+        max(EdgeCurvature(n1, n2, uv1, uv2, dpdu, dpdv), EdgeCurvature(n2, n0, uv2, uv0, dpdu, dpdv)));
+}
+
+// Spread a G-buffer surface adds to a reflection, from the normal differences to the neighbouring pixels
+float GetSurfaceSpreadAngle(float3 dndx, float3 dndy)
+{
+    return 2.0 * sqrt(dot(dndx, dndx) + dot(dndy, dndy));
+}
+
+// |dp/du x dp/dv| is the world area of one unit of UV area
+float GetTriangleLod(float3 dpdu, float3 dpdv)
+{
+    return -0.5 * log2(max(length(cross(dpdu, dpdv)), RAY_CONE_MIN_UV_JACOBIAN));
+}
+
+float GetTextureSizeLod(Texture2D<float4> tex)
+{
+    uint width, height;
+    tex.GetDimensions(width, height);
+    return 0.5 * log2((float)width * (float)height);
+}
+
+float ComputeTextureLod(float triangleLod, float textureSizeLod, float coneWidth, float cosTheta)
+{
+    return triangleLod + textureSizeLod + log2(abs(coneWidth) / max(abs(cosTheta), RAY_CONE_MIN_COS_THETA));
+}
+
+#endif // RAY_CONES_HLSLI_INCLUDED
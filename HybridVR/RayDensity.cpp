@@ -0,0 +1,642 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "RayDensity.h"
+#include "PipelineState.h"
+#include "RootSignature.h"
+#include "CommandContext.h"
+#include "Camera.h"
+#include "BufferManager.h"
+#include "VR.h"
+#include <algorithm>
+#include <cmath>
+
+#include "CompiledShaders/FoveatedUpsampleCS.h"
+
+using namespace Graphics;
+
+extern ColorBuffer g_SceneNormalBuffer;
+
+namespace Settings
+{
+    BoolVar FoveatedRays_Enable("Application/Raytracing/Foveated Rays", false);
+    BoolVar FoveatedRays_GazeFalloff("Application/Raytracing/Foveated Gaze Falloff", false);
+    NumVar FoveatedRays_GazeX("Application/Raytracing/Foveated Gaze X", 0.5f, 0.0f, 1.0f, 0.01f);
+    NumVar FoveatedRays_GazeY("Application/Raytracing/Foveated Gaze Y", 0.5f, 0.0f, 1.0f, 0.01f);
+    NumVar FoveatedRays_InnerRadius("Application/Raytracing/Foveated Inner Radius", 0.25f, 0.0f, 1.0f, 0.01f);
+    NumVar FoveatedRays_OuterRadius("Application/Raytracing/Foveated Outer Radius", 0.4f, 0.0f, 1.5f, 0.01f);
+}
+
+namespace RayDensity
+{
+    // Display samples per tile along each axis when the lens distortion is sampled
+    enum { kDistortionSamplesPerTile = 2 };
+
+    // Relative linear depth difference that halves an upsampling weight, and the power on the normals' cosine
+    const float kDepthSigma = 0.02f;
+    const float kNormalPower = 8.0f;
+
+    RootSignature m_RootSig;
+    ComputePSO m_UpsampleCS;
+    ByteAddressBuffer m_DensityMap;
+
+    uint32_t m_Width;
+    uint32_t m_Height;
+    uint32_t m_TilesX;
+    uint32_t m_TilesY;
+    uint32_t m_EyeStride;
+
+    DistortionGrid m_Distortion[2];
+    bool m_HasDistortion[2];
+    std::vector<float> m_HiddenTriangles[2];
+    GazeFalloff m_BuiltGaze;
+    bool m_Built;
+
+    // Must match FoveatedUpsampleCS.hlsl
+    __declspec(align(16)) struct CSConstants
+    {
+        uint32_t Resolution[2];
+        uint32_t Slice;
+        uint32_t TilesX;
+        uint32_t DensityMapOffset;
+        uint32_t RequireReflective;
+        float DepthSigma;
+        float NormalPower;
+        float DepthUnproject[4];
+    };
+
+    uint8_t RateForDensity( float RelativeDensity )
+    {
+        if (RelativeDensity > 0.5f)
+            return kRateFull;
+        if (RelativeDensity > 0.25f)
+            return kRateHalf;
+        return kRateQuarter;
+    }
+
+    bool InsideTriangle( const float* Tri, float x, float y )
+    {
+        const float e0 = (Tri[2] - Tri[0]) * (y - Tri[1]) - (Tri[3] - Tri[1]) * (x - Tri[0]);
+        const float e1 = (Tri[4] - Tri[2]) * (y - Tri[3]) - (Tri[5] - Tri[3]) * (x - Tri[2]);
+        const float e2 = (Tri[0] - Tri[4]) * (y - Tri[5]) - (Tri[1] - Tri[5]) * (x - Tri[4]);
+        return (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f) || (e0 <= 0.0f && e1 <= 0.0f && e2 <= 0.0f);
+    }
+
+    GazeFalloff GetGazeSettings( void )
+    {
+        GazeFalloff Gaze;
+        Gaze.Enable = Settings::FoveatedRays_GazeFalloff;
+        Gaze.GazeU = Settings::FoveatedRays_GazeX;
+        Gaze.GazeV = Settings::FoveatedRays_GazeY;
+        Gaze.InnerRadius = Settings::FoveatedRays_InnerRadius;
+        Gaze.OuterRadius = Settings::FoveatedRays_OuterRadius;
+        return Gaze;
+    }
+
+    bool SameGaze( const GazeFalloff& a, const GazeFalloff& b )
+    {
+        return a.Enable == b.Enable && a.GazeU == b.GazeU && a.GazeV == b.GazeV &&
+            a.InnerRadius == b.InnerRadius && a.OuterRadius == b.OuterRadius;
+    }
+
+    // Where the compositor samples the eye buffer for each display pixel, as it uses the green channel
+    bool SampleDistortion( vr::IVRSystem* HMD, vr::EVREye Eye, uint32_t SamplesX, uint32_t SamplesY, DistortionGrid& Grid )
+    {
+        Grid.SamplesX = SamplesX;
+        Grid.SamplesY = SamplesY;
+        Grid.SourceUV.resize((size_t)SamplesX * SamplesY * 2);
+
+        for (uint32_t j = 0; j < SamplesY; ++j)
+        {
+            for (uint32_t i = 0; i < SamplesX; ++i)
+            {
+                vr::DistortionCoordinates_t Coords;
+                if (!HMD->ComputeDistortion(Eye, (float)i / (SamplesX - 1), (float)j / (SamplesY - 1), &Coords))
+                    return false;
+
+                Grid.SourceUV[(j * SamplesX + i) * 2 + 0] = Coords.rfGreen[0];
+                Grid.SourceUV[(j * SamplesX + i) * 2 + 1] = Coords.rfGreen[1];
+            }
+        }
+        return true;
+    }
+
+    void BuildAndUpload( CommandContext* Context )
+    {
+        m_BuiltGaze = GetGazeSettings();
+        m_Built = true;
+
+        std::vector<uint32_t> Data((size_t)m_EyeStride * 2, kRateFull);
+        float TracedFraction[2];
+        for (uint32_t Eye = 0; Eye < 2; ++Eye)
+        {
+            DensityMap Map;
+            BuildDensityMap(m_Width, m_Height, m_HasDistortion[Eye] ? &m_Distortion[Eye] : nullptr,
+                m_HiddenTriangles[Eye], m_BuiltGaze, Map);
+            std::copy(Map.Rates.begin(), Map.Rates.end(), Data.begin() + Eye * m_EyeStride);
+            TracedFraction[Eye] = GetTracedFraction(Map);
+        }
+
+        Utility::Printf("Foveated rays trace %.1f%% of the left eye's pixels and %.1f%% of the right eye's\n",
+            TracedFraction[0] * 100.0f, TracedFraction[1] * 100.0f);
+
+        if (Context == nullptr)
+            m_DensityMap.Create(L"Ray Density Map", (uint32_t)Data.size(), 4, Data.data());
+        else
+            Context->WriteBuffer(m_DensityMap, 0, Data.data(), Data.size() * 4);
+    }
+}
+
+void RayDensity::Initialize( uint32_t Width, uint32_t Height )
+{
+    m_RootSig.Reset(3, 0);
+    m_RootSig[0].InitAsConstantBuffer(0);
+    m_RootSig[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, 3);
+    m_RootSig[2].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 0, 1);
+    m_RootSig.Finalize(L"RayDensityRS");
+
+    m_UpsampleCS.SetRootSignature(m_RootSig);
+    m_UpsampleCS.SetComputeShader(g_pFoveatedUpsampleCS, sizeof(g_pFoveatedUpsampleCS));
+    m_UpsampleCS.Finalize();
+
+    m_Width = Width;
+    m_Height = Height;
+    m_TilesX = (Width + kTileSize - 1) / kTileSize;
+    m_TilesY = (Height + kTileSize - 1) / kTileSize;
+
+    // WriteBuffer copies whole 16 byte blocks
+    m_EyeStride = (m_TilesX * m_TilesY + 3) & ~3u;
+
+    // Without a headset every tile stays at full rate unless the gaze falloff is on
+    vr::IVRSystem* HMD = VR::GetHMD();
+    for (uint32_t Eye = 0; Eye < 2; ++Eye)
+    {
+        const vr::EVREye VREye = Eye == 0 ? vr::Eye_Left : vr::Eye_Right;
+        m_HasDistortion[Eye] = HMD != nullptr && SampleDistortion(HMD, VREye,
+            m_TilesX * kDistortionSamplesPerTile + 1, m_TilesY * kDistortionSamplesPerTile + 1, m_Distortion[Eye]);
+        m_HiddenTriangles[Eye].clear();
+
+        if (HMD != nullptr)
+        {
+            const vr::HiddenAreaMesh_t Mesh = HMD->GetHiddenAreaMesh(VREye);
+            const float* Verts = Mesh.pVertexData != nullptr ? &Mesh.pVertexData[0].v[0] : nullptr;
+            if (Verts != nullptr)
+                m_HiddenTriangles[Eye].assign(Verts, Verts + Mesh.unTriangleCount * 3 * 2);
+        }
+    }
+
+    BuildAndUpload(nullptr);
+}
+
+void RayDensity::Update( ComputeContext& Context )
+{
+    if (m_Built && SameGaze(m_BuiltGaze, GetGazeSettings()))
+        return;
+
+    BuildAndUpload(&Context);
+    Context.TransitionResource(m_DensityMap, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+}
+
+uint32_t RayDensity::GetTileCountX( void )
+{
+    return m_TilesX;
+}
+
+uint32_t RayDensity::GetTileCountY( void )
+{
+    return m_TilesY;
+}
+
+uint32_t RayDensity::GetEyeStride( void )
+{
+    return m_EyeStride;
+}
+
+void RayDensity::Upsample( ComputeContext& Context, uint32_t Slice, const Math::Camera& Camera, bool RequireReflective )
+{
+    ScopedTimer _prof(L"Foveated Upsample", Context);
+
+    CSConstants csConstants;
+    csConstants.Resolution[0] = m_Width;
+    csConstants.Resolution[1] = m_Height;
+    csConstants.Slice = Slice;
+    csConstants.TilesX = m_TilesX;
+    csConstants.DensityMapOffset = Slice * m_EyeStride;
+    csConstants.RequireReflective = RequireReflective ? 1 : 0;
+    csConstants.DepthSigma = kDepthSigma;
+    csConstants.NormalPower = kNormalPower;
+
+    // The eye projections come from the HMD and are not built from the near and far planes, so view space
+    // depth is solved from the projection's z and w columns instead
+    const Math::Matrix4& Proj = Camera.GetProjMatrix();
+    csConstants.DepthUnproject[0] = Proj.GetZ().GetZ();
+    csConstants.DepthUnproject[1] = Proj.GetZ().GetW();
+    csConstants.DepthUnproject[2] = Proj.GetW().GetZ();
+    csConstants.DepthUnproject[3] = Proj.GetW().GetW();
+
+    Context.SetRootSignature(m_RootSig);
+    Context.SetPipelineState(m_UpsampleCS);
+
+    Context.TransitionResource(g_SceneDepthBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(g_SceneNormalBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(m_DensityMap, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(g_SceneColorBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, true);
+
+    Context.SetDynamicConstantBufferView(0, sizeof(CSConstants), &csConstants);
+    Context.SetDynamicDescriptor(1, 0, g_SceneDepthBuffer.GetDepthSRV());
+    Context.SetDynamicDescriptor(1, 1, g_SceneNormalBuffer.GetSRV());
+    Context.SetDynamicDescriptor(1, 2, m_DensityMap.GetSRV());
+    Context.SetDynamicDescriptor(2, 0, g_SceneColorBuffer.GetUAV());
+
+    Context.Dispatch2D(m_Width, m_Height, 8, 8);
+    Context.InsertUAVBarrier(g_SceneColorBuffer);
+}
+
+void RayDensity::BuildDensityMap( uint32_t Width, uint32_t Height, const DistortionGrid* Distortion,
+    const std::vector<float>& HiddenTriangles, const GazeFalloff& Gaze, DensityMap& Map )
+{
+    Map.Width = Width;
+    Map.Height = Height;
+    Map.TilesX = (Width + kTileSize - 1) / kTileSize;
+    Map.TilesY = (Height + kTileSize - 1) / kTileSize;
+    Map.Rates.assign((size_t)Map.TilesX * Map.TilesY, kRateFull);
+
+    // Display pixels per eye buffer pixel, from the area each cell of the display grid covers in the eye
+    // buffer.  A tile keeps the densest cell whose centre lands in it.
+    if (Distortion != nullptr && Distortion->SamplesX > 1 && Distortion->SamplesY > 1)
+    {
+        const uint32_t SamplesX = Distortion->SamplesX;
+        const float* UV = Distortion->SourceUV.data();
+        const float DisplayCellArea = 1.0f / ((SamplesX - 1) * (Distortion->SamplesY - 1));
+
+        std::vector<float> Density(Map.Rates.size(), 0.0f);
+        float MaxDensity = 0.0f;
+        for (uint32_t j = 0; j + 1 < Distortion->SamplesY; ++j)
+        {
+            for (uint32_t i = 0; i + 1 < SamplesX; ++i)
+            {
+                const float* p00 = UV + (j * SamplesX + i) * 2;
+                const float* p10 = p00 + 2;
+                const float* p01 = p00 + SamplesX * 2;
+                const float* p11 = p01 + 2;
+
+                // Half the cross product of the diagonals is the area of any quad
+                const float Area = 0.5f * std::abs((p11[0] - p00[0]) * (p01[1] - p10[1]) - (p11[1] - p00[1]) * (p01[0] - p10[0]));
+                const float u = 0.25f * (p00[0] + p10[0] + p01[0] + p11[0]);
+                const float v = 0.25f * (p00[1] + p10[1] + p01[1] + p11[1]);
+                if (Area < 1e-12f || u < 0.0f || v < 0.0f || u >= 1.0f || v >= 1.0f)
+                    continue;
+
+                const uint32_t TileX = std::min((uint32_t)(u * Width) / kTileSize, Map.TilesX - 1);
+                const uint32_t TileY = std::min((uint32_t)(v * Height) / kTileSize, Map.TilesY - 1);
+                float& TileDensity = Density[TileY * Map.TilesX + TileX];
+                TileDensity = std::max(TileDensity, DisplayCellArea / Area);
+                MaxDensity = std::max(MaxDensity, TileDensity);
+            }
+        }
+
+        // Tiles no cell lands in are shown on less than a cell of the display
+        for (size_t Tile = 0; Tile < Map.Rates.size(); ++Tile)
+            Map.Rates[Tile] = Density[Tile] > 0.0f ? RateForDensity(Density[Tile] / MaxDensity) : (uint8_t)kRateQuarter;
+    }
+
+    if (Gaze.Enable)
+    {
+        for (uint32_t TileY = 0; TileY < Map.TilesY; ++TileY)
+        {
+            for (uint32_t TileX = 0; TileX < Map.TilesX; ++TileX)
+            {
+                const float x = std::min((TileX + 0.5f) * kTileSize, (float)Width) - Gaze.GazeU * Width;
+                const float y = std::min((TileY + 0.5f) * kTileSize, (float)Height) - Gaze.GazeV * Height;
+                const float Radius = std::sqrt(x * x + y * y) / Height;
+
+                const uint8_t GazeRate = Radius <= Gaze.InnerRadius ? (uint8_t)kRateFull :
+                    Radius <= Gaze.OuterRadius ? (uint8_t)kRateHalf : (uint8_t)kRateQuarter;
+                uint8_t& Rate = Map.Rates[TileY * Map.TilesX + TileX];
+                Rate = std::max(Rate, GazeRate);
+            }
+        }
+    }
+
+    // A tile is hidden when 4x4 samples reaching its edge pixels are all under the mesh.  The mesh is drawn
+    // with v pointing up, as HiddenMeshVS.hlsl does.
+    if (!HiddenTriangles.empty())
+    {
+        const float kSampleOffsets[4] = { 0.5f, 0.5f + 7.0f / 3.0f, 0.5f + 14.0f / 3.0f, 7.5f };
+        std::vector<uint16_t> Covered(Map.Rates.size(), 0);
+
+        for (size_t First = 0; First + 6 <= HiddenTriangles.size(); First += 6)
+        {
+            float Tri[6];
+            for (uint32_t Vert = 0; Vert < 3; ++Vert)
+            {
+                Tri[Vert * 2 + 0] = HiddenTriangles[First + Vert * 2 + 0] * Width;
+                Tri[Vert * 2 + 1] = (1.0f - HiddenTriangles[First + Vert * 2 + 1]) * Height;
+            }
+
+            const float MinX = std::min(Tri[0], std::min(Tri[2], Tri[4]));
+            const float MaxX = std::max(Tri[0], std::max(Tri[2], Tri[4]));
+            const float MinY = std::min(Tri[1], std::min(Tri[3], Tri[5]));
+            const float MaxY = std::max(Tri[1], std::max(Tri[3], Tri[5]));
+            if (MaxX < 0.0f || MaxY < 0.0f || MinX >= Width || MinY >= Height)
+                continue;
+
+            const uint32_t FirstTileX = (uint32_t)std::max(MinX, 0.0f) / kTileSize;
+            const uint32_t FirstTileY = (uint32_t)std::max(MinY, 0.0f) / kTileSize;
+            const uint32_t LastTileX = std::min((uint32_t)MaxX / kTileSize, Map.TilesX - 1);
+            const uint32_t LastTileY = std::min((uint32_t)MaxY / kTileSize, Map.TilesY - 1);
+
+            for (uint32_t TileY = FirstTileY; TileY <= LastTileY; ++TileY)
+            {
+                for (uint32_t TileX = FirstTileX; TileX <= LastTileX; ++TileX)
+                {
+                    uint16_t& Mask = Covered[TileY * Map.TilesX + TileX];
+                    for (uint32_t Sample = 0; Sample < 16; ++Sample)
+                    {
+                        const float x = std::min(TileX * kTileSize + kSampleOffsets[Sample % 4], Width - 0.5f);
+                        const float y = std::min(TileY * kTileSize + kSampleOffsets[Sample / 4], Height - 0.5f);
+                        if (InsideTriangle(Tri, x, y))
+                            Mask |= 1 << Sample;
+                    }
+                }
+            }
+        }
+
+        for (size_t Tile = 0; Tile < Map.Rates.size(); ++Tile)
+        {
+            if (Covered[Tile] == 0xFFFF)
+                Map.Rates[Tile] = kRateHidden;
+        }
+    }
+}
+
+bool RayDensity::IsTracedPixel( uint32_t x, uint32_t y, uint32_t Rate )
+{
+    switch (Rate)
+    {
+    case kRateFull:     return true;
+    case kRateHalf:     return ((x ^ y) & 1) == 0;
+    case kRateQuarter:  return ((x | y) & 1) == 0;
+    default:            return false;
+    }
+}
+
+float RayDensity::GetTracedFraction( const DensityMap& Map )
+{
+    uint64_t Traced = 0;
+    for (uint32_t y = 0; y < Map.Height; ++y)
+    {
+        for (uint32_t x = 0; x < Map.Width; ++x)
+        {
+            if (IsTracedPixel(x, y, Map.Rates[(y / kTileSize) * Map.TilesX + x / kTileSize]))
+                ++Traced;
+        }
+    }
+    return (float)((double)Traced / ((double)Map.Width * Map.Height));
+}
+
+void RayDensity::UpsampleReference( const DensityMap& Map, const float* LinearDepth, const float* Normals,
+    bool RequireReflective, float* Color )
+{
+    const int32_t Width = (int32_t)Map.Width;
+    const int32_t Height = (int32_t)Map.Height;
+
+    auto RateAt = [&Map]( int32_t x, int32_t y ) -> uint32_t
+    {
+        return Map.Rates[(y / kTileSize) * Map.TilesX + x / kTileSize];
+    };
+    auto NeedsColor = [&]( int32_t x, int32_t y ) -> bool
+    {
+        return RateAt(x, y) != kRateHidden && (!RequireReflective || Normals[(y * Width + x) * 4 + 3] != 0.0f);
+    };
+
+    for (int32_t y = 0; y < Height; ++y)
+    {
+        for (int32_t x = 0; x < Width; ++x)
+        {
+            if (!NeedsColor(x, y) || IsTracedPixel(x, y, RateAt(x, y)))
+                continue;
+
+            const float Depth = LinearDepth[y * Width + x];
+            const float* Normal = Normals + (y * Width + x) * 4;
+
+            float Sum[4] = {};
+            float TotalWeight = 0.0f;
+            float BestWeight = -1.0f;
+            int32_t Best = -1;
+
+            for (int32_t dy = -1; dy <= 1; ++dy)
+            {
+                for (int32_t dx = -1; dx <= 1; ++dx)
+                {
+                    const int32_t sx = x + dx;
+                    const int32_t sy = y + dy;
+                    if ((dx == 0 && dy == 0) || sx < 0 || sy < 0 || sx >= Width || sy >= Height)
+                        continue;
+                    if (!NeedsColor(sx, sy) || !IsTracedPixel(sx, sy, RateAt(sx, sy)))
+                        continue;
+
+                    const int32_t s = sy * Width + sx;
+                    const float* SampleNormal = Normals + s * 4;
+                    const float NormalDot = Normal[0] * SampleNormal[0] + Normal[1] * SampleNormal[1] + Normal[2] * SampleNormal[2];
+                    const bool HasNormals = Normal[0] != 0.0f || Normal[1] != 0.0f || Normal[2] != 0.0f;
+
+                    float Weight = dx != 0 && dy != 0 ? 0.5f : 1.0f;
+                    Weight *= std::exp2(-std::abs(LinearDepth[s] - Depth) / (Depth * kDepthSigma));
+                    Weight *= HasNormals ? std::pow(std::max(NormalDot, 0.0f), kNormalPower) : 1.0f;
+
+                    for (uint32_t c = 0; c < 4; ++c)
+                        Sum[c] += Weight * Color[s * 4 + c];
+                    TotalWeight += Weight;
+                    if (Weight > BestWeight)
+                    {
+                        BestWeight = Weight;
+                        Best = s;
+                    }
+                }
+            }
+
+            // With no neighbour on the same surface, the closest match is still better than a hole
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                if (TotalWeight > 1e-4f)
+                    Color[(y * Width + x) * 4 + c] = Sum[c] / TotalWeight;
+                else if (Best >= 0)
+                    Color[(y * Width + x) * 4 + c] = Color[Best * 4 + c];
+            }
+        }
+    }
+}
+
+bool RayDensity::RunSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, float Value )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("Ray density self test failed:  %s (%f)\n", Name, Value);
+            Passed = false;
+        }
+    };
+
+    // A synthetic lens:  a display pixel at radius r from the centre samples the eye buffer at r (1 + k r^2),
+    // so the display pixels per eye buffer pixel fall off as 1 / ((1 + 3 k r^2) (1 + k r^2)).
+    const float kLensK = 0.6f;
+    const uint32_t kSize = 1024;
+    const uint32_t kTiles = kSize / kTileSize;
+
+    DistortionGrid Grid;
+    Grid.SamplesX = kTiles * kDistortionSamplesPerTile + 1;
+    Grid.SamplesY = Grid.SamplesX;
+    Grid.SourceUV.resize(Grid.SamplesX * Grid.SamplesY * 2);
+    for (uint32_t j = 0; j < Grid.SamplesY; ++j)
+    {
+        for (uint32_t i = 0; i < Grid.SamplesX; ++i)
+        {
+            const float x = 2.0f * i / (Grid.SamplesX - 1) - 1.0f;
+            const float y = 2.0f * j / (Grid.SamplesY - 1) - 1.0f;
+            const float Scale = 1.0f + kLensK * (x * x + y * y);
+            Grid.SourceUV[(j * Grid.SamplesX + i) * 2 + 0] = 0.5f + 0.5f * x * Scale;
+            Grid.SourceUV[(j * Grid.SamplesX + i) * 2 + 1] = 0.5f + 0.5f * y * Scale;
+        }
+    }
+
+    // The top left corner of the eye buffer is hidden, which is (0, 1) with v pointing up
+    const std::vector<float> Hidden = { 0.0f, 1.0f,  0.3f, 1.0f,  0.0f, 0.7f };
+
+    GazeFalloff NoGaze = {};
+    DensityMap Map;
+    BuildDensityMap(kSize, kSize, &Grid, Hidden, NoGaze, Map);
+
+    // No tile may get fewer rays per display pixel than the centre of the lens
+    for (uint32_t TileY = 0; TileY < kTiles; ++TileY)
+    {
+        for (uint32_t TileX = 0; TileX < kTiles; ++TileX)
+        {
+            const uint32_t Rate = Map.Rates[TileY * kTiles + TileX];
+            if (Rate == kRateHidden)
+                continue;
+
+            // Invert the lens at the tile centre to find the display radius that samples it
+            const float x = 2.0f * (TileX + 0.5f) / kTiles - 1.0f;
+            const float y = 2.0f * (TileY + 0.5f) / kTiles - 1.0f;
+            const float SourceRadius = std::sqrt(x * x + y * y);
+            float r = SourceRadius;
+            for (uint32_t Iteration = 0; Iteration < 20; ++Iteration)
+                r -= (r * (1.0f + kLensK * r * r) - SourceRadius) / (1.0f + 3.0f * kLensK * r * r);
+            const float RelativeDensity = 1.0f / ((1.0f + 3.0f * kLensK * r * r) * (1.0f + kLensK * r * r));
+
+            // Only tiles the display shows are checked
+            const float DisplayX = x * r / std::max(SourceRadius, 1e-6f);
+            const float DisplayY = y * r / std::max(SourceRadius, 1e-6f);
+            if (std::abs(DisplayX) > 1.0f || std::abs(DisplayY) > 1.0f)
+                continue;
+
+            Expect(1.0f / Rate >= RelativeDensity - 0.02f, "tile rate keeps the centre's density", RelativeDensity);
+        }
+    }
+
+    const uint32_t Centre = kTiles / 2;
+    Expect(Map.Rates[Centre * kTiles + Centre] == kRateFull, "centre traced at full rate", Map.Rates[Centre * kTiles + Centre]);
+    Expect(Map.Rates[kTiles * kTiles - 1] > kRateFull, "corner traced below full rate", Map.Rates[kTiles * kTiles - 1]);
+    Expect(Map.Rates[0] == kRateHidden, "hidden corner not traced", Map.Rates[0]);
+
+    // A hidden tile must not hold a single visible pixel
+    const float HiddenEdge = 0.3f * kSize;
+    for (uint32_t TileY = 0; TileY < kTiles; ++TileY)
+    {
+        for (uint32_t TileX = 0; TileX < kTiles; ++TileX)
+        {
+            if (Map.Rates[TileY * kTiles + TileX] != kRateHidden)
+                continue;
+            const float FarCorner = (TileX + 1) * kTileSize - 0.5f + (TileY + 1) * kTileSize - 0.5f;
+            Expect(FarCorner <= HiddenEdge, "hidden tile fully covered", FarCorner);
+        }
+    }
+
+    const float LensFraction = GetTracedFraction(Map);
+
+    GazeFalloff Gaze = { true, 0.5f, 0.5f, 0.1f, 0.2f };
+    DensityMap GazeMap;
+    BuildDensityMap(kSize, kSize, &Grid, Hidden, Gaze, GazeMap);
+    Expect(GazeMap.Rates[Centre * kTiles + Centre] == kRateFull, "gaze point traced at full rate", GazeMap.Rates[Centre * kTiles + Centre]);
+    Expect(GazeMap.Rates[Centre * kTiles + Centre + kTiles * 3 / 10] == kRateQuarter, "outside the gaze at quarter rate",
+        GazeMap.Rates[Centre * kTiles + Centre + kTiles * 3 / 10]);
+    const float GazeFraction = GetTracedFraction(GazeMap);
+    Expect(GazeFraction <= LensFraction, "gaze falloff saves rays", GazeFraction);
+
+    Utility::Printf("Ray density self test:  the lens alone traces %.1f%% of the pixels, with the gaze falloff %.1f%%\n",
+        LensFraction * 100.0f, GazeFraction * 100.0f);
+
+    // Upsampling a near plane with a gradient next to a far plane of another color, with tiles of every rate
+    const uint32_t kEdgeSize = 64;
+    DensityMap EdgeMap;
+    EdgeMap.Width = kEdgeSize;
+    EdgeMap.Height = kEdgeSize;
+    EdgeMap.TilesX = kEdgeSize / kTileSize;
+    EdgeMap.TilesY = kEdgeSize / kTileSize;
+    EdgeMap.Rates.resize(EdgeMap.TilesX * EdgeMap.TilesY);
+    for (uint32_t Tile = 0; Tile < EdgeMap.Rates.size(); ++Tile)
+    {
+        const uint8_t kRates[] = { kRateFull, kRateHalf, kRateQuarter, kRateHalf, kRateQuarter, kRateHidden };
+        EdgeMap.Rates[Tile] = kRates[(Tile % EdgeMap.TilesX + Tile / EdgeMap.TilesX) % 6];
+    }
+
+    const uint32_t kEdge = 29;
+    std::vector<float> Depth(kEdgeSize * kEdgeSize);
+    std::vector<float> Normals(kEdgeSize * kEdgeSize * 4, 0.0f);
+    std::vector<float> Expected(kEdgeSize * kEdgeSize * 4);
+    std::vector<float> Color(kEdgeSize * kEdgeSize * 4);
+    for (uint32_t y = 0; y < kEdgeSize; ++y)
+    {
+        for (uint32_t x = 0; x < kEdgeSize; ++x)
+        {
+            const uint32_t i = y * kEdgeSize + x;
+            const bool Near = x < kEdge;
+            Depth[i] = Near ? 2.0f : 10.0f;
+            Normals[i * 4 + 2] = -1.0f;
+            Normals[i * 4 + 3] = 1.0f;
+            Expected[i * 4 + 0] = Near ? (float)x / kEdgeSize : 0.0f;
+            Expected[i * 4 + 1] = Near ? (float)y / kEdgeSize : 0.0f;
+            Expected[i * 4 + 2] = Near ? 0.0f : 1.0f;
+            Expected[i * 4 + 3] = 1.0f;
+
+            const bool Traced = IsTracedPixel(x, y, EdgeMap.Rates[(y / kTileSize) * EdgeMap.TilesX + x / kTileSize]);
+            for (uint32_t c = 0; c < 4; ++c)
+                Color[i * 4 + c] = Traced ? Expected[i * 4 + c] : -100.0f;
+        }
+    }
+
+    UpsampleReference(EdgeMap, Depth.data(), Normals.data(), true, Color.data());
+
+    float MaxError = 0.0f;
+    for (uint32_t y = 0; y < kEdgeSize; ++y)
+    {
+        for (uint32_t x = 0; x < kEdgeSize; ++x)
+        {
+            const uint32_t i = y * kEdgeSize + x;
+            if (EdgeMap.Rates[(y / kTileSize) * EdgeMap.TilesX + x / kTileSize] == kRateHidden)
+            {
+                Expect(Color[i * 4] == -100.0f, "hidden pixel left alone", Color[i * 4]);
+                continue;
+            }
+
+            // Nothing bleeds across the depth edge, and the gradient is off by at most a pixel's step
+            const bool Near = x < kEdge;
+            Expect(Near ? Color[i * 4 + 2] < 1e-3f : Color[i * 4 + 0] < 1e-3f && Color[i * 4 + 1] < 1e-3f,
+                "no bleeding across the depth edge", (float)i);
+            for (uint32_t c = 0; c < 4; ++c)
+                MaxError = std::max(MaxError, std::abs(Color[i * 4 + c] - Expected[i * 4 + c]));
+        }
+    }
+    Expect(MaxError <= 1.5f / kEdgeSize, "upsampled gradient error", MaxError);
+
+    return Passed;
+}
@@ -0,0 +1,105 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// Lens matched ray density.  The HMD's lens distortion shows the periphery of an eye buffer on far fewer
+// display pixels than the centre, so tracing every pixel there is wasted.  Each 8x8 tile gets one of:
+//
+//     kRateFull       every pixel is traced
+//     kRateHalf       a checkerboard of pixels is traced
+//     kRateQuarter    the top left pixel of every 2x2 quad is traced
+//     kRateHidden     nothing is traced, the tile is under the hidden area mesh
+//
+// A tile gets the lowest rate that still gives it as many rays per display pixel as the centre of the
+// lens, so the centre is traced exactly as before.  An optional gaze falloff lowers the rate further away
+// from a gaze point.  The ray list (see RayCompaction.h) only holds the traced pixels, and Upsample()
+// fills in the others from traced neighbours on the same surface.
+//
+// BuildDensityMap() and UpsampleReference() are CPU references of the GPU passes and take synthetic input
+// in the self test.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class ByteAddressBuffer;
+class ComputeContext;
+namespace Math
+{
+    class Camera;
+}
+
+namespace RayDensity
+{
+    enum { kTileSize = 8 };
+    enum { kRateHidden = 0, kRateFull = 1, kRateHalf = 2, kRateQuarter = 4 };
+
+    // One uint per tile, the left eye's tiles followed by the right eye's
+    extern ByteAddressBuffer m_DensityMap;
+
+    void Initialize( uint32_t Width, uint32_t Height );
+
+    // Rebuilds the density maps when the gaze settings changed
+    void Update( ComputeContext& Context );
+
+    uint32_t GetTileCountX( void );
+    uint32_t GetTileCountY( void );
+
+    // Tiles from the start of one eye's map to the next
+    uint32_t GetEyeStride( void );
+
+    // Fills the pixels of one slice of g_SceneColorBuffer that were skipped because of their tile's rate
+    void Upsample( ComputeContext& Context, uint32_t Slice, const Math::Camera& Camera, bool RequireReflective );
+
+    // Where each display pixel samples the eye buffer, on a regular grid over the display.  Both are in
+    // texture coordinates with the origin in the top left.
+    struct DistortionGrid
+    {
+        uint32_t SamplesX;
+        uint32_t SamplesY;
+        std::vector<float> SourceUV;
+    };
+
+    struct GazeFalloff
+    {
+        bool Enable;
+        float GazeU;
+        float GazeV;
+        float InnerRadius;      // Full rate inside, as a fraction of the buffer height
+        float OuterRadius;      // Quarter rate outside, half rate in between
+    };
+
+    struct DensityMap
+    {
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t TilesX;
+        uint32_t TilesY;
+        std::vector<uint8_t> Rates;
+    };
+
+    // Distortion may be null for a display without lenses.  HiddenTriangles holds the hidden area mesh as
+    // OpenVR returns it:  three (u, v) pairs per triangle, with v pointing up.
+    void BuildDensityMap( uint32_t Width, uint32_t Height, const DistortionGrid* Distortion,
+        const std::vector<float>& HiddenTriangles, const GazeFalloff& Gaze, DensityMap& Map );
+
+    bool IsTracedPixel( uint32_t x, uint32_t y, uint32_t Rate );
+
+    // Fraction of the buffer's pixels that get a ray
+    float GetTracedFraction( const DensityMap& Map );
+
+    // Same weights as FoveatedUpsampleCS.hlsl, but on linear depth.  Normals hold xyz and the reflectivity
+    // in w, and Color holds rgba.  Only the skipped pixels of Color are written.
+    void UpsampleReference( const DensityMap& Map, const float* LinearDepth, const float* Normals,
+        bool RequireReflective, float* Color );
+
+    // Checks the density map against the analytic density of a synthetic lens, checks the upsampler on a
+    // synthetic depth edge, and prints the rays saved
+    bool RunSelfTest( void );
+}
@@ -16,18 +16,25 @@
 [shader("raygeneration")]
 void RayGen()
 {
-    float3 origin, direction;
-    GenerateCameraRay(DispatchRaysIndex().xy, origin, direction);
+    for (uint rayIndex = FirstRayIndex(); rayIndex < GetRayCount(); rayIndex += RayIndexStride())
+    {
+        uint2 pixel = GetRayPixel(rayIndex);
 
-    RayDesc rayDesc = { origin,
-        0.0f,
-        direction,
-        FLT_MAX };
-    RayPayload payload;
-    payload.SkipShading = false;
-    payload.RayHitT = FLT_MAX;
-    payload.Bounces = 0;
-	payload.Reflectivity = 1;
-	TraceRay(g_accel, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, ~0, 0, 1, 0, rayDesc, payload);
-}
+        float3 origin, direction;
+        GenerateCameraRay(pixel, origin, direction);
 
+        RayDesc rayDesc = { origin,
+            0.0f,
+            direction,
+            FLT_MAX };
+        RayPayload payload;
+        payload.SkipShading = false;
+        payload.RayHitT = FLT_MAX;
+        payload.Bounces = 0;
+        payload.Reflectivity = 1;
+        payload.Pixel = PackRayPixel(pixel);
+        payload.ConeWidth = 0;
+        payload.ConeSpread = g_dynamic.pixelSpreadAngle;
+        TraceRay(g_accel, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, ~0, 0, 1, 0, rayDesc, payload);
+    }
+}
@@ -11,60 +11,79 @@
 
 #define HLSL
 #include "ModelViewerRaytracing.h"
+#include "RayCones.hlsli"
 
 Texture2DArray<float>    depth    : register(t12);
 Texture2DArray<float4>   normals  : register(t13);
 
+// The smaller of the one-sided normal differences to two neighbours, so a silhouette on one side does not
+// count as curvature
+float3 GetNormalDifference(float3 normal, int2 before, int2 after)
+{
+    float3 toBefore = normal - normals.Load(int4(before, g_dynamic.curCam, 0)).xyz;
+    float3 toAfter = normals.Load(int4(after, g_dynamic.curCam, 0)).xyz - normal;
+    return dot(toBefore, toBefore) < dot(toAfter, toAfter) ? toBefore : toAfter;
+}
+
 [shader("raygeneration")]
 void RayGen()
 {
-    uint2 DTid = DispatchRaysIndex().xy;
-    float2 xy = DTid.xy + 0.5;
+    for (uint rayIndex = FirstRayIndex(); rayIndex < GetRayCount(); rayIndex += RayIndexStride())
+    {
+        uint2 DTid = GetRayPixel(rayIndex);
+        float2 xy = DTid.xy + 0.5;
 
-    // Screen position for the ray
-    float2 screenPos = xy / g_dynamic.resolution * 2.0 - 1.0;
+        // Screen position for the ray
+        float2 screenPos = xy / g_dynamic.resolution * 2.0 - 1.0;
 
-    // Invert Y for DirectX-style coordinates
-    screenPos.y =  -screenPos.y;
+        // Invert Y for DirectX-style coordinates
+        screenPos.y =  -screenPos.y;
 
-    float2 readGBufferAt = xy;
+        float2 readGBufferAt = xy;
 
-    // Read depth and normal
-    float sceneDepth = depth.Load(int4(readGBufferAt, g_dynamic.curCam, 0));
-    float4 normalData = normals.Load(int4(readGBufferAt, g_dynamic.curCam, 0));
-    if (normalData.w == 0.0)
-        return;
+        // Read depth and normal
+        float sceneDepth = depth.Load(int4(readGBufferAt, g_dynamic.curCam, 0));
+        float4 normalData = normals.Load(int4(readGBufferAt, g_dynamic.curCam, 0));
+        if (normalData.w == 0.0)
+            continue;
 
 #ifdef VALIDATE_NORMAL
-    // Check if normal is real and non-zero
-    float lenSq = dot(normalData.xyz, normalData.xyz);
-    if (!isfinite(lenSq) || lenSq < 1e-6)
-        return;
-    float3 normal = normalData.xyz * rsqrt(lenSq);
+        // Check if normal is real and non-zero
+        float lenSq = dot(normalData.xyz, normalData.xyz);
+        if (!isfinite(lenSq) || lenSq < 1e-6)
+            continue;
+        float3 normal = normalData.xyz * rsqrt(lenSq);
 #else
-    float3 normal = normalData.xyz;
+        float3 normal = normalData.xyz;
 #endif
 
-    // Unproject into the world position using depth
-    float4 unprojected = mul(g_dynamic.cameraToWorld, float4(screenPos, sceneDepth, 1));
-    float3 world = unprojected.xyz / unprojected.w;
+        // Unproject into the world position using depth
+        float4 unprojected = mul(g_dynamic.cameraToWorld, float4(screenPos, sceneDepth, 1));
+        float3 world = unprojected.xyz / unprojected.w;
 
-	float3 primaryRayDirection = normalize(world - g_dynamic.worldCameraPosition);
+        float3 primaryRayDirection = normalize(world - g_dynamic.worldCameraPosition);
 
-    // R
-	float3 direction = reflect(primaryRayDirection, normal);
-    float3 origin = world - primaryRayDirection * 0.1f;     // Lift off the surface a bit
+        // R
+        float3 direction = reflect(primaryRayDirection, normal);
+        float3 origin = world - primaryRayDirection * 0.1f;     // Lift off the surface a bit
 
-    RayDesc rayDesc = { origin,
-        0.0f,
-        direction,
-        FLT_MAX };
+        RayDesc rayDesc = { origin,
+            0.0f,
+            direction,
+            FLT_MAX };
 
-    RayPayload payload;
-    payload.SkipShading = false;
-    payload.RayHitT = FLT_MAX;
-    payload.Bounces = 1;
-	payload.Reflectivity = normalData.w;
-    TraceRay(g_accel, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, ~0,0,1,0, rayDesc, payload);
-}
+        RayPayload payload;
+        payload.SkipShading = false;
+        payload.RayHitT = FLT_MAX;
+        payload.Bounces = 1;
+        payload.Reflectivity = normalData.w;
+        payload.Pixel = PackRayPixel(DTid);
 
+        // The cone starts on the G-buffer surface, widened by the curvature of the surface
+        float3 dndx = GetNormalDifference(normal, int2(DTid) - int2(1, 0), int2(DTid) + int2(1, 0));
+        float3 dndy = GetNormalDifference(normal, int2(DTid) - int2(0, 1), int2(DTid) + int2(0, 1));
+        payload.ConeWidth = length(world - g_dynamic.worldCameraPosition) * g_dynamic.pixelSpreadAngle;
+        payload.ConeSpread = g_dynamic.pixelSpreadAngle + GetSurfaceSpreadAngle(dndx, dndy);
+        TraceRay(g_accel, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, ~0,0,1,0, rayDesc, payload);
+    }
+}
@@ -11,48 +11,56 @@
 
 #define HLSL
 #include "ModelViewerRaytracing.h"
+#include "ShadowRayCulling.hlsli"
 
-Texture2D<float>    depth    : register(t12);
+Texture2DArray<float>    depth    : register(t12);
 
 [shader("raygeneration")]
 void RayGen()
 {
-    uint2 DTid = DispatchRaysIndex().xy;
-    float2 xy = DTid.xy + 0.5;
+    for (uint rayIndex = FirstRayIndex(); rayIndex < GetRayCount(); rayIndex += RayIndexStride())
+    {
+        uint2 DTid = GetRayPixel(rayIndex);
+        float2 xy = DTid.xy + 0.5;
 
-    // Screen position for the ray
-    float2 screenPos = xy / g_dynamic.resolution * 2.0 - 1.0;
+        // Screen position for the ray
+        float2 screenPos = xy / g_dynamic.resolution * 2.0 - 1.0;
 
-    // Invert Y for DirectX-style coordinates
-    screenPos.y = -screenPos.y;
+        // Invert Y for DirectX-style coordinates
+        screenPos.y = -screenPos.y;
 
-    float2 readGBufferAt = xy;
+        float2 readGBufferAt = xy;
 
-    // Read depth and normal
-    float sceneDepth = depth.Load(int3(readGBufferAt, 0));
+        // Read depth and normal
+        float sceneDepth = depth.Load(int4(readGBufferAt, g_dynamic.curCam, 0));
 
-    // Unproject into the world position using depth
-    float4 unprojected = mul(g_dynamic.cameraToWorld, float4(screenPos, sceneDepth, 1));
-    float3 world = unprojected.xyz / unprojected.w;
+        // Unproject into the world position using depth
+        float4 unprojected = mul(g_dynamic.cameraToWorld, float4(screenPos, sceneDepth, 1));
+        float3 world = unprojected.xyz / unprojected.w;
 
-    // R
-    float3 direction = SunDirection;
-    float3 origin = world;
+        // R
+        float3 direction = SunDirection;
+        float3 origin = world;
 
-    RayDesc rayDesc = { origin,
-        0.1f,
-        direction,
-        FLT_MAX };
-	RayPayload payload = { false, FLT_MAX, 0, 0 };
-    TraceRay(g_accel, RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH, ~0,0,1,0, rayDesc, payload);
+        // Nothing can be hit once the ray leaves the scene's bounding box
+        float maxT = GetShadowRayMaxT(origin, direction, g_dynamic.sceneBoundsMin, g_dynamic.sceneBoundsMax);
 
-    if (payload.RayHitT < FLT_MAX)
-    {
-        g_screenOutput[int3(DispatchRaysIndex().xy, g_dynamic.curCam)] = float4(0, 0, 0, 1);
-    }
-    else
-    {
-        g_screenOutput[int3(DispatchRaysIndex().xy, g_dynamic.curCam)] = float4(1, 1, 1, 1);
+        RayDesc rayDesc = { origin,
+            0.1f,
+            direction,
+            max(maxT, 0.1f) };
+        // The cone starts on the G-buffer surface
+        float coneWidth = length(world - g_dynamic.worldCameraPosition) * g_dynamic.pixelSpreadAngle;
+        RayPayload payload = { false, FLT_MAX, 0, 0, PackRayPixel(DTid), coneWidth, g_dynamic.pixelSpreadAngle };
+        TraceRay(g_accel, RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH, ~0,0,1,0, rayDesc, payload);
+
+        if (payload.RayHitT < FLT_MAX)
+        {
+            g_screenOutput[int3(DTid, g_dynamic.curCam)] = float4(0, 0, 0, 1);
+        }
+        else
+        {
+            g_screenOutput[int3(DTid, g_dynamic.curCam)] = float4(1, 1, 1, 1);
+        }
     }
 }
-
@@ -6,16 +6,15 @@
 #endif
 
 
+// Offsets into g_attributes, which holds the packed hit attributes described in HitAttributes.h
 struct RayTraceMeshInfo
 {
     uint  m_indexOffsetBytes;
-    uint  m_uvAttributeOffsetBytes;
-    uint  m_normalAttributeOffsetBytes;
-    uint  m_tangentAttributeOffsetBytes;
-    uint  m_bitangentAttributeOffsetBytes;
-    uint  m_positionAttributeOffsetBytes;
-    uint  m_attributeStrideBytes;
+    uint  m_vertexOffsetBytes;      // Packed vertex of index 0
+    uint  m_triangleOffsetBytes;    // Packed triangle of PrimitiveIndex() 0
     uint  m_materialInstanceId;
+    float2 m_uvOffset;              // Packed UVs are quantized to the UV bounds of the mesh
+    float2 m_uvScale;
 };
 
 #endif //RAYTRACING_USER_HLSL_COMPAT_H_INCLUDED
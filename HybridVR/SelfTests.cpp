@@ -0,0 +1,87 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "SelfTests.h"
+#include "TriangleOpacity.h"
+#include "FileUtility.h"
+#include "ChunkedFile.h"
+#include "SceneArchive.h"
+#include "TransientMemoryPlanner.h"
+#include "BuddyAllocator.h"
+#include "HitAttributes.h"
+#include "RayCompaction.h"
+#include "StereoReuse.h"
+#include "RayDensity.h"
+#include "InterleavedRays.h"
+#include "RayCones.h"
+#include "ShadowRayCulling.h"
+#include "AccelerationStructures.h"
+#include "MeshletCulling.h"
+#include "LevelOfDetail.h"
+#include "DepthGeometry.h"
+#include "ShadowCasterCulling.h"
+#include "ForwardPlusLighting.h"
+#include <cwchar>
+
+namespace
+{
+    struct SelfTest
+    {
+        const char* Name;
+        bool (*Run)( void );
+    };
+
+    const SelfTest kSelfTests[] =
+    {
+        { "Transient memory planning", TransientMemoryPlanner::RunSelfTest },
+        { "Buddy allocation", BuddyAllocator::RunSelfTest },
+        { "Triangle opacity classification", TriangleOpacity::RunSelfTest },
+        { "Hit attribute packing", HitAttributes::RunSelfTest },
+        { "Ray compaction", RayCompaction::RunSelfTest },
+        { "Stereo reuse classification", StereoReuse::RunSelfTest },
+        { "Foveated ray density", RayDensity::RunSelfTest },
+        { "Interleaved ray reconstruction", InterleavedRays::RunSelfTest },
+        { "Ray cone texture LOD", RayCones::RunSelfTest },
+        { "Shadow ray culling", ShadowRayCulling::RunSelfTest },
+        { "Acceleration structure scheduling", AccelerationStructures::RunSelfTest },
+        { "Meshlet culling", MeshletCulling::RunSelfTest },
+        { "Level of detail selection", LevelOfDetail::RunSelfTest },
+        { "Merged depth geometry", DepthGeometry::RunSelfTest },
+        { "Shadow caster culling", ShadowCasterCulling::RunSelfTest },
+        { "Light clusters", Lighting::RunSelfTest },
+        { "Zipped file decompression", Utility::RunInflateSelfTest },
+        { "Chunked file packing", ChunkedFile::RunSelfTest },
+        { "Scene archive lookup", SceneArchive::RunSelfTest },
+    };
+}
+
+bool SelfTests::Requested( int argc, wchar_t** argv )
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::wcscmp(argv[i], L"-selftest") == 0)
+            return true;
+    }
+    return false;
+}
+
+bool SelfTests::Run( void )
+{
+    const uint32_t TestCount = _countof(kSelfTests);
+    uint32_t FailedCount = 0;
+    for (const SelfTest& Test : kSelfTests)
+    {
+        const bool Passed = Test.Run();
+        Utility::Printf("%s:  %s\n", Test.Name, Passed ? "passed" : "FAILED");
+        FailedCount += Passed ? 0 : 1;
+    }
+
+    Utility::Printf("%u of %u self tests passed\n", TestCount - FailedCount, TestCount);
+    return FailedCount == 0;
+}
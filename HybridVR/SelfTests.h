@@ -0,0 +1,23 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// The CPU checks of the modules the sample is built from, each a RunSelfTest() next to the code it checks.
+// Starting the sample with -selftest runs them all in place of the sample, in any configuration, and exits
+// with 0 only when every one passed.  A normal launch runs none of them.
+
+#pragma once
+
+namespace SelfTests
+{
+    // Whether the command line holds -selftest
+    bool Requested( int argc, wchar_t** argv );
+
+    // Runs every self test, even after one fails, prints which failed, and returns whether all passed
+    bool Run( void );
+}
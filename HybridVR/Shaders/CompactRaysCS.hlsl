@@ -0,0 +1,54 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Lists the pixels the ray generation shaders trace:  the reflective ones for the reflection passes, only
+// those the tile's rate keeps when the ray density map is used, and only this frame's share when rays are
+// interleaved.  RayCompaction.cpp has a CPU
+// reference of the reflective compaction.
+//
+
+#include "RayCompactionCS.hlsli"
+#include "RayDensity.hlsli"
+#include "InterleavedRays.hlsli"
+
+cbuffer CSConstants : register(b0)
+{
+    uint2 Resolution;
+    uint Slice;
+    uint RequireReflective;
+    uint UseDensityMap;
+    uint TilesX;
+    uint DensityMapOffset;
+    uint InterleaveRate;
+    uint InterleavePhase;
+};
+
+Texture2DArray<float4> Normals : register(t0);
+ByteAddressBuffer DensityMap : register(t1);
+RWByteAddressBuffer RayList : register(u0);
+
+#define _RootSig \
+    "RootFlags(0), " \
+    "CBV(b0), " \
+    "DescriptorTable(SRV(t0, numDescriptors = 2))," \
+    "DescriptorTable(UAV(u0, numDescriptors = 1))"
+
+[RootSignature(_RootSig)]
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID, uint GI : SV_GroupIndex)
+{
+    bool needsRay = all(DTid.xy < Resolution);
+    if (needsRay && RequireReflective)
+        needsRay = Normals[uint3(DTid.xy, Slice)].w != 0.0;
+    if (needsRay && UseDensityMap)
+        needsRay = IsTracedPixel(DTid.xy, LoadTileRate(DensityMap, DensityMapOffset, TilesX, DTid.xy));
+    if (needsRay)
+        needsRay = IsInterleavedPixel(DTid.xy, InterleaveRate, InterleavePhase);
+
+    AppendRayPixel(RayList, GI, DTid.xy, needsRay);
+}
@@ -0,0 +1,41 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "ModelViewerRS.hlsli"
+
+cbuffer VSConstants : register(b0)
+{
+    float4x4 modelToProjection;
+};
+
+// DepthGeometry::Vertex
+struct VSInput
+{
+    float3 position : POSITION;     // snorm16 within the bounding box of its mesh
+    uint meshIndex : MESHINDEX;
+};
+
+// DepthGeometry::MeshDequantization
+struct MeshDequantization
+{
+    float3 positionScale;
+    float3 positionOffset;
+};
+
+StructuredBuffer<MeshDequantization> meshes : register(t0);
+
+[RootSignature(ModelViewer_RootSig)]
+float4 main(VSInput vsInput) : SV_Position
+{
+    MeshDequantization mesh = meshes[vsInput.meshIndex];
+
+    // The same expression as ModelViewerVS, so the color pass finds the same depth
+    float3 position = mesh.positionOffset + mesh.positionScale * vsInput.position;
+    return mul(modelToProjection, float4(position, 1.0));
+}
@@ -19,13 +19,21 @@ cbuffer VSConstants : register(b0)
     float4x4 modelToProjection;
 };
 
+// Model::QuantizedVertex
 struct VSInput
 {
     float3 position : POSITION;
     float2 texcoord0 : TEXCOORD;
     float3 normal : NORMAL;
-    float3 tangent : TANGENT;
-    float3 bitangent : BITANGENT;
+    float4 tangent : TANGENT;
+};
+
+cbuffer StartVertex : register(b1)
+{
+    float3 positionScale;
+    uint baseVertex;
+    float3 positionOffset;
+    uint materialIdx;
 };
 
 struct VSOutput
@@ -39,8 +47,9 @@ struct VSOutput
 VSOutput main(VSInput vsInput)
 {
     VSOutput vsOutput;
-    vsOutput.pos = mul(modelToProjection, float4(vsInput.position, 1.0));
+    float3 position = positionOffset + positionScale * vsInput.position;
+    vsOutput.pos = mul(modelToProjection, float4(position, 1.0));
     vsOutput.uv = vsInput.texcoord0;
-    vsOutput.worldPos = vsInput.position;
+    vsOutput.worldPos = position;
     return vsOutput;
 }
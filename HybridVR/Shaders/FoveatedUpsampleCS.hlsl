@@ -0,0 +1,107 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Fills the pixels the ray density map skipped from their traced 3x3 neighbours, weighted by how close
+// their linear depth and normal are so colors do not bleed across edges.  Only skipped pixels are
+// written, so the traced ones can be read in place.  RayDensity::UpsampleReference() is the CPU version.
+//
+
+#include "RayDensity.hlsli"
+
+cbuffer CSConstants : register(b0)
+{
+    uint2 Resolution;
+    uint Slice;
+    uint TilesX;
+    uint DensityMapOffset;
+    uint RequireReflective;
+    float DepthSigma;
+    float NormalPower;
+    float4 DepthUnproject;  // The z and w of the projection's z column, then of its w column
+};
+
+Texture2DArray<float> Depth : register(t0);
+Texture2DArray<float4> Normals : register(t1);
+ByteAddressBuffer DensityMap : register(t2);
+RWTexture2DArray<float4> Color : register(u0);
+
+#define _RootSig \
+    "RootFlags(0), " \
+    "CBV(b0), " \
+    "DescriptorTable(SRV(t0, numDescriptors = 3))," \
+    "DescriptorTable(UAV(u0, numDescriptors = 1))"
+
+float LinearDepth(uint2 pixel)
+{
+    float depth = Depth[uint3(pixel, Slice)];
+    return abs((DepthUnproject.z - depth * DepthUnproject.w) / (depth * DepthUnproject.y - DepthUnproject.x));
+}
+
+uint TileRate(uint2 pixel)
+{
+    return LoadTileRate(DensityMap, DensityMapOffset, TilesX, pixel);
+}
+
+bool NeedsColor(uint2 pixel, float4 normal)
+{
+    return TileRate(pixel) != RAY_RATE_HIDDEN && (!RequireReflective || normal.w != 0.0);
+}
+
+[RootSignature(_RootSig)]
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+    uint2 pixel = DTid.xy;
+    if (any(pixel >= Resolution))
+        return;
+
+    float4 normal = Normals[uint3(pixel, Slice)];
+    if (!NeedsColor(pixel, normal) || IsTracedPixel(pixel, TileRate(pixel)))
+        return;
+
+    float depth = LinearDepth(pixel);
+    bool hasNormal = any(normal.xyz != 0.0);
+
+    float4 sum = 0.0;
+    float totalWeight = 0.0;
+    float bestWeight = -1.0;
+    int2 best = -1;
+
+    for (int dy = -1; dy <= 1; ++dy)
+    {
+        for (int dx = -1; dx <= 1; ++dx)
+        {
+            int2 neighbour = int2(pixel) + int2(dx, dy);
+            if ((dx == 0 && dy == 0) || any(neighbour < 0) || any(neighbour >= int2(Resolution)))
+                continue;
+
+            float4 neighbourNormal = Normals[uint3(neighbour, Slice)];
+            if (!NeedsColor(neighbour, neighbourNormal) || !IsTracedPixel(neighbour, TileRate(neighbour)))
+                continue;
+
+            float weight = dx != 0 && dy != 0 ? 0.5 : 1.0;
+            weight *= exp2(-abs(LinearDepth(neighbour) - depth) / (depth * DepthSigma));
+            weight *= hasNormal ? pow(saturate(dot(normal.xyz, neighbourNormal.xyz)), NormalPower) : 1.0;
+
+            float4 neighbourColor = Color[uint3(neighbour, Slice)];
+            sum += weight * neighbourColor;
+            totalWeight += weight;
+            if (weight > bestWeight)
+            {
+                bestWeight = weight;
+                best = neighbour;
+            }
+        }
+    }
+
+    // With no neighbour on the same surface, the closest match is still better than a hole
+    if (totalWeight > 1e-4)
+        Color[uint3(pixel, Slice)] = sum / totalWeight;
+    else if (best.x >= 0)
+        Color[uint3(pixel, Slice)] = Color[uint3(best, Slice)];
+}
@@ -0,0 +1,22 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// The rotating pattern of interleaved ray tracing.  Must match InterleavedRays::IsTracedPixel().
+//
+
+bool IsInterleavedPixel(uint2 pixel, uint rate, uint phase)
+{
+    // The pixel of each 2x2 quad traced in each phase, as x | y << 1
+    static const uint quadOrder[4] = { 0, 3, 1, 2 };
+
+    if (rate == 2)
+        return ((pixel.x + pixel.y + phase) & 1) == 0;
+    if (rate == 4)
+        return ((pixel.x & 1) | (pixel.y & 1) << 1) == quadOrder[phase & 3];
+    return true;
+}
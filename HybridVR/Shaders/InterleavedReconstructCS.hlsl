@@ -0,0 +1,137 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Reconstructs the pixels interleaved ray tracing skipped this frame from the eye's reprojected history,
+// or from traced neighbours where the history is rejected, and writes the whole image as the next
+// history.  Only skipped pixels of Color are written, so the traced ones can be read in place.
+// InterleavedRays::ReconstructReference() is the CPU version.
+//
+
+#include "InterleavedRays.hlsli"
+#include "../../MiniEngine/Core/Shaders/PixelPacking_Velocity.hlsli"
+
+cbuffer CSConstants : register(b0)
+{
+    uint2 Resolution;
+    uint Slice;
+    uint Rate;
+    uint Phase;
+    uint RequireReflective;
+    float MaxVelocity;
+    float DepthTolerance;
+};
+
+Texture2D<float> LinearDepth : register(t0);
+Texture2D<packed_velocity_t> Velocity : register(t1);
+Texture2DArray<float4> Normals : register(t2);
+Texture2DArray<float4> History : register(t3);
+RWTexture2DArray<float4> Color : register(u0);
+RWTexture2DArray<float4> NewHistory : register(u1);
+
+#define _RootSig \
+    "RootFlags(0), " \
+    "CBV(b0), " \
+    "DescriptorTable(SRV(t0, numDescriptors = 4))," \
+    "DescriptorTable(UAV(u0, numDescriptors = 2))"
+
+bool NeedsColor(uint2 pixel)
+{
+    return !RequireReflective || Normals[uint3(pixel, Slice)].w != 0.0;
+}
+
+// Bilinear history from where the velocity says the surface was, skipping taps of other surfaces
+bool ReprojectHistory(uint2 pixel, float depth, out float3 color)
+{
+    color = 0.0;
+
+    float3 velocity = UnpackVelocity(Velocity[pixel]);
+    if (length(velocity.xy) > MaxVelocity)
+        return false;
+
+    float2 prevPos = pixel + velocity.xy;
+    float expectedDepth = max(depth + velocity.z, 1e-4);
+    int2 base = int2(floor(prevPos));
+    float2 f = prevPos - base;
+
+    float3 sum = 0.0;
+    float totalWeight = 0.0;
+    for (uint tap = 0; tap < 4; ++tap)
+    {
+        int2 tapPos = base + int2(tap & 1, tap >> 1);
+        if (any(tapPos < 0) || any(tapPos >= int2(Resolution)))
+            continue;
+
+        float4 history = History[uint3(tapPos, Slice)];
+        if (abs(history.a - expectedDepth) > DepthTolerance * expectedDepth)
+            continue;
+
+        float weight = ((tap & 1) ? f.x : 1.0 - f.x) * ((tap >> 1) ? f.y : 1.0 - f.y);
+        sum += weight * history.rgb;
+        totalWeight += weight;
+    }
+
+    if (totalWeight <= 0.01)
+        return false;
+
+    color = sum / totalWeight;
+    return true;
+}
+
+float3 FillFromNeighbours(uint2 pixel, float depth)
+{
+    float3 sum = 0.0;
+    float totalWeight = 0.0;
+    float bestWeight = -1.0;
+    float3 best = 0.0;
+
+    for (int dy = -1; dy <= 1; ++dy)
+    {
+        for (int dx = -1; dx <= 1; ++dx)
+        {
+            int2 neighbour = int2(pixel) + int2(dx, dy);
+            if ((dx == 0 && dy == 0) || any(neighbour < 0) || any(neighbour >= int2(Resolution)))
+                continue;
+            if (!IsInterleavedPixel(neighbour, Rate, Phase) || !NeedsColor(neighbour))
+                continue;
+
+            float weight = (dx != 0 && dy != 0 ? 0.5 : 1.0) *
+                exp2(-abs(LinearDepth[neighbour] - depth) / (max(depth, 1e-4) * DepthTolerance));
+            float3 neighbourColor = Color[uint3(neighbour, Slice)].rgb;
+            sum += weight * neighbourColor;
+            totalWeight += weight;
+            if (weight > bestWeight)
+            {
+                bestWeight = weight;
+                best = neighbourColor;
+            }
+        }
+    }
+
+    return totalWeight > 1e-4 ? sum / totalWeight : best;
+}
+
+[RootSignature(_RootSig)]
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+    uint2 pixel = DTid.xy;
+    if (any(pixel >= Resolution))
+        return;
+
+    float4 color = Color[uint3(pixel, Slice)];
+    float depth = LinearDepth[pixel];
+
+    if (!IsInterleavedPixel(pixel, Rate, Phase) && NeedsColor(pixel))
+    {
+        float3 reprojected;
+        color.rgb = ReprojectHistory(pixel, depth, reprojected) ? reprojected : FillFromNeighbours(pixel, depth);
+        Color[uint3(pixel, Slice)] = color;
+    }
+
+    NewHistory[uint3(pixel, Slice)] = float4(color.rgb, depth);
+}
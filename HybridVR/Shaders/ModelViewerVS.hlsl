@@ -22,18 +22,20 @@ cbuffer VSConstants : register(b0)
 	uint curCam;
 };
 
+// Model::QuantizedVertex
 struct VSInput
 {
-    float3 position : POSITION;
+    float3 position : POSITION;     // snorm16 within the mesh's bounding box
     float2 texcoord0 : TEXCOORD;
     float3 normal : NORMAL;
-    float3 tangent : TANGENT;
-    float3 bitangent : BITANGENT;
+    float4 tangent : TANGENT;       // w is the bitangent's handedness
 };
 
 cbuffer StartVertex : register(b1)
 {
+    float3 positionScale;
     uint baseVertex;
+    float3 positionOffset;
     uint materialIdx;
 };
 
@@ -58,15 +60,17 @@ VSOutput main(VSInput vsInput, uint vertexID : SV_VertexID)
 {
     VSOutput vsOutput;
 
-    vsOutput.position = mul(modelToProjection, float4(vsInput.position, 1.0));
-    vsOutput.worldPos = vsInput.position;
+    float3 position = positionOffset + positionScale * vsInput.position;
+
+    vsOutput.position = mul(modelToProjection, float4(position, 1.0));
+    vsOutput.worldPos = position;
     vsOutput.uv = vsInput.texcoord0;
-    vsOutput.viewDir = vsInput.position - ViewerPos;
-    vsOutput.shadowCoord = mul(modelToShadow, float4(vsInput.position, 1.0)).xyz;
+    vsOutput.viewDir = position - ViewerPos;
+    vsOutput.shadowCoord = mul(modelToShadow, float4(position, 1.0)).xyz;
 
     vsOutput.normal = vsInput.normal;
-    vsOutput.tangent = vsInput.tangent;
-    vsOutput.bitangent = vsInput.bitangent;
+    vsOutput.tangent = vsInput.tangent.xyz;
+    vsOutput.bitangent = cross(vsInput.normal, vsInput.tangent.xyz) * vsInput.tangent.w;
 
 #if ENABLE_TRIANGLE_ID
     //vsOutput.vertexID = (baseVertex & 0xFFFF) << 16 | (vertexID & 0xFFFF);
@@ -0,0 +1,35 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Appends pixels to the ray list read by the ray generation shaders.  Dword 0 of the list is the count,
+// followed by one pixel per ray packed as x | y << 16.
+//
+
+groupshared uint GroupRayCount;
+groupshared uint GroupRayBase;
+
+// Every thread of the group must call this.  The group's pixels are counted in shared memory first, so
+// the list only takes one atomic per group and each group's pixels stay together.
+void AppendRayPixel(RWByteAddressBuffer rayList, uint groupIndex, uint2 pixel, bool needsRay)
+{
+    if (groupIndex == 0)
+        GroupRayCount = 0;
+    GroupMemoryBarrierWithGroupSync();
+
+    uint localIndex = 0;
+    if (needsRay)
+        InterlockedAdd(GroupRayCount, 1, localIndex);
+    GroupMemoryBarrierWithGroupSync();
+
+    if (groupIndex == 0 && GroupRayCount > 0)
+        rayList.InterlockedAdd(0, GroupRayCount, GroupRayBase);
+    GroupMemoryBarrierWithGroupSync();
+
+    if (needsRay)
+        rayList.Store(4 + (GroupRayBase + localIndex) * 4, pixel.x | pixel.y << 16);
+}
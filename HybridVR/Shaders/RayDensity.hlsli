@@ -0,0 +1,34 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Reads the per tile ray rates built by RayDensity.cpp.  The rate codes and patterns must match
+// RayDensity::IsTracedPixel().
+//
+
+#define RAY_DENSITY_TILE_SIZE 8
+#define RAY_RATE_HIDDEN 0
+#define RAY_RATE_FULL 1
+#define RAY_RATE_HALF 2
+#define RAY_RATE_QUARTER 4
+
+uint LoadTileRate(ByteAddressBuffer densityMap, uint mapOffset, uint tilesX, uint2 pixel)
+{
+    uint2 tile = pixel / RAY_DENSITY_TILE_SIZE;
+    return densityMap.Load((mapOffset + tile.y * tilesX + tile.x) * 4);
+}
+
+bool IsTracedPixel(uint2 pixel, uint rate)
+{
+    if (rate == RAY_RATE_FULL)
+        return true;
+    if (rate == RAY_RATE_HALF)
+        return ((pixel.x ^ pixel.y) & 1) == 0;
+    if (rate == RAY_RATE_QUARTER)
+        return ((pixel.x | pixel.y) & 1) == 0;
+    return false;
+}
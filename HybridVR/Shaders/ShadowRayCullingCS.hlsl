@@ -0,0 +1,133 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Resolves the sun shadow of every pixel whose answer is known without a ray and appends the rest to the
+// ray list.  Counts each class for the statistics.  ShadowRayCulling.cpp has a CPU reference of the same
+// classification.
+//
+
+#include "RayCompactionCS.hlsli"
+#include "RayDensity.hlsli"
+#include "InterleavedRays.hlsli"
+#include "../ShadowRayCulling.hlsli"
+
+cbuffer CSConstants : register(b0)
+{
+    float4x4 InvViewProj;
+    float4x4 ModelToShadow;
+    float3 SunDirection;
+    float SkyDepth;
+    float3 SceneMin;
+    float MinT;
+    float3 SceneMax;
+    float ShadowMapMargin;
+    uint2 Resolution;
+    uint2 ShadowMapSize;
+    uint Slice;
+    uint UseShadowMap;
+    uint UseDensityMap;
+    uint TilesX;
+    uint DensityMapOffset;
+    uint InterleaveRate;
+    uint InterleavePhase;
+};
+
+Texture2DArray<float> Depth : register(t0);
+Texture2DArray<float4> Normals : register(t1);
+Texture2D<float> ShadowMap : register(t2);
+ByteAddressBuffer DensityMap : register(t3);
+RWTexture2DArray<float4> Color : register(u0);
+RWByteAddressBuffer RayList : register(u1);
+RWByteAddressBuffer ClassCounts : register(u2);
+
+#define _RootSig \
+    "RootFlags(0), " \
+    "CBV(b0), " \
+    "DescriptorTable(SRV(t0, numDescriptors = 4))," \
+    "DescriptorTable(UAV(u0, numDescriptors = 3))"
+
+groupshared uint GroupClassCounts[SHADOW_RAY_CLASS_COUNT];
+
+// The shadow map only answers for pixels that every texel around them shadows by more than the margin.  A pixel
+// it sees lit is still traced, since an occluder thinner than a texel can fall between the texel centres.
+uint ClassifyWithShadowMap(float3 world)
+{
+    float3 shadowCoord = mul(ModelToShadow, float4(world, 1)).xyz;
+    int2 center = int2(floor(shadowCoord.xy * ShadowMapSize));
+    if (any(center < 1) || any(center >= int2(ShadowMapSize) - 1))
+        return SHADOW_RAY_TRACE;
+
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = -1; x <= 1; ++x)
+        {
+            float occluder = ShadowMap.Load(int3(center + int2(x, y), 0));
+            if (shadowCoord.z >= occluder - ShadowMapMargin)
+                return SHADOW_RAY_TRACE;
+        }
+    }
+
+    return SHADOW_RAY_SHADOW_MAP_SHADOWED;
+}
+
+uint ClassifyPixel(uint2 pixel)
+{
+    float depth = Depth[uint3(pixel, Slice)];
+    if (depth == SkyDepth)
+        return SHADOW_RAY_SKY;
+
+    if (dot(Normals[uint3(pixel, Slice)].xyz, SunDirection) <= 0.0)
+        return SHADOW_RAY_BACK_FACING;
+
+    float2 screenPos = (pixel + 0.5) / Resolution * 2.0 - 1.0;
+    screenPos.y = -screenPos.y;
+    float4 unprojected = mul(InvViewProj, float4(screenPos, depth, 1));
+    float3 world = unprojected.xyz / unprojected.w;
+
+    if (GetShadowRayMaxT(world, SunDirection, SceneMin, SceneMax) <= MinT)
+        return SHADOW_RAY_LEAVES_SCENE;
+
+    return UseShadowMap ? ClassifyWithShadowMap(world) : SHADOW_RAY_TRACE;
+}
+
+[RootSignature(_RootSig)]
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID, uint GI : SV_GroupIndex)
+{
+    if (GI < SHADOW_RAY_CLASS_COUNT)
+        GroupClassCounts[GI] = 0;
+    GroupMemoryBarrierWithGroupSync();
+
+    // Pixels the density map or interleaving skip are filled in after tracing, as for any other mode
+    bool classify = all(DTid.xy < Resolution);
+    if (classify && UseDensityMap)
+        classify = IsTracedPixel(DTid.xy, LoadTileRate(DensityMap, DensityMapOffset, TilesX, DTid.xy));
+    if (classify)
+        classify = IsInterleavedPixel(DTid.xy, InterleaveRate, InterleavePhase);
+
+    bool needsRay = false;
+    if (classify)
+    {
+        uint pixelClass = ClassifyPixel(DTid.xy);
+        InterlockedAdd(GroupClassCounts[pixelClass], 1);
+
+        // Same colors as RayGenerationShadowsLib.hlsl writes
+        if (pixelClass == SHADOW_RAY_TRACE)
+            needsRay = true;
+        else if (pixelClass == SHADOW_RAY_BACK_FACING || pixelClass == SHADOW_RAY_SHADOW_MAP_SHADOWED)
+            Color[uint3(DTid.xy, Slice)] = float4(0, 0, 0, 1);
+        else
+            Color[uint3(DTid.xy, Slice)] = float4(1, 1, 1, 1);
+    }
+
+    AppendRayPixel(RayList, GI, DTid.xy, needsRay);
+
+    // Every count was added before the first barrier in AppendRayPixel()
+    if (GI < SHADOW_RAY_CLASS_COUNT && GroupClassCounts[GI] > 0)
+        ClassCounts.InterlockedAdd(GI * 4, GroupClassCounts[GI]);
+}
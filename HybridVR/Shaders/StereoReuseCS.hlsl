@@ -0,0 +1,92 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Reprojects every pixel of the target eye into the source eye.  Pixels the source eye sees from nearly
+// the same direction copy its ray traced color, the rest are appended to the ray list.  StereoReuse.cpp
+// has a CPU reference of the same classification.
+//
+
+#include "RayCompactionCS.hlsli"
+
+cbuffer CSConstants : register(b0)
+{
+    float4x4 TargetInvViewProj;
+    float4x4 SourceViewProj;
+    float4x4 SourceInvViewProj;
+    float3 SourcePosition;
+    uint SourceSlice;
+    float3 TargetPosition;
+    uint TargetSlice;
+    uint2 Resolution;
+    float MaxDepthError;
+    float MinViewCos;
+    uint RequireReflective;
+};
+
+Texture2DArray<float> Depth : register(t0);
+Texture2DArray<float4> Normals : register(t1);
+RWTexture2DArray<float4> Color : register(u0);
+RWByteAddressBuffer RayList : register(u1);
+
+#define _RootSig \
+    "RootFlags(0), " \
+    "CBV(b0), " \
+    "DescriptorTable(SRV(t0, numDescriptors = 2))," \
+    "DescriptorTable(UAV(u0, numDescriptors = 2))"
+
+float3 Unproject(float4x4 invViewProj, float2 pixel, float depth)
+{
+    float2 screenPos = pixel / Resolution * 2.0 - 1.0;
+    screenPos.y = -screenPos.y;
+    float4 unprojected = mul(invViewProj, float4(screenPos, depth, 1));
+    return unprojected.xyz / unprojected.w;
+}
+
+// Returns the source pixel to copy, or false when the pixel needs a ray
+bool FindSourcePixel(uint2 pixel, out uint2 sourcePixel)
+{
+    sourcePixel = 0;
+
+    float3 world = Unproject(TargetInvViewProj, pixel + 0.5, Depth[uint3(pixel, TargetSlice)]);
+    float4 clip = mul(SourceViewProj, float4(world, 1));
+    if (clip.w <= 0.0)
+        return false;
+
+    // Off screen in the source eye
+    float2 sourcePos = float2(clip.x / clip.w * 0.5 + 0.5, 0.5 - clip.y / clip.w * 0.5) * Resolution;
+    if (any(sourcePos < 0.0) || any(sourcePos >= float2(Resolution)))
+        return false;
+
+    // Disoccluded:  the source eye sees a different surface in front of or behind this point
+    sourcePixel = min(uint2(sourcePos), Resolution - 1);
+    float3 sourceWorld = Unproject(SourceInvViewProj, sourcePixel + 0.5, Depth[uint3(sourcePixel, SourceSlice)]);
+    float expected = length(world - SourcePosition);
+    float actual = length(sourceWorld - SourcePosition);
+    if (abs(actual - expected) > MaxDepthError * expected)
+        return false;
+
+    // Too far apart for view dependent shading to match
+    return dot(normalize(SourcePosition - world), normalize(TargetPosition - world)) >= MinViewCos;
+}
+
+[RootSignature(_RootSig)]
+[numthreads(8, 8, 1)]
+void main(uint3 DTid : SV_DispatchThreadID, uint GI : SV_GroupIndex)
+{
+    bool needsRay = false;
+    if (all(DTid.xy < Resolution) && (!RequireReflective || Normals[uint3(DTid.xy, TargetSlice)].w != 0.0))
+    {
+        uint2 sourcePixel;
+        if (FindSourcePixel(DTid.xy, sourcePixel))
+            Color[uint3(DTid.xy, TargetSlice)] = Color[uint3(sourcePixel, SourceSlice)];
+        else
+            needsRay = true;
+    }
+
+    AppendRayPixel(RayList, GI, DTid.xy, needsRay);
+}
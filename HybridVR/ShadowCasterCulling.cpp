@@ -0,0 +1,349 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "ShadowCasterCulling.h"
+#include "Model.h"
+#include "Camera.h"
+#include "SystemTime.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace Math;
+
+namespace Settings
+{
+    BoolVar ShadowCasterCulling_Enable("Application/Shadow Caster Culling", true);
+}
+
+namespace
+{
+    // Inside is where every plane is positive, the same as 0 <= z <= w and |x|, |y| <= w in clip space.  Only
+    // the sign of a distance matters here, so the planes are not normalized.
+    void GetFrustumPlanes( const float ViewProj[16], float Planes[6][4] )
+    {
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            const float* Row = ViewProj + i * 4;
+            Planes[0][i] = Row[3] + Row[0];
+            Planes[1][i] = Row[3] - Row[0];
+            Planes[2][i] = Row[3] + Row[1];
+            Planes[3][i] = Row[3] - Row[1];
+            Planes[4][i] = Row[2];
+            Planes[5][i] = Row[3] - Row[2];
+        }
+    }
+
+    // The distance of the box's corner furthest along the plane's normal
+    float GetMaxDistance( const float Plane[4], const ShadowCasterCulling::Box& Box )
+    {
+        float Distance = Plane[3];
+        for (uint32_t k = 0; k < 3; ++k)
+            Distance += Plane[k] * (Plane[k] > 0.0f ? Box.Max[k] : Box.Min[k]);
+        return Distance;
+    }
+
+    // The distance along a plane's normal changes linearly as the box moves, so the swept box is outside a
+    // plane only when the box is outside it at both ends of the sweep
+    bool InFrustum( const float Planes[6][4], const ShadowCasterCulling::Box& Box, const float Sweep[3] )
+    {
+        for (uint32_t p = 0; p < 6; ++p)
+        {
+            const float Distance = GetMaxDistance(Planes[p], Box);
+            const float Moved = Planes[p][0] * Sweep[0] + Planes[p][1] * Sweep[1] + Planes[p][2] * Sweep[2];
+            if (Distance < 0.0f && Distance + Moved < 0.0f)
+                return false;
+        }
+        return true;
+    }
+}
+
+uint32_t ShadowCasterCulling::FindCasters( const Volume& Volume, const Box* Boxes, uint32_t BoxCount, uint8_t* Visible )
+{
+    ASSERT(Volume.EyeCount <= 2);
+
+    float ShadowPlanes[6][4];
+    GetFrustumPlanes(Volume.ShadowViewProj, ShadowPlanes);
+    float EyePlanes[2][6][4];
+    for (uint32_t e = 0; e < Volume.EyeCount; ++e)
+        GetFrustumPlanes(Volume.EyeViewProj[e], EyePlanes[e]);
+
+    const float NoSweep[3] = {};
+    const float Sweep[3] = { Volume.LightDirection[0] * Volume.Length, Volume.LightDirection[1] * Volume.Length,
+        Volume.LightDirection[2] * Volume.Length };
+
+    uint32_t VisibleCount = 0;
+    for (uint32_t b = 0; b < BoxCount; ++b)
+    {
+        bool Caster = InFrustum(ShadowPlanes, Boxes[b], NoSweep);
+        if (Caster && Volume.EyeCount > 0)
+        {
+            Caster = false;
+            for (uint32_t e = 0; e < Volume.EyeCount && !Caster; ++e)
+                Caster = InFrustum(EyePlanes[e], Boxes[b], Sweep);
+        }
+        Visible[b] = Caster;
+        VisibleCount += Caster;
+    }
+    return VisibleCount;
+}
+
+namespace ShadowCasterCulling
+{
+    std::vector<Box> m_Boxes;
+    std::vector<MeshletCulling::MeshDraw> m_Levels;     // m_LevelCount of each mesh in turn
+    uint32_t m_LevelCount = 1;
+    std::vector<uint8_t> m_Visible;
+    const ByteAddressBuffer* m_IndexBuffer = nullptr;
+    MeshletCulling::DrawList m_DrawList;
+    Stats m_Stats;
+}
+
+void ShadowCasterCulling::Initialize( const Model& Model )
+{
+    const uint32_t MeshCount = Model.m_Header.meshCount;
+    m_LevelCount = std::max(Model.m_LodCount, 1u);
+    m_Boxes.resize(MeshCount);
+    m_Levels.resize(MeshCount * m_LevelCount);
+    m_Visible.resize(MeshCount);
+
+    for (uint32_t m = 0; m < MeshCount; ++m)
+    {
+        const Model::Mesh& Mesh = Model.m_pMesh[m];
+        const Model::BoundingBox& Bounds = Mesh.boundingBox;
+        const Box MeshBox = { { Bounds.min.GetX(), Bounds.min.GetY(), Bounds.min.GetZ() },
+            { Bounds.max.GetX(), Bounds.max.GetY(), Bounds.max.GetZ() } };
+        m_Boxes[m] = MeshBox;
+
+        // Level 0 is the mesh itself, the same as RenderObjects() draws it
+        m_Levels[m * m_LevelCount] = { Mesh.indexDataByteOffset / (uint32_t)sizeof(uint16_t), Mesh.indexCount };
+        for (uint32_t l = 1; l < m_LevelCount; ++l)
+        {
+            const Model::LodLevel& Lod = Model.GetLod(m, l);
+            m_Levels[m * m_LevelCount + l] = { Lod.indexDataByteOffset / (uint32_t)sizeof(uint16_t), Lod.indexCount };
+        }
+    }
+
+    m_IndexBuffer = &Model.m_IndexBuffer;
+    m_DrawList.Culled.Draws.resize(MeshCount);
+    m_DrawList.Culled.Levels.resize(MeshCount);
+}
+
+const MeshletCulling::DrawList& ShadowCasterCulling::Cull( const Matrix4& ShadowViewProj, const Vector3& LightDirection,
+    float Length, Camera* const* Eyes, uint32_t EyeCount, const uint32_t* Levels )
+{
+    const int64_t Start = SystemTime::GetCurrentTick();
+
+    Volume ShadowVolume;
+    std::memcpy(ShadowVolume.ShadowViewProj, &ShadowViewProj, sizeof(ShadowVolume.ShadowViewProj));
+    ShadowVolume.LightDirection[0] = LightDirection.GetX();
+    ShadowVolume.LightDirection[1] = LightDirection.GetY();
+    ShadowVolume.LightDirection[2] = LightDirection.GetZ();
+    ShadowVolume.Length = Length;
+    ShadowVolume.EyeCount = EyeCount;
+    for (uint32_t e = 0; e < EyeCount; ++e)
+        std::memcpy(ShadowVolume.EyeViewProj[e], &Eyes[e]->GetViewProjMatrix(), sizeof(ShadowVolume.EyeViewProj[e]));
+
+    const uint32_t MeshCount = (uint32_t)m_Boxes.size();
+    const uint32_t VisibleCount = FindCasters(ShadowVolume, m_Boxes.data(), MeshCount, m_Visible.data());
+
+    // Model::UpdateIndexBuffer() re-creates the buffer after Initialize(), so the view is never cached
+    m_DrawList.IndexBuffer = m_IndexBuffer->IndexBufferView();
+
+    MeshletCulling::Result& Culled = m_DrawList.Culled;
+    Culled.IndexCount = 0;
+    for (uint32_t m = 0; m < MeshCount; ++m)
+    {
+        Culled.Levels[m] = Levels ? std::min(Levels[m], m_LevelCount - 1) : 0;
+        Culled.Draws[m] = m_Visible[m] ? m_Levels[m * m_LevelCount + Culled.Levels[m]] : MeshletCulling::MeshDraw{ 0, 0 };
+        Culled.IndexCount += Culled.Draws[m].IndexCount;
+    }
+
+    m_Stats.Casters = MeshCount;
+    m_Stats.VisibleCasters = VisibleCount;
+    m_Stats.Milliseconds = (float)(SystemTime::TimeBetweenTicks(Start, SystemTime::GetCurrentTick()) * 1000.0);
+    return m_DrawList;
+}
+
+ShadowCasterCulling::Stats ShadowCasterCulling::GetStats( void )
+{
+    return m_Stats;
+}
+
+namespace
+{
+    // A reverse Z perspective like Camera::UpdateProjMatrix() with the eye at Eye looking down -z
+    void MakePerspective( float Scale, float NearClip, float FarClip, const float Eye[3], float ViewProj[16] )
+    {
+        const float Q1 = NearClip / (FarClip - NearClip);
+        const float Q2 = Q1 * FarClip;
+        const float Proj[16] = { Scale, 0, 0, 0,  0, Scale, 0, 0,  0, 0, Q1, -1,  0, 0, Q2, 0 };
+        std::memcpy(ViewProj, Proj, sizeof(Proj));
+        for (uint32_t j = 0; j < 4; ++j)
+            ViewProj[12 + j] = Proj[12 + j] - Eye[0] * Proj[j] - Eye[1] * Proj[4 + j] - Eye[2] * Proj[8 + j];
+    }
+
+    // An orthographic box like ShadowCamera::UpdateMatrix() makes, Size wide and Depth deep around Center,
+    // looking along Direction
+    void MakeShadowBox( const float Direction[3], const float Center[3], float Size, float Depth, float ViewProj[16] )
+    {
+        // Any two axes across the direction
+        const float Up[3] = { std::fabs(Direction[1]) < 0.9f ? 0.0f : 1.0f, std::fabs(Direction[1]) < 0.9f ? 1.0f : 0.0f, 0.0f };
+        float Right[3] = { Up[1] * Direction[2] - Up[2] * Direction[1], Up[2] * Direction[0] - Up[0] * Direction[2],
+            Up[0] * Direction[1] - Up[1] * Direction[0] };
+        const float RightLength = std::sqrt(Right[0] * Right[0] + Right[1] * Right[1] + Right[2] * Right[2]);
+        for (float& R : Right)
+            R /= RightLength;
+        const float Down[3] = { Direction[1] * Right[2] - Direction[2] * Right[1], Direction[2] * Right[0] - Direction[0] * Right[2],
+            Direction[0] * Right[1] - Direction[1] * Right[0] };
+
+        const float* Axes[3] = { Right, Down, Direction };
+        const float Scales[3] = { 2.0f / Size, 2.0f / Size, 1.0f / Depth };
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            float Offset = 0.0f;
+            for (uint32_t i = 0; i < 3; ++i)
+            {
+                ViewProj[i * 4 + c] = Axes[c][i] * Scales[c];
+                Offset -= Axes[c][i] * Center[i] * Scales[c];
+            }
+            ViewProj[12 + c] = Offset + (c == 2 ? 0.5f : 0.0f);
+        }
+        ViewProj[3] = ViewProj[7] = ViewProj[11] = 0.0f;
+        ViewProj[15] = 1.0f;
+    }
+
+    bool InClipSpace( const float ViewProj[16], const float Point[3] )
+    {
+        float Clip[4];
+        for (uint32_t c = 0; c < 4; ++c)
+            Clip[c] = Point[0] * ViewProj[c] + Point[1] * ViewProj[4 + c] + Point[2] * ViewProj[8 + c] + ViewProj[12 + c];
+        return std::fabs(Clip[0]) <= Clip[3] && std::fabs(Clip[1]) <= Clip[3] && Clip[2] >= 0.0f && Clip[2] <= Clip[3];
+    }
+
+    // Whether a point sampled in the box, inside the shadow camera's box, shadows a point in view.  Finding
+    // none proves nothing, but finding one means the box must be kept.
+    bool SampleShadow( const ShadowCasterCulling::Volume& Volume, const ShadowCasterCulling::Box& Box )
+    {
+        const uint32_t kSamples = 4;
+        const uint32_t kSteps = 32;
+        for (uint32_t s = 0; s < kSamples * kSamples * kSamples; ++s)
+        {
+            const uint32_t Cell[3] = { s % kSamples, s / kSamples % kSamples, s / (kSamples * kSamples) };
+            float Point[3];
+            for (uint32_t k = 0; k < 3; ++k)
+                Point[k] = Box.Min[k] + (Box.Max[k] - Box.Min[k]) * Cell[k] / (kSamples - 1);
+            if (!InClipSpace(Volume.ShadowViewProj, Point))
+                continue;
+
+            for (uint32_t t = 0; t <= kSteps; ++t)
+            {
+                const float Distance = Volume.Length * t / kSteps;
+                const float Receiver[3] = { Point[0] + Volume.LightDirection[0] * Distance,
+                    Point[1] + Volume.LightDirection[1] * Distance, Point[2] + Volume.LightDirection[2] * Distance };
+                for (uint32_t e = 0; e < Volume.EyeCount; ++e)
+                {
+                    if (InClipSpace(Volume.EyeViewProj[e], Receiver))
+                        return true;
+                }
+            }
+        }
+        return false;
+    }
+}
+
+bool ShadowCasterCulling::RunSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, float Value )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("Shadow caster culling self test failed:  %s (%f)\n", Name, Value);
+            Passed = false;
+        }
+    };
+
+    // The sun high and to one side over a 200 unit scene, two eyes at its middle looking down -z
+    Volume TestVolume = {};
+    const float Light[3] = { 0.3f, -0.9f, 0.2f };
+    const float LightLength = std::sqrt(Light[0] * Light[0] + Light[1] * Light[1] + Light[2] * Light[2]);
+    for (uint32_t k = 0; k < 3; ++k)
+        TestVolume.LightDirection[k] = Light[k] / LightLength;
+    const float kSceneSize = 200.0f;
+    const float Center[3] = {};
+    MakeShadowBox(TestVolume.LightDirection, Center, kSceneSize * 1.2f, kSceneSize * 1.8f, TestVolume.ShadowViewProj);
+    TestVolume.Length = kSceneSize * 1.8f;
+    TestVolume.EyeCount = 2;
+    const float LeftEye[3] = { -0.5f, 2.0f, 0.0f };
+    const float RightEye[3] = { 0.5f, 2.0f, 0.0f };
+    MakePerspective(1.2f, 0.1f, 60.0f, LeftEye, TestVolume.EyeViewProj[0]);
+    MakePerspective(1.2f, 0.1f, 60.0f, RightEye, TestVolume.EyeViewProj[1]);
+
+    // Hand placed:  in view, outside the shadow camera's box, over the view with the light reaching it, and
+    // the same behind the eyes where the light carries its shadow away
+    const Box Placed[] =
+    {
+        { { -1.0f, 0.0f, -11.0f }, { 1.0f, 2.0f, -9.0f } },
+        { { 300.0f, 0.0f, 0.0f }, { 302.0f, 2.0f, 2.0f } },
+        { { -20.0f, 40.0f, -30.0f }, { -15.0f, 45.0f, -25.0f } },
+        { { -20.0f, 40.0f, 20.0f }, { -15.0f, 45.0f, 25.0f } },
+    };
+    const uint8_t PlacedCasters[] = { 1, 0, 1, 0 };
+    uint8_t PlacedVisible[4];
+    FindCasters(TestVolume, Placed, 4, PlacedVisible);
+    for (uint32_t b = 0; b < 4; ++b)
+        Expect(PlacedVisible[b] == PlacedCasters[b], "hand placed caster", (float)b);
+
+    // With no eyes every box touching the shadow camera's box is kept
+    Volume NoEyes = TestVolume;
+    NoEyes.EyeCount = 0;
+    FindCasters(NoEyes, Placed, 4, PlacedVisible);
+    Expect(PlacedVisible[0] && !PlacedVisible[1] && PlacedVisible[2] && PlacedVisible[3], "shadow camera only", 0.0f);
+
+    // Random scenes, never culling a box a sampled shadow links to a point in view
+    std::mt19937 Random(13);
+    std::uniform_real_distribution<float> Position(-kSceneSize * 0.5f, kSceneSize * 0.5f);
+    std::uniform_real_distribution<float> Extent(0.5f, 12.0f);
+    const uint32_t kBoxes = 2000;
+    std::vector<Box> Boxes(kBoxes);
+    std::vector<uint8_t> Visible(kBoxes);
+    uint32_t Kept = 0;
+    uint32_t Needed = 0;
+    for (uint32_t Scene = 0; Scene < 2; ++Scene)
+    {
+        for (Box& SceneBox : Boxes)
+        {
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                SceneBox.Min[k] = Position(Random);
+                SceneBox.Max[k] = SceneBox.Min[k] + Extent(Random);
+            }
+        }
+
+        Kept += FindCasters(TestVolume, Boxes.data(), kBoxes, Visible.data());
+        for (uint32_t b = 0; b < kBoxes; ++b)
+        {
+            if (SampleShadow(TestVolume, Boxes[b]))
+            {
+                ++Needed;
+                Expect(Visible[b] != 0, "box casting a shadow in view culled", (float)b);
+            }
+        }
+    }
+
+    // Most of the scene is behind the eyes, or too far to the side for the light to carry a shadow into view
+    const float CulledShare = 1.0f - (float)Kept / (2 * kBoxes);
+    Expect(CulledShare > 0.5f, "share of the boxes culled", CulledShare);
+    Utility::Printf("Shadow caster culling:  kept %u of %u boxes, %u of them seen casting a shadow in view\n",
+        Kept, 2 * kBoxes, Needed);
+
+    return Passed;
+}
@@ -0,0 +1,71 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// Culls the meshes drawn into the sun's shadow map on the CPU.  A mesh casts a shadow someone sees only when
+// its bounding box touches the shadow camera's box, and when the box, swept along the direction the light
+// travels for as far as the shadow map reaches, touches the frustum of either eye.  Both tests are per plane,
+// so they keep some meshes they could cull but never cull a shadow in view.
+//
+// The meshes left are drawn from the model's own index buffer at their levels of detail, through the same
+// draw list the meshlet culler gives the eyes, so RenderObjects() and DepthGeometry::Draw() need nothing
+// new.  Reflection rays look the shadow map up wherever they land, so they only cull by the shadow camera.
+
+#pragma once
+
+#include "MeshletCulling.h"
+#include <cstdint>
+#include <vector>
+
+class Model;
+namespace Math
+{
+    class Vector3;
+    class Matrix4;
+    class Camera;
+}
+
+namespace ShadowCasterCulling
+{
+    struct Box
+    {
+        float Min[3];
+        float Max[3];
+    };
+
+    struct Volume
+    {
+        float ShadowViewProj[16];   // As Math::Matrix4 stores it, world to the shadow map's clip space
+        float LightDirection[3];    // The way the light travels
+        float Length;               // How far shadows reach along LightDirection
+        float EyeViewProj[2][16];
+        uint32_t EyeCount;          // 0 keeps every caster in the shadow camera's box
+    };
+
+    // Flags the boxes that can cast a shadow the eyes see, and returns how many
+    uint32_t FindCasters( const Volume& Volume, const Box* Boxes, uint32_t BoxCount, uint8_t* Visible );
+
+    void Initialize( const Model& Model );
+
+    // Culls the model's meshes for the shadow map.  The list is valid until the next call.
+    const MeshletCulling::DrawList& Cull( const Math::Matrix4& ShadowViewProj, const Math::Vector3& LightDirection,
+        float Length, Math::Camera* const* Eyes, uint32_t EyeCount, const uint32_t* Levels );
+
+    struct Stats
+    {
+        uint32_t Casters;
+        uint32_t VisibleCasters;
+        float Milliseconds;
+    };
+
+    Stats GetStats( void );
+
+    // Culls synthetic scenes of boxes, checks hand placed casters and that every box a sampled shadow ray
+    // links to a point in view is kept, then reports the share culled
+    bool RunSelfTest( void );
+}
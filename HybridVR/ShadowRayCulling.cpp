@@ -0,0 +1,432 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "ShadowRayCulling.h"
+#include "RayCompaction.h"
+#include "RayDensity.h"
+#include "PipelineState.h"
+#include "RootSignature.h"
+#include "CommandContext.h"
+#include "CommandListManager.h"
+#include "ReadbackBuffer.h"
+#include "Camera.h"
+#include "BufferManager.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "CompiledShaders/ShadowRayCullingCS.h"
+
+using namespace Math;
+using namespace Graphics;
+
+extern ColorBuffer g_SceneNormalBuffer;
+
+namespace Settings
+{
+    BoolVar ShadowRayCulling_Enable("Application/Raytracing/Cull Shadow Rays", true);
+    BoolVar ShadowRayCulling_ShadowMapHint("Application/Raytracing/Cull Shadow Rays With Shadow Map", false);
+    NumVar ShadowRayCulling_DepthMargin("Application/Raytracing/Shadow Map Cull Margin", 1.0f, 0.0f, 20.0f, 0.25f);
+}
+
+namespace ShadowRayCulling
+{
+    // Counts are looked at this many frames later, and only read once the fence of the frame that copied them
+    // has completed
+    enum { kReadbackFrames = 3 };
+
+    // Same as the TMin of RayGenerationShadowsLib.hlsl
+    const float kMinT = 0.1f;
+
+    RootSignature m_RootSig;
+    ComputePSO m_ClassifyCS;
+    ByteAddressBuffer m_ClassCounts;
+
+    float m_SceneMin[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    float m_SceneMax[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+
+    ReadbackBuffer m_CountReadback[2][kReadbackFrames];
+    bool m_ReadbackPending[2][kReadbackFrames];
+    uint64_t m_ReadbackFence[2][kReadbackFrames];    // Zero until the copy has been submitted
+    ClassCounters m_Counters[2];
+
+    // Must match ShadowRayCullingCS.hlsl
+    __declspec(align(16)) struct CSConstants
+    {
+        Matrix4 InvViewProj;
+        Matrix4 ModelToShadow;
+        float SunDirection[3];
+        float SkyDepth;
+        float SceneMin[3];
+        float MinT;
+        float SceneMax[3];
+        float ShadowMapMargin;
+        uint32_t Resolution[2];
+        uint32_t ShadowMapSize[2];
+        uint32_t Slice;
+        uint32_t UseShadowMap;
+        uint32_t UseDensityMap;
+        uint32_t TilesX;
+        uint32_t DensityMapOffset;
+        uint32_t InterleaveRate;
+        uint32_t InterleavePhase;
+    };
+
+    void TransformPoint( const float M[16], const float P[3], float Result[3] )
+    {
+        for (uint32_t i = 0; i < 3; ++i)
+            Result[i] = P[0] * M[i] + P[1] * M[4 + i] + P[2] * M[8 + i] + M[12 + i];
+    }
+
+    // Shadow map depth per world unit along the sun
+    float GetDepthScale( const float ModelToShadow[16] )
+    {
+        return std::sqrt(ModelToShadow[2] * ModelToShadow[2] + ModelToShadow[6] * ModelToShadow[6] +
+            ModelToShadow[10] * ModelToShadow[10]);
+    }
+}
+
+void ShadowRayCulling::Initialize( void )
+{
+    m_RootSig.Reset(3, 0);
+    m_RootSig[0].InitAsConstantBuffer(0);
+    m_RootSig[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, 4);
+    m_RootSig[2].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 0, 3);
+    m_RootSig.Finalize(L"ShadowRayCullingRS");
+
+    m_ClassifyCS.SetRootSignature(m_RootSig);
+    m_ClassifyCS.SetComputeShader(g_pShadowRayCullingCS, sizeof(g_pShadowRayCullingCS));
+    m_ClassifyCS.Finalize();
+
+    m_ClassCounts.Create(L"Shadow Ray Class Counts", kClassCount, 4);
+
+    for (uint32_t Eye = 0; Eye < 2; ++Eye)
+    {
+        for (uint32_t Slot = 0; Slot < kReadbackFrames; ++Slot)
+        {
+            m_CountReadback[Eye][Slot].Create(L"Shadow Ray Class Readback", kClassCount, 4);
+            m_ReadbackPending[Eye][Slot] = false;
+            m_ReadbackFence[Eye][Slot] = 0;
+        }
+        m_Counters[Eye] = {};
+    }
+}
+
+void ShadowRayCulling::SetSceneBounds( const Vector3& Min, const Vector3& Max )
+{
+    m_SceneMin[0] = Min.GetX();
+    m_SceneMin[1] = Min.GetY();
+    m_SceneMin[2] = Min.GetZ();
+    m_SceneMax[0] = Max.GetX();
+    m_SceneMax[1] = Max.GetY();
+    m_SceneMax[2] = Max.GetZ();
+}
+
+void ShadowRayCulling::GetSceneBounds( float Min[3], float Max[3] )
+{
+    std::memcpy(Min, m_SceneMin, sizeof(m_SceneMin));
+    std::memcpy(Max, m_SceneMax, sizeof(m_SceneMax));
+}
+
+void ShadowRayCulling::BuildRayList( ComputeContext& Context, uint32_t Slice, const Camera& Camera,
+    const Vector3& SunDirection, const Matrix4& ModelToShadow, bool UseDensityMap,
+    uint32_t InterleaveRate, uint32_t InterleavePhase )
+{
+    ScopedTimer _prof(L"Cull Shadow Rays", Context);
+
+    // Pick up the counts of the frame that last used this slot, if the GPU is done with them
+    const uint32_t ReadbackSlot = (uint32_t)(Graphics::GetFrameCount() % kReadbackFrames);
+    const uint64_t FenceValue = m_ReadbackFence[Slice][ReadbackSlot];
+    if (m_ReadbackPending[Slice][ReadbackSlot] && FenceValue != 0 && g_CommandManager.IsFenceComplete(FenceValue))
+    {
+        std::memcpy(&m_Counters[Slice], m_CountReadback[Slice][ReadbackSlot].Map(), sizeof(ClassCounters));
+        m_CountReadback[Slice][ReadbackSlot].Unmap();
+        m_ReadbackPending[Slice][ReadbackSlot] = false;
+    }
+
+    CSConstants csConstants;
+    csConstants.InvViewProj = Invert(Camera.GetViewProjMatrix());
+    csConstants.ModelToShadow = ModelToShadow;
+    csConstants.SunDirection[0] = SunDirection.GetX();
+    csConstants.SunDirection[1] = SunDirection.GetY();
+    csConstants.SunDirection[2] = SunDirection.GetZ();
+    csConstants.SkyDepth = g_SceneDepthBuffer.GetClearDepth();
+    GetSceneBounds(csConstants.SceneMin, csConstants.SceneMax);
+    csConstants.MinT = kMinT;
+    csConstants.ShadowMapMargin = Settings::ShadowRayCulling_DepthMargin *
+        GetDepthScale((const float*)&csConstants.ModelToShadow);
+    csConstants.Resolution[0] = g_SceneColorBuffer.GetWidth();
+    csConstants.Resolution[1] = g_SceneColorBuffer.GetHeight();
+    csConstants.ShadowMapSize[0] = g_ShadowBuffer.GetWidth();
+    csConstants.ShadowMapSize[1] = g_ShadowBuffer.GetHeight();
+    csConstants.Slice = Slice;
+    csConstants.UseShadowMap = Settings::ShadowRayCulling_ShadowMapHint ? 1 : 0;
+    csConstants.UseDensityMap = UseDensityMap ? 1 : 0;
+    csConstants.TilesX = RayDensity::GetTileCountX();
+    csConstants.DensityMapOffset = Slice * RayDensity::GetEyeStride();
+    csConstants.InterleaveRate = InterleaveRate;
+    csConstants.InterleavePhase = InterleavePhase;
+
+    // Both counts are bumped once per thread group, so they have to start from zero
+    Context.FillBuffer(RayCompaction::m_RayList, 0, 0, sizeof(uint32_t));
+    Context.FillBuffer(m_ClassCounts, 0, 0, kClassCount * sizeof(uint32_t));
+
+    Context.SetRootSignature(m_RootSig);
+    Context.SetPipelineState(m_ClassifyCS);
+
+    Context.TransitionResource(g_SceneDepthBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(g_SceneNormalBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(g_ShadowBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(RayDensity::m_DensityMap, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(g_SceneColorBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    Context.TransitionResource(RayCompaction::m_RayList, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    Context.TransitionResource(m_ClassCounts, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, true);
+
+    Context.SetDynamicConstantBufferView(0, sizeof(CSConstants), &csConstants);
+    Context.SetDynamicDescriptor(1, 0, g_SceneDepthBuffer.GetDepthSRV());
+    Context.SetDynamicDescriptor(1, 1, g_SceneNormalBuffer.GetSRV());
+    Context.SetDynamicDescriptor(1, 2, g_ShadowBuffer.GetSRV());
+    Context.SetDynamicDescriptor(1, 3, RayDensity::m_DensityMap.GetSRV());
+    Context.SetDynamicDescriptor(2, 0, g_SceneColorBuffer.GetUAV());
+    Context.SetDynamicDescriptor(2, 1, RayCompaction::m_RayList.GetUAV());
+    Context.SetDynamicDescriptor(2, 2, m_ClassCounts.GetUAV());
+
+    Context.Dispatch2D(csConstants.Resolution[0], csConstants.Resolution[1], 8, 8);
+
+    Context.TransitionResource(m_ClassCounts, D3D12_RESOURCE_STATE_COPY_SOURCE);
+    Context.CopyBufferRegion(m_CountReadback[Slice][ReadbackSlot], 0, m_ClassCounts, 0, kClassCount * sizeof(uint32_t));
+    m_ReadbackPending[Slice][ReadbackSlot] = true;
+    m_ReadbackFence[Slice][ReadbackSlot] = 0;
+
+    // The ray generation shaders read the list through the global root signature
+    Context.TransitionResource(RayCompaction::m_RayList, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.InsertUAVBarrier(g_SceneColorBuffer);
+}
+
+void ShadowRayCulling::SetReadbackFence( uint32_t Eye, uint64_t FenceValue )
+{
+    const uint32_t Slot = (uint32_t)(Graphics::GetFrameCount() % kReadbackFrames);
+    if (m_ReadbackPending[Eye][Slot] && m_ReadbackFence[Eye][Slot] == 0)
+        m_ReadbackFence[Eye][Slot] = FenceValue;
+}
+
+ShadowRayCulling::ClassCounters ShadowRayCulling::GetCounters( uint32_t Eye )
+{
+    return m_Counters[Eye];
+}
+
+float ShadowRayCulling::GetMaxDistance( const float Origin[3], const float Direction[3], const float BoxMin[3],
+    const float BoxMax[3] )
+{
+    float MaxT = FLT_MAX;
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        if (std::fabs(Direction[i]) > 1e-20f)
+        {
+            const float ExitPlane = Direction[i] >= 0.0f ? BoxMax[i] : BoxMin[i];
+            MaxT = std::min(MaxT, (ExitPlane - Origin[i]) / Direction[i]);
+        }
+    }
+    return MaxT;
+}
+
+ShadowRayCulling::PixelClass ShadowRayCulling::ClassifyPixel( bool Sky, const float Position[3], const float Normal[3],
+    const ClassifyParams& Params, const float* ShadowMap )
+{
+    if (Sky)
+        return kSky;
+
+    const float* L = Params.SunDirection;
+    if (Normal[0] * L[0] + Normal[1] * L[1] + Normal[2] * L[2] <= 0.0f)
+        return kBackFacing;
+
+    if (GetMaxDistance(Position, L, Params.SceneMin, Params.SceneMax) <= Params.MinT)
+        return kLeavesScene;
+
+    if (ShadowMap == nullptr)
+        return kTrace;
+
+    float ShadowCoord[3];
+    TransformPoint(Params.ModelToShadow, Position, ShadowCoord);
+    const int32_t CenterX = (int32_t)std::floor(ShadowCoord[0] * Params.ShadowMapWidth);
+    const int32_t CenterY = (int32_t)std::floor(ShadowCoord[1] * Params.ShadowMapHeight);
+    if (CenterX < 1 || CenterY < 1 || CenterX >= (int32_t)Params.ShadowMapWidth - 1 ||
+        CenterY >= (int32_t)Params.ShadowMapHeight - 1)
+    {
+        return kTrace;
+    }
+
+    for (int32_t y = -1; y <= 1; ++y)
+    {
+        for (int32_t x = -1; x <= 1; ++x)
+        {
+            const float Occluder = ShadowMap[(CenterY + y) * Params.ShadowMapWidth + CenterX + x];
+            if (ShadowCoord[2] >= Occluder - Params.ShadowMapMargin)
+                return kTrace;
+        }
+    }
+
+    return kShadowMapShadowed;
+}
+
+bool ShadowRayCulling::RunSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, float Value )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("Shadow ray culling self test failed:  %s (%g)\n", Name, Value);
+            Passed = false;
+        }
+    };
+
+    // A ground plane at y = 0 under a floating square of 6x6 at y = 4, in a scene box whose top is at y = 5
+    const float kOccluderHeight = 4.0f;
+    const float kOccluderHalfSize = 3.0f;
+    const float kGroundHalfSize = 10.0f;
+
+    ClassifyParams Params;
+    const float SunLength = std::sqrt(0.3f * 0.3f + 1.0f + 0.2f * 0.2f);
+    const float Sun[3] = { 0.3f / SunLength, 1.0f / SunLength, 0.2f / SunLength };
+    std::memcpy(Params.SunDirection, Sun, sizeof(Sun));
+    const float SceneMin[3] = { -kGroundHalfSize, 0.0f, -kGroundHalfSize };
+    const float SceneMax[3] = { kGroundHalfSize, 5.0f, kGroundHalfSize };
+    std::memcpy(Params.SceneMin, SceneMin, sizeof(SceneMin));
+    std::memcpy(Params.SceneMax, SceneMax, sizeof(SceneMax));
+    Params.MinT = kMinT;
+
+    // An orthographic shadow map along the sun, 40 units wide and 40 deep.  Larger depths are closer to the sun.
+    const float kExtent = 40.0f;
+    const float kDepthRange = 40.0f;
+    const uint32_t kShadowMapSize = 256;
+    float U[3] = { Sun[1], -Sun[0], 0.0f };
+    const float ULength = std::sqrt(U[0] * U[0] + U[1] * U[1]);
+    U[0] /= ULength;
+    U[1] /= ULength;
+    const float V[3] = { Sun[1] * U[2] - Sun[2] * U[1], Sun[2] * U[0] - Sun[0] * U[2], Sun[0] * U[1] - Sun[1] * U[0] };
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        Params.ModelToShadow[i * 4 + 0] = U[i] / kExtent;
+        Params.ModelToShadow[i * 4 + 1] = V[i] / kExtent;
+        Params.ModelToShadow[i * 4 + 2] = Sun[i] / kDepthRange;
+        Params.ModelToShadow[i * 4 + 3] = 0.0f;
+    }
+    Params.ModelToShadow[12] = Params.ModelToShadow[13] = Params.ModelToShadow[14] = 0.5f;
+    Params.ModelToShadow[15] = 1.0f;
+    Params.ShadowMapWidth = kShadowMapSize;
+    Params.ShadowMapHeight = kShadowMapSize;
+    Params.ShadowMapMargin = 0.5f * GetDepthScale(Params.ModelToShadow);
+
+    // Point sampled at texel centres like the rasterizer, cleared to 0 where nothing was drawn
+    std::vector<float> ShadowMap(kShadowMapSize * kShadowMapSize, 0.0f);
+    for (uint32_t y = 0; y < kShadowMapSize; ++y)
+    {
+        for (uint32_t x = 0; x < kShadowMapSize; ++x)
+        {
+            const float S = ((x + 0.5f) / kShadowMapSize - 0.5f) * kExtent;
+            const float T = ((y + 0.5f) / kShadowMapSize - 0.5f) * kExtent;
+            const float P[3] = { S * U[0] + T * V[0], S * U[1] + T * V[1], S * U[2] + T * V[2] };
+            for (float Height : { kOccluderHeight, 0.0f })
+            {
+                const float Along = (Height - P[1]) / Sun[1];
+                const float Q[3] = { P[0] + Sun[0] * Along, Height, P[2] + Sun[2] * Along };
+                const float HalfSize = Height > 0.0f ? kOccluderHalfSize : kGroundHalfSize;
+                if (std::fabs(Q[0]) <= HalfSize && std::fabs(Q[2]) <= HalfSize)
+                {
+                    ShadowMap[y * kShadowMapSize + x] = (Q[0] * Sun[0] + Q[1] * Sun[1] + Q[2] * Sun[2]) / kDepthRange + 0.5f;
+                    break;
+                }
+            }
+        }
+    }
+
+    auto IsShadowed = [&]( const float P[3] )
+    {
+        if (P[1] >= kOccluderHeight)
+            return false;
+        const float Along = (kOccluderHeight - P[1]) / Sun[1];
+        return std::fabs(P[0] + Sun[0] * Along) <= kOccluderHalfSize && std::fabs(P[2] + Sun[2] * Along) <= kOccluderHalfSize;
+    };
+
+    const float Up[3] = { 0.0f, 1.0f, 0.0f };
+    const float Down[3] = { 0.0f, -1.0f, 0.0f };
+    uint32_t Counts[kClassCount] = {};
+    uint32_t Wrong = 0;
+    uint32_t SkySamples = 0;
+    uint32_t ShadowedGround = 0;
+    uint32_t ShadowedGroundResolved = 0;
+    auto Check = [&]( bool Sky, const float P[3], const float N[3] )
+    {
+        const PixelClass Class = ClassifyPixel(Sky, P, N, Params, ShadowMap.data());
+        ++Counts[Class];
+        if (Class == kLeavesScene)
+            Wrong += IsShadowed(P) ? 1 : 0;
+        else if (Class == kShadowMapShadowed)
+            Wrong += IsShadowed(P) ? 0 : 1;
+
+        if (!Sky && P[1] == 0.0f && IsShadowed(P))
+        {
+            ++ShadowedGround;
+            ShadowedGroundResolved += Class == kShadowMapShadowed ? 1 : 0;
+        }
+    };
+
+    // The ground, the top and underside of the occluder, and the sky
+    const float kStep = 0.1f;
+    for (float z = -kGroundHalfSize + 0.05f; z < kGroundHalfSize; z += kStep)
+    {
+        for (float x = -kGroundHalfSize + 0.05f; x < kGroundHalfSize; x += kStep)
+        {
+            const float Ground[3] = { x, 0.0f, z };
+            Check(false, Ground, Up);
+            if (std::fabs(x) < kOccluderHalfSize && std::fabs(z) < kOccluderHalfSize)
+            {
+                const float Top[3] = { x, kOccluderHeight, z };
+                Check(false, Top, Up);
+                Check(false, Top, Down);
+            }
+            Check(true, Ground, Up);
+            ++SkySamples;
+        }
+    }
+
+    // A surface just under the top of the scene box is lit without looking at the shadow map
+    {
+        const float Roof[3] = { 0.0f, 4.95f, 0.0f };
+        Expect(ClassifyPixel(false, Roof, Up, Params, nullptr) == kLeavesScene, "roof leaves the scene", 0.0f);
+        Expect(ClassifyPixel(false, Roof, Up, Params, ShadowMap.data()) == kLeavesScene, "roof with shadow map", 0.0f);
+        const float Origin[3] = { 0.0f, 0.0f, 0.0f };
+        const float Axis[3] = { 0.0f, 0.0f, -1.0f };
+        Expect(GetMaxDistance(Origin, Axis, SceneMin, SceneMax) == kGroundHalfSize, "distance to leave the scene",
+            GetMaxDistance(Origin, Axis, SceneMin, SceneMax));
+    }
+
+    // A pole one unit high at (-7, -7), far thinner than the 0.16 unit texels, so the rasterized shadow map
+    // above never drew it.  The ground it shadows looks lit to the map and still has to be traced.
+    {
+        const float BehindPole[3] = { -7.0f - Sun[0] / Sun[1], 0.0f, -7.0f - Sun[2] / Sun[1] };
+        Expect(ClassifyPixel(false, BehindPole, Up, Params, ShadowMap.data()) == kTrace, "thin pole traced", 0.0f);
+    }
+
+    const uint32_t SurfaceCount = Counts[kTrace] + Counts[kBackFacing] + Counts[kLeavesScene] + Counts[kShadowMapShadowed];
+    const float TracedFraction = (float)Counts[kTrace] / SurfaceCount;
+    const float ResolvedFraction = (float)ShadowedGroundResolved / ShadowedGround;
+    Expect(Wrong == 0, "pixels resolved to the wrong shadow", (float)Wrong);
+    Expect(Counts[kSky] == SkySamples, "sky", (float)Counts[kSky]);
+    Expect(Counts[kBackFacing] > 0 && Counts[kShadowMapShadowed] > 0, "every class seen", (float)Counts[kShadowMapShadowed]);
+    Expect(ResolvedFraction > 0.8f, "shadowed ground resolved by the shadow map", ResolvedFraction);
+
+    Utility::Printf("Shadow ray culling:  %.1f%% of surface pixels traced (%u back facing, %u shadowed by the shadow map)\n",
+        100.0f * TracedFraction, Counts[kBackFacing], Counts[kShadowMapShadowed]);
+
+    return Passed;
+}
@@ -0,0 +1,89 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// Sun shadow rays are only traced for pixels whose answer is not known beforehand.  Each pixel gets one of:
+//
+//     kSky                the depth buffer was never written, lit
+//     kBackFacing         the normal faces away from the sun, shadowed
+//     kLeavesScene        the ray would leave the scene's bounding box before it starts, lit
+//     kShadowMapShadowed  every shadow map texel around the pixel has an occluder further than a margin in front
+//     kTrace              a ray is needed
+//
+// The resolved pixels are written straight to g_SceneColorBuffer and the rest go to the ray list of
+// RayCompaction.h.  The shadow map is never trusted to say lit, since an occluder thinner than a texel can
+// fall between its samples.  It can still be wrong about shadowed where the occluder has a hole smaller than a
+// texel, such as in cutout foliage, so it has its own setting and is off by default.  Traced rays also end where
+// they leave the scene's bounding box instead of at FLT_MAX.
+//
+// ClassifyPixel() is a CPU reference of ShadowRayCullingCS.hlsl.
+
+#pragma once
+
+#include <cstdint>
+
+class ComputeContext;
+namespace Math
+{
+    class Vector3;
+    class Matrix4;
+    class Camera;
+}
+
+namespace ShadowRayCulling
+{
+    // Must match ShadowRayCulling.hlsli
+    enum PixelClass { kTrace, kSky, kBackFacing, kLeavesScene, kShadowMapShadowed, kClassCount };
+
+    struct ClassCounters
+    {
+        uint32_t Pixels[kClassCount];
+    };
+
+    void Initialize( void );
+
+    // The bounding box of everything in the acceleration structure
+    void SetSceneBounds( const Math::Vector3& Min, const Math::Vector3& Max );
+    void GetSceneBounds( float Min[3], float Max[3] );
+
+    // Resolves the pixels of one slice of g_SceneColorBuffer that need no shadow ray and fills
+    // RayCompaction::m_RayList with the rest, among the pixels the density map and the interleaving phase keep
+    void BuildRayList( ComputeContext& Context, uint32_t Slice, const Math::Camera& Camera,
+        const Math::Vector3& SunDirection, const Math::Matrix4& ModelToShadow, bool UseDensityMap,
+        uint32_t InterleaveRate = 1, uint32_t InterleavePhase = 0 );
+
+    // The fence value returned by Finish() on the context BuildRayList() recorded into this frame.  The class
+    // counts are not read before the GPU has passed it.
+    void SetReadbackFence( uint32_t Eye, uint64_t FenceValue );
+
+    // The latest counters that came back for an eye, a few frames late
+    ClassCounters GetCounters( uint32_t Eye );
+
+    // Distance along a ray to where it leaves the box.  Same as GetShadowRayMaxT() in ShadowRayCulling.hlsli.
+    float GetMaxDistance( const float Origin[3], const float Direction[3], const float BoxMin[3], const float BoxMax[3] );
+
+    struct ClassifyParams
+    {
+        float SunDirection[3];      // Towards the sun
+        float SceneMin[3];
+        float SceneMax[3];
+        float MinT;                 // Where shadow rays start
+        float ModelToShadow[16];    // As Math::Matrix4 stores it, world to shadow map texture space
+        uint32_t ShadowMapWidth;
+        uint32_t ShadowMapHeight;
+        float ShadowMapMargin;      // In shadow map depth, how far in front a texel may be and still be the surface
+    };
+
+    // ShadowMap holds the shadow buffer's depths, larger is closer to the sun, or is null to ignore it
+    PixelClass ClassifyPixel( bool Sky, const float Position[3], const float Normal[3], const ClassifyParams& Params,
+        const float* ShadowMap );
+
+    // Classifies a synthetic scene with a floating occluder against its exact shadows, including a pole too thin
+    // for the shadow map, and prints the rays saved
+    bool RunSelfTest( void );
+}
@@ -0,0 +1,31 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+// Shared by the shadow ray generation shader and ShadowRayCullingCS.hlsl.  The classes must match
+// ShadowRayCulling.h.
+//
+
+#ifndef SHADOW_RAY_CULLING_HLSLI_INCLUDED
+#define SHADOW_RAY_CULLING_HLSLI_INCLUDED
+
+#define SHADOW_RAY_TRACE                0
+#define SHADOW_RAY_SKY                  1
+#define SHADOW_RAY_BACK_FACING          2
+#define SHADOW_RAY_LEAVES_SCENE         3
+#define SHADOW_RAY_SHADOW_MAP_SHADOWED  4
+#define SHADOW_RAY_CLASS_COUNT          5
+
+// Distance along the ray to where it leaves the scene's bounding box.  Nothing can be hit beyond it.
+float GetShadowRayMaxT(float3 origin, float3 direction, float3 sceneMin, float3 sceneMax)
+{
+    float3 exitPlane = direction >= 0.0 ? sceneMax : sceneMin;
+    float3 t = abs(direction) > 1e-20 ? (exitPlane - origin) / direction : 3.402823466e+38;
+    return min(t.x, min(t.y, t.z));
+}
+
+#endif // SHADOW_RAY_CULLING_HLSLI_INCLUDED
@@ -0,0 +1,391 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "StereoReuse.h"
+#include "RayCompaction.h"
+#include "PipelineState.h"
+#include "RootSignature.h"
+#include "CommandContext.h"
+#include "Camera.h"
+#include "BufferManager.h"
+#include <algorithm>
+#include <cmath>
+
+#include "CompiledShaders/StereoReuseCS.h"
+
+using namespace Math;
+using namespace Graphics;
+
+extern ColorBuffer g_SceneNormalBuffer;
+
+namespace Settings
+{
+    BoolVar StereoReuse_Enable("Application/Raytracing/Stereo Reuse", false);
+    NumVar StereoReuse_MaxAngle("Application/Raytracing/Stereo Reuse Max Angle", 2.0f, 0.0f, 10.0f, 0.1f);
+    NumVar StereoReuse_DepthTolerance("Application/Raytracing/Stereo Reuse Depth Tolerance", 0.02f, 0.001f, 0.2f, 0.001f);
+}
+
+namespace StereoReuse
+{
+    RootSignature m_RootSig;
+    ComputePSO m_BuildRayListCS;
+
+    // Must match StereoReuseCS.hlsl
+    __declspec(align(16)) struct CSConstants
+    {
+        Matrix4 TargetInvViewProj;
+        Matrix4 SourceViewProj;
+        Matrix4 SourceInvViewProj;
+        float SourcePosition[3];
+        uint32_t SourceSlice;
+        float TargetPosition[3];
+        uint32_t TargetSlice;
+        uint32_t Resolution[2];
+        float MaxDepthError;
+        float MinViewCos;
+        uint32_t RequireReflective;
+    };
+
+    ReprojectionParams GetParams( void )
+    {
+        ReprojectionParams Params;
+        Params.MaxDepthError = Settings::StereoReuse_DepthTolerance;
+        Params.MinViewCos = std::cos((float)Settings::StereoReuse_MaxAngle * 3.14159265f / 180.0f);
+        return Params;
+    }
+
+    Vector3 Unproject( const Matrix4& InvViewProj, float X, float Y, float Depth, float InvWidth, float InvHeight, bool& Valid )
+    {
+        const Vector4 Clip(X * 2.0f * InvWidth - 1.0f, 1.0f - Y * 2.0f * InvHeight, Depth, 1.0f);
+        const Vector4 H = InvViewProj * Clip;
+        const float W = H.GetW();
+        Valid = std::abs(W) > 1e-20f;
+        return Valid ? Vector3(H) / W : Vector3(kZero);
+    }
+}
+
+void StereoReuse::Initialize( void )
+{
+    m_RootSig.Reset(3, 0);
+    m_RootSig[0].InitAsConstantBuffer(0);
+    m_RootSig[1].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 0, 2);
+    m_RootSig[2].InitAsDescriptorRange(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 0, 2);
+    m_RootSig.Finalize(L"StereoReuseRS");
+
+    m_BuildRayListCS.SetRootSignature(m_RootSig);
+    m_BuildRayListCS.SetComputeShader(g_pStereoReuseCS, sizeof(g_pStereoReuseCS));
+    m_BuildRayListCS.Finalize();
+}
+
+void StereoReuse::BuildRayList( ComputeContext& Context, const Camera& Source, const Camera& Target,
+    uint32_t SourceSlice, uint32_t TargetSlice, bool RequireReflective )
+{
+    ScopedTimer _prof(L"Stereo Reuse", Context);
+
+    const ReprojectionParams Params = GetParams();
+    const Vector3 SourcePosition = Source.GetPosition();
+    const Vector3 TargetPosition = Target.GetPosition();
+
+    CSConstants csConstants;
+    csConstants.TargetInvViewProj = Invert(Target.GetViewProjMatrix());
+    csConstants.SourceViewProj = Source.GetViewProjMatrix();
+    csConstants.SourceInvViewProj = Invert(Source.GetViewProjMatrix());
+    csConstants.SourcePosition[0] = SourcePosition.GetX();
+    csConstants.SourcePosition[1] = SourcePosition.GetY();
+    csConstants.SourcePosition[2] = SourcePosition.GetZ();
+    csConstants.SourceSlice = SourceSlice;
+    csConstants.TargetPosition[0] = TargetPosition.GetX();
+    csConstants.TargetPosition[1] = TargetPosition.GetY();
+    csConstants.TargetPosition[2] = TargetPosition.GetZ();
+    csConstants.TargetSlice = TargetSlice;
+    csConstants.Resolution[0] = g_SceneColorBuffer.GetWidth();
+    csConstants.Resolution[1] = g_SceneColorBuffer.GetHeight();
+    csConstants.MaxDepthError = Params.MaxDepthError;
+    csConstants.MinViewCos = Params.MinViewCos;
+    csConstants.RequireReflective = RequireReflective ? 1 : 0;
+
+    // The count is bumped once per thread group, so it has to start from zero
+    Context.FillBuffer(RayCompaction::m_RayList, 0, 0, sizeof(uint32_t));
+
+    Context.SetRootSignature(m_RootSig);
+    Context.SetPipelineState(m_BuildRayListCS);
+
+    Context.TransitionResource(g_SceneDepthBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(g_SceneNormalBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.TransitionResource(g_SceneColorBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    Context.TransitionResource(RayCompaction::m_RayList, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, true);
+
+    Context.SetDynamicConstantBufferView(0, sizeof(CSConstants), &csConstants);
+    Context.SetDynamicDescriptor(1, 0, g_SceneDepthBuffer.GetDepthSRV());
+    Context.SetDynamicDescriptor(1, 1, g_SceneNormalBuffer.GetSRV());
+    Context.SetDynamicDescriptor(2, 0, g_SceneColorBuffer.GetUAV());
+    Context.SetDynamicDescriptor(2, 1, RayCompaction::m_RayList.GetUAV());
+
+    Context.Dispatch2D(csConstants.Resolution[0], csConstants.Resolution[1], 8, 8);
+
+    // The ray generation shaders read the list through the global root signature
+    Context.TransitionResource(RayCompaction::m_RayList, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+    Context.InsertUAVBarrier(g_SceneColorBuffer);
+}
+
+uint32_t StereoReuse::ClassifyPixels( const float* SourceDepth, const float* TargetDepth, uint32_t Width, uint32_t Height,
+    const Matrix4& SourceViewProj, const Matrix4& TargetViewProj,
+    const Vector3& SourcePosition, const Vector3& TargetPosition,
+    const ReprojectionParams& Params, std::vector<uint32_t>& SourcePixels )
+{
+    const Matrix4 TargetInvViewProj = Invert(TargetViewProj);
+    const Matrix4 SourceInvViewProj = Invert(SourceViewProj);
+    const float InvWidth = 1.0f / Width;
+    const float InvHeight = 1.0f / Height;
+
+    SourcePixels.assign((size_t)Width * Height, kTracePixel);
+    uint32_t RayCount = 0;
+
+    for (uint32_t y = 0; y < Height; ++y)
+    {
+        for (uint32_t x = 0; x < Width; ++x)
+        {
+            const uint32_t Pixel = y * Width + x;
+            uint32_t& Reuse = SourcePixels[Pixel];
+
+            bool Valid;
+            const Vector3 World = Unproject(TargetInvViewProj, x + 0.5f, y + 0.5f, TargetDepth[Pixel], InvWidth, InvHeight, Valid);
+            const Vector4 Clip = SourceViewProj * Vector4(World, 1.0f);
+            const float ClipW = Clip.GetW();
+            if (!Valid || ClipW <= 0.0f)
+            {
+                ++RayCount;
+                continue;
+            }
+
+            // Off screen in the source eye
+            const float SourceX = ((float)Clip.GetX() / ClipW * 0.5f + 0.5f) * Width;
+            const float SourceY = (0.5f - (float)Clip.GetY() / ClipW * 0.5f) * Height;
+            if (!(SourceX >= 0.0f && SourceX < (float)Width && SourceY >= 0.0f && SourceY < (float)Height))
+            {
+                ++RayCount;
+                continue;
+            }
+
+            // Disoccluded:  the source eye sees a different surface in front of or behind this point
+            const uint32_t SX = std::min((uint32_t)SourceX, Width - 1);
+            const uint32_t SY = std::min((uint32_t)SourceY, Height - 1);
+            const uint32_t SourcePixel = SY * Width + SX;
+            const Vector3 SourceWorld = Unproject(SourceInvViewProj, SX + 0.5f, SY + 0.5f, SourceDepth[SourcePixel], InvWidth, InvHeight, Valid);
+            const float Expected = Length(World - SourcePosition);
+            const float Actual = Length(SourceWorld - SourcePosition);
+            if (!Valid || std::abs(Actual - Expected) > Params.MaxDepthError * Expected)
+            {
+                ++RayCount;
+                continue;
+            }
+
+            // Too far apart for view dependent shading to match
+            const float ViewCos = Dot(Normalize(SourcePosition - World), Normalize(TargetPosition - World));
+            if (ViewCos < Params.MinViewCos)
+            {
+                ++RayCount;
+                continue;
+            }
+
+            Reuse = SourcePixel;
+        }
+    }
+
+    return RayCount;
+}
+
+namespace
+{
+    using namespace Math;
+
+    // A forward-Z right handed perspective projection, matching Camera::Setup(false)
+    Matrix4 MakePerspective( float VerticalFOV, float AspectHeightOverWidth, float NearClip, float FarClip )
+    {
+        const float Y = 1.0f / std::tan(VerticalFOV * 0.5f);
+        const float X = Y * AspectHeightOverWidth;
+        const float Q1 = FarClip / (NearClip - FarClip);
+        const float Q2 = Q1 * NearClip;
+        return Matrix4(
+            Vector4(X, 0.0f, 0.0f, 0.0f),
+            Vector4(0.0f, Y, 0.0f, 0.0f),
+            Vector4(0.0f, 0.0f, Q1, -1.0f),
+            Vector4(0.0f, 0.0f, Q2, 0.0f));
+    }
+
+    // Eyes look down -Z from (EyeX, 0, 0) at a back wall, a floor, and optionally a card floating in front
+    struct SyntheticScene
+    {
+        static const float kWallZ;
+        static const float kFloorY;
+        static const float kCardZ;
+        static const float kCardHalfSize;
+
+        bool HasCard;
+
+        // Distance along a view ray with a -1 z component, which is the negated view space depth
+        float Trace( float EyeX, float DirX, float DirY ) const
+        {
+            float T = -kWallZ;
+            if (DirY < 0.0f)
+                T = std::min(T, kFloorY / DirY);
+            if (HasCard)
+            {
+                const float CardT = -kCardZ;
+                const float X = EyeX + DirX * CardT;
+                const float Y = DirY * CardT;
+                if (CardT < T && std::abs(X) <= kCardHalfSize && std::abs(Y) <= kCardHalfSize)
+                    T = CardT;
+            }
+            return T;
+        }
+
+        // Whether the card blocks the segment from an eye to a point behind it
+        bool IsOccluded( float EyeX, float PX, float PY, float PZ ) const
+        {
+            if (!HasCard || PZ >= kCardZ)
+                return false;
+            const float S = kCardZ / PZ;
+            const float X = EyeX + (PX - EyeX) * S;
+            const float Y = PY * S;
+            return std::abs(X) <= kCardHalfSize && std::abs(Y) <= kCardHalfSize;
+        }
+    };
+
+    const float SyntheticScene::kWallZ = -10.0f;
+    const float SyntheticScene::kFloorY = -1.5f;
+    const float SyntheticScene::kCardZ = -3.0f;
+    const float SyntheticScene::kCardHalfSize = 0.5f;
+}
+
+bool StereoReuse::RunSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, float Value )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("Stereo reuse self test failed:  %s (%g)\n", Name, Value);
+            Passed = false;
+        }
+    };
+
+    const uint32_t kSize = 256;
+    const float kNear = 0.1f;
+    const float kFar = 100.0f;
+    const float kEyeX[2] = { -0.032f, 0.032f };
+    const Matrix4 Proj = MakePerspective(3.14159265f * 0.5f, 1.0f, kNear, kFar);
+    const float ProjX = 1.0f;
+    const float ProjY = 1.0f;
+    const float Q1 = kFar / (kNear - kFar);
+    const float Q2 = Q1 * kNear;
+
+    Matrix4 ViewProj[2];
+    Vector3 Position[2];
+    for (int Eye = 0; Eye < 2; ++Eye)
+    {
+        ViewProj[Eye] = Proj * Matrix4::MakeTranslation(Vector3(-kEyeX[Eye], 0.0f, 0.0f));
+        Position[Eye] = Vector3(kEyeX[Eye], 0.0f, 0.0f);
+    }
+
+    auto RayDir = [&]( uint32_t x, uint32_t y, float& DirX, float& DirY )
+    {
+        DirX = ((x + 0.5f) * 2.0f / kSize - 1.0f) / ProjX;
+        DirY = (1.0f - (y + 0.5f) * 2.0f / kSize) / ProjY;
+    };
+
+    ReprojectionParams Params;
+    Params.MaxDepthError = 0.02f;
+    Params.MinViewCos = std::cos(2.0f * 3.14159265f / 180.0f);
+
+    for (int Card = 0; Card < 2; ++Card)
+    {
+        SyntheticScene Scene;
+        Scene.HasCard = Card != 0;
+
+        std::vector<float> Depth[2];
+        for (int Eye = 0; Eye < 2; ++Eye)
+        {
+            Depth[Eye].resize(kSize * kSize);
+            for (uint32_t y = 0; y < kSize; ++y)
+            {
+                for (uint32_t x = 0; x < kSize; ++x)
+                {
+                    float DirX, DirY;
+                    RayDir(x, y, DirX, DirY);
+                    const float ViewZ = -Scene.Trace(kEyeX[Eye], DirX, DirY);
+                    Depth[Eye][y * kSize + x] = (Q1 * ViewZ + Q2) / -ViewZ;
+                }
+            }
+        }
+
+        // Left eye traced, right eye reuses
+        std::vector<uint32_t> SourcePixels;
+        const uint32_t RayCount = ClassifyPixels(Depth[0].data(), Depth[1].data(), kSize, kSize,
+            ViewProj[0], ViewProj[1], Position[0], Position[1], Params, SourcePixels);
+
+        uint32_t Counted = 0, Occluded = 0, MissedOcclusions = 0;
+        for (uint32_t y = 0; y < kSize; ++y)
+        {
+            for (uint32_t x = 0; x < kSize; ++x)
+            {
+                const bool Traced = SourcePixels[y * kSize + x] == kTracePixel;
+                Counted += Traced ? 1 : 0;
+
+                float DirX, DirY;
+                RayDir(x, y, DirX, DirY);
+                const float T = Scene.Trace(kEyeX[1], DirX, DirY);
+                if (Scene.IsOccluded(kEyeX[0], kEyeX[1] + DirX * T, DirY * T, -T))
+                {
+                    ++Occluded;
+                    MissedOcclusions += Traced ? 0 : 1;
+                }
+            }
+        }
+
+        const float Savings = 1.0f - (float)RayCount / (kSize * kSize);
+        Utility::Printf("Stereo reuse:  %s saves %.1f%% of the second eye's rays (%u of %u disoccluded pixels traced)\n",
+            Scene.HasCard ? "wall, floor and card" : "wall and floor", Savings * 100.0f,
+            Occluded - MissedOcclusions, Occluded);
+
+        Expect(Counted == RayCount, "ray count matches the classification", (float)Counted);
+        Expect(MissedOcclusions == 0, "disoccluded pixels reused", (float)MissedOcclusions);
+        Expect(!Scene.HasCard || Occluded > 0, "card disoccludes the wall", (float)Occluded);
+        Expect(Savings > 0.9f, "ray savings", Savings);
+
+        // A card 3 m away subtends about 1.2 degrees between the eyes, the wall less than 0.4
+        if (Scene.HasCard)
+        {
+            ReprojectionParams Tight = Params;
+            Tight.MinViewCos = std::cos(0.5f * 3.14159265f / 180.0f);
+            ClassifyPixels(Depth[0].data(), Depth[1].data(), kSize, kSize,
+                ViewProj[0], ViewProj[1], Position[0], Position[1], Tight, SourcePixels);
+
+            uint32_t CardReused = 0, WallReused = 0;
+            for (uint32_t y = 0; y < kSize; ++y)
+            {
+                for (uint32_t x = 0; x < kSize; ++x)
+                {
+                    float DirX, DirY;
+                    RayDir(x, y, DirX, DirY);
+                    const float T = Scene.Trace(kEyeX[1], DirX, DirY);
+                    const bool Reused = SourcePixels[y * kSize + x] != kTracePixel;
+                    if (T <= -SyntheticScene::kCardZ)
+                        CardReused += Reused ? 1 : 0;
+                    else if (T >= -SyntheticScene::kWallZ)
+                        WallReused += Reused ? 1 : 0;
+                }
+            }
+            Expect(CardReused == 0, "view angle limit up close", (float)CardReused);
+            Expect(WallReused > 0, "view angle limit on the wall", (float)WallReused);
+        }
+    }
+
+    return Passed;
+}
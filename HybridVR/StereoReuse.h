@@ -0,0 +1,57 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// Reuses the ray traced result of one eye for the other.  Every pixel of the target eye is reprojected
+// into the source eye with both depth buffers.  When the source eye sees the same surface point, and from
+// a direction close enough that view dependent shading still matches, the source result is copied.  All
+// other pixels are appended to the ray list of RayCompaction.h, and the target eye only traces those.
+//
+// ClassifyPixels() is a CPU reference of StereoReuseCS.hlsl, used by the self test to check disocclusion
+// handling and to report the fraction of rays saved on synthetic stereo depth pairs.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class ComputeContext;
+namespace Math
+{
+    class Vector3;
+    class Matrix4;
+    class Camera;
+}
+
+namespace StereoReuse
+{
+    struct ReprojectionParams
+    {
+        float MaxDepthError;    // Relative difference in distance from the source eye that still counts as the same surface
+        float MinViewCos;       // Cosine of the largest angle between the two eyes' view directions at the surface
+    };
+
+    void Initialize( void );
+
+    // Copies reusable pixels from the source slice of g_SceneColorBuffer to the target slice and fills
+    // RayCompaction::m_RayList with the rest.  With RequireReflective, pixels whose normal buffer has no
+    // reflectivity are left alone since the reflection pass would not trace them either.
+    void BuildRayList( ComputeContext& Context, const Math::Camera& Source, const Math::Camera& Target,
+        uint32_t SourceSlice, uint32_t TargetSlice, bool RequireReflective );
+
+    // For each target pixel, the index of the source pixel to reuse or kTracePixel.  Returns the number of
+    // pixels that need a ray.  Depths are raw depth buffer values in row-major order.
+    enum { kTracePixel = 0xFFFFFFFF };
+    uint32_t ClassifyPixels( const float* SourceDepth, const float* TargetDepth, uint32_t Width, uint32_t Height,
+        const Math::Matrix4& SourceViewProj, const Math::Matrix4& TargetViewProj,
+        const Math::Vector3& SourcePosition, const Math::Vector3& TargetPosition,
+        const ReprojectionParams& Params, std::vector<uint32_t>& SourcePixels );
+
+    // Classifies synthetic stereo pairs with known disocclusions and prints the ray savings
+    bool RunSelfTest( void );
+}
@@ -0,0 +1,59 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "TestMeshes.h"
+#include <cstddef>
+#include <cstring>
+
+void TestMeshes::MakeModel( Model& Out, const std::vector<Mesh>& Meshes )
+{
+    uint32_t VertexCount = 0;
+    uint32_t IndexCount = 0;
+    for (const Mesh& Source : Meshes)
+    {
+        VertexCount += (uint32_t)Source.Vertices.size();
+        IndexCount += (uint32_t)Source.Indices.size();
+    }
+
+    Out.m_Header.meshCount = (uint32_t)Meshes.size();
+    Out.m_Header.vertexDataByteSize = VertexCount * sizeof(Model::FloatVertex);
+    Out.m_Header.indexDataByteSize = IndexCount * sizeof(uint16_t);
+    Out.m_pMesh = new Model::Mesh[Meshes.size()];
+    std::memset(Out.m_pMesh, 0, sizeof(Model::Mesh) * Meshes.size());
+    Out.m_pVertexData = new unsigned char[Out.m_Header.vertexDataByteSize];
+    Out.m_pIndexData = new unsigned char[Out.m_Header.indexDataByteSize];
+    Out.m_VertexStride = sizeof(Model::FloatVertex);
+
+    uint32_t VertexOffset = 0;
+    uint32_t IndexOffset = 0;
+    for (uint32_t m = 0; m < Meshes.size(); ++m)
+    {
+        Model::Mesh& Mesh = Out.m_pMesh[m];
+        Mesh.materialIndex = Meshes[m].Material;
+        Mesh.vertexStride = sizeof(Model::FloatVertex);
+        Mesh.attrib[Model::attrib_position].offset = offsetof(Model::FloatVertex, position);
+        Mesh.attrib[Model::attrib_texcoord0].offset = offsetof(Model::FloatVertex, texcoord0);
+        Mesh.attrib[Model::attrib_normal].offset = offsetof(Model::FloatVertex, normal);
+        Mesh.attrib[Model::attrib_tangent].offset = offsetof(Model::FloatVertex, tangent);
+        Mesh.attrib[Model::attrib_bitangent].offset = offsetof(Model::FloatVertex, bitangent);
+        for (uint32_t a = Model::attrib_position; a <= Model::attrib_bitangent; ++a)
+            Mesh.attrib[a].format = Model::attrib_format_float;
+        Mesh.vertexCount = (uint32_t)Meshes[m].Vertices.size();
+        Mesh.vertexDataByteOffset = VertexOffset * sizeof(Model::FloatVertex);
+        Mesh.indexCount = (uint32_t)Meshes[m].Indices.size();
+        Mesh.indexDataByteOffset = IndexOffset * sizeof(uint16_t);
+
+        std::memcpy(Out.m_pVertexData + Mesh.vertexDataByteOffset, Meshes[m].Vertices.data(),
+            Meshes[m].Vertices.size() * sizeof(Model::FloatVertex));
+        std::memcpy(Out.m_pIndexData + Mesh.indexDataByteOffset, Meshes[m].Indices.data(),
+            Meshes[m].Indices.size() * sizeof(uint16_t));
+        VertexOffset += Mesh.vertexCount;
+        IndexOffset += Mesh.indexCount;
+    }
+}
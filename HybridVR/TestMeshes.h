@@ -0,0 +1,72 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// Synthetic meshes for the self tests of the modules that process the model on the CPU.
+
+#pragma once
+
+#include "Model.h"
+#include <cstdint>
+#include <vector>
+
+namespace TestMeshes
+{
+    struct Mesh
+    {
+        std::vector<Model::FloatVertex> Vertices;
+        std::vector<uint16_t> Indices;
+        uint32_t Material;
+    };
+
+    // Lays the meshes out in a model the way ModelH3D.cpp reads a float file
+    void MakeModel( Model& Out, const std::vector<Mesh>& Meshes );
+
+    // Adds a grid of Rows x Columns quads with its own vertices, wound so that the geometric normal agrees
+    // with Normal().  Position() and the texture coordinates take the grid coordinates in [0, 1].
+    template <typename PositionFn, typename NormalFn>
+    void AddGrid( Mesh& Mesh, uint32_t Rows, uint32_t Columns, PositionFn Position, NormalFn Normal )
+    {
+        const uint32_t First = (uint32_t)Mesh.Vertices.size();
+        for (uint32_t r = 0; r <= Rows; ++r)
+        {
+            for (uint32_t c = 0; c <= Columns; ++c)
+            {
+                Model::FloatVertex Vertex = {};
+                Vertex.position = Position((float)r / Rows, (float)c / Columns);
+                Vertex.texcoord0 = XMFLOAT2((float)r / Rows, (float)c / Columns);
+                Vertex.normal = Normal(Vertex.position);
+                Mesh.Vertices.push_back(Vertex);
+            }
+        }
+
+        for (uint32_t r = 0; r < Rows; ++r)
+        {
+            for (uint32_t c = 0; c < Columns; ++c)
+            {
+                const uint16_t A = (uint16_t)(First + r * (Columns + 1) + c);
+                const uint16_t B = (uint16_t)(A + Columns + 1);
+                const uint16_t Quad[2][3] = { { A, B, (uint16_t)(B + 1) }, { A, (uint16_t)(B + 1), (uint16_t)(A + 1) } };
+                for (const auto& Triangle : Quad)
+                {
+                    const XMFLOAT3& P0 = Mesh.Vertices[Triangle[0]].position;
+                    const XMFLOAT3& P1 = Mesh.Vertices[Triangle[1]].position;
+                    const XMFLOAT3& P2 = Mesh.Vertices[Triangle[2]].position;
+                    const XMFLOAT3& N = Mesh.Vertices[Triangle[0]].normal;
+                    const float E1[3] = { P1.x - P0.x, P1.y - P0.y, P1.z - P0.z };
+                    const float E2[3] = { P2.x - P0.x, P2.y - P0.y, P2.z - P0.z };
+                    const float Face[3] = { E1[1] * E2[2] - E1[2] * E2[1], E1[2] * E2[0] - E1[0] * E2[2], E1[0] * E2[1] - E1[1] * E2[0] };
+                    const bool Flip = Face[0] * N.x + Face[1] * N.y + Face[2] * N.z < 0.0f;
+                    Mesh.Indices.push_back(Triangle[0]);
+                    Mesh.Indices.push_back(Triangle[Flip ? 2 : 1]);
+                    Mesh.Indices.push_back(Triangle[Flip ? 1 : 2]);
+                }
+            }
+        }
+    }
+}
@@ -18,7 +18,7 @@ void Hit(inout RayPayload payload, in BuiltInTriangleIntersectionAttributes attr
     payload.RayHitT = RayTCurrent();
     if (!payload.SkipShading)
     {
-        g_screenOutput[int3(DispatchRaysIndex().xy, g_dynamic.curCam )] = float4(attr.barycentrics, 1, 1);
+        g_screenOutput[int3(UnpackRayPixel(payload.Pixel), g_dynamic.curCam )] = float4(attr.barycentrics, 1, 1);
     }
 }
 
@@ -17,6 +17,6 @@ void Miss(inout RayPayload payload)
 {
     if (!payload.SkipShading)
     {
-        g_screenOutput[int3(DispatchRaysIndex().xy, g_dynamic.curCam)] = float4(0, 0, 0, 1);
+        g_screenOutput[int3(UnpackRayPixel(payload.Pixel), g_dynamic.curCam)] = float4(0, 0, 0, 1);
     }
 }
\ No newline at end of file
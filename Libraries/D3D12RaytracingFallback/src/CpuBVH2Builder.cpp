@@ -672,6 +672,12 @@ void BuildRaytracingAccelerationStructureOnCpu(
     FallbackLayer::BVH bvh;
     FallbackLayer::BuildUniformBVH(pDesc->Inputs.NumDescs, pDesc->Inputs.pGeometryDescs, bvh);
 
+    // Same optimization the GPU builder applies through TreeletReorder
+    FallbackLayer::CpuTreeletReorder::Optimize(
+        bvh.m_nodes.data(),
+        (UINT)bvh.m_nodes.size(),
+        FallbackLayer::CpuTreeletReorder::SettingsFromBuildFlags(pDesc->Inputs.Flags));
+
     BYTE* outputData = (BYTE*)pData;
     BVHOffsets offsets;
     offsets.offsetToBoxes = sizeof(BVHOffsets);
@@ -0,0 +1,544 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+
+// Using the Karras/Aila paper on treelet reoordering:
+// "Fast Parallel Construction of High-Quality Bounding Volume
+// Hierarchies"
+
+#include "pch.h"
+#include "TreeletReorderBindings.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace FallbackLayer
+{
+    // Same constants as TreeletReorder.hlsl
+    static const float CostOfRayBoxIntersection = 1.2f;
+    static const float CostOfRayTriangleIntersection = 1.0f;
+
+    static const UINT NumInternalTreeletNodes = FullTreeletSize - 1;
+    static const UINT NumTreeletSplitPermutations = 1 << FullTreeletSize;
+    static const UINT RootNodeIndex = 0;
+    static const UINT InvalidNodeIndex = (UINT)-1;
+
+    static
+        void DecompressNodeAABB(
+            AABB& box,
+            const AABBNode& node)
+    {
+        for (UINT i = 0; i < 3; ++i)
+        {
+            box.minArr[i] = node.center[i] - node.halfDim[i];
+            box.maxArr[i] = node.center[i] + node.halfDim[i];
+        }
+    }
+
+    static
+        void CombineAABB(
+            AABB& box,
+            const AABB& a,
+            const AABB& b)
+    {
+        for (UINT i = 0; i < 3; ++i)
+        {
+            box.minArr[i] = std::min(a.minArr[i], b.minArr[i]);
+            box.maxArr[i] = std::max(a.maxArr[i], b.maxArr[i]);
+        }
+    }
+
+    static
+        float ComputeBoxSurfaceArea(
+            const AABB& box)
+    {
+        const float dims[3] =
+        {
+            box.max.x - box.min.x,
+            box.max.y - box.min.y,
+            box.max.z - box.min.z
+        };
+
+        return 2 * (dims[0] * dims[1] + dims[0] * dims[2] + dims[1] * dims[2]);
+    }
+
+    static
+        UINT CountBits(UINT mask)
+    {
+        UINT count = 0;
+        for (; mask; mask &= mask - 1)
+        {
+            count++;
+        }
+        return count;
+    }
+
+    static
+        UINT FirstBitLow(UINT mask)
+    {
+        assert(mask != 0);
+        UINT index = 0;
+        while (!(mask & (1u << index)))
+        {
+            index++;
+        }
+        return index;
+    }
+
+    static
+        UINT GetLeftChild(const AABBNode& node)
+    {
+        return node.internalNode.leftNodeIndex;
+    }
+
+    static
+        UINT GetRightChild(const AABBNode& node)
+    {
+        return node.rightNodeIndex;
+    }
+
+    //
+    // Per pass state shared by all worker threads. Every worker owns a disjoint
+    // subtree at any given time, so only the arrival counters need to be atomic.
+    //
+    struct TreeletReorderPass
+    {
+        AABBNode*                    pNodes;
+        UINT                         numNodes;
+        std::vector<AABB>            boxes;
+        std::vector<UINT>            parents;
+        std::vector<UINT>            numTriangles;
+        std::vector<UINT>            numCandidateChildren;
+        std::vector<UINT>            baseTreelets;
+        std::unique_ptr<std::atomic<UINT>[]> arrivals;
+        std::atomic<UINT>            nextBaseTreelet;
+        std::atomic<UINT>            numTreeletsReordered;
+    };
+
+    static
+        void InitializePass(
+            TreeletReorderPass& pass,
+            UINT minTrianglesPerTreelet)
+    {
+        const UINT numNodes = pass.numNodes;
+        pass.boxes.resize(numNodes);
+        pass.parents.assign(numNodes, InvalidNodeIndex);
+        pass.numTriangles.assign(numNodes, 0);
+        pass.numCandidateChildren.assign(numNodes, 0);
+        pass.baseTreelets.clear();
+        pass.arrivals.reset(new std::atomic<UINT>[numNodes]);
+        pass.nextBaseTreelet = 0;
+
+        // Pre-order walk so every parent is visited before its children, then
+        // accumulate triangle counts in reverse to get a bottom-up order
+        std::vector<UINT> order;
+        order.reserve(numNodes);
+        order.push_back(RootNodeIndex);
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            const UINT nodeIndex = order[i];
+            const AABBNode& node = pass.pNodes[nodeIndex];
+            DecompressNodeAABB(pass.boxes[nodeIndex], node);
+            pass.arrivals[nodeIndex] = 0;
+
+            if (!node.leaf)
+            {
+                const UINT left = GetLeftChild(node);
+                const UINT right = GetRightChild(node);
+                assert(left < numNodes && right < numNodes);
+                pass.parents[left] = nodeIndex;
+                pass.parents[right] = nodeIndex;
+                order.push_back(left);
+                order.push_back(right);
+            }
+        }
+
+        for (auto it = order.rbegin(); it != order.rend(); ++it)
+        {
+            const UINT nodeIndex = *it;
+            const AABBNode& node = pass.pNodes[nodeIndex];
+            if (node.leaf)
+            {
+                pass.numTriangles[nodeIndex] = node.leafNode.numTriangleIds;
+            }
+            else
+            {
+                const UINT left = GetLeftChild(node);
+                const UINT right = GetRightChild(node);
+                pass.numTriangles[nodeIndex] = pass.numTriangles[left] + pass.numTriangles[right];
+
+                const bool bLeftIsCandidate = pass.numTriangles[left] >= minTrianglesPerTreelet;
+                const bool bRightIsCandidate = pass.numTriangles[right] >= minTrianglesPerTreelet;
+                pass.numCandidateChildren[nodeIndex] = (bLeftIsCandidate ? 1 : 0) + (bRightIsCandidate ? 1 : 0);
+
+                // Same criteria as FindTreelets.hlsl: the lowest nodes that reach the
+                // triangle threshold start a bottom-up walk to the root
+                if (pass.numTriangles[nodeIndex] >= minTrianglesPerTreelet &&
+                    !bLeftIsCandidate && !bRightIsCandidate)
+                {
+                    pass.baseTreelets.push_back(nodeIndex);
+                }
+            }
+        }
+    }
+
+    static
+        bool ReorderTreelet(
+            TreeletReorderPass& pass,
+            UINT rootIndex)
+    {
+        AABBNode* pNodes = pass.pNodes;
+        std::vector<AABB>& boxes = pass.boxes;
+
+        UINT treeletToReorder[FullTreeletSize];
+        UINT internalNodes[NumInternalTreeletNodes];
+        UINT treeletSize = 2;
+
+        //
+        // Form the treelet by repeatedly expanding the leaf with the largest surface area
+        //
+        internalNodes[0] = rootIndex;
+        treeletToReorder[0] = GetLeftChild(pNodes[rootIndex]);
+        treeletToReorder[1] = GetRightChild(pNodes[rootIndex]);
+
+        while (treeletSize < FullTreeletSize)
+        {
+            float largestSurfaceArea = -1.0f;
+            UINT indexOfNodeToTraverse = InvalidNodeIndex;
+            for (UINT i = 0; i < treeletSize; ++i)
+            {
+                const UINT treeletNodeIndex = treeletToReorder[i];
+                if (!pNodes[treeletNodeIndex].leaf)
+                {
+                    const float surfaceArea = ComputeBoxSurfaceArea(boxes[treeletNodeIndex]);
+                    if (surfaceArea > largestSurfaceArea)
+                    {
+                        largestSurfaceArea = surfaceArea;
+                        indexOfNodeToTraverse = i;
+                    }
+                }
+            }
+
+            // Subtree ran out of internal nodes before the treelet could be filled
+            if (indexOfNodeToTraverse == InvalidNodeIndex)
+            {
+                break;
+            }
+
+            const UINT nodeToTraverse = treeletToReorder[indexOfNodeToTraverse];
+            internalNodes[treeletSize - 1] = nodeToTraverse;
+            treeletToReorder[indexOfNodeToTraverse] = GetLeftChild(pNodes[nodeToTraverse]);
+            treeletToReorder[treeletSize] = GetRightChild(pNodes[nodeToTraverse]);
+            treeletSize++;
+        }
+
+        // A treelet with less than 3 leaves only has one possible topology
+        if (treeletSize < 3)
+        {
+            return false;
+        }
+
+        //
+        // Dynamic programming over every subset of the treelet leaves. Subsets are visited
+        // in increasing order, which guarantees all of their partitions have been solved.
+        //
+        const UINT fullPartitionMask = (1u << treeletSize) - 1;
+        const float rootSurfaceArea = std::max(ComputeBoxSurfaceArea(boxes[rootIndex]), FLT_MIN);
+        const float inverseRootSurfaceArea = 1.0f / rootSurfaceArea;
+
+        float surfaceArea[NumTreeletSplitPermutations];
+        float optimalCost[NumTreeletSplitPermutations];
+        UINT optimalPartition[NumTreeletSplitPermutations];
+
+        for (UINT treeletBitmask = 1; treeletBitmask <= fullPartitionMask; ++treeletBitmask)
+        {
+            AABB aabb;
+            for (UINT i = 0; i < 3; ++i)
+            {
+                aabb.minArr[i] = FLT_MAX;
+                aabb.maxArr[i] = -FLT_MAX;
+            }
+            for (UINT i = 0; i < treeletSize; ++i)
+            {
+                if (treeletBitmask & (1u << i))
+                {
+                    CombineAABB(aabb, aabb, boxes[treeletToReorder[i]]);
+                }
+            }
+            surfaceArea[treeletBitmask] = ComputeBoxSurfaceArea(aabb) * inverseRootSurfaceArea;
+
+            // Single leaves of the treelet keep their subtree, so their cost is a constant
+            if ((treeletBitmask & (treeletBitmask - 1)) == 0)
+            {
+                const AABBNode& leaf = pNodes[treeletToReorder[FirstBitLow(treeletBitmask)]];
+                optimalCost[treeletBitmask] = leaf.leaf ?
+                    CostOfRayTriangleIntersection * surfaceArea[treeletBitmask] * leaf.leafNode.numTriangleIds :
+                    CostOfRayBoxIntersection * surfaceArea[treeletBitmask];
+                optimalPartition[treeletBitmask] = 0;
+                continue;
+            }
+
+            float lowestCost = FLT_MAX;
+            UINT bestPartition = 0;
+
+            // Only partitions containing the lowest set bit, the mirrored ones cost the same
+            const UINT lowestBit = treeletBitmask & (0u - treeletBitmask);
+            const UINT remainingBits = treeletBitmask ^ lowestBit;
+            UINT subset = remainingBits;
+            do
+            {
+                subset = (subset - 1) & remainingBits;
+                const UINT partitionBitmask = subset | lowestBit;
+                const float cost = optimalCost[partitionBitmask] + optimalCost[treeletBitmask ^ partitionBitmask];
+                if (cost < lowestCost)
+                {
+                    lowestCost = cost;
+                    bestPartition = partitionBitmask;
+                }
+            } while (subset != 0);
+
+            optimalCost[treeletBitmask] = CostOfRayBoxIntersection * surfaceArea[treeletBitmask] + lowestCost;
+            optimalPartition[treeletBitmask] = bestPartition;
+        }
+
+        //
+        // Reform the tree, reusing the internal nodes of the original treelet
+        //
+        struct PartitionEntry
+        {
+            UINT Mask;
+            UINT NodeIndex;
+        };
+
+        UINT nodesAllocated = 1;
+        UINT partitionStackSize = 1;
+        PartitionEntry partitionStack[FullTreeletSize];
+        partitionStack[0].Mask = fullPartitionMask;
+        partitionStack[0].NodeIndex = internalNodes[0];
+
+        UINT allocationOrder[NumInternalTreeletNodes];
+        UINT numAllocated = 0;
+
+        while (partitionStackSize > 0)
+        {
+            const PartitionEntry partition = partitionStack[--partitionStackSize];
+            allocationOrder[numAllocated++] = partition.NodeIndex;
+
+            PartitionEntry childEntries[2];
+            childEntries[0].Mask = optimalPartition[partition.Mask];
+            childEntries[1].Mask = partition.Mask ^ childEntries[0].Mask;
+
+            for (PartitionEntry& entry : childEntries)
+            {
+                if (CountBits(entry.Mask) > 1)
+                {
+                    entry.NodeIndex = internalNodes[nodesAllocated++];
+                    partitionStack[partitionStackSize++] = entry;
+                }
+                else
+                {
+                    entry.NodeIndex = treeletToReorder[FirstBitLow(entry.Mask)];
+                }
+            }
+
+            AABBNode& node = pNodes[partition.NodeIndex];
+            node.nodeAllBits = 0;
+            node.internalNode.leftNodeIndex = childEntries[0].NodeIndex;
+            node.rightNodeIndex = childEntries[1].NodeIndex;
+        }
+        assert(nodesAllocated == treeletSize - 1);
+
+        // Allocation happened top-down, so walking it in reverse refits bottom-up.
+        // The root covers the same leaves as before and keeps its bounds.
+        for (int j = (int)numAllocated - 1; j > 0; --j)
+        {
+            const UINT internalNodeIndex = allocationOrder[j];
+            AABBNode& node = pNodes[internalNodeIndex];
+            AABB& box = boxes[internalNodeIndex];
+            CombineAABB(box, boxes[GetLeftChild(node)], boxes[GetRightChild(node)]);
+
+            for (UINT i = 0; i < 3; ++i)
+            {
+                const float center = (box.maxArr[i] + box.minArr[i]) * 0.5f;
+                node.center[i] = center;
+                node.halfDim[i] = std::max(box.maxArr[i] - center, center - box.minArr[i]);
+            }
+        }
+
+        return true;
+    }
+
+    static
+        void ReorderWorker(
+            TreeletReorderPass& pass,
+            std::chrono::steady_clock::time_point deadline,
+            bool bHasDeadline)
+    {
+        const UINT numBaseTreelets = (UINT)pass.baseTreelets.size();
+        for (UINT baseTreelet = pass.nextBaseTreelet++; baseTreelet < numBaseTreelets; baseTreelet = pass.nextBaseTreelet++)
+        {
+            UINT nodeIndex = pass.baseTreelets[baseTreelet];
+            do
+            {
+                if (bHasDeadline && std::chrono::steady_clock::now() >= deadline)
+                {
+                    // Every treelet is left consistent, so stopping early still yields a valid hierarchy
+                    return;
+                }
+
+                if (ReorderTreelet(pass, nodeIndex))
+                {
+                    pass.numTreeletsReordered++;
+                }
+
+                if (nodeIndex == RootNodeIndex)
+                {
+                    break;
+                }
+
+                // The last candidate child to arrive continues to the parent, mirroring
+                // TraverseToParent in TreeletReorder.hlsl
+                const UINT parentIndex = pass.parents[nodeIndex];
+                const UINT numArrived = pass.arrivals[parentIndex].fetch_add(1, std::memory_order_acq_rel) + 1;
+                if (numArrived < pass.numCandidateChildren[parentIndex])
+                {
+                    break;
+                }
+
+                nodeIndex = parentIndex;
+            } while (true);
+        }
+    }
+
+    CpuTreeletReorder::Settings CpuTreeletReorder::SettingsFromBuildFlags(
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags)
+    {
+        Settings settings;
+
+        bool bPrioritizeTrace = buildFlags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
+        bool bPrioritizeBuild = buildFlags & D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD;
+
+        if (bPrioritizeBuild)
+        {
+            settings.NumOptimizationPasses = 0;
+        }
+        else if (bPrioritizeTrace)
+        {
+            settings.NumOptimizationPasses = 3;
+        }
+        else
+        {
+            settings.NumOptimizationPasses = 1;
+        }
+
+        return settings;
+    }
+
+    UINT CpuTreeletReorder::Optimize(
+        AABBNode *pNodes,
+        UINT numNodes,
+        const Settings &settings)
+    {
+        if (numNodes < 3 || settings.NumOptimizationPasses == 0)
+        {
+            return 0;
+        }
+
+        const auto startTime = std::chrono::steady_clock::now();
+        const bool bHasDeadline = settings.TimeBudgetInMs > 0.0f;
+        const auto deadline = startTime + std::chrono::microseconds((INT64)(settings.TimeBudgetInMs * 1000.0f));
+
+        UINT numThreads = settings.NumThreads;
+        if (numThreads == 0)
+        {
+            numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        TreeletReorderPass pass;
+        pass.pNodes = pNodes;
+        pass.numNodes = numNodes;
+        pass.numTreeletsReordered = 0;
+
+        UINT minTrianglesPerTreelet = FullTreeletSize;
+        for (UINT i = 0; i < settings.NumOptimizationPasses; i++)
+        {
+            if (bHasDeadline && std::chrono::steady_clock::now() >= deadline)
+            {
+                break;
+            }
+
+            InitializePass(pass, minTrianglesPerTreelet);
+            if (pass.baseTreelets.empty())
+            {
+                break;
+            }
+
+            const UINT numWorkers = std::min(numThreads, (UINT)pass.baseTreelets.size());
+            std::vector<std::thread> workers;
+            workers.reserve(numWorkers - 1);
+            for (UINT w = 1; w < numWorkers; w++)
+            {
+                workers.emplace_back(ReorderWorker, std::ref(pass), deadline, bHasDeadline);
+            }
+            ReorderWorker(pass, deadline, bHasDeadline);
+
+            for (auto &worker : workers)
+            {
+                worker.join();
+            }
+
+            minTrianglesPerTreelet *= 2;
+        }
+
+        return pass.numTreeletsReordered;
+    }
+
+    float CpuTreeletReorder::CalculateSAHCost(
+        const AABBNode *pNodes,
+        UINT numNodes)
+    {
+        if (numNodes == 0)
+        {
+            return 0.0f;
+        }
+
+        AABB rootBox;
+        DecompressNodeAABB(rootBox, pNodes[RootNodeIndex]);
+        const float rootSurfaceArea = std::max(ComputeBoxSurfaceArea(rootBox), FLT_MIN);
+
+        float cost = 0.0f;
+        std::vector<UINT> stack;
+        stack.push_back(RootNodeIndex);
+        while (!stack.empty())
+        {
+            const UINT nodeIndex = stack.back();
+            stack.pop_back();
+            assert(nodeIndex < numNodes);
+
+            const AABBNode& node = pNodes[nodeIndex];
+            AABB box;
+            DecompressNodeAABB(box, node);
+            const float surfaceArea = ComputeBoxSurfaceArea(box) / rootSurfaceArea;
+
+            if (node.leaf)
+            {
+                cost += CostOfRayTriangleIntersection * surfaceArea * node.leafNode.numTriangleIds;
+            }
+            else
+            {
+                cost += CostOfRayBoxIntersection * surfaceArea;
+                stack.push_back(GetLeftChild(node));
+                stack.push_back(GetRightChild(node));
+            }
+        }
+
+        return cost;
+    }
+}
@@ -0,0 +1,47 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+namespace FallbackLayer
+{
+    // CPU counterpart of TreeletReorder. Restructures an already built AABBNode
+    // hierarchy in place by searching the optimal topology of every 7-leaf treelet,
+    // following the same Karras/Aila scheme as the GPU pass. Only internal node links
+    // and bounds are rewritten, leaves and primitive data are left untouched.
+    class CpuTreeletReorder
+    {
+    public:
+        struct Settings
+        {
+            // Each pass doubles the minimum number of triangles a treelet root must contain
+            UINT NumOptimizationPasses = 3;
+
+            // Stop restructuring once this many milliseconds have elapsed, 0 disables the limit
+            float TimeBudgetInMs = 0.0f;
+
+            // 0 uses one worker per hardware thread
+            UINT NumThreads = 0;
+        };
+
+        // Matches the number of passes GpuBvh2Builder runs for the same build flags
+        static Settings SettingsFromBuildFlags(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags);
+
+        // The hierarchy must be rooted at node 0. Returns the number of treelets restructured.
+        static UINT Optimize(
+            AABBNode *pNodes,
+            UINT numNodes,
+            const Settings &settings);
+
+        // Surface area heuristic cost of the hierarchy, normalized to the root's surface area
+        static float CalculateSAHCost(
+            const AABBNode *pNodes,
+            UINT numNodes);
+    };
+}
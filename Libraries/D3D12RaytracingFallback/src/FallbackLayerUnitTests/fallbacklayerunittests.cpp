@@ -775,6 +775,74 @@ namespace FallbackLayerUnitTests
                 testCase);
         }
 
+        TEST_METHOD(StressBottomLevelCpuBVHBuilderPreferFastTrace)
+        {
+            std::vector<float> AutoGeneratedReferenceVertices;
+            std::vector<UINT16> AutoGeneratedReferenceIndicies;
+            for (UINT i = 0; i < 1000; i++)
+            {
+                for (float f : ReferenceVerticies0)
+                {
+                    AutoGeneratedReferenceVertices.push_back(f + i);
+                }
+
+                for (UINT16 index : ReferenceIndices0)
+                {
+                    AutoGeneratedReferenceIndicies.push_back(index + (UINT16)ARRAYSIZE(ReferenceIndices0) * i);
+                }
+            }
+            CpuGeometryDescriptor testCase(AutoGeneratedReferenceVertices.data(),
+                (UINT)(AutoGeneratedReferenceVertices.size() / 3),
+                AutoGeneratedReferenceIndicies.data(),
+                (UINT)AutoGeneratedReferenceIndicies.size());
+
+            TestCpuBvh2Builder(
+                testCase,
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE);
+        }
+
+        TEST_METHOD(CpuTreeletReorderOnCpuBVH)
+        {
+            std::vector<float> AutoGeneratedReferenceVertices;
+            std::vector<UINT16> AutoGeneratedReferenceIndicies;
+            for (UINT i = 0; i < 1000; i++)
+            {
+                // Scatter the copies so the SAH builder leaves room for improvement
+                const float offset = (float)((i * 7919) % 1000);
+                for (float f : ReferenceVerticies0)
+                {
+                    AutoGeneratedReferenceVertices.push_back(f + offset);
+                }
+
+                for (UINT16 index : ReferenceIndices0)
+                {
+                    AutoGeneratedReferenceIndicies.push_back(index + (UINT16)ARRAYSIZE(ReferenceIndices0) * i);
+                }
+            }
+            CpuGeometryDescriptor testCase(AutoGeneratedReferenceVertices.data(),
+                (UINT)(AutoGeneratedReferenceVertices.size() / 3),
+                AutoGeneratedReferenceIndicies.data(),
+                (UINT)AutoGeneratedReferenceIndicies.size());
+
+            FallbackLayer::CpuTreeletReorder::Settings singleThreaded;
+            singleThreaded.NumOptimizationPasses = 8;
+            singleThreaded.NumThreads = 1;
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY,
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD, &singleThreaded);
+
+            FallbackLayer::CpuTreeletReorder::Settings multiThreaded;
+            multiThreaded.NumOptimizationPasses = 8;
+            multiThreaded.NumThreads = 8;
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY,
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD, &multiThreaded);
+
+            FallbackLayer::CpuTreeletReorder::Settings timeBudget;
+            timeBudget.NumOptimizationPasses = 8;
+            timeBudget.TimeBudgetInMs = 0.01f;
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY,
+                D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD, &timeBudget);
+        }
+
         template <UINT numBottomLevels>
         void SimpleTopLevelGpuBVHBuilder(
             D3D12_ELEMENTS_LAYOUT layoutToTest,
@@ -1341,7 +1409,12 @@ namespace FallbackLayerUnitTests
             }
         }
 
-        void TestCpuBvh2Builder(CpuGeometryDescriptor *pGeomDescs, UINT numGeoms, D3D12_ELEMENTS_LAYOUT layoutToTest = D3D12_ELEMENTS_LAYOUT_ARRAY)
+        void TestCpuBvh2Builder(
+            CpuGeometryDescriptor *pGeomDescs,
+            UINT numGeoms,
+            D3D12_ELEMENTS_LAYOUT layoutToTest = D3D12_ELEMENTS_LAYOUT_ARRAY,
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD,
+            const FallbackLayer::CpuTreeletReorder::Settings *pReorderSettings = nullptr)
         {
             ID3D12Device &device = m_d3d12Context.GetDevice();
             std::unique_ptr<FallbackLayer::IAccelerationStructureBuilder> pBuilder =
@@ -1376,9 +1449,24 @@ namespace FallbackLayerUnitTests
             inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
             inputs.NumDescs = numGeoms;
             inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+            inputs.Flags = buildFlags;
             inputs.pGeometryDescs = geomDescs.data();
 
             BuildRaytracingAccelerationStructureOnCpu(&desc, pData.get());
+
+            if (pReorderSettings)
+            {
+                // Post-process the finished hierarchy in place and make sure it never gets worse
+                BVHOffsets offsets = *(BVHOffsets*)pData.get();
+                AABBNode *pNodes = (AABBNode*)(pData.get() + offsets.offsetToBoxes);
+                const UINT numNodes = (offsets.offsetToVertices - offsets.offsetToBoxes) / sizeof(AABBNode);
+
+                const float costBefore = FallbackLayer::CpuTreeletReorder::CalculateSAHCost(pNodes, numNodes);
+                FallbackLayer::CpuTreeletReorder::Optimize(pNodes, numNodes, *pReorderSettings);
+                const float costAfter = FallbackLayer::CpuTreeletReorder::CalculateSAHCost(pNodes, numNodes);
+                Assert::IsTrue(costAfter <= costBefore * 1.001f, L"Treelet reordering increased the SAH cost");
+            }
+
             std::wstring errorMessage;
             auto &validator = FallbackLayer::GetAccelerationStructureValidator(pBuilder->GetAccelerationStructureType());
             if (!validator.VerifyBottomLevelOutput(pGeomDescs, numGeoms, pData.get(), errorMessage))
@@ -1387,9 +1475,11 @@ namespace FallbackLayerUnitTests
             }
         }
 
-        void TestCpuBvh2Builder(CpuGeometryDescriptor &geomDesc)
+        void TestCpuBvh2Builder(
+            CpuGeometryDescriptor &geomDesc,
+            D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_BUILD)
         {
-            TestCpuBvh2Builder(&geomDesc, 1);
+            TestCpuBvh2Builder(&geomDesc, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, buildFlags);
         }
 
         void TestGpuBvh2Builder(CpuGeometryDescriptor *pGeomDescs, UINT numGeoms, D3D12_ELEMENTS_LAYOUT layoutToTest = D3D12_ELEMENTS_LAYOUT_ARRAY)
@@ -85,6 +85,7 @@
 #include "PostBuildInfoQuery.h"
 #include "GpuBvh2Copy.h"
 #include "TreeletReorder.h"
+#include "CpuTreeletReorder.h"
 #include "GpuBvh2Builder.h"
 
 // Dispatchers
@@ -16,6 +16,8 @@
 #include "GraphicsCore.h"
 #include "CommandListManager.h"
 #include "CommandContext.h"
+#include <random>
+#include <set>
 
 using namespace Graphics;
 using namespace std;
@@ -50,10 +52,69 @@ void BuddyBlock::InitFromResource(ByteAddressBuffer* pBuffer, uint32_t numElemen
 
 void BuddyBlock::Destroy()
 {
+    // Only placed blocks own their buffer
     m_pBuffer->Destroy();
+    delete m_pBuffer;
     m_pBuffer = nullptr;
 }
 
+void BuddyFreeBitmap::Reset(size_t NumBlocks)
+{
+    m_Levels.clear();
+
+    size_t NumBits = NumBlocks;
+    do
+    {
+        m_Levels.emplace_back((NumBits + 63) / 64, 0ull);
+        NumBits = m_Levels.back().size();
+    }
+    while (NumBits > 1);
+}
+
+void BuddyFreeBitmap::MarkFree(size_t Index)
+{
+    for (auto& Level : m_Levels)
+    {
+        uint64_t& Word = Level[Index >> 6];
+        const bool WasEmpty = (Word == 0);
+        Word |= 1ull << (Index & 63);
+
+        // The levels above already know about this word
+        if (!WasEmpty)
+            break;
+
+        Index >>= 6;
+    }
+}
+
+void BuddyFreeBitmap::MarkUsed(size_t Index)
+{
+    for (auto& Level : m_Levels)
+    {
+        uint64_t& Word = Level[Index >> 6];
+        Word &= ~(1ull << (Index & 63));
+
+        if (Word != 0)
+            break;
+
+        Index >>= 6;
+    }
+}
+
+size_t BuddyFreeBitmap::FindFirstFree() const
+{
+    ASSERT(!IsEmpty());
+
+    size_t Index = 0;
+    for (size_t Level = m_Levels.size(); Level-- > 0; )
+    {
+        unsigned long Bit;
+        _BitScanForward64(&Bit, m_Levels[Level][Index]);
+        Index = (Index << 6) + Bit;
+    }
+    return Index;
+}
+
 BuddyAllocator::BuddyAllocator(kBuddyAllocationStrategy allocationStrategy, D3D12_HEAP_TYPE heapType, size_t maxBlockSize, size_t MinBlockSize, size_t baseOffset)
     : m_allocationStrategy(allocationStrategy)
     , m_heapType(heapType)
@@ -61,6 +122,7 @@ BuddyAllocator::BuddyAllocator(kBuddyAllocationStrategy allocationStrategy, D3D1
     , m_maxBlockSize(maxBlockSize)
     , m_minBlockSize(MinBlockSize)
     , m_pBackingHeap(nullptr)
+    , m_nonEmptyOrders(0)
 #if defined(PROFILE) || defined(_DEBUG)
     , m_SpaceUsed(0)
     , m_InternalFragmentation(0)
@@ -70,6 +132,7 @@ BuddyAllocator::BuddyAllocator(kBuddyAllocationStrategy allocationStrategy, D3D1
     ASSERT(Math::IsPowerOfTwo(maxBlockSize / m_minBlockSize));
 
     m_maxOrder = UnitSizeToOrder(SizeToUnitSize(maxBlockSize));
+    ASSERT(m_maxOrder < 64);
 
     Reset();
 }
@@ -96,6 +159,17 @@ void BuddyAllocator::Initialize()
 
 void BuddyAllocator::Destroy()
 {
+    // Whatever is still pending belongs to work that has to be finished before the backing memory goes away
+    {
+        lock_guard<mutex> LockGuard(m_deletionMutex);
+        while (!m_deferredDeletionQueue.empty())
+        {
+            g_CommandManager.WaitForFence(m_deferredDeletionQueue.front().first);
+            DeallocateInternal(m_deferredDeletionQueue.front().second);
+            m_deferredDeletionQueue.pop();
+        }
+    }
+
     if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
     {
         m_pBackingHeap->Release();
@@ -106,159 +180,321 @@ void BuddyAllocator::Destroy()
     }
 }
 
-size_t BuddyAllocator::AllocateBlock(UINT order)
+void BuddyAllocator::Reset()
 {
-    size_t offset;
-
-    if (order > m_maxOrder)
-    {
-        throw(std::bad_alloc()); // Can't allocate a block that large  
-    }
+    lock_guard<mutex> LockGuard(m_freeListMutex);
 
-    auto it = m_freeBlocks[order].begin();
+    // Order N has (maxBlockSize / minBlockSize) >> N blocks
+    m_freeBlocks.resize(m_maxOrder + 1);
+    for (UINT order = 0; order <= m_maxOrder; ++order)
+        m_freeBlocks[order].Reset(OrderToUnitSize(m_maxOrder - order));
 
-    if (it == m_freeBlocks[order].end())
-    {
-        // No free nodes in the requested pool.  Try to find a higher-order block and split it.  
-        size_t left = AllocateBlock(order + 1);
+    // Initialize the pool with a single free block of the max block size
+    m_freeBlocks[m_maxOrder].MarkFree(0);
+    m_nonEmptyOrders = 1ull << m_maxOrder;
+}
 
-        size_t size = OrderToUnitSize(order);
+bool BuddyAllocator::AllocateBlock(UINT order, size_t& offset)
+{
+    if (order > m_maxOrder)
+        return false; // Can't allocate a block that large
 
-        size_t right = left + size;
+    // Smallest order at least as large as the request with a free block
+    const uint64_t candidates = m_nonEmptyOrders & ~((1ull << order) - 1);
+    if (candidates == 0)
+        return false;
 
-        m_freeBlocks[order].insert(right); // Add the right block to the free pool  
+    unsigned long foundOrder;
+    _BitScanForward64(&foundOrder, candidates);
 
-        offset = left; // Return the left block  
-    }
+    BuddyFreeBitmap& foundList = m_freeBlocks[foundOrder];
+    size_t index = foundList.FindFirstFree();
+    foundList.MarkUsed(index);
+    if (foundList.IsEmpty())
+        m_nonEmptyOrders &= ~(1ull << foundOrder);
 
-    else
+    // Split down to the requested order, keeping the left half and freeing the right half each time
+    for (UINT splitOrder = foundOrder; splitOrder > order; --splitOrder)
     {
-        offset = *it;
-
-        // Remove the block from the free list  
-        m_freeBlocks[order].erase(it);
+        index <<= 1;
+        m_freeBlocks[splitOrder - 1].MarkFree(index + 1);
+        m_nonEmptyOrders |= 1ull << (splitOrder - 1);
     }
 
-    return offset;
+    offset = index << order;
+    return true;
 }
 
 void BuddyAllocator::DeallocateBlock(size_t offset, UINT order)
 {
-    // See if the buddy block is free  
-    size_t size = OrderToUnitSize(order);
-
-    size_t buddy = GetBuddyOffset(offset, size);
-
-    auto it = m_freeBlocks[order].find(buddy);
+    size_t index = offset >> order;
 
-    if (it != m_freeBlocks[order].end())
+    // Merge with the buddy for as long as it is free
+    while (order < m_maxOrder && m_freeBlocks[order].IsFree(index ^ 1))
     {
-        // Deallocate merged blocks  
-        DeallocateBlock(min(offset, buddy), order + 1);
-        // Remove the buddy from the free list  
-        m_freeBlocks[order].erase(it);
-    }
-    else
-    {
-        // Add the block to the free list  
-        m_freeBlocks[order].insert(offset); // throw(std::bad_alloc) 
+        BuddyFreeBitmap& freeList = m_freeBlocks[order];
+        freeList.MarkUsed(index ^ 1);
+        if (freeList.IsEmpty())
+            m_nonEmptyOrders &= ~(1ull << order);
+
+        index >>= 1;
+        ++order;
     }
+
+    m_freeBlocks[order].MarkFree(index);
+    m_nonEmptyOrders |= 1ull << order;
 }
 
 BuddyBlock* BuddyAllocator::Allocate(uint32_t numElements, uint32_t elementSize, const void* initialData)
 {
+    CleanUpAllocations();
+
     size_t size = numElements * elementSize;
     size_t unitSize = SizeToUnitSize(size);
     UINT order = UnitSizeToOrder(unitSize);
 
-    try
+    size_t offset;
     {
-        size_t offset = AllocateBlock(order);
-        uint32_t paddedSize = uint32_t(OrderToUnitSize(order) * m_minBlockSize);
-
-        uint32_t blockOffset = uint32_t(m_baseOffset + (offset * m_minBlockSize));
+        lock_guard<mutex> LockGuard(m_freeListMutex);
 
-        INCREASE_BUDDY_COUNTER(m_SpaceUsed, paddedSize);
-        INCREASE_BUDDY_COUNTER(m_InternalFragmentation, (paddedSize - size));
-
-        BuddyBlock* pBlock = new BuddyBlock(blockOffset, //offset
-            paddedSize, //total size (padded to fit a block)
-            numElements * elementSize);
-            
-        if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
+        if (!AllocateBlock(order, offset))
         {
-            pBlock->InitPlaced(m_pBackingHeap, numElements, elementSize, initialData);
-        }
-        else
-        {
-            //TODO: To be truely thread-safe this operation should be atomic to guard against
-            //      the case in which blocks from this allocator are used on multiple threads 
-            //      (because it's really only 1 resource underneath)
-            pBlock->InitFromResource(&m_BackingResource, numElements, elementSize, initialData);
+            // There are no blocks available for the requested size so  
+            // return the NULL block type  
+            return new BuddyBlock();
         }
 
-        return pBlock;
+        INCREASE_BUDDY_COUNTER(m_SpaceUsed, OrderToUnitSize(order) * m_minBlockSize);
+        INCREASE_BUDDY_COUNTER(m_InternalFragmentation, (OrderToUnitSize(order) * m_minBlockSize - size));
     }
 
-    catch (std::bad_alloc&)
+    uint32_t paddedSize = uint32_t(OrderToUnitSize(order) * m_minBlockSize);
+
+    uint32_t blockOffset = uint32_t(m_baseOffset + (offset * m_minBlockSize));
+
+    BuddyBlock* pBlock = new BuddyBlock(blockOffset, //offset
+        paddedSize, //total size (padded to fit a block)
+        numElements * elementSize);
+            
+    if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
+    {
+        pBlock->InitPlaced(m_pBackingHeap, numElements, elementSize, initialData);
+    }
+    else
     {
-        // There are no blocks available for the requested size so  
-        // return the NULL block type  
-        return new BuddyBlock();
+        lock_guard<mutex> LockGuard(m_initializationMutex);
+        pBlock->InitFromResource(&m_BackingResource, numElements, elementSize, initialData);
     }
+
+    return pBlock;
+}
+
+void BuddyAllocator::Deallocate(BuddyBlock* pBlock, uint64_t FenceValue)
+{
+    pBlock->m_fenceValue = FenceValue;
+
+    lock_guard<mutex> LockGuard(m_deletionMutex);
+    m_deferredDeletionQueue.push(make_pair(FenceValue, pBlock));
 }
 
-/*
 void BuddyAllocator::Deallocate(BuddyBlock* pBlock)
 {
-    pBlock->m_fenceValue = g_CommandManager.GetNextFenceValue();
-    m_deferredDeletionQueue.push(pBlock);
+    // The next fence value of the graphics queue is signaled after everything submitted so far
+    Deallocate(pBlock, g_CommandManager.GetGraphicsQueue().GetNextFenceValue());
 }
-*/
 
 void BuddyAllocator::DeallocateInternal(BuddyBlock* pBlock)
 {
-    ASSERT(IsOwner(*pBlock));
+    // The NULL block returned by a failed allocation owns no memory
+    if (pBlock->GetSize() > 0)
+    {
+        ASSERT(IsOwner(*pBlock));
 
-    size_t offset = SizeToUnitSize(pBlock->GetOffset() - m_baseOffset);
+        size_t offset = SizeToUnitSize(pBlock->GetOffset() - m_baseOffset);
 
-    size_t size = SizeToUnitSize(pBlock->GetSize());
+        size_t size = SizeToUnitSize(pBlock->GetSize());
 
-    UINT order = UnitSizeToOrder(size);
+        UINT order = UnitSizeToOrder(size);
 
-    try
-    {
-        DeallocateBlock(offset, order); // throw(std::bad_alloc)
+        {
+            lock_guard<mutex> LockGuard(m_freeListMutex);
+
+            DeallocateBlock(offset, order);
+
+            DECREASE_BUDDY_COUNTER(m_SpaceUsed, pBlock->GetSize());
+            DECREASE_BUDDY_COUNTER(m_InternalFragmentation, (pBlock->GetSize() - pBlock->m_unpaddedSize));
+        }
 
-        DECREASE_BUDDY_COUNTER(m_SpaceUsed, size);
-        DECREASE_BUDDY_COUNTER(m_InternalFragmentation, (size - pBlock->m_unpaddedSize));
-        
         if (m_allocationStrategy == kBuddyAllocationStrategy::kPlacedResourceStrategy)
         {
             // Release the resource
             pBlock->Destroy();
         }
-        delete(pBlock);
     }
 
-    catch (std::bad_alloc&)
-    {
-        // Deallocate failed trying to add the free block to the pool  
-        // resulting in a leak.  Unfortunately there is not much we can do.  
-        // Fortunately this is expected to be extremely rare as the storage  
-        // needed for each deallocate is very small.  
-    }
-};
+    delete(pBlock);
+}
 
-/*
 void BuddyAllocator::CleanUpAllocations()
 {
-    while (m_deferredDeletionQueue.empty() == false &&
-        g_CommandManager.IsFenceComplete(m_deferredDeletionQueue.front()->m_fenceValue))
+    lock_guard<mutex> LockGuard(m_deletionMutex);
+
+    while (!m_deferredDeletionQueue.empty() &&
+        g_CommandManager.IsFenceComplete(m_deferredDeletionQueue.front().first))
     {
-        BuddyBlock* pBlock = m_deferredDeletionQueue.front();
+        BuddyBlock* pBlock = m_deferredDeletionQueue.front().second;
         m_deferredDeletionQueue.pop();
 
         DeallocateInternal(pBlock);
     }
-}*/
+}
+
+namespace
+{
+    // The std::set free lists the bitmaps replaced, in units of the minimum block size.  Both take the lowest
+    // free block of the smallest order that fits and keep the left half when splitting, so they have to agree
+    // on every offset.
+    class SetBuddyFreeLists
+    {
+    public:
+        explicit SetBuddyFreeLists( UINT MaxOrder ) : m_FreeBlocks(MaxOrder + 1)
+        {
+            m_FreeBlocks[MaxOrder].insert(0);
+        }
+
+        bool Allocate( UINT Order, size_t& Offset )
+        {
+            if (Order >= m_FreeBlocks.size())
+                return false;
+
+            auto it = m_FreeBlocks[Order].begin();
+            if (it == m_FreeBlocks[Order].end())
+            {
+                // Split the next order up and keep the left half
+                if (!Allocate(Order + 1, Offset))
+                    return false;
+                m_FreeBlocks[Order].insert(Offset + ((size_t)1 << Order));
+                return true;
+            }
+
+            Offset = *it;
+            m_FreeBlocks[Order].erase(it);
+            return true;
+        }
+
+        void Deallocate( size_t Offset, UINT Order )
+        {
+            auto it = Order + 1 < m_FreeBlocks.size() ? m_FreeBlocks[Order].find(Offset ^ ((size_t)1 << Order)) : m_FreeBlocks[Order].end();
+            if (it != m_FreeBlocks[Order].end())
+            {
+                m_FreeBlocks[Order].erase(it);
+                Deallocate(Offset & ~((size_t)1 << Order), Order + 1);
+            }
+            else
+            {
+                m_FreeBlocks[Order].insert(Offset);
+            }
+        }
+
+        bool IsSingleBlock( void ) const
+        {
+            for (size_t Order = 0; Order + 1 < m_FreeBlocks.size(); ++Order)
+            {
+                if (!m_FreeBlocks[Order].empty())
+                    return false;
+            }
+            return m_FreeBlocks.back().size() == 1;
+        }
+
+    private:
+        std::vector<std::set<size_t>> m_FreeBlocks;
+    };
+}
+
+bool BuddyAllocator::RunSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, uint64_t Value )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("Buddy allocator self test failed:  %s (%llu)\n", Name, Value);
+            Passed = false;
+        }
+    };
+
+    // 16384 units of one byte, requests of up to 128 units
+    const UINT kMaxOrder = 14;
+    const UINT kMaxRequestOrder = 7;
+    const size_t kUnits = (size_t)1 << kMaxOrder;
+
+    std::mt19937 Random(28);
+    for (uint32_t Round = 0; Round < 8 && Passed; ++Round)
+    {
+        BuddyAllocator Allocator(kManualSubAllocationStrategy, D3D12_HEAP_TYPE_DEFAULT, kUnits, 1);
+        SetBuddyFreeLists Reference(kMaxOrder);
+
+        std::vector<std::pair<size_t, UINT>> LiveBlocks;
+        std::vector<uint8_t> Occupied(kUnits, 0);
+
+        // Later rounds lean further towards allocating, so the range runs full and both sides have to fail together
+        const uint32_t AllocatePercent = 50 + Round * 5;
+
+        lock_guard<mutex> LockGuard(Allocator.m_freeListMutex);
+        for (uint32_t Step = 0; Step < 20000 && Passed; ++Step)
+        {
+            if (LiveBlocks.empty() || Random() % 100 < AllocatePercent)
+            {
+                const UINT Order = Random() % (kMaxRequestOrder + 1);
+                size_t Offset = 0, ReferenceOffset = 0;
+                const bool Allocated = Allocator.AllocateBlock(Order, Offset);
+                const bool ReferenceAllocated = Reference.Allocate(Order, ReferenceOffset);
+                Expect(Allocated == ReferenceAllocated, "allocation fails exactly when the set version does", Step);
+                if (!Allocated || !ReferenceAllocated)
+                    continue;
+
+                Expect(Offset == ReferenceOffset, "same offset as the set version", Offset);
+                Expect(Offset % Allocator.OrderToUnitSize(Order) == 0, "offset aligned to its order", Offset);
+                for (size_t Unit = Offset; Unit < Offset + ((size_t)1 << Order) && Unit < kUnits; ++Unit)
+                {
+                    Expect(!Occupied[Unit], "live blocks do not overlap", Unit);
+                    Occupied[Unit] = 1;
+                }
+                LiveBlocks.push_back(std::make_pair(Offset, Order));
+            }
+            else
+            {
+                const size_t Index = Random() % LiveBlocks.size();
+                const std::pair<size_t, UINT> Block = LiveBlocks[Index];
+                LiveBlocks[Index] = LiveBlocks.back();
+                LiveBlocks.pop_back();
+
+                Allocator.DeallocateBlock(Block.first, Block.second);
+                Reference.Deallocate(Block.first, Block.second);
+                std::fill_n(Occupied.begin() + Block.first, (size_t)1 << Block.second, uint8_t(0));
+            }
+        }
+
+        // With everything returned the range has to be one free block again
+        for (const std::pair<size_t, UINT>& Block : LiveBlocks)
+        {
+            Allocator.DeallocateBlock(Block.first, Block.second);
+            Reference.Deallocate(Block.first, Block.second);
+        }
+        Expect(Allocator.m_nonEmptyOrders == (1ull << kMaxOrder) && Allocator.m_freeBlocks[kMaxOrder].IsFree(0),
+            "bitmaps coalesce into one block", Round);
+        Expect(Reference.IsSingleBlock(), "set version coalesces into one block", Round);
+    }
+
+    // Requests larger than the range fail without touching it
+    {
+        BuddyAllocator Allocator(kManualSubAllocationStrategy, D3D12_HEAP_TYPE_DEFAULT, kUnits, 1);
+        lock_guard<mutex> LockGuard(Allocator.m_freeListMutex);
+        size_t Offset = 0;
+        Expect(!Allocator.AllocateBlock(kMaxOrder + 1, Offset), "oversized request fails", kMaxOrder + 1);
+        Expect(Allocator.AllocateBlock(kMaxOrder, Offset) && Offset == 0, "whole range", Offset);
+        Expect(!Allocator.AllocateBlock(0, Offset), "full range fails", 0);
+    }
+
+    return Passed;
+}
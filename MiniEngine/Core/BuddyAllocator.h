@@ -16,6 +16,11 @@
 // When a block is de-allocated an attempt is made to merge it with it's 
 // neighbour (buddy) if it is contiguous and free.
 // Based on reference implementation by Bill Kristiansen
+//
+// Each order keeps its free blocks in a two-level bitmap, so finding a free block is a pair of
+// bit scans rather than a tree lookup.  The bitmaps are guarded by a mutex that is only held for
+// the bit manipulation; creating and initializing the buffer happens outside of it.  Freed blocks
+// are retired with a fence value and only become available again once the GPU has passed it.
 //  
 
 #pragma once
@@ -24,7 +29,6 @@
 #include <vector>
 #include <queue>
 #include <mutex>
-#include <set>
 
 // Unfortunately the api restricts the minimum size of a placed buffer resource to 64k
 #define MIN_PLACED_BUFFER_SIZE (64 * 1024)
@@ -75,6 +79,27 @@ struct BuddyBlock
     void Destroy();
 };
 
+// Free list of a single order.  The lowest level has one bit per block, set while the block is free.
+// Every level above has one bit per word of the level below, set while that word is non-zero, so the
+// lowest free block is found with one bit scan per level (at most four for 16M blocks.)
+class BuddyFreeBitmap
+{
+public:
+    void Reset(size_t NumBlocks);
+
+    inline bool IsEmpty() const { return m_Levels.back()[0] == 0; }
+    inline bool IsFree(size_t Index) const { return (m_Levels[0][Index >> 6] & (1ull << (Index & 63))) != 0; }
+
+    void MarkFree(size_t Index);
+    void MarkUsed(size_t Index);
+
+    // Returns the lowest free block.  The bitmap must not be empty.
+    size_t FindFirstFree() const;
+
+private:
+    std::vector<std::vector<uint64_t>> m_Levels;
+};
+
 class BuddyAllocator
 {
 public:
@@ -87,6 +112,10 @@ public:
 
     BuddyBlock* Allocate(uint32_t numElements, uint32_t elementSize, const void* initialData = nullptr);
 
+    // The block is recycled once the GPU has passed FenceValue, e.g. the value returned by CommandContext::Finish()
+    void Deallocate(BuddyBlock* pBlock, uint64_t FenceValue);
+
+    // Retire the block against work that has been submitted to the graphics queue so far
     void Deallocate(BuddyBlock* pBlock);
 
     inline bool IsOwner(const BuddyBlock &block)
@@ -94,26 +123,32 @@ public:
         return block.GetOffset() >= m_baseOffset && block.GetSize() <= m_maxBlockSize;
     }
 
-    inline void Reset()
-    {
-        // Clear the free blocks collection  
-        m_freeBlocks.clear();
-
-        // Initialize the pool with a free inner block of max inner block size  
-        m_freeBlocks.resize(m_maxOrder + 1);
-        m_freeBlocks[m_maxOrder].insert((size_t)0);
-    }
+    void Reset();
 
+    // Return blocks whose fence has completed to the free lists.  Also done on every allocation.
     void CleanUpAllocations();
 
+    // Drives random allocations and frees through the bitmap free lists and through the std::set free lists
+    // they replaced, and checks that both place every block at the same offset, that no two live blocks
+    // overlap and that the range coalesces back into one block.  Only the free lists are touched, no memory.
+    static bool RunSelfTest( void );
+
 private:
     ID3D12Heap* m_pBackingHeap;
     ByteAddressBuffer m_BackingResource;
 
     const D3D12_HEAP_TYPE m_heapType;
 
-    std::queue<BuddyBlock*> m_deferredDeletionQueue;
-    std::vector<std::set<size_t>> m_freeBlocks;
+    std::mutex m_freeListMutex;
+    std::vector<BuddyFreeBitmap> m_freeBlocks;
+    uint64_t m_nonEmptyOrders; // Bit N is set when order N has at least one free block
+
+    std::mutex m_deletionMutex;
+    std::queue<std::pair<uint64_t, BuddyBlock*>> m_deferredDeletionQueue;
+
+    // Blocks of the manual strategy share one resource, so its state can only be changed by one thread at a time
+    std::mutex m_initializationMutex;
+
     UINT m_maxOrder;
     const size_t m_baseOffset;
     const size_t m_maxBlockSize;
@@ -131,15 +166,12 @@ private:
         return Math::Log2(size); // Log2 rounds up fractions to next whole value
     }
 
-    inline size_t GetBuddyOffset(const size_t &offset, const size_t &size)
-    {
-        return offset ^ size;
-    }
-
     void DeallocateInternal(BuddyBlock* pBlock);
 
     size_t OrderToUnitSize(UINT order) const { return ((size_t)1) << order; }
-    size_t AllocateBlock(UINT order);
+
+    // Offsets are in units of the minimum block size.  Both must be called with m_freeListMutex held.
+    bool AllocateBlock(UINT order, size_t& offset);
     void DeallocateBlock(size_t offset, UINT order);
 
 #if defined(PROFILE) || defined(_DEBUG)
@@ -17,6 +17,7 @@
 #include "GraphicsCore.h"
 #include "CommandContext.h"
 #include "EsramAllocator.h"
+#include "TransientResourceAllocator.h"
 #include "TemporalEffects.h"
 
 namespace Graphics
@@ -82,6 +83,9 @@ namespace Graphics
     ColorBuffer g_GenMipsBuffer;
 
     DXGI_FORMAT DefaultHdrColorFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+    // Owns the heaps backing every buffer that is only live within a single eTransientPhase range
+    TransientResourceAllocator s_TransientResources;
 }
 
 #define T2X_COLOR_FORMAT DXGI_FORMAT_R10G10B10A2_UNORM
@@ -106,6 +110,9 @@ void Graphics::InitializeRenderingBuffers( uint32_t bufferWidth, uint32_t buffer
 
     EsramAllocator esram;
 
+    // Changing the resolution recreates all buffers
+    s_TransientResources.Destroy();
+
     esram.PushStack();
 
         g_SceneColorBuffer.CreateArray( L"Main Color Buffers", bufferWidth, bufferHeight, 2, DefaultHdrColorFormat, esram );
@@ -129,25 +136,25 @@ void Graphics::InitializeRenderingBuffers( uint32_t bufferWidth, uint32_t buffer
                     g_SSAOFullScreen.Create( L"SSAO Full Res", bufferWidth, bufferHeight, 1, DXGI_FORMAT_R8_UNORM );
 
                     esram.PushStack();    // Begin generating SSAO
-                        g_DepthDownsize1.Create( L"Depth Down-Sized 1", bufferWidth1, bufferHeight1, 1, DXGI_FORMAT_R32_FLOAT, esram );
-                        g_DepthDownsize2.Create( L"Depth Down-Sized 2", bufferWidth2, bufferHeight2, 1, DXGI_FORMAT_R32_FLOAT, esram );
-                        g_DepthDownsize3.Create( L"Depth Down-Sized 3", bufferWidth3, bufferHeight3, 1, DXGI_FORMAT_R32_FLOAT, esram );
-                        g_DepthDownsize4.Create( L"Depth Down-Sized 4", bufferWidth4, bufferHeight4, 1, DXGI_FORMAT_R32_FLOAT, esram );
-                        g_DepthTiled1.CreateArray( L"Depth De-Interleaved 1", bufferWidth3, bufferHeight3, 16, DXGI_FORMAT_R16_FLOAT, esram );
-                        g_DepthTiled2.CreateArray( L"Depth De-Interleaved 2", bufferWidth4, bufferHeight4, 16, DXGI_FORMAT_R16_FLOAT, esram );
-                        g_DepthTiled3.CreateArray( L"Depth De-Interleaved 3", bufferWidth5, bufferHeight5, 16, DXGI_FORMAT_R16_FLOAT, esram );
-                        g_DepthTiled4.CreateArray( L"Depth De-Interleaved 4", bufferWidth6, bufferHeight6, 16, DXGI_FORMAT_R16_FLOAT, esram );
-                        g_AOMerged1.Create( L"AO Re-Interleaved 1", bufferWidth1, bufferHeight1, 1, DXGI_FORMAT_R8_UNORM, esram );
-                        g_AOMerged2.Create( L"AO Re-Interleaved 2", bufferWidth2, bufferHeight2, 1, DXGI_FORMAT_R8_UNORM, esram );
-                        g_AOMerged3.Create( L"AO Re-Interleaved 3", bufferWidth3, bufferHeight3, 1, DXGI_FORMAT_R8_UNORM, esram );
-                        g_AOMerged4.Create( L"AO Re-Interleaved 4", bufferWidth4, bufferHeight4, 1, DXGI_FORMAT_R8_UNORM, esram );
-                        g_AOSmooth1.Create( L"AO Smoothed 1", bufferWidth1, bufferHeight1, 1, DXGI_FORMAT_R8_UNORM, esram );
-                        g_AOSmooth2.Create( L"AO Smoothed 2", bufferWidth2, bufferHeight2, 1, DXGI_FORMAT_R8_UNORM, esram );
-                        g_AOSmooth3.Create( L"AO Smoothed 3", bufferWidth3, bufferHeight3, 1, DXGI_FORMAT_R8_UNORM, esram );
-                        g_AOHighQuality1.Create( L"AO High Quality 1", bufferWidth1, bufferHeight1, 1, DXGI_FORMAT_R8_UNORM, esram );
-                        g_AOHighQuality2.Create( L"AO High Quality 2", bufferWidth2, bufferHeight2, 1, DXGI_FORMAT_R8_UNORM, esram );
-                        g_AOHighQuality3.Create( L"AO High Quality 3", bufferWidth3, bufferHeight3, 1, DXGI_FORMAT_R8_UNORM, esram );
-                        g_AOHighQuality4.Create( L"AO High Quality 4", bufferWidth4, bufferHeight4, 1, DXGI_FORMAT_R8_UNORM, esram );
+                        s_TransientResources.AddColorBuffer( g_DepthDownsize1, L"Depth Down-Sized 1", bufferWidth1, bufferHeight1, 1, 1, DXGI_FORMAT_R32_FLOAT, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_DepthDownsize2, L"Depth Down-Sized 2", bufferWidth2, bufferHeight2, 1, 1, DXGI_FORMAT_R32_FLOAT, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_DepthDownsize3, L"Depth Down-Sized 3", bufferWidth3, bufferHeight3, 1, 1, DXGI_FORMAT_R32_FLOAT, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_DepthDownsize4, L"Depth Down-Sized 4", bufferWidth4, bufferHeight4, 1, 1, DXGI_FORMAT_R32_FLOAT, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_DepthTiled1, L"Depth De-Interleaved 1", bufferWidth3, bufferHeight3, 16, 1, DXGI_FORMAT_R16_FLOAT, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_DepthTiled2, L"Depth De-Interleaved 2", bufferWidth4, bufferHeight4, 16, 1, DXGI_FORMAT_R16_FLOAT, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_DepthTiled3, L"Depth De-Interleaved 3", bufferWidth5, bufferHeight5, 16, 1, DXGI_FORMAT_R16_FLOAT, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_DepthTiled4, L"Depth De-Interleaved 4", bufferWidth6, bufferHeight6, 16, 1, DXGI_FORMAT_R16_FLOAT, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_AOMerged1, L"AO Re-Interleaved 1", bufferWidth1, bufferHeight1, 1, 1, DXGI_FORMAT_R8_UNORM, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_AOMerged2, L"AO Re-Interleaved 2", bufferWidth2, bufferHeight2, 1, 1, DXGI_FORMAT_R8_UNORM, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_AOMerged3, L"AO Re-Interleaved 3", bufferWidth3, bufferHeight3, 1, 1, DXGI_FORMAT_R8_UNORM, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_AOMerged4, L"AO Re-Interleaved 4", bufferWidth4, bufferHeight4, 1, 1, DXGI_FORMAT_R8_UNORM, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_AOSmooth1, L"AO Smoothed 1", bufferWidth1, bufferHeight1, 1, 1, DXGI_FORMAT_R8_UNORM, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_AOSmooth2, L"AO Smoothed 2", bufferWidth2, bufferHeight2, 1, 1, DXGI_FORMAT_R8_UNORM, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_AOSmooth3, L"AO Smoothed 3", bufferWidth3, bufferHeight3, 1, 1, DXGI_FORMAT_R8_UNORM, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_AOHighQuality1, L"AO High Quality 1", bufferWidth1, bufferHeight1, 1, 1, DXGI_FORMAT_R8_UNORM, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_AOHighQuality2, L"AO High Quality 2", bufferWidth2, bufferHeight2, 1, 1, DXGI_FORMAT_R8_UNORM, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_AOHighQuality3, L"AO High Quality 3", bufferWidth3, bufferHeight3, 1, 1, DXGI_FORMAT_R8_UNORM, kSSAOPhase, kSSAOPhase );
+                        s_TransientResources.AddColorBuffer( g_AOHighQuality4, L"AO High Quality 4", bufferWidth4, bufferHeight4, 1, 1, DXGI_FORMAT_R8_UNORM, kSSAOPhase, kSSAOPhase );
                     esram.PopStack();    // End generating SSAO
 
                     g_ShadowBuffer.Create( L"Shadow Map", 2048, 2048, esram );
@@ -155,18 +162,18 @@ void Graphics::InitializeRenderingBuffers( uint32_t bufferWidth, uint32_t buffer
                 esram.PopStack();    // End Shading
 
                 esram.PushStack();    // Begin depth of field
-                    g_DoFTileClass[0].Create(L"DoF Tile Classification Buffer 0", bufferWidth4, bufferHeight4, 1, DXGI_FORMAT_R11G11B10_FLOAT);
-                    g_DoFTileClass[1].Create(L"DoF Tile Classification Buffer 1", bufferWidth4, bufferHeight4, 1, DXGI_FORMAT_R11G11B10_FLOAT);
-
-                    g_DoFPresortBuffer.Create(L"DoF Presort Buffer", bufferWidth1, bufferHeight1, 1, DXGI_FORMAT_R11G11B10_FLOAT, esram );
-                    g_DoFPrefilter.Create(L"DoF PreFilter Buffer", bufferWidth1, bufferHeight1, 1, DXGI_FORMAT_R11G11B10_FLOAT, esram );
-                    g_DoFBlurColor[0].Create(L"DoF Blur Color", bufferWidth1, bufferHeight1, 1, DXGI_FORMAT_R11G11B10_FLOAT, esram );
-                    g_DoFBlurColor[1].Create(L"DoF Blur Color", bufferWidth1, bufferHeight1, 1, DXGI_FORMAT_R11G11B10_FLOAT, esram );
-                    g_DoFBlurAlpha[0].Create(L"DoF FG Alpha", bufferWidth1, bufferHeight1, 1, DXGI_FORMAT_R8_UNORM, esram );
-                    g_DoFBlurAlpha[1].Create(L"DoF FG Alpha", bufferWidth1, bufferHeight1, 1, DXGI_FORMAT_R8_UNORM, esram );
-                    g_DoFWorkQueue.Create(L"DoF Work Queue", bufferWidth4 * bufferHeight4, 4, esram );
-                    g_DoFFastQueue.Create(L"DoF Fast Queue", bufferWidth4 * bufferHeight4, 4, esram );
-                    g_DoFFixupQueue.Create(L"DoF Fixup Queue", bufferWidth4 * bufferHeight4, 4, esram );
+                    s_TransientResources.AddColorBuffer( g_DoFTileClass[0], L"DoF Tile Classification Buffer 0", bufferWidth4, bufferHeight4, 1, 1, DXGI_FORMAT_R11G11B10_FLOAT, kDepthOfFieldPhase, kDepthOfFieldPhase );
+                    s_TransientResources.AddColorBuffer( g_DoFTileClass[1], L"DoF Tile Classification Buffer 1", bufferWidth4, bufferHeight4, 1, 1, DXGI_FORMAT_R11G11B10_FLOAT, kDepthOfFieldPhase, kDepthOfFieldPhase );
+
+                    s_TransientResources.AddColorBuffer( g_DoFPresortBuffer, L"DoF Presort Buffer", bufferWidth1, bufferHeight1, 1, 1, DXGI_FORMAT_R11G11B10_FLOAT, kDepthOfFieldPhase, kDepthOfFieldPhase );
+                    s_TransientResources.AddColorBuffer( g_DoFPrefilter, L"DoF PreFilter Buffer", bufferWidth1, bufferHeight1, 1, 1, DXGI_FORMAT_R11G11B10_FLOAT, kDepthOfFieldPhase, kDepthOfFieldPhase );
+                    s_TransientResources.AddColorBuffer( g_DoFBlurColor[0], L"DoF Blur Color", bufferWidth1, bufferHeight1, 1, 1, DXGI_FORMAT_R11G11B10_FLOAT, kDepthOfFieldPhase, kDepthOfFieldPhase );
+                    s_TransientResources.AddColorBuffer( g_DoFBlurColor[1], L"DoF Blur Color", bufferWidth1, bufferHeight1, 1, 1, DXGI_FORMAT_R11G11B10_FLOAT, kDepthOfFieldPhase, kDepthOfFieldPhase );
+                    s_TransientResources.AddColorBuffer( g_DoFBlurAlpha[0], L"DoF FG Alpha", bufferWidth1, bufferHeight1, 1, 1, DXGI_FORMAT_R8_UNORM, kDepthOfFieldPhase, kDepthOfFieldPhase );
+                    s_TransientResources.AddColorBuffer( g_DoFBlurAlpha[1], L"DoF FG Alpha", bufferWidth1, bufferHeight1, 1, 1, DXGI_FORMAT_R8_UNORM, kDepthOfFieldPhase, kDepthOfFieldPhase );
+                    s_TransientResources.AddBuffer( g_DoFWorkQueue, L"DoF Work Queue", bufferWidth4 * bufferHeight4, 4, kDepthOfFieldPhase, kDepthOfFieldPhase );
+                    s_TransientResources.AddBuffer( g_DoFFastQueue, L"DoF Fast Queue", bufferWidth4 * bufferHeight4, 4, kDepthOfFieldPhase, kDepthOfFieldPhase );
+                    s_TransientResources.AddBuffer( g_DoFFixupQueue, L"DoF Fixup Queue", bufferWidth4 * bufferHeight4, 4, kDepthOfFieldPhase, kDepthOfFieldPhase );
                 esram.PopStack();    // End depth of field
 
                 g_TemporalColor[0].CreateArray( L"Temporal Color 0", bufferWidth, bufferHeight, 2, DXGI_FORMAT_R16G16B16A16_FLOAT);
@@ -174,7 +181,7 @@ void Graphics::InitializeRenderingBuffers( uint32_t bufferWidth, uint32_t buffer
                 TemporalEffects::ClearHistory(InitContext);
 
                 esram.PushStack();    // Begin motion blur
-                    g_MotionPrepBuffer.Create( L"Motion Blur Prep", bufferWidth1, bufferHeight1, 1, HDR_MOTION_FORMAT, esram );
+                    s_TransientResources.AddColorBuffer( g_MotionPrepBuffer, L"Motion Blur Prep", bufferWidth1, bufferHeight1, 1, 1, HDR_MOTION_FORMAT, kMotionBlurPhase, kMotionBlurPhase );
                 esram.PopStack();    // End motion blur
 
             esram.PopStack();    // End opaque geometry
@@ -184,7 +191,7 @@ void Graphics::InitializeRenderingBuffers( uint32_t bufferWidth, uint32_t buffer
         esram.PushStack();    // Begin post processing
 
             // This is useful for storing per-pixel weights such as motion strength or pixel luminance
-            g_LumaBuffer.Create( L"Luminance", bufferWidth, bufferHeight, 1, DXGI_FORMAT_R8_UNORM, esram );
+            s_TransientResources.AddColorBuffer( g_LumaBuffer, L"Luminance", bufferWidth, bufferHeight, 1, 1, DXGI_FORMAT_R8_UNORM, kBloomPhase, kAntialiasingPhase );
             g_Histogram.Create( L"Histogram", 256, 4, esram );
 
             // Divisible by 128 so that after dividing by 16, we still have multiples of 8x8 tiles.  The bloom
@@ -195,23 +202,23 @@ void Graphics::InitializeRenderingBuffers( uint32_t bufferWidth, uint32_t buffer
             uint32_t kBloomHeight = bufferHeight > 1440 ? 768 : 384;
 
             esram.PushStack();    // Begin bloom and tone mapping
-                g_LumaLR.Create( L"Luma Buffer", kBloomWidth, kBloomHeight, 1, DXGI_FORMAT_R8_UINT, esram );
-                g_aBloomUAV1[0].Create( L"Bloom Buffer 1a", kBloomWidth,    kBloomHeight,    1, DefaultHdrColorFormat, esram );
-                g_aBloomUAV1[1].Create( L"Bloom Buffer 1b", kBloomWidth,    kBloomHeight,    1, DefaultHdrColorFormat, esram);
-                g_aBloomUAV2[0].Create( L"Bloom Buffer 2a", kBloomWidth/2,  kBloomHeight/2,  1, DefaultHdrColorFormat, esram );
-                g_aBloomUAV2[1].Create( L"Bloom Buffer 2b", kBloomWidth/2,  kBloomHeight/2,  1, DefaultHdrColorFormat, esram );
-                g_aBloomUAV3[0].Create( L"Bloom Buffer 3a", kBloomWidth/4,  kBloomHeight/4,  1, DefaultHdrColorFormat, esram );
-                g_aBloomUAV3[1].Create( L"Bloom Buffer 3b", kBloomWidth/4,  kBloomHeight/4,  1, DefaultHdrColorFormat, esram );
-                g_aBloomUAV4[0].Create( L"Bloom Buffer 4a", kBloomWidth/8,  kBloomHeight/8,  1, DefaultHdrColorFormat, esram );
-                g_aBloomUAV4[1].Create( L"Bloom Buffer 4b", kBloomWidth/8,  kBloomHeight/8,  1, DefaultHdrColorFormat, esram );
-                g_aBloomUAV5[0].Create( L"Bloom Buffer 5a", kBloomWidth/16, kBloomHeight/16, 1, DefaultHdrColorFormat, esram );
-                g_aBloomUAV5[1].Create( L"Bloom Buffer 5b", kBloomWidth/16, kBloomHeight/16, 1, DefaultHdrColorFormat, esram );
+                s_TransientResources.AddColorBuffer( g_LumaLR, L"Luma Buffer", kBloomWidth, kBloomHeight, 1, 1, DXGI_FORMAT_R8_UINT, kBloomPhase, kBloomPhase );
+                s_TransientResources.AddColorBuffer( g_aBloomUAV1[0], L"Bloom Buffer 1a", kBloomWidth, kBloomHeight, 1, 1, DefaultHdrColorFormat, kBloomPhase, kBloomPhase );
+                s_TransientResources.AddColorBuffer( g_aBloomUAV1[1], L"Bloom Buffer 1b", kBloomWidth, kBloomHeight, 1, 1, DefaultHdrColorFormat, kBloomPhase, kBloomPhase );
+                s_TransientResources.AddColorBuffer( g_aBloomUAV2[0], L"Bloom Buffer 2a", kBloomWidth/2, kBloomHeight/2, 1, 1, DefaultHdrColorFormat, kBloomPhase, kBloomPhase );
+                s_TransientResources.AddColorBuffer( g_aBloomUAV2[1], L"Bloom Buffer 2b", kBloomWidth/2, kBloomHeight/2, 1, 1, DefaultHdrColorFormat, kBloomPhase, kBloomPhase );
+                s_TransientResources.AddColorBuffer( g_aBloomUAV3[0], L"Bloom Buffer 3a", kBloomWidth/4, kBloomHeight/4, 1, 1, DefaultHdrColorFormat, kBloomPhase, kBloomPhase );
+                s_TransientResources.AddColorBuffer( g_aBloomUAV3[1], L"Bloom Buffer 3b", kBloomWidth/4, kBloomHeight/4, 1, 1, DefaultHdrColorFormat, kBloomPhase, kBloomPhase );
+                s_TransientResources.AddColorBuffer( g_aBloomUAV4[0], L"Bloom Buffer 4a", kBloomWidth/8, kBloomHeight/8, 1, 1, DefaultHdrColorFormat, kBloomPhase, kBloomPhase );
+                s_TransientResources.AddColorBuffer( g_aBloomUAV4[1], L"Bloom Buffer 4b", kBloomWidth/8, kBloomHeight/8, 1, 1, DefaultHdrColorFormat, kBloomPhase, kBloomPhase );
+                s_TransientResources.AddColorBuffer( g_aBloomUAV5[0], L"Bloom Buffer 5a", kBloomWidth/16, kBloomHeight/16, 1, 1, DefaultHdrColorFormat, kBloomPhase, kBloomPhase );
+                s_TransientResources.AddColorBuffer( g_aBloomUAV5[1], L"Bloom Buffer 5b", kBloomWidth/16, kBloomHeight/16, 1, 1, DefaultHdrColorFormat, kBloomPhase, kBloomPhase );
             esram.PopStack();    // End tone mapping
 
             esram.PushStack();    // Begin antialiasing
                 const uint32_t kFXAAWorkSize = bufferWidth * bufferHeight / 4 + 128;
-                g_FXAAWorkQueue.Create( L"FXAA Work Queue", kFXAAWorkSize, sizeof(uint32_t), esram );
-                g_FXAAColorQueue.Create( L"FXAA Color Queue", kFXAAWorkSize, sizeof(uint32_t), esram );
+                s_TransientResources.AddBuffer( g_FXAAWorkQueue, L"FXAA Work Queue", kFXAAWorkSize, sizeof(uint32_t), kAntialiasingPhase, kAntialiasingPhase );
+                s_TransientResources.AddBuffer( g_FXAAColorQueue, L"FXAA Color Queue", kFXAAWorkSize, sizeof(uint32_t), kAntialiasingPhase, kAntialiasingPhase );
                 g_FXAAWorkCounters.Create(L"FXAA Work Counters", 2, sizeof(uint32_t));
                 InitContext.ClearUAV(g_FXAAWorkCounters);
             esram.PopStack();    // End antialiasing
@@ -219,7 +226,7 @@ void Graphics::InitializeRenderingBuffers( uint32_t bufferWidth, uint32_t buffer
         esram.PopStack();    // End post processing
 
         esram.PushStack(); // GenerateMipMaps() test
-            g_GenMipsBuffer.Create(L"GenMips", bufferWidth, bufferHeight, 0, DXGI_FORMAT_R11G11B10_FLOAT, esram );
+            s_TransientResources.AddColorBuffer( g_GenMipsBuffer, L"GenMips", bufferWidth, bufferHeight, 1, 0, DXGI_FORMAT_R11G11B10_FLOAT, kGenerateMipsPhase, kGenerateMipsPhase );
         esram.PopStack();
 
         g_OverlayBuffer.Create( L"UI Overlay", g_DisplayWidth, g_DisplayHeight, 1, DXGI_FORMAT_R8G8B8A8_UNORM, esram );
@@ -227,9 +234,16 @@ void Graphics::InitializeRenderingBuffers( uint32_t bufferWidth, uint32_t buffer
 
     esram.PopStack(); // End final image
 
+    s_TransientResources.Commit();
+
     InitContext.Finish();
 }
 
+void Graphics::BeginTransientPhase( CommandContext& Context, eTransientPhase Phase )
+{
+    s_TransientResources.BeginPhase(Context, Phase);
+}
+
 void Graphics::ResizeDisplayDependentBuffers(uint32_t /*NativeWidth*/, uint32_t NativeHeight)
 {
     g_OverlayBuffer.Create( L"UI Overlay", g_DisplayWidth, g_DisplayHeight, 1, DXGI_FORMAT_R8G8B8A8_UNORM );
@@ -306,4 +320,6 @@ void Graphics::DestroyRenderingBuffers()
     g_FXAAColorQueue.Destroy();
 
     g_GenMipsBuffer.Destroy();
+
+    s_TransientResources.Destroy();
 }
@@ -79,6 +79,23 @@ namespace Graphics
     extern ByteAddressBuffer g_FXAAWorkQueue;
     extern TypedBuffer g_FXAAColorQueue;
 
+    // Intermediate buffers that are only needed within one of these phases share memory with the
+    // buffers of the other phases.  Phases are listed in the order they are rendered for each eye.
+    enum eTransientPhase
+    {
+        kSSAOPhase,
+        kDepthOfFieldPhase,
+        kMotionBlurPhase,
+        kBloomPhase,
+        kAntialiasingPhase,
+        kGenerateMipsPhase,
+
+        kNumTransientPhases
+    };
+
+    // Must be called before the first use of the buffers of a phase
+    void BeginTransientPhase( CommandContext& Context, eTransientPhase Phase );
+
     void InitializeRenderingBuffers(uint32_t NativeWidth, uint32_t NativeHeight );
     void ResizeDisplayDependentBuffers(uint32_t NativeWidth, uint32_t NativeHeight);
     void DestroyRenderingBuffers();
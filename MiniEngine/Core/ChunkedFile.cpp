@@ -0,0 +1,492 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "pch.h"
+#include "ChunkedFile.h"
+#include <ppl.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <zlib.h> // From NuGet package
+
+using namespace ChunkedFile;
+
+namespace
+{
+    // The LZ4 block format:  every match is at least 4 bytes, the last match starts at least 12 bytes before
+    // the end, and the last 5 bytes are always literals
+    const size_t kMinMatch = 4;
+    const size_t kMatchStartMargin = 12;
+    const size_t kLastLiterals = 5;
+    const size_t kMaxOffset = 65535;
+    const uint32_t kHashBits = 14;
+
+    uint32_t Read32( const uint8_t* Source )
+    {
+        uint32_t Value;
+        std::memcpy(&Value, Source, sizeof(Value));
+        return Value;
+    }
+
+    uint32_t HashSequence( uint32_t Sequence )
+    {
+        return (Sequence * 2654435761u) >> (32 - kHashBits);
+    }
+
+    size_t GetBlockSize( const Header& FileHeader, uint32_t Block )
+    {
+        return (size_t)std::min<uint64_t>(FileHeader.BlockSize, FileHeader.Size - (uint64_t)Block * FileHeader.BlockSize);
+    }
+
+    size_t GetIndexEnd( const Header& FileHeader )
+    {
+        return sizeof(Header) + FileHeader.BlockCount * sizeof(BlockEntry);
+    }
+
+    // The header is one this code wrote, and the blocks follow the index in order within the file
+    bool IsValid( const Header& FileHeader, const std::vector<BlockEntry>& Blocks, uint64_t FileSize )
+    {
+        if (FileHeader.Magic != kMagic || FileHeader.Version != kVersion || FileHeader.BlockSize == 0 ||
+            FileHeader.BlockCount != (FileHeader.Size + FileHeader.BlockSize - 1) / FileHeader.BlockSize)
+            return false;
+
+        uint64_t End = GetIndexEnd(FileHeader);
+        for (const BlockEntry& Block : Blocks)
+        {
+            if (Block.Offset < End || Block.Offset + Block.CompressedSize > FileSize || Block.Codec > kLZ)
+                return false;
+            End = Block.Offset + Block.CompressedSize;
+        }
+        return true;
+    }
+
+    bool DecodeBlock( const BlockEntry& Block, const uint8_t* Source, uint8_t* Dest, size_t DestSize )
+    {
+        switch (Block.Codec)
+        {
+        case kStored:
+            if (Block.CompressedSize != DestSize)
+                return false;
+            std::memcpy(Dest, Source, DestSize);
+            return true;
+
+        case kZlib:
+        {
+            uLongf Length = (uLongf)DestSize;
+            return uncompress(Dest, &Length, Source, Block.CompressedSize) == Z_OK && Length == DestSize;
+        }
+
+        case kLZ:
+            return DecompressLZ(Source, Block.CompressedSize, Dest, DestSize);
+
+        default:
+            return false;
+        }
+    }
+}
+
+size_t ChunkedFile::CompressLZ( const uint8_t* Source, size_t SourceSize, uint8_t* Dest, size_t Capacity )
+{
+    uint8_t* Out = Dest;
+    uint8_t* const OutEnd = Dest + Capacity;
+    size_t Anchor = 0;
+
+    // The bytes that follow a length nibble of 15
+    auto WriteLength = [&]( size_t Length )
+    {
+        for (; Length >= 255; Length -= 255)
+        {
+            if (Out == OutEnd)
+                return false;
+            *Out++ = 255;
+        }
+        if (Out == OutEnd)
+            return false;
+        *Out++ = (uint8_t)Length;
+        return true;
+    };
+
+    // The literals since the last match, then a match unless MatchLength is 0
+    auto WriteSequence = [&]( size_t LiteralEnd, size_t Offset, size_t MatchLength )
+    {
+        const size_t Literals = LiteralEnd - Anchor;
+        if (Out == OutEnd)
+            return false;
+        uint8_t* Token = Out++;
+        *Token = (uint8_t)(std::min<size_t>(Literals, 15) << 4);
+        if (Literals >= 15 && !WriteLength(Literals - 15))
+            return false;
+        if ((size_t)(OutEnd - Out) < Literals)
+            return false;
+        std::memcpy(Out, Source + Anchor, Literals);
+        Out += Literals;
+        if (MatchLength == 0)
+            return true;
+
+        if (OutEnd - Out < 2)
+            return false;
+        *Out++ = (uint8_t)Offset;
+        *Out++ = (uint8_t)(Offset >> 8);
+        const size_t Extra = MatchLength - kMinMatch;
+        *Token |= (uint8_t)std::min<size_t>(Extra, 15);
+        return Extra < 15 || WriteLength(Extra - 15);
+    };
+
+    if (SourceSize > kMatchStartMargin)
+    {
+        std::vector<uint32_t> Table(1 << kHashBits, UINT32_MAX);
+        const size_t MatchStartLimit = SourceSize - kMatchStartMargin;
+        const size_t MatchEndLimit = SourceSize - kLastLiterals;
+        size_t Pos = 0;
+        uint32_t Misses = 0;
+        while (Pos < MatchStartLimit)
+        {
+            const uint32_t Sequence = Read32(Source + Pos);
+            uint32_t& Slot = Table[HashSequence(Sequence)];
+            const size_t Candidate = Slot;
+            Slot = (uint32_t)Pos;
+            if (Candidate == UINT32_MAX || Pos - Candidate > kMaxOffset || Read32(Source + Candidate) != Sequence)
+            {
+                // Step faster through data that does not compress
+                Pos += 1 + (Misses++ >> 6);
+                continue;
+            }
+
+            Misses = 0;
+            size_t Length = kMinMatch;
+            while (Pos + Length < MatchEndLimit && Source[Candidate + Length] == Source[Pos + Length])
+                ++Length;
+            if (!WriteSequence(Pos, Pos - Candidate, Length))
+                return 0;
+            Pos += Length;
+            Anchor = Pos;
+        }
+    }
+
+    if (!WriteSequence(SourceSize, 0, 0))
+        return 0;
+    return Out - Dest;
+}
+
+bool ChunkedFile::DecompressLZ( const uint8_t* Source, size_t SourceSize, uint8_t* Dest, size_t DestSize )
+{
+    const uint8_t* In = Source;
+    const uint8_t* const InEnd = Source + SourceSize;
+    uint8_t* Out = Dest;
+    uint8_t* const OutEnd = Dest + DestSize;
+
+    auto ReadLength = [&]( size_t& Length )
+    {
+        uint8_t Byte;
+        do
+        {
+            if (In == InEnd)
+                return false;
+            Byte = *In++;
+            Length += Byte;
+        } while (Byte == 255);
+        return true;
+    };
+
+    while (In < InEnd)
+    {
+        const uint8_t Token = *In++;
+        size_t Literals = Token >> 4;
+        if (Literals == 15 && !ReadLength(Literals))
+            return false;
+        if ((size_t)(InEnd - In) < Literals || (size_t)(OutEnd - Out) < Literals)
+            return false;
+        std::memcpy(Out, In, Literals);
+        In += Literals;
+        Out += Literals;
+
+        // The last sequence has no match
+        if (In == InEnd)
+            break;
+
+        if (InEnd - In < 2)
+            return false;
+        const size_t Offset = In[0] | In[1] << 8;
+        In += 2;
+        size_t Length = Token & 15;
+        if (Length == 15 && !ReadLength(Length))
+            return false;
+        Length += kMinMatch;
+        if (Offset == 0 || Offset > (size_t)(Out - Dest) || (size_t)(OutEnd - Out) < Length)
+            return false;
+
+        // A match that overlaps itself repeats its first Offset bytes.  Each copy doubles how far back the
+        // next one can read from without overlapping.
+        size_t Period = Offset;
+        while (Length > 0)
+        {
+            const size_t Step = std::min(Period, Length);
+            std::memcpy(Out, Out - Period, Step);
+            Out += Step;
+            Length -= Step;
+            Period += Step;
+        }
+    }
+
+    return Out == OutEnd;
+}
+
+std::vector<uint8_t> ChunkedFile::Pack( const uint8_t* Data, size_t Size, Codec BlockCodec, uint32_t BlockSize )
+{
+    ASSERT(BlockSize > 0);
+
+    Header FileHeader = {};
+    FileHeader.Magic = kMagic;
+    FileHeader.Version = kVersion;
+    FileHeader.Size = Size;
+    FileHeader.BlockSize = BlockSize;
+    FileHeader.BlockCount = (uint32_t)((Size + BlockSize - 1) / BlockSize);
+
+    std::vector<BlockEntry> Blocks(FileHeader.BlockCount);
+    std::vector<std::vector<uint8_t> > Compressed(FileHeader.BlockCount);
+    concurrency::parallel_for(0u, FileHeader.BlockCount, [&]( uint32_t b )
+    {
+        const uint8_t* Source = Data + (size_t)b * BlockSize;
+        const size_t SourceSize = GetBlockSize(FileHeader, b);
+        std::vector<uint8_t>& Block = Compressed[b];
+
+        size_t CompressedSize = 0;
+        if (BlockCodec == kZlib)
+        {
+            uLongf Length = compressBound((uLong)SourceSize);
+            Block.resize(Length);
+            if (compress2(Block.data(), &Length, Source, (uLong)SourceSize, Z_DEFAULT_COMPRESSION) == Z_OK)
+                CompressedSize = Length;
+        }
+        else if (BlockCodec == kLZ)
+        {
+            Block.resize(SourceSize);
+            CompressedSize = CompressLZ(Source, SourceSize, Block.data(), Block.size());
+        }
+
+        if (CompressedSize == 0 || CompressedSize >= SourceSize)
+        {
+            Block.assign(Source, Source + SourceSize);
+            Blocks[b].Codec = kStored;
+        }
+        else
+        {
+            Block.resize(CompressedSize);
+            Blocks[b].Codec = BlockCodec;
+        }
+        Blocks[b].CompressedSize = (uint32_t)Block.size();
+    });
+
+    uint64_t Offset = GetIndexEnd(FileHeader);
+    for (BlockEntry& Block : Blocks)
+    {
+        Block.Offset = Offset;
+        Offset += Block.CompressedSize;
+    }
+
+    std::vector<uint8_t> File((size_t)Offset);
+    std::memcpy(File.data(), &FileHeader, sizeof(FileHeader));
+    if (!Blocks.empty())
+        std::memcpy(File.data() + sizeof(FileHeader), Blocks.data(), Blocks.size() * sizeof(BlockEntry));
+    for (uint32_t b = 0; b < FileHeader.BlockCount; ++b)
+    {
+        if (!Compressed[b].empty())
+            std::memcpy(File.data() + Blocks[b].Offset, Compressed[b].data(), Compressed[b].size());
+    }
+    return File;
+}
+
+bool ChunkedFile::Unpack( const uint8_t* File, size_t FileSize, std::vector<uint8_t>& Data )
+{
+    Header FileHeader;
+    if (FileSize < sizeof(FileHeader))
+        return false;
+    std::memcpy(&FileHeader, File, sizeof(FileHeader));
+    if (FileHeader.Magic != kMagic || FileSize < GetIndexEnd(FileHeader))
+        return false;
+
+    std::vector<BlockEntry> Blocks(FileHeader.BlockCount);
+    if (!Blocks.empty())
+        std::memcpy(Blocks.data(), File + sizeof(FileHeader), Blocks.size() * sizeof(BlockEntry));
+    if (!IsValid(FileHeader, Blocks, FileSize))
+        return false;
+
+    Data.resize((size_t)FileHeader.Size);
+    std::atomic<bool> Failed(false);
+    concurrency::parallel_for(0u, FileHeader.BlockCount, [&]( uint32_t b )
+    {
+        if (!DecodeBlock(Blocks[b], File + Blocks[b].Offset, Data.data() + (size_t)b * FileHeader.BlockSize,
+            GetBlockSize(FileHeader, b)))
+            Failed = true;
+    });
+    return !Failed;
+}
+
+bool ChunkedFile::Reader::Open( const std::wstring& FileName )
+{
+    m_FileName = FileName;
+    m_Blocks.clear();
+
+    std::ifstream File(FileName, std::ios::in | std::ios::binary);
+    if (!File)
+        return false;
+    const uint64_t FileSize = (uint64_t)File.seekg(0, std::ios::end).tellg();
+    if (FileSize < sizeof(m_Header))
+        return false;
+
+    File.seekg(0, std::ios::beg).read((char*)&m_Header, sizeof(m_Header));
+    if (m_Header.Magic != kMagic || FileSize < GetIndexEnd(m_Header))
+        return false;
+
+    m_Blocks.resize(m_Header.BlockCount);
+    File.read((char*)m_Blocks.data(), m_Blocks.size() * sizeof(BlockEntry));
+    return File && IsValid(m_Header, m_Blocks, FileSize);
+}
+
+bool ChunkedFile::Reader::Read( uint64_t Offset, size_t Size, uint8_t* Dest ) const
+{
+    if (Offset + Size > m_Header.Size || m_Blocks.size() != m_Header.BlockCount)
+        return false;
+    if (Size == 0)
+        return true;
+
+    // The blocks are in order, so the ones a range touches are one read
+    const uint32_t First = (uint32_t)(Offset / m_Header.BlockSize);
+    const uint32_t Last = (uint32_t)((Offset + Size - 1) / m_Header.BlockSize);
+    const uint64_t Begin = m_Blocks[First].Offset;
+    const uint64_t End = m_Blocks[Last].Offset + m_Blocks[Last].CompressedSize;
+
+    std::ifstream File(m_FileName, std::ios::in | std::ios::binary);
+    std::vector<uint8_t> Compressed((size_t)(End - Begin));
+    File.seekg(Begin, std::ios::beg).read((char*)Compressed.data(), Compressed.size());
+    if (!File)
+        return false;
+
+    std::atomic<bool> Failed(false);
+    concurrency::parallel_for(First, Last + 1, [&]( uint32_t b )
+    {
+        const BlockEntry& Block = m_Blocks[b];
+        const uint8_t* Source = Compressed.data() + (Block.Offset - Begin);
+        const uint64_t BlockStart = (uint64_t)b * m_Header.BlockSize;
+        const size_t BlockSize = GetBlockSize(m_Header, b);
+        const uint64_t CopyStart = std::max(Offset, BlockStart);
+        const uint64_t CopyEnd = std::min(Offset + Size, BlockStart + BlockSize);
+
+        if (CopyStart == BlockStart && CopyEnd == BlockStart + BlockSize)
+        {
+            if (!DecodeBlock(Block, Source, Dest + (BlockStart - Offset), BlockSize))
+                Failed = true;
+            return;
+        }
+
+        // The first or last block of the range is only partly wanted
+        std::vector<uint8_t> Scratch(BlockSize);
+        if (!DecodeBlock(Block, Source, Scratch.data(), BlockSize))
+        {
+            Failed = true;
+            return;
+        }
+        std::memcpy(Dest + (CopyStart - Offset), Scratch.data() + (CopyStart - BlockStart), (size_t)(CopyEnd - CopyStart));
+    });
+    return !Failed;
+}
+
+bool ChunkedFile::RunSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, size_t Value )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("Chunked file self test failed:  %s (%zu)\n", Name, Value);
+            Passed = false;
+        }
+    };
+
+    std::mt19937 Random(11);
+    auto MakePayload = [&Random]( size_t Size, uint32_t Kind )
+    {
+        std::vector<uint8_t> Payload(Size);
+        for (size_t i = 0; i < Size; ++i)
+        {
+            switch (Kind)
+            {
+            case 0: Payload[i] = (uint8_t)Random(); break;                                                  // Incompressible
+            case 1: Payload[i] = (uint8_t)((i & 0xff) + (i >> 12 & 0x3f) + (Random() & 0x1)); break;        // Texture-like
+            default: Payload[i] = (uint8_t)(i / 1000); break;                                               // Long runs
+            }
+        }
+        return Payload;
+    };
+
+    // The LZ codec on its own, around the limits of its format
+    const size_t LZSizes[] = { 0, 1, 12, 13, 17, 300, 70000, 1 << 20 };
+    for (size_t Size : LZSizes)
+    {
+        for (uint32_t Kind = 0; Kind < 3; ++Kind)
+        {
+            const std::vector<uint8_t> Payload = MakePayload(Size, Kind);
+            std::vector<uint8_t> Compressed(Size + Size / 255 + 16);
+            const size_t CompressedSize = CompressLZ(Payload.data(), Size, Compressed.data(), Compressed.size());
+            std::vector<uint8_t> Inflated(Size);
+            Expect(CompressedSize > 0 && DecompressLZ(Compressed.data(), CompressedSize, Inflated.data(), Size) &&
+                Inflated == Payload, "LZ round trip", Size);
+            Expect(Size == 0 || !DecompressLZ(Compressed.data(), CompressedSize - 1, Inflated.data(), Size),
+                "truncated LZ stream fails", Size);
+            if (Kind == 2 && Size >= 70000)
+                Expect(CompressedSize < Size / 50, "LZ packs runs", CompressedSize);
+        }
+    }
+
+    // Containers around the block size, through both codecs
+    const uint32_t kSmallBlock = 4096;
+    const size_t Sizes[] = { 0, 1, kSmallBlock - 1, kSmallBlock, kSmallBlock + 1, kSmallBlock * 5 + 7 };
+    for (size_t Size : Sizes)
+    {
+        for (uint32_t Kind = 0; Kind < 3; ++Kind)
+        {
+            const std::vector<uint8_t> Payload = MakePayload(Size, Kind);
+            for (Codec BlockCodec : { kZlib, kLZ })
+            {
+                const std::vector<uint8_t> File = Pack(Payload.data(), Size, BlockCodec, kSmallBlock);
+                std::vector<uint8_t> Unpacked;
+                Expect(Unpack(File.data(), File.size(), Unpacked) && Unpacked == Payload, "container round trip", Size);
+                Expect(!Unpack(File.data(), File.size() - 1, Unpacked), "truncated container fails", Size);
+            }
+        }
+    }
+
+    // A file of a few blocks on disk, read whole and in ranges that cross blocks
+    const size_t kPayloadSize = 1 << 20;
+    const std::vector<uint8_t> Payload = MakePayload(kPayloadSize, 1);
+    const std::vector<uint8_t> LZFile = Pack(Payload.data(), kPayloadSize, kLZ);
+
+    wchar_t TempPath[MAX_PATH];
+    GetTempPathW(MAX_PATH, TempPath);
+    const std::wstring FileName = std::wstring(TempPath) + L"ChunkedFileSelfTest.chunked";
+    std::ofstream(FileName, std::ios::out | std::ios::binary).write((const char*)LZFile.data(), LZFile.size());
+
+    Reader FileReader;
+    Expect(FileReader.Open(FileName) && FileReader.GetSize() == kPayloadSize, "open", LZFile.size());
+    std::vector<uint8_t> Range(kPayloadSize);
+    Expect(FileReader.Read(0, kPayloadSize, Range.data()) && Range == Payload, "whole file", kPayloadSize);
+    for (uint32_t r = 0; r < 32; ++r)
+    {
+        const size_t Offset = Random() % kPayloadSize;
+        const size_t Size = std::min<size_t>(Random() % (r < 16 ? 4096 : 600 << 10), kPayloadSize - Offset);
+        Expect(FileReader.Read(Offset, Size, Range.data()) && std::equal(Range.begin(), Range.begin() + Size,
+            Payload.begin() + Offset), "range", Offset);
+    }
+    Expect(!FileReader.Read(kPayloadSize - 1, 2, Range.data()), "range past the end fails", kPayloadSize);
+    _wremove(FileName.c_str());
+
+    return Passed;
+}
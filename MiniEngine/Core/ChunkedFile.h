@@ -0,0 +1,81 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// A compressed file cut into blocks that compress on their own, so that a whole file inflates on every
+// core and a range of it, such as one mip of a DDS texture, only inflates the blocks it touches.  The
+// file starts with a Header, then one BlockEntry per block, then the blocks in order.  Each block holds
+// BlockSize bytes of the original, the last one fewer, and is stored as is when its codec would not make
+// it smaller.  Utility::ReadFileSync() reads "name.chunked" in place of "name" when it exists.
+//
+// The LZ codec writes the LZ4 block format:  it inflates several times faster than zlib, and packs
+// worse.  Both codecs are CPU only code with no dependency on D3D12 resources.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ChunkedFile
+{
+    enum Codec : uint32_t { kStored, kZlib, kLZ };
+
+    const uint32_t kMagic = 0x4b4e4843;     // "CHNK"
+    const uint32_t kVersion = 1;
+    const uint32_t kDefaultBlockSize = 256 * 1024;
+
+    struct Header
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint64_t Size;              // Of the original
+        uint32_t BlockSize;
+        uint32_t BlockCount;
+    };
+
+    struct BlockEntry
+    {
+        uint64_t Offset;            // From the start of the file
+        uint32_t CompressedSize;
+        uint32_t Codec;
+    };
+
+    // Compresses Size bytes into a whole chunked file, its blocks in parallel
+    std::vector<uint8_t> Pack( const uint8_t* Data, size_t Size, Codec BlockCodec, uint32_t BlockSize = kDefaultBlockSize );
+
+    // Unpacks a whole chunked file that is already in memory, its blocks in parallel
+    bool Unpack( const uint8_t* File, size_t FileSize, std::vector<uint8_t>& Data );
+
+    class Reader
+    {
+    public:
+        // Reads the header and the block index
+        bool Open( const std::wstring& FileName );
+
+        uint64_t GetSize( void ) const { return m_Header.Size; }
+
+        // Reads the blocks that bytes [Offset, Offset + Size) of the original fall in and inflates them in
+        // parallel, the whole ones straight into Dest
+        bool Read( uint64_t Offset, size_t Size, uint8_t* Dest ) const;
+
+    private:
+        std::wstring m_FileName;
+        Header m_Header;
+        std::vector<BlockEntry> m_Blocks;
+    };
+
+    // Compresses with the LZ codec.  Returns the compressed size, or 0 when it does not fit in Capacity.
+    size_t CompressLZ( const uint8_t* Source, size_t SourceSize, uint8_t* Dest, size_t Capacity );
+
+    // Fails unless the stream inflates to exactly DestSize bytes
+    bool DecompressLZ( const uint8_t* Source, size_t SourceSize, uint8_t* Dest, size_t DestSize );
+
+    // Round trips edge cases of both codecs in memory, then reads a small chunked file whole and in ranges
+    bool RunSelfTest( void );
+}
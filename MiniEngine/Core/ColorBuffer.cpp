@@ -71,16 +71,19 @@ void ColorBuffer::CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Format, u
         SRVDesc.Texture2D.MostDetailedMip = 0;
     }
 
+    ID3D12Resource* Resource = m_pResource.Get();
+    const bool IsRenderTarget = (Resource->GetDesc().Flags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET) != 0;
+
     if (m_SRVHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
     {
-        m_RTVHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+        if (IsRenderTarget)
+            m_RTVHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
         m_SRVHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
     }
 
-    ID3D12Resource* Resource = m_pResource.Get();
-
     // Create the render target view
-    Device->CreateRenderTargetView(Resource, &RTVDesc, m_RTVHandle);
+    if (IsRenderTarget)
+        Device->CreateRenderTargetView(Resource, &RTVDesc, m_RTVHandle);
 
     // Create the shader resource view
     Device->CreateShaderResourceView(Resource, &SRVDesc, m_SRVHandle);
@@ -102,7 +105,7 @@ void ColorBuffer::CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Format, u
 	if (ArraySize > 1)
 	{
 		m_RTVSubHandles.reserve(ArraySize);
-		for (int i = 0; i < ArraySize; i++)
+		for (int i = 0; i < ArraySize && IsRenderTarget; i++)
 		{
 			D3D12_RENDER_TARGET_VIEW_DESC RTVDesc = {};
 			RTVDesc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DARRAY;
@@ -161,10 +164,37 @@ void ColorBuffer::CreateFromSwapChain( const std::wstring& Name, ID3D12Resource*
     //m_UAVHandle[0] = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
     //Graphics::g_Device->CreateUnorderedAccessView(m_pResource.Get(), nullptr, nullptr, m_UAVHandle[0]);
 
-    m_RTVHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
+    if (m_RTVHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+        m_RTVHandle = Graphics::AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
     Graphics::g_Device->CreateRenderTargetView(m_pResource.Get(), nullptr, m_RTVHandle);
 }
 
+void ColorBuffer::Destroy( void )
+{
+    PixelBuffer::Destroy();
+
+    Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_RTV, m_RTVHandle);
+    Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_SRVHandle);
+    m_RTVHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+    m_SRVHandle.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+
+    for (uint32_t i = 0; i < _countof(m_UAVHandle); ++i)
+    {
+        Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_UAVHandle[i]);
+        m_UAVHandle[i].ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+    }
+
+    for (D3D12_CPU_DESCRIPTOR_HANDLE& Handle : m_RTVSubHandles)
+        Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_RTV, Handle);
+    for (D3D12_CPU_DESCRIPTOR_HANDLE& Handle : m_UAVSubHandles)
+        Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, Handle);
+    for (D3D12_CPU_DESCRIPTOR_HANDLE& Handle : m_SRVSubHandles)
+        Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, Handle);
+    m_RTVSubHandles.clear();
+    m_UAVSubHandles.clear();
+    m_SRVSubHandles.clear();
+}
+
 void ColorBuffer::Create(const std::wstring& Name, uint32_t Width, uint32_t Height, uint32_t NumMips,
     DXGI_FORMAT Format, D3D12_GPU_VIRTUAL_ADDRESS VidMem)
 {
@@ -215,6 +245,25 @@ void ColorBuffer::CreateArray( const std::wstring& Name, uint32_t Width, uint32_
     CreateArray(Name, Width, Height, ArrayCount, Format);
 }
 
+void ColorBuffer::CreatePlaced( const std::wstring& Name, uint32_t Width, uint32_t Height, uint32_t ArrayCount, uint32_t NumMips,
+    DXGI_FORMAT Format, ID3D12Heap* pBackingHeap, uint64_t HeapOffset )
+{
+    NumMips = (NumMips == 0 ? ComputeNumMips(Width, Height) : NumMips);
+    D3D12_RESOURCE_FLAGS Flags = CombinePlacedResourceFlags();
+    D3D12_RESOURCE_DESC ResourceDesc = DescribeTex2D(Width, Height, ArrayCount, NumMips, Format, Flags);
+
+    CreatePlacedTextureResource(Graphics::g_Device, Name, ResourceDesc, pBackingHeap, HeapOffset);
+    CreateDerivedViews(Graphics::g_Device, Format, ArrayCount, NumMips);
+}
+
+D3D12_RESOURCE_ALLOCATION_INFO ColorBuffer::GetPlacedAllocationInfo( uint32_t Width, uint32_t Height, uint32_t ArrayCount,
+    uint32_t NumMips, DXGI_FORMAT Format )
+{
+    NumMips = (NumMips == 0 ? ComputeNumMips(Width, Height) : NumMips);
+    D3D12_RESOURCE_DESC ResourceDesc = DescribeTex2D(Width, Height, ArrayCount, NumMips, Format, CombinePlacedResourceFlags());
+    return Graphics::g_Device->GetResourceAllocationInfo(0, 1, &ResourceDesc);
+}
+
 void ColorBuffer::GenerateMipMaps(CommandContext& BaseContext)
 {
     if (m_NumMipMaps == 0)
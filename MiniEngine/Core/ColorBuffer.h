@@ -29,6 +29,9 @@ public:
         std::memset(m_UAVHandle, 0xFF, sizeof(m_UAVHandle));
     }
 
+    // Release the resource and return its descriptors to the allocator
+    virtual void Destroy(void) override;
+
     // Create a color buffer from a swap chain buffer.  Unordered access is restricted.
     void CreateFromSwapChain( const std::wstring& Name, ID3D12Resource* BaseResource );
 
@@ -53,6 +56,18 @@ public:
     // this functions the same as Create() without a video address.
     void CreateArray(const std::wstring& Name, uint32_t Width, uint32_t Height, uint32_t ArrayCount,
         DXGI_FORMAT Format, EsramAllocator& Allocator);
+
+    // Create a color buffer at an offset within an existing heap.  Buffers sharing heap memory must be
+    // activated with an aliasing barrier before use (see TransientResourceAllocator.)  Pass 0 for NumMips
+    // to allocate a full mip chain.  The buffer is only for shader reads and unordered access, so it has
+    // no render target view and needs no clear or discard after aliasing.
+    void CreatePlaced(const std::wstring& Name, uint32_t Width, uint32_t Height, uint32_t ArrayCount, uint32_t NumMips,
+        DXGI_FORMAT Format, ID3D12Heap* pBackingHeap, uint64_t HeapOffset);
+
+    // Size and alignment CreatePlaced() requires for the same parameters
+    D3D12_RESOURCE_ALLOCATION_INFO GetPlacedAllocationInfo(uint32_t Width, uint32_t Height, uint32_t ArrayCount, uint32_t NumMips,
+        DXGI_FORMAT Format);
+
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetSubRTV(int i) const { return m_RTVSubHandles[i]; }
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetSubUAV(int i) const { return m_UAVSubHandles[i]; }
 	const D3D12_CPU_DESCRIPTOR_HANDLE& GetSubSRV(int i) const { return m_SRVSubHandles[i]; }
@@ -91,6 +106,13 @@ protected:
         return D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | Flags;
     }
 
+    // Placed buffers are never render targets (see CreatePlaced())
+    D3D12_RESOURCE_FLAGS CombinePlacedResourceFlags( void ) const
+    {
+        ASSERT(m_FragmentCount == 1, "Placed color buffers need unordered access");
+        return D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+    }
+
     // Compute the number of texture levels needed to reduce to 1x1.  This uses
     // _BitScanReverse to find the highest set bit.  Each dimension reduces by
     // half and truncates bits.  The dimension 256 (0x100) has 9 mip levels, same
@@ -433,6 +433,20 @@ void CommandContext::InsertAliasBarrier(GpuResource& Before, GpuResource& After,
         FlushResourceBarriers();
 }
 
+void CommandContext::InsertAliasBarrier(GpuResource& After, bool FlushImmediate)
+{
+    ASSERT(m_NumBarriersToFlush < 16, "Exceeded arbitrary limit on buffered barriers");
+    D3D12_RESOURCE_BARRIER& BarrierDesc = m_ResourceBarrierBuffer[m_NumBarriersToFlush++];
+
+    BarrierDesc.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+    BarrierDesc.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+    BarrierDesc.Aliasing.pResourceBefore = nullptr;
+    BarrierDesc.Aliasing.pResourceAfter = After.GetResource();
+
+    if (FlushImmediate || m_NumBarriersToFlush == 16)
+        FlushResourceBarriers();
+}
+
 void CommandContext::WriteBuffer( GpuResource& Dest, size_t DestOffset, const void* BufferData, size_t NumBytes )
 {
     ASSERT(BufferData != nullptr && Math::IsAligned(BufferData, 16));
@@ -141,6 +141,8 @@ public:
     void BeginResourceTransition(GpuResource& Resource, D3D12_RESOURCE_STATES NewState, bool FlushImmediate = false);
     void InsertUAVBarrier(GpuResource& Resource, bool FlushImmediate = false);
     void InsertAliasBarrier(GpuResource& Before, GpuResource& After, bool FlushImmediate = false);
+    // Activate a placed resource without naming the one it replaces.  Any resource sharing its memory is deactivated.
+    void InsertAliasBarrier(GpuResource& After, bool FlushImmediate = false);
     inline void FlushResourceBarriers(void);
 
     void InsertTimeStamp( ID3D12QueryHeap* pQueryHeap, uint32_t QueryIdx );
@@ -203,3 +203,31 @@ void DepthBuffer::CreateDerivedViews(ID3D12Device* Device, DXGI_FORMAT Format, u
 		Device->CreateShaderResourceView(Resource, &SRVDesc, m_hStencilSRV);
 	}
 }
+
+void DepthBuffer::Destroy( void )
+{
+	PixelBuffer::Destroy();
+
+	// Without a stencil plane the stencil read-only views alias the depth views
+	if (m_hDSV[2].ptr != m_hDSV[0].ptr)
+	{
+		Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_DSV, m_hDSV[2]);
+		Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_DSV, m_hDSV[3]);
+	}
+	Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_DSV, m_hDSV[0]);
+	Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_DSV, m_hDSV[1]);
+	Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_hDepthSRV);
+	Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_hStencilSRV);
+
+	for (uint32_t i = 0; i < 4; ++i)
+		m_hDSV[i].ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+	m_hDepthSRV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+	m_hStencilSRV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+
+	for (D3D12_CPU_DESCRIPTOR_HANDLE& Handle : m_DSVSubHandles)
+		Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_DSV, Handle);
+	for (D3D12_CPU_DESCRIPTOR_HANDLE& Handle : m_SRVSubHandles)
+		Graphics::FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, Handle);
+	m_DSVSubHandles.clear();
+	m_SRVSubHandles.clear();
+}
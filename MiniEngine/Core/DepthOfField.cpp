@@ -157,6 +157,8 @@ void DepthOfField::Render( CommandContext& BaseContext, float /*NearClipDist*/,
     ComputeContext& Context = BaseContext.GetComputeContext();
     Context.SetRootSignature(s_RootSignature);
 
+    BeginTransientPhase(Context, kDepthOfFieldPhase);
+
     ColorBuffer& LinearDepth = g_LinearDepth[ Graphics::GetFrameCount() % 2 ];
 
     uint32_t BufferWidth = (uint32_t)LinearDepth.GetWidth();
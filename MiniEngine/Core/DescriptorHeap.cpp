@@ -23,9 +23,14 @@ using namespace Graphics;
 //
 std::mutex DescriptorAllocator::sm_AllocationMutex;
 std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> DescriptorAllocator::sm_DescriptorHeapPool;
+bool DescriptorAllocator::sm_HeapsDestroyed = false;
 
 void DescriptorAllocator::DestroyAll(void)
 {
+    std::lock_guard<std::mutex> LockGuard(sm_AllocationMutex);
+
+    // Resources destroyed after this point (e.g. by static destructors) have nothing left to return their descriptors to
+    sm_HeapsDestroyed = true;
     sm_DescriptorHeapPool.clear();
 }
 
@@ -45,10 +50,66 @@ ID3D12DescriptorHeap* DescriptorAllocator::RequestNewHeap(D3D12_DESCRIPTOR_HEAP_
     return pHeap.Get();
 }
 
+void DescriptorAllocator::AddFreeRange( D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count )
+{
+    // Round down so that every range in a class is at least as large as the class size
+    unsigned long SizeClass;
+    _BitScanReverse(&SizeClass, Count);
+
+    DescriptorRange Range = { Handle, Count };
+    m_FreeRanges[SizeClass].push_back(Range);
+    m_NonEmptyClasses |= 1u << SizeClass;
+}
+
+void DescriptorAllocator::ReclaimRetiredRanges( void )
+{
+    while (!m_RetiredRanges.empty() && g_CommandManager.IsFenceComplete(m_RetiredRanges.front().first))
+    {
+        const DescriptorRange& Range = m_RetiredRanges.front().second;
+        AddFreeRange(Range.Handle, Range.Count);
+        m_RetiredRanges.pop();
+    }
+}
+
 D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::Allocate( uint32_t Count )
 {
+    ASSERT(Count > 0 && Count <= sm_NumDescriptorsPerHeap, "Descriptor allocations cannot span heaps");
+
+    std::lock_guard<std::mutex> LockGuard(m_Mutex);
+
+    ReclaimRetiredRanges();
+
+    // Round up so that any range in the first class searched is large enough
+    const uint32_t MinClass = Math::IsPowerOfTwo(Count) ? Math::Log2(Count) : Math::Log2(Count) + 1;
+    const uint32_t Candidates = m_NonEmptyClasses & ~((1u << MinClass) - 1);
+
+    if (Candidates != 0)
+    {
+        unsigned long SizeClass;
+        _BitScanForward(&SizeClass, Candidates);
+
+        std::vector<DescriptorRange>& FreeList = m_FreeRanges[SizeClass];
+        DescriptorRange Range = FreeList.back();
+        FreeList.pop_back();
+        if (FreeList.empty())
+            m_NonEmptyClasses &= ~(1u << SizeClass);
+
+        if (Range.Count > Count)
+        {
+            D3D12_CPU_DESCRIPTOR_HANDLE Remainder = Range.Handle;
+            Remainder.ptr += Count * m_DescriptorSize;
+            AddFreeRange(Remainder, Range.Count - Count);
+        }
+
+        return Range.Handle;
+    }
+
     if (m_CurrentHeap == nullptr || m_RemainingFreeHandles < Count)
     {
+        // Keep the tail of the old heap rather than abandoning it
+        if (m_CurrentHeap != nullptr && m_RemainingFreeHandles > 0)
+            AddFreeRange(m_CurrentHandle, m_RemainingFreeHandles);
+
         m_CurrentHeap = RequestNewHeap(m_Type);
         m_CurrentHandle = m_CurrentHeap->GetCPUDescriptorHandleForHeapStart();
         m_RemainingFreeHandles = sm_NumDescriptorsPerHeap;
@@ -63,6 +124,20 @@ D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::Allocate( uint32_t Count )
     return ret;
 }
 
+void DescriptorAllocator::Free( D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count )
+{
+    if (Handle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN || Handle.ptr == 0 || Count == 0 || sm_HeapsDestroyed)
+        return;
+
+    ASSERT(Count <= sm_NumDescriptorsPerHeap);
+
+    std::lock_guard<std::mutex> LockGuard(m_Mutex);
+
+    // Contexts recording this frame may still copy the old view into a shader-visible heap
+    DescriptorRange Range = { Handle, Count };
+    m_RetiredRanges.push(std::make_pair(g_CommandManager.GetGraphicsQueue().GetNextFenceValue(), Range));
+}
+
 //
 // UserDescriptorHeap implementation
 //
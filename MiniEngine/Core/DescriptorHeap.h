@@ -22,22 +22,47 @@
 // This is an unbounded resource descriptor allocator.  It is intended to provide space for CPU-visible resource descriptors
 // as resources are created.  For those that need to be made shader-visible, they will need to be copied to a UserDescriptorHeap
 // or a DynamicDescriptorHeap.
+//
+// Freed ranges are retired until the GPU has passed the current graphics fence and are then recycled through power-of-two
+// size class free lists.  A request is served from the smallest class that is guaranteed to fit, and the unused tail of the
+// range is returned to its own class.  New heaps are only created when no recycled range can satisfy a request.
 class DescriptorAllocator
 {
 public:
-    DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE Type) : m_Type(Type), m_CurrentHeap(nullptr) {}
+    DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE Type) : m_NonEmptyClasses(0), m_Type(Type), m_CurrentHeap(nullptr), m_DescriptorSize(0) {}
 
     D3D12_CPU_DESCRIPTOR_HANDLE Allocate( uint32_t Count );
 
+    // Return a range obtained from Allocate().  The descriptors are not reused until in-flight graphics work completes.
+    // Ranges may be freed piecewise, but each descriptor must be freed at most once.
+    void Free( D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count );
+
     static void DestroyAll(void);
 
 protected:
 
     static const uint32_t sm_NumDescriptorsPerHeap = 256;
+    static const uint32_t sm_NumSizeClasses = 9;    // Log2(sm_NumDescriptorsPerHeap) + 1
     static std::mutex sm_AllocationMutex;
     static std::vector<Microsoft::WRL::ComPtr<ID3D12DescriptorHeap>> sm_DescriptorHeapPool;
+    static bool sm_HeapsDestroyed;
     static ID3D12DescriptorHeap* RequestNewHeap( D3D12_DESCRIPTOR_HEAP_TYPE Type );
 
+    struct DescriptorRange
+    {
+        D3D12_CPU_DESCRIPTOR_HANDLE Handle;
+        uint32_t Count;
+    };
+
+    // Move retired ranges whose fence has completed to the free lists
+    void ReclaimRetiredRanges( void );
+    void AddFreeRange( D3D12_CPU_DESCRIPTOR_HANDLE Handle, uint32_t Count );
+
+    std::mutex m_Mutex;
+    std::queue<std::pair<uint64_t, DescriptorRange>> m_RetiredRanges;
+    std::vector<DescriptorRange> m_FreeRanges[sm_NumSizeClasses];   // Class i holds ranges of [2^i, 2^(i+1)) descriptors
+    uint32_t m_NonEmptyClasses;
+
     D3D12_DESCRIPTOR_HEAP_TYPE m_Type;
     ID3D12DescriptorHeap* m_CurrentHeap;
     D3D12_CPU_DESCRIPTOR_HANDLE m_CurrentHandle;
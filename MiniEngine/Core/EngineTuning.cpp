@@ -621,6 +621,8 @@ void EngineTuning::Display( GraphicsContext& Context, float x, float y, float w,
     float hScale = g_DisplayWidth / 1920.0f;
     float vScale = g_DisplayHeight / 1080.0f;
 
+    // The frame rate is not clipped to the tuning window
+    Text.Flush();
     Context.SetScissor((uint32_t)Floor(x * hScale), (uint32_t)Floor(y * vScale), 
         (uint32_t)Ceiling((x + w) * hScale), (uint32_t)Ceiling((y + h) * vScale));
 
@@ -630,7 +632,8 @@ void EngineTuning::Display( GraphicsContext& Context, float x, float y, float w,
     Text.SetTextSize(20.0f);
 
     VariableGroup::sm_RootGroup.Display( Text, x, sm_SelectedVariable );
-    
+
+    Text.Flush();
     EngineProfiling::DisplayPerfGraph(Context);
 
     Text.End();
@@ -114,6 +114,8 @@ void FXAA::Render( ComputeContext& Context, bool bUsePreComputedLuma, UINT curCa
 {
     ScopedTimer _prof(L"FXAA", Context);
 
+    BeginTransientPhase(Context, kAntialiasingPhase);
+
     if (Settings::FXAA_ForceOffPreComputedLuma)
         bUsePreComputedLuma = false;
 
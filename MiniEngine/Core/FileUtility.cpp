@@ -13,8 +13,12 @@
 
 #include "pch.h"
 #include "FileUtility.h"
+#include "ChunkedFile.h"
+#include "SceneArchive.h"
 #include <fstream>
 #include <mutex>
+#include <random>
+#include <unordered_map>
 #include <zlib.h> // From NuGet package 
 
 using namespace std;
@@ -25,7 +29,7 @@ namespace Utility
     ByteArray NullFile = make_shared<vector<byte> > (vector<byte>() );
 }
 
-ByteArray DecompressZippedFile( wstring& fileName );
+ByteArray DecompressZippedFile( const wstring& fileName );
 
 ByteArray ReadFileHelper(const wstring& fileName)
 {
@@ -47,76 +51,190 @@ ByteArray ReadFileHelper(const wstring& fileName)
     return byteArray;
 }
 
-ByteArray ReadFileHelperEx( shared_ptr<wstring> fileName)
+namespace
 {
-    std::wstring zippedFileName = *fileName + L".gz";
-    ByteArray firstTry = DecompressZippedFile(zippedFileName);
-    if (firstTry != NullFile)
-        return firstTry;
+    // Compressed bytes handed to zlib per read of a zipped file
+    const size_t kInputChunkSize = 0x40000;
 
-    return ReadFileHelper(*fileName);
-}
+    // Deflate cannot do better than about 1032:1, so a larger gzip trailer is not to be trusted
+    const size_t kMaxInflateRatio = 1032;
 
-ByteArray Inflate(ByteArray CompressedSource, int& err, uint32_t ChunkSize = 0x100000 ) 
-{
-    // Create a dynamic buffer to hold compressed blocks
-    vector<unique_ptr<byte> > blocks;
+    enum PackedKind { kUnpacked, kZipped, kChunked };
+
+    // Which packed form of the file exists, a ".chunked" file before a ".gz" file.  Every read probes for
+    // them first, so the answer is remembered for each name.
+    PackedKind FindPackedFile( const wstring& fileName )
+    {
+        static mutex s_Mutex;
+        static unordered_map<wstring, PackedKind> s_Kinds;
+        {
+            lock_guard<mutex> lock(s_Mutex);
+            auto iter = s_Kinds.find(fileName);
+            if (iter != s_Kinds.end())
+                return iter->second;
+        }
 
-    z_stream strm  = {};
-    strm.data_type = Z_BINARY;
-    strm.total_in  = strm.avail_in  = (uInt)CompressedSource->size();
-    strm.next_in   = CompressedSource->data();
+        struct _stat64 fileStat;
+        PackedKind kind = kUnpacked;
+        if (_wstat64((fileName + L".chunked").c_str(), &fileStat) == 0)
+            kind = kChunked;
+        else if (_wstat64((fileName + L".gz").c_str(), &fileStat) == 0)
+            kind = kZipped;
 
-    err = inflateInit2(&strm, (15 + 32)); //15 window bits, and the +32 tells zlib to to detect if using gzip or zlib
+        lock_guard<mutex> lock(s_Mutex);
+        s_Kinds[fileName] = kind;
+        return kind;
+    }
 
-    while (err == Z_OK || err == Z_BUF_ERROR)
+    // The decompressed size a gzip stream's ISIZE trailer promises, or 0 when it is not a gzip stream or
+    // the trailer cannot be right
+    size_t GetInflatedSize( const byte header[2], const byte trailer[4], size_t compressedSize )
     {
-        strm.avail_out = ChunkSize;
-        strm.next_out = (byte*)malloc(ChunkSize);
-        blocks.emplace_back(strm.next_out);
-        err = inflate(&strm, Z_NO_FLUSH);
+        if (compressedSize < 18 || header[0] != 0x1f || header[1] != 0x8b)
+            return 0;
+
+        const size_t size = (size_t)trailer[0] | (size_t)trailer[1] << 8 | (size_t)trailer[2] << 16 | (size_t)trailer[3] << 24;
+        return size <= compressedSize * kMaxInflateRatio ? size : 0;
     }
 
-    if (err != Z_STREAM_END) 
+    // Inflates a zlib or gzip stream straight into one array of expectedSize bytes.  Read(data) points data
+    // at the next compressed bytes and returns how many there are, 0 at the end of the input.  The array
+    // only grows when the size was not known or was wrong, and is trimmed to what was inflated.
+    template <typename ReadFn>
+    ByteArray InflateStream( ReadFn Read, size_t expectedSize, int& err )
     {
+        ByteArray byteArray = make_shared<vector<byte> >( max(expectedSize, (size_t)1) );
+
+        z_stream strm  = {};
+        strm.data_type = Z_BINARY;
+
+        err = inflateInit2(&strm, (15 + 32)); //15 window bits, and the +32 tells zlib to to detect if using gzip or zlib
+
+        while (err == Z_OK || err == Z_BUF_ERROR)
+        {
+            if (strm.avail_in == 0)
+            {
+                const byte* data = nullptr;
+                strm.avail_in = (uInt)Read(data);
+                strm.next_in = (Bytef*)data;
+                if (strm.avail_in == 0)
+                {
+                    err = Z_DATA_ERROR; // Truncated
+                    break;
+                }
+            }
+            else if (err == Z_BUF_ERROR)
+            {
+                // No progress with input left, so the output is full
+                byteArray->resize(byteArray->size() * 2);
+            }
+
+            strm.next_out = byteArray->data() + strm.total_out;
+            strm.avail_out = (uInt)min(byteArray->size() - strm.total_out, (size_t)UINT_MAX);
+            err = inflate(&strm, Z_NO_FLUSH);
+        }
+
         inflateEnd(&strm);
-        return NullFile;
-    }
 
-    ASSERT(strm.total_out > 0, "Nothing to decompress");
+        if (err != Z_STREAM_END)
+            return NullFile;
 
-    Utility::ByteArray byteArray = make_shared<vector<byte> >( strm.total_out );
+        ASSERT(strm.total_out > 0, "Nothing to decompress");
 
-    // Allocate actual memory for this.
-    // copy the bits into that RAM.
-    // Free everything else up!!
-    void* curDest = byteArray->data();
-    size_t remaining = byteArray->size();
+        byteArray->resize(strm.total_out);
+        return byteArray;
+    }
 
-    for (size_t i = 0; i < blocks.size(); ++i)
+    ByteArray Inflate( const byte* compressed, size_t compressedSize, int& err )
     {
-        ASSERT(remaining > 0);
-
-        size_t CopySize = min(remaining, (size_t)ChunkSize);
+        const size_t expectedSize = compressedSize < 4 ? 0 :
+            GetInflatedSize(compressed, compressed + compressedSize - 4, compressedSize);
 
-        memcpy(curDest, blocks[i].get(), CopySize);
-        curDest = (byte*)curDest + CopySize;
-        remaining -= CopySize;
+        // All of the input is already in memory
+        auto Read = [&]( const byte*& data )
+        {
+            data = compressed;
+            const size_t size = min(compressedSize, (size_t)UINT_MAX);
+            compressed += size;
+            compressedSize -= size;
+            return size;
+        };
+        return InflateStream(Read, expectedSize ? expectedSize : compressedSize * 4, err);
     }
+}
+
+ByteArray ReadChunkedFile( const wstring& fileName )
+{
+    ChunkedFile::Reader reader;
+    if (!reader.Open(fileName))
+        return NullFile;
 
-    inflateEnd(&strm);
+    ByteArray byteArray = make_shared<vector<byte> >( (size_t)reader.GetSize() );
+    if (!reader.Read(0, byteArray->size(), byteArray->data()))
+    {
+        Utility::Printf(L"Couldn't unpack file %s\n", fileName.c_str());
+        return NullFile;
+    }
 
     return byteArray;
 }
 
-ByteArray DecompressZippedFile( wstring& fileName )
+// The mounted scene archive decides whether the file exists
+ByteArray ReadArchivedFile( const wstring& fileName )
+{
+    const void* data;
+    size_t size;
+    if (!SceneArchive::Find(fileName, data, size))
+        return NullFile;
+
+    return make_shared<vector<byte> >( (const byte*)data, (const byte*)data + size );
+}
+
+ByteArray ReadFileHelperEx( shared_ptr<wstring> fileName)
+{
+    if (SceneArchive::Covers(*fileName))
+        return ReadArchivedFile(*fileName);
+
+    const PackedKind kind = FindPackedFile(*fileName);
+    if (kind != kUnpacked)
+    {
+        ByteArray firstTry = kind == kChunked ? ReadChunkedFile(*fileName + L".chunked") :
+            DecompressZippedFile(*fileName + L".gz");
+        if (firstTry != NullFile)
+            return firstTry;
+    }
+
+    return ReadFileHelper(*fileName);
+}
+
+ByteArray DecompressZippedFile( const wstring& fileName )
 {
-    ByteArray CompressedFile = ReadFileHelper(fileName);
-    if (CompressedFile == NullFile)
+    ifstream file( fileName, ios::in | ios::binary );
+    if (!file)
         return NullFile;
 
+    const size_t fileSize = (size_t)file.seekg(0, ios::end).tellg();
+    byte header[2] = {};
+    byte trailer[4] = {};
+    if (fileSize >= 4)
+    {
+        file.seekg(0, ios::beg).read( (char*)header, sizeof(header) );
+        file.seekg(fileSize - sizeof(trailer), ios::beg).read( (char*)trailer, sizeof(trailer) );
+    }
+    const size_t expectedSize = GetInflatedSize(header, trailer, fileSize);
+    file.seekg(0, ios::beg);
+
+    // Only a chunk of the compressed file is in memory at a time
+    vector<byte> input(kInputChunkSize);
+    auto Read = [&]( const byte*& data )
+    {
+        file.read( (char*)input.data(), input.size() );
+        data = input.data();
+        return (size_t)file.gcount();
+    };
+
     int error;
-    ByteArray DecompressedFile = Inflate(CompressedFile, error);
+    ByteArray DecompressedFile = InflateStream(Read, expectedSize ? expectedSize : fileSize * 4, error);
     if (DecompressedFile->size() == 0)
     {
         Utility::Printf(L"Couldn't unzip file %s:  Error = %d\n", fileName.c_str(), error);
@@ -136,3 +254,106 @@ task<ByteArray> Utility::ReadFileAsync(const wstring& fileName)
     shared_ptr<wstring> SharedPtr = make_shared<wstring>(fileName);
     return create_task( [=] { return ReadFileHelperEx(SharedPtr); } );
 }
+
+ByteArray Utility::ReadFileRange( const wstring& fileName, uint64_t offset, size_t size )
+{
+    if (SceneArchive::Covers(fileName))
+    {
+        const void* data;
+        size_t fileSize;
+        if (!SceneArchive::Find(fileName, data, fileSize) || offset + size > fileSize)
+            return NullFile;
+        return make_shared<vector<byte> >( (const byte*)data + offset, (const byte*)data + offset + size );
+    }
+
+    const PackedKind kind = FindPackedFile(fileName);
+    if (kind == kChunked)
+    {
+        ChunkedFile::Reader reader;
+        if (reader.Open(fileName + L".chunked"))
+        {
+            ByteArray byteArray = make_shared<vector<byte> >( size );
+            if (reader.Read(offset, size, byteArray->data()))
+                return byteArray;
+        }
+    }
+    else if (kind == kZipped)
+    {
+        // A gzip stream can only be inflated from its start
+        ByteArray wholeFile = DecompressZippedFile(fileName + L".gz");
+        if (wholeFile != NullFile)
+        {
+            if (offset + size > wholeFile->size())
+                return NullFile;
+            return make_shared<vector<byte> >( wholeFile->begin() + (size_t)offset, wholeFile->begin() + (size_t)(offset + size) );
+        }
+    }
+
+    ifstream file( fileName, ios::in | ios::binary );
+    if (!file)
+        return NullFile;
+
+    ByteArray byteArray = make_shared<vector<byte> >( size );
+    file.seekg(offset, ios::beg).read( (char*)byteArray->data(), size );
+    if ((size_t)file.gcount() != size)
+        return NullFile;
+
+    return byteArray;
+}
+
+namespace
+{
+    vector<byte> Deflate( const vector<byte>& source, bool gzip )
+    {
+        z_stream strm = {};
+        deflateInit2(&strm, Z_BEST_SPEED, Z_DEFLATED, gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY);
+
+        vector<byte> compressed(deflateBound(&strm, (uLong)source.size()));
+        strm.next_in = (Bytef*)source.data();
+        strm.avail_in = (uInt)source.size();
+        strm.next_out = compressed.data();
+        strm.avail_out = (uInt)compressed.size();
+        deflate(&strm, Z_FINISH);
+        compressed.resize(strm.total_out);
+        deflateEnd(&strm);
+        return compressed;
+    }
+}
+
+bool Utility::RunInflateSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, const char* Payload )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("File utility self test failed:  %s (%s)\n", Name, Payload);
+            Passed = false;
+        }
+    };
+
+    // Texture-like bytes that compress to under half, and sparse runs that compress a hundredfold
+    const size_t kPayloadSize = 1 << 20;
+    mt19937 random(7);
+    vector<byte> Payloads[2] = { vector<byte>(kPayloadSize), vector<byte>(kPayloadSize) };
+    for (size_t i = 0; i < kPayloadSize; ++i)
+        Payloads[0][i] = (byte)((i & 0xff) + (i >> 12 & 0x3f) + (random() & 0x1));
+    for (size_t i = 0; i < kPayloadSize; i += 4096)
+        fill(Payloads[1].begin() + i, Payloads[1].begin() + i + (random() & 0x3ff), (byte)random());
+    const char* Names[2] = { "texels", "runs" };
+
+    for (uint32_t p = 0; p < 2; ++p)
+    {
+        const vector<byte>& Payload = Payloads[p];
+        const vector<byte> Gzip = Deflate(Payload, true);
+        const vector<byte> Zlib = Deflate(Payload, false);
+        auto Matches = [&]( const ByteArray& Inflated ) { return Inflated != NullFile && *Inflated == Payload; };
+
+        int err;
+        Expect(Matches(Inflate(Gzip.data(), Gzip.size(), err)), "gzip stream", Names[p]);
+        Expect(Matches(Inflate(Zlib.data(), Zlib.size(), err)), "zlib stream of unknown size", Names[p]);
+        Expect(Inflate(Zlib.data(), Zlib.size() / 2, err) == NullFile, "truncated stream fails", Names[p]);
+    }
+
+    return Passed;
+}
@@ -26,12 +26,24 @@ namespace Utility
     typedef shared_ptr<vector<byte> > ByteArray;
     extern ByteArray NullFile;
 
-    // Reads the entire contents of a binary file.  If the file with the same name except with an additional
-    // ".gz" suffix exists, it will be loaded and decompressed instead.
+    // Reads the entire contents of a binary file.  A file under the directory of the mounted scene archive
+    // is read from the archive, and is missing when the archive does not hold it (see SceneArchive.h).
+    // Otherwise, if the file with the same name except with an additional ".chunked" suffix exists, its
+    // blocks are inflated in parallel instead (see ChunkedFile.h).  Otherwise if the file with an
+    // additional ".gz" suffix exists, it will be loaded and decompressed instead, straight into an array
+    // sized by its gzip trailer.  Which of them exists is only checked the first time a name is read.
     // This operation blocks until the entire file is read.
     ByteArray ReadFileSync(const wstring& fileName);
 
     // Same as previous except that it does not block but instead returns a task.
     task<ByteArray> ReadFileAsync(const wstring& fileName);
 
+    // Reads size bytes from offset on of the same file ReadFileSync() would read.  Of a ".chunked" file only
+    // the blocks that hold the range are read and inflated, but a ".gz" file is inflated whole first.
+    // Returns NullFile when the range does not fit in the file.
+    ByteArray ReadFileRange(const wstring& fileName, uint64_t offset, size_t size);
+
+    // Inflates synthetic payloads from gzip and zlib streams in memory and checks them against the originals
+    bool RunInflateSelfTest( void );
+
 } // namespace Utility
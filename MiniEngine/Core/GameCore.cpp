@@ -129,6 +129,7 @@ namespace GameCore
             GraphicsContext& MipsContext = GraphicsContext::Begin();
 
             // Exclude from timings this copy necessary to setup the test
+            BeginTransientPhase(MipsContext, kGenerateMipsPhase);
             MipsContext.TransitionResource(g_SceneColorBuffer, D3D12_RESOURCE_STATE_GENERIC_READ);
             MipsContext.TransitionResource(g_GenMipsBuffer, D3D12_RESOURCE_STATE_COPY_DEST);
             MipsContext.CopySubresource(g_GenMipsBuffer, 0, g_SceneColorBuffer, 0);
@@ -57,6 +57,16 @@ void GpuBuffer::Create( const std::wstring& name, uint32_t NumElements, uint32_t
     CreateDerivedViews();
 }
 
+void GpuBuffer::Destroy( void )
+{
+    GpuResource::Destroy();
+
+    FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_SRV);
+    FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_UAV);
+    m_SRV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+    m_UAV.ptr = D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN;
+}
+
 // Sub-Allocate a buffer out of a pre-allocated heap.  If initial data is provided, it will be copied into the buffer using the default command context.
 void GpuBuffer::CreatePlaced(const std::wstring& name, ID3D12Heap* pBackingHeap, uint32_t HeapOffset, uint32_t NumElements, uint32_t ElementSize,
     const void* initialData)
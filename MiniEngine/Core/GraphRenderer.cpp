@@ -453,6 +453,7 @@ void GraphRenderer::RenderGraphs(GraphicsContext& Context, GraphType Type)
         DrawGraphHeaders(Text, (viewport.TopLeftX),  blankSpace, 0.0f, (viewport.Height + blankSpace), ProfileGraphs.GetMin(), 
             ProfileGraphs.GetMax(), ProfileGraphs.GetPresetMax(), false, PROFILE_DEBUG_VAR_COUNT, graphTitles);
         
+        Text.Flush();
         Context.SetRootSignature(s_RootSignature);
         Context.TransitionResource(g_OverlayBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
         Context.SetRenderTarget(g_OverlayBuffer.GetRTV());
@@ -489,6 +490,7 @@ void GraphRenderer::RenderGraphs(GraphicsContext& Context, GraphType Type)
         DrawGraphHeaders( Text, (viewport.TopLeftX), blankSpace,  (viewport.TopLeftY - blankSpace - textSpace.y), (viewport.Height + blankSpace), 
                                         GlobalGraphs.GetMinAbs(), GlobalGraphs.GetMaxAbs(), GlobalGraphs.GetPresetMax(), true, 1, graphTitles);
 
+        Text.Flush();
         Context.SetRootSignature(s_RootSignature);
         Context.TransitionResource(g_OverlayBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
         Context.SetRenderTarget(g_OverlayBuffer.GetRTV());
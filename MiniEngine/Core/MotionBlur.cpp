@@ -169,6 +169,8 @@ void MotionBlur::RenderCameraBlur( CommandContext& BaseContext, const Matrix4& r
 
     Context.SetRootSignature(s_RootSignature);
 
+    BeginTransientPhase(Context, kMotionBlurPhase);
+
     uint32_t Width = g_SceneColorBuffer.GetWidth();
     uint32_t Height = g_SceneColorBuffer.GetHeight();
 
@@ -267,6 +269,8 @@ void MotionBlur::RenderObjectBlur( CommandContext& BaseContext, ColorBuffer& vel
 
     Context.SetRootSignature(s_RootSignature);
 
+    BeginTransientPhase(Context, kMotionBlurPhase);
+
     Context.TransitionResource(g_MotionPrepBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
     Context.TransitionResource(g_SceneColorBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
     Context.TransitionResource(velocityBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
@@ -378,6 +378,27 @@ void PixelBuffer::CreateTextureResource( ID3D12Device* Device, const std::wstrin
     CreateTextureResource(Device, Name, ResourceDesc, ClearValue);
 }
 
+void PixelBuffer::CreatePlacedTextureResource( ID3D12Device* Device, const std::wstring& Name,
+    const D3D12_RESOURCE_DESC& ResourceDesc, ID3D12Heap* pBackingHeap, uint64_t HeapOffset )
+{
+    ASSERT((ResourceDesc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) == 0,
+        "Placed render targets would need a clear or discard after every aliasing barrier");
+
+    Destroy();
+
+    ASSERT_SUCCEEDED( Device->CreatePlacedResource( pBackingHeap, HeapOffset, &ResourceDesc,
+        D3D12_RESOURCE_STATE_COMMON, nullptr, MY_IID_PPV_ARGS(&m_pResource) ));
+
+    m_UsageState = D3D12_RESOURCE_STATE_COMMON;
+    m_GpuVirtualAddress = D3D12_GPU_VIRTUAL_ADDRESS_NULL;
+
+#ifndef RELEASE
+    m_pResource->SetName(Name.c_str());
+#else
+    (Name);
+#endif
+}
+
 void PixelBuffer::ExportToFile( const std::wstring& FilePath )
 {
     // Create the buffer.  We will release it after all is done.
@@ -46,6 +46,11 @@ protected:
     void CreateTextureResource( ID3D12Device* Device, const std::wstring& Name, const D3D12_RESOURCE_DESC& ResourceDesc,
         D3D12_CLEAR_VALUE ClearValue, EsramAllocator& Allocator );
 
+    // Create the resource at an offset within an existing heap.  The heap must outlive the resource, and
+    // the resource can be neither a render target nor a depth stencil, so it has no clear value.
+    void CreatePlacedTextureResource( ID3D12Device* Device, const std::wstring& Name, const D3D12_RESOURCE_DESC& ResourceDesc,
+        ID3D12Heap* pBackingHeap, uint64_t HeapOffset );
+
     static DXGI_FORMAT GetBaseFormat( DXGI_FORMAT Format );
     static DXGI_FORMAT GetUAVFormat( DXGI_FORMAT Format );
     static DXGI_FORMAT GetDSVFormat( DXGI_FORMAT Format );
@@ -473,6 +473,9 @@ void PostEffects::Render( UINT curCam )
 
     Context.SetRootSignature(PostEffectsRS);
 
+    // Luminance is generated during tone mapping and consumed by FXAA, so it is activated here as well
+    BeginTransientPhase(Context, kBloomPhase);
+
     Context.TransitionResource(g_SceneColorBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 
     if (Settings::EnableHDR && !Settings::SSAO_DebugDraw && !(Settings::DOF_Enable && Settings::DOF_DebugMode >= 3))
@@ -354,6 +354,8 @@ void SSAO::Render( GraphicsContext& GfxContext, const float* ProjMat, float Near
     ComputeContext& Context = Settings::AsyncCompute ? ComputeContext::Begin(L"Async SSAO", true) : GfxContext.GetComputeContext();
     Context.SetRootSignature(s_RootSignature);
 
+    BeginTransientPhase(Context, kSSAOPhase);
+
     { ScopedTimer _prof(L"Decompress and downsample", Context);
 
     // Phase 1:  Decompress, linearize, downsample, and deinterleave the depth buffer
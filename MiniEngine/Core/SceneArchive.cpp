@@ -0,0 +1,381 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "pch.h"
+#include "SceneArchive.h"
+#include "FileUtility.h"
+#include <cstring>
+#include <cwctype>
+#include <fstream>
+#include <random>
+#include <unordered_set>
+
+using namespace SceneArchive;
+
+namespace
+{
+    // The mounted archive
+    const uint8_t* m_View = nullptr;
+    std::wstring m_Directory;
+    const Header* m_Header = nullptr;
+    const uint32_t* m_Slots = nullptr;
+    const Entry* m_Entries = nullptr;
+    const wchar_t* m_Names = nullptr;
+
+    // FNV-1a of the UTF-16 code units
+    uint64_t HashName( const wchar_t* Name, size_t Length )
+    {
+        uint64_t Hash = 14695981039346656037ull;
+        for (size_t i = 0; i < Length; ++i)
+        {
+            Hash = (Hash ^ (Name[i] & 0xff)) * 1099511628211ull;
+            Hash = (Hash ^ (Name[i] >> 8 & 0xff)) * 1099511628211ull;
+        }
+        return Hash;
+    }
+
+    // Through the last '/' of a normalized path
+    std::wstring GetDirectory( const std::wstring& Path )
+    {
+        const size_t Slash = Path.find_last_of(L'/');
+        return Slash == std::wstring::npos ? std::wstring() : Path.substr(0, Slash + 1);
+    }
+
+    uint64_t GetTableSize( uint32_t SlotCount, uint32_t EntryCount, uint64_t NamesSize )
+    {
+        return sizeof(Header) + (uint64_t)SlotCount * sizeof(uint32_t) + (uint64_t)EntryCount * sizeof(Entry) +
+            NamesSize * sizeof(wchar_t);
+    }
+
+    uint64_t AlignToArchive( uint64_t Offset )
+    {
+        return (Offset + kAlignment - 1) & ~(uint64_t)(kAlignment - 1);
+    }
+
+    bool IsValid( const uint8_t* View, uint64_t Size )
+    {
+        const Header& ArchiveHeader = *(const Header*)View;
+        if (ArchiveHeader.Magic != kMagic || ArchiveHeader.Version != kVersion || ArchiveHeader.SlotCount < 2 ||
+            (ArchiveHeader.SlotCount & (ArchiveHeader.SlotCount - 1)) != 0 ||
+            ArchiveHeader.EntryCount > ArchiveHeader.SlotCount / 2 ||
+            GetTableSize(ArchiveHeader.SlotCount, ArchiveHeader.EntryCount, ArchiveHeader.NamesSize) > Size)
+            return false;
+
+        // Every lookup ends at an empty slot, since at most half of them are used
+        const uint32_t* Slots = (const uint32_t*)(View + sizeof(Header));
+        for (uint32_t s = 0; s < ArchiveHeader.SlotCount; ++s)
+        {
+            if (Slots[s] != kEmptySlot && Slots[s] >= ArchiveHeader.EntryCount)
+                return false;
+        }
+
+        const Entry* Entries = (const Entry*)(Slots + ArchiveHeader.SlotCount);
+        for (uint32_t e = 0; e < ArchiveHeader.EntryCount; ++e)
+        {
+            const Entry& FileEntry = Entries[e];
+            if (FileEntry.Offset % kAlignment != 0 || FileEntry.Size > Size || FileEntry.Offset > Size - FileEntry.Size ||
+                (uint64_t)FileEntry.NameOffset + FileEntry.NameLength > ArchiveHeader.NamesSize)
+                return false;
+        }
+        return true;
+    }
+
+    // The file's name in the mounted archive, or false when it is not under its directory
+    bool GetArchiveName( const std::wstring& FileName, std::wstring& Name )
+    {
+        if (m_View == nullptr)
+            return false;
+
+        const std::wstring Path = NormalizePath(FileName);
+        if (Path.size() <= m_Directory.size() || Path.compare(0, m_Directory.size(), m_Directory) != 0)
+            return false;
+
+        Name = Path.substr(m_Directory.size());
+        return true;
+    }
+
+    const Entry* FindEntry( const std::wstring& Name )
+    {
+        const uint64_t Hash = HashName(Name.data(), Name.size());
+        const uint32_t Mask = m_Header->SlotCount - 1;
+        for (uint32_t Slot = (uint32_t)Hash & Mask; m_Slots[Slot] != kEmptySlot; Slot = (Slot + 1) & Mask)
+        {
+            const Entry& FileEntry = m_Entries[m_Slots[Slot]];
+            if (FileEntry.NameHash == Hash && FileEntry.NameLength == Name.size() &&
+                std::wmemcmp(m_Names + FileEntry.NameOffset, Name.data(), Name.size()) == 0)
+                return &FileEntry;
+        }
+        return nullptr;
+    }
+}
+
+std::wstring SceneArchive::NormalizePath( const std::wstring& Path )
+{
+    std::wstring FullPath(MAX_PATH, L'\0');
+    DWORD Length = GetFullPathNameW(Path.c_str(), (DWORD)FullPath.size(), &FullPath[0], nullptr);
+    if (Length > FullPath.size())
+    {
+        FullPath.resize(Length);
+        Length = GetFullPathNameW(Path.c_str(), (DWORD)FullPath.size(), &FullPath[0], nullptr);
+    }
+    FullPath.resize(Length < FullPath.size() ? Length : 0);
+
+    for (wchar_t& Character : FullPath)
+        Character = Character == L'\\' ? L'/' : (wchar_t)towlower(Character);
+    return FullPath;
+}
+
+bool SceneArchive::Write( const std::wstring& ArchiveName, const std::vector<std::wstring>& FileNames )
+{
+    const std::wstring Directory = GetDirectory(NormalizePath(ArchiveName));
+
+    std::vector<std::wstring> Names;
+    std::vector<std::wstring> Paths;
+    std::unordered_set<std::wstring> Seen;
+    uint64_t NamesSize = 0;
+    for (const std::wstring& FileName : FileNames)
+    {
+        const std::wstring Path = NormalizePath(FileName);
+        if (Directory.empty() || Path.size() <= Directory.size() || Path.compare(0, Directory.size(), Directory) != 0)
+        {
+            Utility::Printf(L"%s is not under the directory of %s\n", FileName.c_str(), ArchiveName.c_str());
+            return false;
+        }
+        if (!Seen.insert(Path).second)
+            continue;
+        Names.push_back(Path.substr(Directory.size()));
+        Paths.push_back(FileName);
+        NamesSize += Names.back().size();
+    }
+
+    // The table is sized for every file asked for, so the files can be written as they are read.  Those that
+    // cannot be read leave padding before the first one.
+    Header ArchiveHeader = {};
+    ArchiveHeader.Magic = kMagic;
+    ArchiveHeader.Version = kVersion;
+    ArchiveHeader.SlotCount = 2;
+    while (ArchiveHeader.SlotCount < Names.size() * 2)
+        ArchiveHeader.SlotCount *= 2;
+
+    std::ofstream File(ArchiveName, std::ios::out | std::ios::binary);
+    if (!File)
+        return false;
+
+    const std::vector<char> Padding(kAlignment);
+    uint64_t Offset = AlignToArchive(GetTableSize(ArchiveHeader.SlotCount, (uint32_t)Names.size(), NamesSize));
+    for (uint64_t Written = 0; Written < Offset; Written += kAlignment)
+        File.write(Padding.data(), kAlignment);
+
+    std::vector<Entry> Entries;
+    std::wstring NameData;
+    for (size_t f = 0; f < Names.size(); ++f)
+    {
+        Utility::ByteArray Data = Utility::ReadFileSync(Paths[f]);
+        if (Data == Utility::NullFile)
+            continue;
+
+        Entry FileEntry = {};
+        FileEntry.NameHash = HashName(Names[f].data(), Names[f].size());
+        FileEntry.Offset = Offset;
+        FileEntry.Size = Data->size();
+        FileEntry.NameOffset = (uint32_t)NameData.size();
+        FileEntry.NameLength = (uint32_t)Names[f].size();
+        Entries.push_back(FileEntry);
+        NameData += Names[f];
+
+        File.write((const char*)Data->data(), Data->size());
+        const uint64_t End = AlignToArchive(Offset + Data->size());
+        File.write(Padding.data(), End - Offset - Data->size());
+        Offset = End;
+    }
+
+    ArchiveHeader.EntryCount = (uint32_t)Entries.size();
+    ArchiveHeader.NamesSize = (uint32_t)NameData.size();
+    std::vector<uint32_t> Slots(ArchiveHeader.SlotCount, kEmptySlot);
+    for (uint32_t e = 0; e < ArchiveHeader.EntryCount; ++e)
+    {
+        uint32_t Slot = (uint32_t)Entries[e].NameHash & (ArchiveHeader.SlotCount - 1);
+        while (Slots[Slot] != kEmptySlot)
+            Slot = (Slot + 1) & (ArchiveHeader.SlotCount - 1);
+        Slots[Slot] = e;
+    }
+
+    File.seekp(0, std::ios::beg);
+    File.write((const char*)&ArchiveHeader, sizeof(ArchiveHeader));
+    File.write((const char*)Slots.data(), Slots.size() * sizeof(uint32_t));
+    File.write((const char*)Entries.data(), Entries.size() * sizeof(Entry));
+    File.write((const char*)NameData.data(), NameData.size() * sizeof(wchar_t));
+    return (bool)File;
+}
+
+bool SceneArchive::Mount( const std::wstring& ArchiveName )
+{
+    Unmount();
+
+    HANDLE File = CreateFile2(ArchiveName.c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+    if (File == INVALID_HANDLE_VALUE)
+        return false;
+
+    // The view keeps the file open after its handles are closed
+    LARGE_INTEGER FileSize = {};
+    HANDLE Mapping = nullptr;
+    if (GetFileSizeEx(File, &FileSize) && FileSize.QuadPart >= (LONGLONG)sizeof(Header))
+        Mapping = CreateFileMappingW(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(File);
+    if (Mapping == nullptr)
+        return false;
+
+    const uint8_t* View = (const uint8_t*)MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(Mapping);
+    if (View == nullptr)
+        return false;
+
+    if (!IsValid(View, (uint64_t)FileSize.QuadPart))
+    {
+        Utility::Printf(L"%s is not a scene archive\n", ArchiveName.c_str());
+        UnmapViewOfFile(View);
+        return false;
+    }
+
+    m_View = View;
+    m_Directory = GetDirectory(NormalizePath(ArchiveName));
+    m_Header = (const Header*)View;
+    m_Slots = (const uint32_t*)(View + sizeof(Header));
+    m_Entries = (const Entry*)(m_Slots + m_Header->SlotCount);
+    m_Names = (const wchar_t*)(m_Entries + m_Header->EntryCount);
+    return true;
+}
+
+void SceneArchive::Unmount( void )
+{
+    if (m_View == nullptr)
+        return;
+
+    UnmapViewOfFile(m_View);
+    m_View = nullptr;
+    m_Directory.clear();
+    m_Header = nullptr;
+    m_Slots = nullptr;
+    m_Entries = nullptr;
+    m_Names = nullptr;
+}
+
+bool SceneArchive::Covers( const std::wstring& FileName )
+{
+    std::wstring Name;
+    return GetArchiveName(FileName, Name);
+}
+
+bool SceneArchive::Find( const std::wstring& FileName, const void*& Data, size_t& Size )
+{
+    std::wstring Name;
+    if (!GetArchiveName(FileName, Name))
+        return false;
+
+    const Entry* FileEntry = FindEntry(Name);
+    if (FileEntry == nullptr)
+        return false;
+
+    Data = m_View + FileEntry->Offset;
+    Size = (size_t)FileEntry->Size;
+    return true;
+}
+
+bool SceneArchive::RunSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, size_t Value )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("Scene archive self test failed:  %s (%zu)\n", Name, Value);
+            Passed = false;
+        }
+    };
+
+    wchar_t TempPath[MAX_PATH];
+    GetTempPathW(MAX_PATH, TempPath);
+    const std::wstring Directory = std::wstring(TempPath) + L"SceneArchiveSelfTest/";
+    CreateDirectoryW(Directory.c_str(), nullptr);
+
+    auto WriteFile = []( const std::wstring& FileName, const std::vector<uint8_t>& Data )
+    {
+        std::ofstream(FileName, std::ios::out | std::ios::binary).write((const char*)Data.data(), Data.size());
+    };
+
+    // Enough files that some names share a home slot, in sizes around the alignment
+    std::mt19937 Random(5);
+    const uint32_t kFileCount = 64;
+    std::vector<std::wstring> FileNames;
+    std::vector<std::vector<uint8_t> > Contents(kFileCount);
+    for (uint32_t f = 0; f < kFileCount; ++f)
+    {
+        const size_t Sizes[] = { 0, 1, kAlignment - 1, kAlignment, kAlignment + 1 };
+        Contents[f].resize(f < 5 ? Sizes[f] : Random() % 20000);
+        for (uint8_t& Byte : Contents[f])
+            Byte = (uint8_t)Random();
+        FileNames.push_back(Directory + L"File" + std::to_wstring(f) + L".dds");
+        WriteFile(FileNames.back(), Contents[f]);
+    }
+
+    // Asked for but missing, on disk but not packed, and outside the archive's directory
+    FileNames.push_back(Directory + L"Missing.dds");
+    const std::wstring Unpacked = Directory + L"Unpacked.dds";
+    const std::wstring Outside = std::wstring(TempPath) + L"SceneArchiveSelfTest.dds";
+    WriteFile(Unpacked, Contents[10]);
+    WriteFile(Outside, Contents[11]);
+
+    const std::wstring ArchiveName = Directory + L"Scene.scene";
+    Expect(Write(ArchiveName, FileNames), "write", FileNames.size());
+    Expect(!Write(ArchiveName, std::vector<std::wstring>(1, Outside)), "file outside the directory", 0);
+    Expect(Mount(ArchiveName), "mount", 0);
+    Expect(m_Header != nullptr && m_Header->EntryCount == kFileCount, "entry count", m_Header ? m_Header->EntryCount : 0);
+
+    uint32_t Displaced = 0;
+    for (uint32_t s = 0; m_Header != nullptr && s < m_Header->SlotCount; ++s)
+    {
+        if (m_Slots[s] != kEmptySlot && ((uint32_t)m_Entries[m_Slots[s]].NameHash & (m_Header->SlotCount - 1)) != s)
+            ++Displaced;
+    }
+    Expect(Displaced > 0, "colliding names", Displaced);
+
+    for (uint32_t f = 0; f < kFileCount; ++f)
+    {
+        const void* Data = nullptr;
+        size_t Size = 0;
+        Expect(Find(FileNames[f], Data, Size) && Size == Contents[f].size() &&
+            std::memcmp(Data, Contents[f].data(), Size) == 0, "find", f);
+        Expect((uintptr_t)Data % kAlignment == 0, "alignment", f);
+
+        Utility::ByteArray Bytes = Utility::ReadFileSync(FileNames[f]);
+        Expect(*Bytes == std::vector<byte>(Contents[f].begin(), Contents[f].end()), "read", f);
+    }
+
+    // Names are matched whatever their case and separators
+    const void* Data = nullptr;
+    size_t Size = 0;
+    Expect(Find(Directory + L"Sub\\..\\FILE7.DDS", Data, Size) && Size == Contents[7].size(), "normalized name", 7);
+    Expect(Utility::ReadFileRange(Directory + L"file9.dds", 10, 20)->size() == 20, "range", 9);
+
+    Expect(Covers(Unpacked) && !Find(Unpacked, Data, Size) && Utility::ReadFileSync(Unpacked) == Utility::NullFile,
+        "unpacked file under the directory is missing", 0);
+    Expect(!Covers(Outside) && Utility::ReadFileSync(Outside)->size() == Contents[11].size(), "file outside", 0);
+
+    Unmount();
+    Expect(!Covers(Unpacked) && Utility::ReadFileSync(Unpacked)->size() == Contents[10].size(), "unmount", 0);
+
+    for (uint32_t f = 0; f < kFileCount; ++f)
+        _wremove(FileNames[f].c_str());
+    _wremove(Unpacked.c_str());
+    _wremove(Outside.c_str());
+    _wremove(ArchiveName.c_str());
+    RemoveDirectoryW(Directory.c_str());
+
+    return Passed;
+}
@@ -0,0 +1,75 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// A whole scene in one file:  the H3D and every texture it may load, behind a hashed table of contents,
+// with each file's bytes starting on a 4 KB boundary.  A mounted archive is mapped into memory and stands
+// in for the directory it was packed for.  Every file under that directory that Utility::ReadFileSync()
+// is asked for resolves through the table without touching the filesystem, and a file the archive does not
+// hold is missing even when it exists on disk.  Files outside the directory are read as before.
+//
+// The file starts with a Header, then SlotCount slots of an open addressing table, each the index of an
+// Entry or kEmptySlot, then the entries, then their names, then the files.  Names are full paths in lower
+// case with '/' separators, relative to the archive's directory.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace SceneArchive
+{
+    const uint32_t kMagic = 0x414e4353;     // "SCNA"
+    const uint32_t kVersion = 1;
+    const uint32_t kAlignment = 4096;
+    const uint32_t kEmptySlot = 0xffffffff;
+
+    struct Header
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t EntryCount;
+        uint32_t SlotCount;         // A power of two, at least twice EntryCount
+        uint32_t NamesSize;         // In characters
+        uint32_t Reserved;
+    };
+
+    struct Entry
+    {
+        uint64_t NameHash;
+        uint64_t Offset;            // From the start of the archive, a multiple of kAlignment
+        uint64_t Size;
+        uint32_t NameOffset;        // In characters
+        uint32_t NameLength;
+    };
+
+    // The full path in lower case with '/' separators and without "." or ".." components
+    std::wstring NormalizePath( const std::wstring& Path );
+
+    // Packs the files into an archive for the directory ArchiveName is in, which every file must be under.
+    // Files are read with Utility::ReadFileSync(), so a ".chunked" or ".gz" copy is stored inflated, and
+    // files that cannot be read are left out.
+    bool Write( const std::wstring& ArchiveName, const std::vector<std::wstring>& FileNames );
+
+    // Maps the archive in place of its directory, after unmounting any other.  Returns false, leaving
+    // nothing mounted, when the file is missing or is not an archive.  Files must not be read on other
+    // threads while mounting or unmounting.
+    bool Mount( const std::wstring& ArchiveName );
+    void Unmount( void );
+
+    // Whether the file is under the mounted archive's directory, so the archive decides whether it exists
+    bool Covers( const std::wstring& FileName );
+
+    // Points Data at the file's bytes in the mapped archive, which stay valid until it is unmounted
+    bool Find( const std::wstring& FileName, const void*& Data, size_t& Size );
+
+    // Packs synthetic files, including some whose slots collide, then checks lookups through the mounted
+    // archive, the alignment of their bytes, and that misses under its directory never reach the disk
+    bool RunSelfTest( void );
+}
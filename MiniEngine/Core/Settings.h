@@ -42,6 +42,56 @@ namespace Settings
 	extern BoolVar UseSceneLighting;
 	// Lighting Grid
 
+	// Stereo Reuse
+	extern BoolVar StereoReuse_Enable;
+	extern NumVar StereoReuse_MaxAngle;
+	extern NumVar StereoReuse_DepthTolerance;
+	// Stereo Reuse
+
+	// Ray Compaction
+	extern BoolVar CompactReflectionRays;
+	// Ray Compaction
+
+	// Foveated Rays
+	extern BoolVar FoveatedRays_Enable;
+	extern BoolVar FoveatedRays_GazeFalloff;
+	extern NumVar FoveatedRays_GazeX;
+	extern NumVar FoveatedRays_GazeY;
+	extern NumVar FoveatedRays_InnerRadius;
+	extern NumVar FoveatedRays_OuterRadius;
+	// Foveated Rays
+
+	// Interleaved Rays
+	extern EnumVar InterleavedRays_Shadows;
+	extern EnumVar InterleavedRays_Diffuse;
+	extern EnumVar InterleavedRays_Reflections;
+	extern NumVar InterleavedRays_MaxVelocity;
+	extern NumVar InterleavedRays_DepthTolerance;
+	// Interleaved Rays
+
+	// Shadow Ray Culling
+	extern BoolVar ShadowRayCulling_Enable;
+	extern BoolVar ShadowRayCulling_ShadowMapHint;
+	extern NumVar ShadowRayCulling_DepthMargin;
+	// Shadow Ray Culling
+
+	// Meshlet Culling
+	extern BoolVar MeshletCulling_Enable;
+	// Meshlet Culling
+
+	// Level of Detail
+	extern BoolVar LevelOfDetail_Enable;
+	extern NumVar LevelOfDetail_PixelError;
+	// Level of Detail
+
+	// Merged Depth Geometry
+	extern BoolVar DepthGeometry_Merge;
+	// Merged Depth Geometry
+
+	// Shadow Caster Culling
+	extern BoolVar ShadowCasterCulling_Enable;
+	// Shadow Caster Culling
+
 	// FXAA
 	extern BoolVar FXAA_Enable;
 	extern BoolVar FXAA_DebugDraw;
@@ -15,7 +15,6 @@
 
 cbuffer cbFontParams : register(b0)
 {
-    float4 Color;
     float2 ShadowOffset;
     float ShadowHardness;
     float ShadowOpacity;
@@ -29,6 +28,7 @@ struct PS_INPUT
 {
     float4 pos : SV_POSITION;
     float2 uv : TEXCOORD0;
+    float4 color : COLOR0;
 };
 
 float GetAlpha( float2 uv )
@@ -39,5 +39,5 @@ float GetAlpha( float2 uv )
 [RootSignature(Text_RootSig)]
 float4 main( PS_INPUT Input ) : SV_Target
 {
-    return float4(Color.rgb, 1) * GetAlpha(Input.uv) * Color.a;
+    return float4(Input.color.rgb, 1) * GetAlpha(Input.uv) * Input.color.a;
 }
@@ -15,7 +15,6 @@
 
 cbuffer cbFontParams : register(b0)
 {
-    float4 Color;
     float2 ShadowOffset;
     float ShadowHardness;
     float ShadowOpacity;
@@ -29,6 +28,7 @@ struct PS_INPUT
 {
     float4 pos : SV_POSITION;
     float2 uv : TEXCOORD0;
+    float4 color : COLOR0;
 };
 
 float GetAlpha( float2 uv, float range )
@@ -39,7 +39,7 @@ float GetAlpha( float2 uv, float range )
 [RootSignature(Text_RootSig)]
 float4 main( PS_INPUT Input ) : SV_Target
 {
-    float alpha1 = GetAlpha(Input.uv, HeightRange) * Color.a;
-    float alpha2 = GetAlpha(Input.uv - ShadowOffset, HeightRange * ShadowHardness) * ShadowOpacity * Color.a;
-    return float4( Color.rgb * alpha1, lerp(alpha2, 1, alpha1) );
+    float alpha1 = GetAlpha(Input.uv, HeightRange) * Input.color.a;
+    float alpha2 = GetAlpha(Input.uv - ShadowOffset, HeightRange * ShadowHardness) * ShadowOpacity * Input.color.a;
+    return float4( Input.color.rgb * alpha1, lerp(alpha2, 1, alpha1) );
 }
@@ -28,12 +28,14 @@ struct VS_INPUT
 {
     float2 ScreenPos : POSITION;    // Upper-left position in screen pixel coordinates
     uint4  Glyph : TEXCOORD;        // X, Y, Width, Height in texel space
+    float4 Color : COLOR;            // Text color and opacity
 };
 
 struct VS_OUTPUT
 {
     float4 Pos : SV_POSITION;    // Upper-left and lower-right coordinates in clip space
     float2 Tex : TEXCOORD0;        // Upper-left and lower-right normalized UVs
+    float4 Color : COLOR0;
 };
 
 [RootSignature(Text_RootSig)]
@@ -49,5 +51,6 @@ VS_OUTPUT main( VS_INPUT input, uint VertID : SV_VertexID )
     VS_OUTPUT output;
     output.Pos = float4( lerp(xy0, xy1, uv) * Scale + Offset, 0, 1 );
     output.Tex = lerp(uv0, uv1, uv) * InvTexDim;
+    output.Color = input.Color;
     return output;
 }
@@ -29,7 +29,6 @@
 #include <string>
 #include <cstdio>
 #include <memory>
-#include <malloc.h>
 
 using namespace Graphics;
 using namespace Math;
@@ -50,6 +49,7 @@ namespace TextRenderer
             m_BorderSize = 0;
             m_TextureWidth = 0;
             m_TextureHeight = 0;
+            std::memset(m_Latin1Glyphs, 0, sizeof(m_Latin1Glyphs));
         }
 
         ~Font()
@@ -96,6 +96,13 @@ namespace TextRenderer
             for (uint16_t i = 0; i < NumGlyphs; ++i)
                 m_Dictionary[wcharList[i]] = glyphData[i];
 
+            // Map nodes never move, so the flat table can point straight at them
+            for (auto& it : m_Dictionary)
+            {
+                if (it.first < _countof(m_Latin1Glyphs))
+                    m_Latin1Glyphs[it.first] = &it.second;
+            }
+
             m_Texture.Create( textureWidth, textureHeight, DXGI_FORMAT_R8_SNORM, texelData );
 
             DEBUGPRINT( "Loaded SDF font:  %ls (ver. %d.%d)", fontName, header->majorVersion, header->minorVersion);
@@ -126,6 +133,9 @@ namespace TextRenderer
 
         const Glyph* GetGlyph( wchar_t ch ) const
         {
+            if (ch < _countof(m_Latin1Glyphs))
+                return m_Latin1Glyphs[ch];
+
             auto it = m_Dictionary.find( ch );
             return it == m_Dictionary.end() ? nullptr : &it->second;
         }
@@ -161,6 +171,7 @@ namespace TextRenderer
         uint16_t m_TextureHeight;
         Texture m_Texture;
         map<wchar_t, Glyph> m_Dictionary;
+        const Glyph* m_Latin1Glyphs[256];    // Direct lookup for ASCII and Latin-1, null for missing glyphs
     };
 
     map< wstring, unique_ptr<Font> > LoadedFonts;
@@ -200,7 +211,8 @@ void TextRenderer::Initialize( void )
     D3D12_INPUT_ELEMENT_DESC vertElem[] =
     {
         { "POSITION", 0, DXGI_FORMAT_R32G32_FLOAT     , 0, 0, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
-        { "TEXCOORD", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 }
+        { "TEXCOORD", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 },
+        { "COLOR",    0, DXGI_FORMAT_R8G8B8A8_UNORM   , 0, 16, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1 }
     };
     auto overlayBuffer = g_OverlayBuffer;
 
@@ -238,6 +250,11 @@ TextContext::TextContext( GraphicsContext& CmdContext, float ViewWidth, float Vi
 {
     m_HDR = FALSE;
     m_CurrentFont = nullptr;
+    m_GlyphChunk = nullptr;
+    m_GlyphChunkGpuAddress = D3D12_GPU_VIRTUAL_ADDRESS_NULL;
+    m_GlyphChunkCapacity = 0;
+    m_NumGlyphs = 0;
+    m_FirstPendingGlyph = 0;
     m_ViewWidth = ViewWidth;
     m_ViewHeight = ViewHeight;
 
@@ -255,6 +272,11 @@ TextContext::TextContext( GraphicsContext& CmdContext, float ViewWidth, float Vi
     ResetSettings();
 }
 
+TextContext::~TextContext()
+{
+    Flush();
+}
+
 void TextContext::ResetSettings( void )
 {
     m_EnableShadow = true;
@@ -263,7 +285,7 @@ void TextContext::ResetSettings( void )
     m_ShadowOffsetY = 0.05f;
     m_PSParams.ShadowHardness = 0.5f;
     m_PSParams.ShadowOpacity = 1.0f;
-    m_PSParams.TextColor = Color(1.0f, 1.0f, 1.0f, 1.0f);
+    m_TextColor = Color(1.0f, 1.0f, 1.0f, 1.0f).R8G8B8A8();
 
     m_VSConstantBufferIsStale = true;
     m_PSConstantBufferIsStale = true;
@@ -293,6 +315,8 @@ void TextContext::EnableDropShadow(bool enable)
     if (m_EnableShadow == enable)
         return;
 
+    Flush();
+
     m_EnableShadow = enable;
 
     m_Context.SetPipelineState( m_EnableShadow ? TextRenderer::s_ShadowPSO[m_HDR] : TextRenderer::s_TextPSO[m_HDR] );
@@ -316,8 +340,7 @@ void TextContext::SetShadowParams(float opacity, float width)
 
 void TextContext::SetColor( Color c )
 {
-    m_PSParams.TextColor = c;
-    m_PSConstantBufferIsStale = true;
+    m_TextColor = c.R8G8B8A8();
 }
 
 float TextContext::GetVerticalSpacing( void )
@@ -327,6 +350,7 @@ float TextContext::GetVerticalSpacing( void )
 
 void TextContext::Begin( bool EnableHDR )
 {
+    Flush();
     ResetSettings();
 
     m_HDR = (BOOL)EnableHDR;
@@ -406,6 +430,8 @@ void TextContext::SetViewSize( float ViewWidth, float ViewHeight )
 
 void TextContext::End( void )
 {
+    Flush();
+
     m_VSConstantBufferIsStale = true;
     m_PSConstantBufferIsStale = true;
     m_TextureIsStale = true;
@@ -449,7 +475,7 @@ UINT TextContext::FillVertexBuffer( TextVert volatile* verts, const char* str, s
     const char* iter = str;
     for (size_t i = 0; i < slen; ++i)
     {
-        wchar_t wc = (stride == 2 ? *(wchar_t*)iter : *iter);
+        wchar_t wc = (stride == 2 ? *(wchar_t*)iter : (uint8_t)*iter);
         iter += stride;
 
         // Terminate on null character (this really shouldn't happen with string or wstring)
@@ -476,6 +502,7 @@ UINT TextContext::FillVertexBuffer( TextVert volatile* verts, const char* str, s
         verts->V = gi->y;
         verts->W = gi->w;
         verts->H = texelHeight;
+        verts->Color = m_TextColor;
         ++verts;
 
         // Advance the cursor position
@@ -489,38 +516,63 @@ UINT TextContext::FillVertexBuffer( TextVert volatile* verts, const char* str, s
     return charsDrawn;
 }
 
-void TextContext::DrawString( const std::wstring& str )
+TextContext::TextVert* TextContext::ReserveGlyphs( size_t Count )
 {
-    SetRenderState();
-
-    void* stackMem = _malloca((str.size() + 1) * 16);
-    TextVert* vbPtr = Math::AlignUp((TextVert*)stackMem, 16);
-    UINT primCount = FillVertexBuffer(vbPtr, (char*)str.c_str(), 2, str.size());
-
-    if (primCount > 0)
+    if (m_NumGlyphs + Count > m_GlyphChunkCapacity)
     {
-        m_Context.SetDynamicVB(0, primCount, sizeof(TextVert), vbPtr);
-        m_Context.DrawInstanced( 4, primCount );
+        Flush();
+
+        m_GlyphChunkCapacity = Count > kGlyphsPerChunk ? (uint32_t)Count : kGlyphsPerChunk;
+        DynAlloc Chunk = m_Context.ReserveUploadMemory(m_GlyphChunkCapacity * sizeof(TextVert));
+        m_GlyphChunk = (TextVert*)Chunk.DataPtr;
+        m_GlyphChunkGpuAddress = Chunk.GpuAddress;
+        m_NumGlyphs = 0;
+        m_FirstPendingGlyph = 0;
     }
 
-    _freea(stackMem);
+    return m_GlyphChunk + m_NumGlyphs;
 }
 
-void TextContext::DrawString( const std::string& str )
+void TextContext::Flush( void )
 {
-    SetRenderState();
+    const uint32_t NumPending = m_NumGlyphs - m_FirstPendingGlyph;
+    if (NumPending == 0)
+        return;
 
-    void* stackMem = _malloca((str.size() + 1) * 16);
-    TextVert* vbPtr = Math::AlignUp((TextVert*)stackMem, 16);
-    UINT primCount = FillVertexBuffer(vbPtr, (char*)str.c_str(), 1, str.size());
+    D3D12_VERTEX_BUFFER_VIEW VBView;
+    VBView.BufferLocation = m_GlyphChunkGpuAddress + m_FirstPendingGlyph * sizeof(TextVert);
+    VBView.SizeInBytes = NumPending * sizeof(TextVert);
+    VBView.StrideInBytes = sizeof(TextVert);
 
-    if (primCount > 0)
+    m_Context.SetVertexBuffer(0, VBView);
+    m_Context.DrawInstanced(4, NumPending);
+
+    m_FirstPendingGlyph = m_NumGlyphs;
+}
+
+void TextContext::DrawStringInternal( const char* str, size_t stride, size_t slen )
+{
+    if (slen == 0)
+        return;
+
+    // Glyphs already batched were laid out for the bound state, so draw them before rebinding
+    if (m_VSConstantBufferIsStale || m_PSConstantBufferIsStale || m_TextureIsStale)
     {
-        m_Context.SetDynamicVB(0, primCount, sizeof(TextVert), vbPtr);
-        m_Context.DrawInstanced( 4, primCount );
+        Flush();
+        SetRenderState();
     }
 
-    _freea(stackMem);
+    m_NumGlyphs += FillVertexBuffer(ReserveGlyphs(slen), str, stride, slen);
+}
+
+void TextContext::DrawString( const std::wstring& str )
+{
+    DrawStringInternal((const char*)str.c_str(), 2, str.size());
+}
+
+void TextContext::DrawString( const std::string& str )
+{
+    DrawStringInternal(str.c_str(), 1, str.size());
 }
 
 void TextContext::DrawFormattedString( const wchar_t* format, ... )
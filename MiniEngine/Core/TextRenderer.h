@@ -33,12 +33,17 @@ namespace TextRenderer
     class Font;
 }
 
+// Glyphs are written straight into upload memory and drawn with one instanced draw per batch.  A batch
+// ends when the font, text size, shadow settings or pipeline change, or when the context is flushed.
+// Text color is stored per glyph, so changing it does not break a batch.
 class TextContext
 {
 public:
     TextContext( GraphicsContext& CmdContext, float CanvasWidth = 1920.0f, float CanvasHeight = 1080.0f );
+    ~TextContext();
 
-    GraphicsContext& GetCommandContext() const { return m_Context; }
+    // Pending text is drawn first so that commands recorded through the returned context follow it
+    GraphicsContext& GetCommandContext() { Flush(); return m_Context; }
 
     // Put settings back to the defaults.
     void ResetSettings( void );
@@ -90,6 +95,9 @@ public:
     void Begin( bool EnableHDR = false );
     void End( void );
 
+    // Draw all batched text.  Call this before changing command context state outside of the text renderer.
+    void Flush( void );
+
     // Draw a string
     void DrawString( const std::wstring& str );
     void DrawString( const std::string& str );
@@ -111,7 +119,6 @@ private:
 
     __declspec(align(16)) struct PixelShaderParams
     {
-        Color TextColor;
         float ShadowOffsetX, ShadowOffsetY;
         float ShadowHardness;        // More than 1 will cause aliasing
         float ShadowOpacity;        // Should make less opaque when making softer
@@ -120,21 +127,31 @@ private:
 
     void SetRenderState(void);
 
-    // 16 Byte structure to represent an entire glyph in the text vertex buffer
-    __declspec(align(16)) struct TextVert
+    // 20 Byte structure to represent an entire glyph in the text vertex buffer
+    struct TextVert
     {
         float X, Y;                // Upper-left glyph position in screen space
         uint16_t U, V, W, H;    // Upper-left glyph UV and the width in texture space
+        uint32_t Color;            // R8G8B8A8 text color
     };
 
+    // Glyph space is reserved from the context's upload memory in chunks of at least this many glyphs
+    static const uint32_t kGlyphsPerChunk = 1024;
+
     UINT FillVertexBuffer( TextVert volatile* verts, const char* str, size_t stride, size_t slen );
-    void DrawStringInternal( const std::string& str );
-    void DrawStringInternal( const std::wstring& str );
+    void DrawStringInternal( const char* str, size_t stride, size_t slen );
+    TextVert* ReserveGlyphs( size_t Count );
 
     GraphicsContext& m_Context;
     const TextRenderer::Font* m_CurrentFont;
     VertexShaderParams m_VSParams;
     PixelShaderParams m_PSParams;
+    uint32_t m_TextColor;
+    TextVert* m_GlyphChunk;                        // CPU address of the current upload chunk
+    D3D12_GPU_VIRTUAL_ADDRESS m_GlyphChunkGpuAddress;
+    uint32_t m_GlyphChunkCapacity;
+    uint32_t m_NumGlyphs;                        // Glyphs written to the current chunk
+    uint32_t m_FirstPendingGlyph;                // First glyph not yet drawn
     bool m_VSConstantBufferIsStale;    // Tracks when the CB needs updating
     bool m_PSConstantBufferIsStale;    // Tracks when the CB needs updating
     bool m_TextureIsStale;
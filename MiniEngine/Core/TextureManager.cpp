@@ -15,6 +15,7 @@
 #include "pch.h"
 #include "TextureManager.h"
 #include "FileUtility.h"
+#include "SceneArchive.h"
 #include "DDSTextureLoader.h"
 #include "GraphicsCore.h"
 #include "CommandContext.h"
@@ -64,11 +65,18 @@ void Texture::Create( size_t Pitch, size_t Width, size_t Height, DXGI_FORMAT For
 
     CommandContext::InitializeTexture(*this, 1, &texResource);
 
-    if (m_hCpuDescriptorHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+    if (m_hCpuDescriptorHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN || m_hCpuDescriptorHandle.ptr == 0)
         m_hCpuDescriptorHandle = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
     g_Device->CreateShaderResourceView(m_pResource.Get(), nullptr, m_hCpuDescriptorHandle);
 }
 
+void Texture::Destroy( void )
+{
+    GpuResource::Destroy();
+    FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_hCpuDescriptorHandle);
+    m_hCpuDescriptorHandle.ptr = 0;
+}
+
 void Texture::CreateTGAFromMemory( const void* _filePtr, size_t, bool sRGB )
 {
     const uint8_t* filePtr = (const uint8_t*)_filePtr;
@@ -123,7 +131,7 @@ void Texture::CreateTGAFromMemory( const void* _filePtr, size_t, bool sRGB )
 
 bool Texture::CreateDDSFromMemory( const void* filePtr, size_t fileSize, bool sRGB )
 {
-    if (m_hCpuDescriptorHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN)
+    if (m_hCpuDescriptorHandle.ptr == D3D12_GPU_VIRTUAL_ADDRESS_UNKNOWN || m_hCpuDescriptorHandle.ptr == 0)
         m_hCpuDescriptorHandle = AllocateDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
     HRESULT hr = CreateDDSTextureFromMemory( Graphics::g_Device,
@@ -164,6 +172,17 @@ namespace TextureManager
         s_TextureCache.clear();
     }
 
+    // Points data at the whole file, in place when the mounted scene archive holds it and otherwise in ba
+    void ReadTextureFile( const wstring& fileName, Utility::ByteArray& ba, const void*& data, size_t& size )
+    {
+        if (SceneArchive::Find(fileName, data, size))
+            return;
+
+        ba = Utility::ReadFileSync(fileName);
+        data = ba->data();
+        size = ba->size();
+    }
+
     pair<ManagedTexture*, bool> FindOrLoadTexture( const wstring& fileName )
     {
         static mutex s_Mutex;
@@ -248,10 +267,22 @@ void ManagedTexture::WaitForLoad( void ) const
 
 void ManagedTexture::SetToInvalidTexture( void )
 {
+    // A failed load may already have allocated its own SRV
+    if (m_IsValid)
+        FreeDescriptor(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, m_hCpuDescriptorHandle);
+
     m_hCpuDescriptorHandle = TextureManager::GetMagentaTex2D().GetSRV();
     m_IsValid = false;
 }
 
+void ManagedTexture::Destroy( void )
+{
+    if (!m_IsValid)
+        m_hCpuDescriptorHandle.ptr = 0;
+
+    Texture::Destroy();
+}
+
 const ManagedTexture* TextureManager::LoadFromFile( const std::wstring& fileName, bool sRGB )
 {
     std::wstring CatPath = fileName;
@@ -279,8 +310,11 @@ const ManagedTexture* TextureManager::LoadDDSFromFile( const std::wstring& fileN
         return ManTex;
     }
 
-    Utility::ByteArray ba = Utility::ReadFileSync( s_RootPath + fileName );
-    if (ba->size() == 0 || !ManTex->CreateDDSFromMemory( ba->data(), ba->size(), sRGB ))
+    Utility::ByteArray ba;
+    const void* data;
+    size_t size;
+    ReadTextureFile( s_RootPath + fileName, ba, data, size );
+    if (size == 0 || !ManTex->CreateDDSFromMemory( data, size, sRGB ))
         ManTex->SetToInvalidTexture();
     else
         ManTex->GetResource()->SetName(fileName.c_str());
@@ -301,10 +335,13 @@ const ManagedTexture* TextureManager::LoadTGAFromFile( const std::wstring& fileN
         return ManTex;
     }
 
-    Utility::ByteArray ba = Utility::ReadFileSync( s_RootPath + fileName );
-    if (ba->size() > 0)
+    Utility::ByteArray ba;
+    const void* data;
+    size_t size;
+    ReadTextureFile( s_RootPath + fileName, ba, data, size );
+    if (size > 0)
     {
-        ManTex->CreateTGAFromMemory( ba->data(), ba->size(), sRGB );
+        ManTex->CreateTGAFromMemory( data, size, sRGB );
         ManTex->GetResource()->SetName(fileName.c_str());
     }
     else
@@ -327,10 +364,13 @@ const ManagedTexture* TextureManager::LoadPIXImageFromFile( const std::wstring&
         return ManTex;
     }
 
-    Utility::ByteArray ba = Utility::ReadFileSync( s_RootPath + fileName );
-    if (ba->size() > 0)
+    Utility::ByteArray ba;
+    const void* data;
+    size_t size;
+    ReadTextureFile( s_RootPath + fileName, ba, data, size );
+    if (size > 0)
     {
-        ManTex->CreatePIXImageFromMemory(ba->data(), ba->size());
+        ManTex->CreatePIXImageFromMemory(data, size);
         ManTex->GetResource()->SetName(fileName.c_str());
     }
     else
@@ -38,12 +38,8 @@ public:
     bool CreateDDSFromMemory( const void* memBuffer, size_t fileSize, bool sRGB );
     void CreatePIXImageFromMemory( const void* memBuffer, size_t fileSize );
 
-    virtual void Destroy() override
-    {
-        GpuResource::Destroy();
-        // This leaks descriptor handles.  We should really give it back to be reused.
-        m_hCpuDescriptorHandle.ptr = 0;
-    }
+    // Release the resource and return the SRV to the descriptor allocator
+    virtual void Destroy() override;
 
     const D3D12_CPU_DESCRIPTOR_HANDLE& GetSRV() const { return m_hCpuDescriptorHandle; }
 
@@ -67,6 +63,9 @@ public:
     void SetToInvalidTexture(void);
     bool IsValid(void) const { return m_IsValid; }
 
+    // An invalid texture borrows the SRV of the default texture and must not free it
+    virtual void Destroy() override;
+
 private:
     std::wstring m_MapKey;        // For deleting from the map later
     bool m_IsValid;
@@ -77,6 +76,7 @@ namespace TextureManager
     void Initialize( const std::wstring& TextureLibRoot );
     void Shutdown(void);
 
+    // Files are read from the mounted scene archive in place when it holds them (see SceneArchive.h)
     const ManagedTexture* LoadFromFile( const std::wstring& fileName, bool sRGB = false );
     const ManagedTexture* LoadDDSFromFile( const std::wstring& fileName, bool sRGB = false );
     const ManagedTexture* LoadTGAFromFile( const std::wstring& fileName, bool sRGB = false );
@@ -0,0 +1,242 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "pch.h"
+#include "TransientMemoryPlanner.h"
+#include <algorithm>
+#include <random>
+
+uint32_t TransientMemoryPlanner::AddResource( uint64_t Size, uint64_t Alignment, uint32_t FirstPhase, uint32_t LastPhase )
+{
+    ASSERT(Size > 0);
+    ASSERT(Alignment > 0 && (Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two");
+    ASSERT(FirstPhase <= LastPhase);
+
+    Resource NewResource;
+    NewResource.Size = Size;
+    NewResource.Alignment = Alignment;
+    NewResource.Offset = 0;
+    NewResource.FirstPhase = FirstPhase;
+    NewResource.LastPhase = LastPhase;
+    m_Resources.push_back(NewResource);
+
+    m_IsSolved = false;
+    return (uint32_t)m_Resources.size() - 1;
+}
+
+void TransientMemoryPlanner::Reset( void )
+{
+    m_Resources.clear();
+    m_HeapSize = 0;
+    m_IsSolved = false;
+}
+
+void TransientMemoryPlanner::Solve( void )
+{
+    const uint32_t NumResources = (uint32_t)m_Resources.size();
+
+    // Place large resources first so that small ones fill the gaps left between them.  Ties are
+    // broken by phase and then by registration order to keep the result reproducible.
+    std::vector<uint32_t> Order(NumResources);
+    for (uint32_t i = 0; i < NumResources; ++i)
+        Order[i] = i;
+
+    std::sort(Order.begin(), Order.end(), [this]( uint32_t A, uint32_t B )
+    {
+        const Resource& RA = m_Resources[A];
+        const Resource& RB = m_Resources[B];
+        if (RA.Size != RB.Size)
+            return RA.Size > RB.Size;
+        if (RA.FirstPhase != RB.FirstPhase)
+            return RA.FirstPhase < RB.FirstPhase;
+        return A < B;
+    });
+
+    // Byte ranges already claimed by placed resources that are live at the same time as the
+    // resource being placed.  Kept sorted by start offset.
+    struct Range
+    {
+        uint64_t Begin;
+        uint64_t End;
+        bool operator<( const Range& Rhs ) const { return Begin < Rhs.Begin; }
+    };
+    std::vector<Range> Occupied;
+    Occupied.reserve(NumResources);
+
+    m_HeapSize = 0;
+
+    for (uint32_t i = 0; i < NumResources; ++i)
+    {
+        Resource& Current = m_Resources[Order[i]];
+
+        Occupied.clear();
+        for (uint32_t j = 0; j < i; ++j)
+        {
+            const uint32_t PlacedIndex = Order[j];
+            if (LifetimesOverlap(Order[i], PlacedIndex))
+            {
+                const Resource& Placed = m_Resources[PlacedIndex];
+                Range R = { Placed.Offset, Placed.Offset + Placed.Size };
+                Occupied.push_back(R);
+            }
+        }
+        std::sort(Occupied.begin(), Occupied.end());
+
+        // First fit:  walk the claimed ranges in address order and take the first aligned gap
+        // that is large enough.  If none is found we end up after the last range.
+        uint64_t Candidate = 0;
+        for (const Range& R : Occupied)
+        {
+            if (Candidate + Current.Size <= R.Begin)
+                break;
+
+            Candidate = std::max(Candidate, Math::AlignUp(R.End, (size_t)Current.Alignment));
+        }
+
+        Current.Offset = Candidate;
+        m_HeapSize = std::max(m_HeapSize, Candidate + Current.Size);
+    }
+
+    // Alignment padding between mixed alignments can leave first fit behind laying every resource out
+    // one after another, which is always valid, so fall back to that
+    if (m_HeapSize > GetUnaliasedSize())
+    {
+        m_HeapSize = 0;
+        for (Resource& R : m_Resources)
+        {
+            R.Offset = Math::AlignUp(m_HeapSize, (size_t)R.Alignment);
+            m_HeapSize = R.Offset + R.Size;
+        }
+    }
+
+    m_IsSolved = true;
+
+    ASSERT(Validate(), "Transient memory planner produced overlapping allocations");
+}
+
+uint64_t TransientMemoryPlanner::GetOffset( uint32_t Index ) const
+{
+    ASSERT(m_IsSolved, "Solve() must be called before retrieving offsets");
+    return m_Resources[Index].Offset;
+}
+
+uint64_t TransientMemoryPlanner::GetUnaliasedSize( void ) const
+{
+    uint64_t TotalSize = 0;
+    for (const Resource& R : m_Resources)
+        TotalSize = Math::AlignUp(TotalSize, (size_t)R.Alignment) + R.Size;
+    return TotalSize;
+}
+
+bool TransientMemoryPlanner::LifetimesOverlap( uint32_t A, uint32_t B ) const
+{
+    const Resource& RA = m_Resources[A];
+    const Resource& RB = m_Resources[B];
+    return RA.FirstPhase <= RB.LastPhase && RB.FirstPhase <= RA.LastPhase;
+}
+
+bool TransientMemoryPlanner::MemoryOverlaps( uint32_t A, uint32_t B ) const
+{
+    const Resource& RA = m_Resources[A];
+    const Resource& RB = m_Resources[B];
+    return RA.Offset < RB.Offset + RB.Size && RB.Offset < RA.Offset + RA.Size;
+}
+
+bool TransientMemoryPlanner::Validate( void ) const
+{
+    if (!m_IsSolved)
+        return false;
+
+    const uint32_t NumResources = (uint32_t)m_Resources.size();
+    for (uint32_t i = 0; i < NumResources; ++i)
+    {
+        const Resource& R = m_Resources[i];
+        if ((R.Offset & (R.Alignment - 1)) != 0 || R.Offset + R.Size > m_HeapSize)
+            return false;
+
+        for (uint32_t j = i + 1; j < NumResources; ++j)
+        {
+            if (LifetimesOverlap(i, j) && MemoryOverlaps(i, j))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool TransientMemoryPlanner::RunSelfTest( void )
+{
+    bool Passed = true;
+    auto Expect = [&Passed]( bool Condition, const char* Name, uint64_t Value )
+    {
+        if (!Condition)
+        {
+            Utility::Printf("Transient memory planner self test failed:  %s (%llu)\n", Name, Value);
+            Passed = false;
+        }
+    };
+
+    const uint64_t kPlacement = 64 * 1024;
+
+    // Disjoint lifetimes share the same bytes, and overlapping ones do not
+    {
+        TransientMemoryPlanner Planner;
+        Planner.AddResource(kPlacement * 4, kPlacement, 0, 1);
+        Planner.AddResource(kPlacement * 4, kPlacement, 2, 3);
+        Planner.AddResource(kPlacement, kPlacement, 1, 2);
+        Planner.Solve();
+        Expect(Planner.Validate(), "hand built lifetimes", 0);
+        Expect(Planner.GetOffset(0) == Planner.GetOffset(1), "disjoint lifetimes alias", Planner.GetOffset(1));
+        Expect(Planner.GetHeapSize() == kPlacement * 5, "hand built heap size", Planner.GetHeapSize());
+
+        // Validate() has to notice two live resources on the same bytes
+        Planner.m_Resources[2].Offset = Planner.m_Resources[0].Offset;
+        Expect(!Planner.Validate(), "forced overlap caught", 0);
+    }
+
+    // Random lifetimes, sizes and alignments, the way the frame's passes register them
+    std::mt19937 Random(3);
+    const uint32_t kPhases = 8;
+    for (uint32_t Scene = 0; Scene < 200; ++Scene)
+    {
+        TransientMemoryPlanner Planner;
+        const uint32_t ResourceCount = 1 + Random() % 64;
+        for (uint32_t i = 0; i < ResourceCount; ++i)
+        {
+            const uint64_t Alignment = (Random() & 1) ? kPlacement : 4096;
+            const uint64_t Size = 1 + Random() % (4 << 20);
+            const uint32_t FirstPhase = Random() % kPhases;
+            const uint32_t LastPhase = FirstPhase + Random() % (kPhases - FirstPhase);
+            Planner.AddResource(Size, Alignment, FirstPhase, LastPhase);
+        }
+        Planner.Solve();
+        Expect(Planner.Validate(), "random lifetimes", Scene);
+        Expect(Planner.GetHeapSize() <= Planner.GetUnaliasedSize(), "no larger than unaliased", Scene);
+
+        // No packing fits in less than the bytes live at once in the busiest phase
+        uint64_t BusiestPhase = 0;
+        for (uint32_t Phase = 0; Phase < kPhases; ++Phase)
+        {
+            uint64_t LiveSize = 0;
+            for (const Resource& R : Planner.m_Resources)
+                LiveSize += (R.FirstPhase <= Phase && Phase <= R.LastPhase) ? R.Size : 0;
+            BusiestPhase = std::max(BusiestPhase, LiveSize);
+        }
+        Expect(Planner.GetHeapSize() >= BusiestPhase, "heap holds the busiest phase", Scene);
+
+        // The same registrations give the same offsets
+        std::vector<uint64_t> Offsets(ResourceCount);
+        for (uint32_t i = 0; i < ResourceCount; ++i)
+            Offsets[i] = Planner.GetOffset(i);
+        Planner.Solve();
+        for (uint32_t i = 0; i < ResourceCount; ++i)
+            Expect(Planner.GetOffset(i) == Offsets[i], "deterministic", Scene);
+    }
+
+    return Passed;
+}
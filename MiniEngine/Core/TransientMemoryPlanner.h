@@ -0,0 +1,74 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// The memory planner assigns heap offsets to resources that are only live for part of a frame.
+// Each resource declares the first and last phase (render pass) in which it is used.  Resources
+// whose phase ranges do not intersect may share memory.  This is interval graph colouring with
+// weighted vertices; offsets are assigned greedily, largest resource first, at the lowest aligned
+// offset that does not collide with an already placed resource of overlapping lifetime.
+//
+// This class knows nothing about D3D12 and can be used (and verified) on its own.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class TransientMemoryPlanner
+{
+public:
+    TransientMemoryPlanner() : m_HeapSize(0), m_IsSolved(false) {}
+
+    // Returns an index used to retrieve the offset after Solve().  Alignment must be a power of two.
+    uint32_t AddResource( uint64_t Size, uint64_t Alignment, uint32_t FirstPhase, uint32_t LastPhase );
+
+    // Assign offsets to every resource.  Deterministic for a given sequence of AddResource() calls.
+    void Solve( void );
+
+    void Reset( void );
+
+    uint32_t GetResourceCount( void ) const { return (uint32_t)m_Resources.size(); }
+    uint64_t GetOffset( uint32_t Index ) const;
+    uint32_t GetFirstPhase( uint32_t Index ) const { return m_Resources[Index].FirstPhase; }
+    uint32_t GetLastPhase( uint32_t Index ) const { return m_Resources[Index].LastPhase; }
+
+    // Bytes required for the shared heap
+    uint64_t GetHeapSize( void ) const { return m_HeapSize; }
+
+    // Bytes required if every resource had its own allocation
+    uint64_t GetUnaliasedSize( void ) const;
+
+    // True if both resources are live in at least one common phase
+    bool LifetimesOverlap( uint32_t A, uint32_t B ) const;
+
+    // True if both resources were assigned intersecting byte ranges
+    bool MemoryOverlaps( uint32_t A, uint32_t B ) const;
+
+    // Checks that no two resources with overlapping lifetimes share memory and that every offset
+    // honours its alignment.  Solve() asserts this in debug builds.
+    bool Validate( void ) const;
+
+    // Solves hand built and random lifetimes, checks every result through Validate() and against the
+    // bytes live in the busiest phase, and checks that Validate() catches a forced overlap
+    static bool RunSelfTest( void );
+
+private:
+    struct Resource
+    {
+        uint64_t Size;
+        uint64_t Alignment;
+        uint64_t Offset;
+        uint32_t FirstPhase;
+        uint32_t LastPhase;
+    };
+
+    std::vector<Resource> m_Resources;
+    uint64_t m_HeapSize;
+    bool m_IsSolved;
+};
@@ -0,0 +1,109 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "pch.h"
+#include "TransientResourceAllocator.h"
+#include "GraphicsCore.h"
+#include "ColorBuffer.h"
+#include "GpuBuffer.h"
+#include "CommandContext.h"
+
+using namespace Graphics;
+
+void TransientResourceAllocator::AddColorBuffer( ColorBuffer& Buffer, const std::wstring& Name, uint32_t Width, uint32_t Height,
+    uint32_t ArrayCount, uint32_t NumMips, DXGI_FORMAT Format, uint32_t FirstPhase, uint32_t LastPhase )
+{
+    D3D12_RESOURCE_ALLOCATION_INFO Info = Buffer.GetPlacedAllocationInfo(Width, Height, ArrayCount, NumMips, Format);
+    m_TexturePlanner.AddResource(Info.SizeInBytes, Info.Alignment, FirstPhase, LastPhase);
+
+    TextureEntry Entry = { &Buffer, Name, Width, Height, ArrayCount, NumMips, Format };
+    m_Textures.push_back(Entry);
+}
+
+void TransientResourceAllocator::AddBuffer( GpuBuffer& Buffer, const std::wstring& Name, uint32_t NumElements, uint32_t ElementSize,
+    uint32_t FirstPhase, uint32_t LastPhase )
+{
+    const uint64_t BufferSize = Math::AlignUp((uint64_t)NumElements * ElementSize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+    m_BufferPlanner.AddResource(BufferSize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, FirstPhase, LastPhase);
+
+    BufferEntry Entry = { &Buffer, Name, NumElements, ElementSize };
+    m_Buffers.push_back(Entry);
+}
+
+void TransientResourceAllocator::Commit( void )
+{
+    ASSERT(m_TextureHeap == nullptr && m_BufferHeap == nullptr, "Transient resources have already been committed");
+
+    m_TexturePlanner.Solve();
+    m_BufferPlanner.Solve();
+
+    if (m_TexturePlanner.GetHeapSize() > 0)
+    {
+        CD3DX12_HEAP_DESC HeapDesc(m_TexturePlanner.GetHeapSize(), D3D12_HEAP_TYPE_DEFAULT,
+            D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES);
+        ASSERT_SUCCEEDED(g_Device->CreateHeap(&HeapDesc, MY_IID_PPV_ARGS(&m_TextureHeap)));
+
+        for (uint32_t i = 0; i < (uint32_t)m_Textures.size(); ++i)
+        {
+            const TextureEntry& Entry = m_Textures[i];
+            Entry.Buffer->CreatePlaced(Entry.Name, Entry.Width, Entry.Height, Entry.ArrayCount, Entry.NumMips,
+                Entry.Format, m_TextureHeap.Get(), m_TexturePlanner.GetOffset(i));
+        }
+    }
+
+    if (m_BufferPlanner.GetHeapSize() > 0)
+    {
+        CD3DX12_HEAP_DESC HeapDesc(m_BufferPlanner.GetHeapSize(), D3D12_HEAP_TYPE_DEFAULT,
+            D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS);
+        ASSERT_SUCCEEDED(g_Device->CreateHeap(&HeapDesc, MY_IID_PPV_ARGS(&m_BufferHeap)));
+
+        for (uint32_t i = 0; i < (uint32_t)m_Buffers.size(); ++i)
+        {
+            const BufferEntry& Entry = m_Buffers[i];
+            Entry.Buffer->CreatePlaced(Entry.Name, m_BufferHeap.Get(), (uint32_t)m_BufferPlanner.GetOffset(i),
+                Entry.NumElements, Entry.ElementSize);
+        }
+    }
+
+    Utility::Printf("Transient resources:  %llu KB aliased in %llu KB of heap memory (%u textures, %u buffers)\n",
+        GetUnaliasedSize() / 1024, GetHeapSize() / 1024, (uint32_t)m_Textures.size(), (uint32_t)m_Buffers.size());
+}
+
+void TransientResourceAllocator::BeginPhase( CommandContext& Context, uint32_t Phase )
+{
+    // A null "before" resource deactivates whatever previously occupied the memory, which may be
+    // several smaller resources, so each activation costs a single barrier.
+    for (uint32_t i = 0; i < (uint32_t)m_Buffers.size(); ++i)
+    {
+        if (m_BufferPlanner.GetFirstPhase(i) == Phase)
+            Context.InsertAliasBarrier(*m_Buffers[i].Buffer);
+    }
+
+    // The textures are not render targets, so their first writes need no clear or discard
+    for (uint32_t i = 0; i < (uint32_t)m_Textures.size(); ++i)
+    {
+        if (m_TexturePlanner.GetFirstPhase(i) == Phase)
+            Context.InsertAliasBarrier(*m_Textures[i].Buffer);
+    }
+}
+
+void TransientResourceAllocator::Destroy( void )
+{
+    for (TextureEntry& Entry : m_Textures)
+        Entry.Buffer->Destroy();
+    for (BufferEntry& Entry : m_Buffers)
+        Entry.Buffer->Destroy();
+
+    m_Textures.clear();
+    m_Buffers.clear();
+    m_TexturePlanner.Reset();
+    m_BufferPlanner.Reset();
+    m_TextureHeap = nullptr;
+    m_BufferHeap = nullptr;
+}
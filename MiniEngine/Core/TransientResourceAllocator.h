@@ -0,0 +1,78 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// Creates resources that only live within part of a frame as placed resources in shared heaps.
+// Register every resource with the phase range in which it is used, then call Commit() to pack
+// them (see TransientMemoryPlanner) and create them.  Before the work of a phase is recorded,
+// BeginPhase() activates the resources that are first used in that phase with aliasing barriers.
+// Their contents are undefined after aliasing.  No texture here is a render target, so none needs
+// a clear or discard, and a phase may begin on a compute context such as the async SSAO one.
+//
+// Nothing stored in a transient resource survives past its last phase.  Work on different queues
+// is only safe to alias when the queues are synchronized between the phases involved.
+
+#pragma once
+
+#include "TransientMemoryPlanner.h"
+
+class ColorBuffer;
+class GpuBuffer;
+class CommandContext;
+
+class TransientResourceAllocator
+{
+public:
+    // Textures are written through UAVs only and live in a heap restricted to such textures, so Resource
+    // Heap Tier 1 is sufficient
+    void AddColorBuffer( ColorBuffer& Buffer, const std::wstring& Name, uint32_t Width, uint32_t Height,
+        uint32_t ArrayCount, uint32_t NumMips, DXGI_FORMAT Format, uint32_t FirstPhase, uint32_t LastPhase );
+
+    void AddBuffer( GpuBuffer& Buffer, const std::wstring& Name, uint32_t NumElements, uint32_t ElementSize,
+        uint32_t FirstPhase, uint32_t LastPhase );
+
+    // Solve the packing, create the heaps and create every registered resource
+    void Commit( void );
+
+    // Activate every resource whose lifetime begins with this phase
+    void BeginPhase( CommandContext& Context, uint32_t Phase );
+
+    // Destroy every registered resource, release the heaps and forget all registrations
+    void Destroy( void );
+
+    uint64_t GetHeapSize( void ) const { return m_TexturePlanner.GetHeapSize() + m_BufferPlanner.GetHeapSize(); }
+    uint64_t GetUnaliasedSize( void ) const { return m_TexturePlanner.GetUnaliasedSize() + m_BufferPlanner.GetUnaliasedSize(); }
+
+private:
+    struct TextureEntry
+    {
+        ColorBuffer* Buffer;
+        std::wstring Name;
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t ArrayCount;
+        uint32_t NumMips;
+        DXGI_FORMAT Format;
+    };
+
+    struct BufferEntry
+    {
+        GpuBuffer* Buffer;
+        std::wstring Name;
+        uint32_t NumElements;
+        uint32_t ElementSize;
+    };
+
+    // Entries are indexed the same as the resources of the matching planner
+    std::vector<TextureEntry> m_Textures;
+    std::vector<BufferEntry> m_Buffers;
+    TransientMemoryPlanner m_TexturePlanner;
+    TransientMemoryPlanner m_BufferPlanner;
+    Microsoft::WRL::ComPtr<ID3D12Heap> m_TextureHeap;
+    Microsoft::WRL::ComPtr<ID3D12Heap> m_BufferHeap;
+};
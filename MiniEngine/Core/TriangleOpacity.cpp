@@ -0,0 +1,522 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "pch.h"
+#include "TriangleOpacity.h"
+#include "FileUtility.h"
+#include "dds.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+    // Texels visited per triangle before falling back to a coarser level of the min/max pyramids
+    const uint32_t kMaxFootprintTexels = 1024;
+
+    enum AlphaFormat { kAlphaNone, kAlphaBC1, kAlphaBC2, kAlphaBC3, kAlpha8, kAlphaRGBA8 };
+
+    AlphaFormat GetAlphaFormat( const DDS_HEADER& Header, const DDS_HEADER_DXT10* Header10 )
+    {
+        if (Header10 != nullptr)
+        {
+            switch (Header10->dxgiFormat)
+            {
+            case DXGI_FORMAT_BC1_TYPELESS:
+            case DXGI_FORMAT_BC1_UNORM:
+            case DXGI_FORMAT_BC1_UNORM_SRGB:
+                return kAlphaBC1;
+            case DXGI_FORMAT_BC2_TYPELESS:
+            case DXGI_FORMAT_BC2_UNORM:
+            case DXGI_FORMAT_BC2_UNORM_SRGB:
+                return kAlphaBC2;
+            case DXGI_FORMAT_BC3_TYPELESS:
+            case DXGI_FORMAT_BC3_UNORM:
+            case DXGI_FORMAT_BC3_UNORM_SRGB:
+                return kAlphaBC3;
+            case DXGI_FORMAT_A8_UNORM:
+                return kAlpha8;
+            case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+            case DXGI_FORMAT_R8G8B8A8_UNORM:
+            case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+            case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+            case DXGI_FORMAT_B8G8R8A8_UNORM:
+            case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+                return kAlphaRGBA8;
+            default:
+                return kAlphaNone;
+            }
+        }
+
+        const DDS_PIXELFORMAT& pf = Header.ddspf;
+        if (pf.flags & DDS_FOURCC)
+        {
+            if (pf.fourCC == MAKEFOURCC('D','X','T','1'))
+                return kAlphaBC1;
+            if (pf.fourCC == MAKEFOURCC('D','X','T','2') || pf.fourCC == MAKEFOURCC('D','X','T','3'))
+                return kAlphaBC2;
+            if (pf.fourCC == MAKEFOURCC('D','X','T','4') || pf.fourCC == MAKEFOURCC('D','X','T','5'))
+                return kAlphaBC3;
+            return kAlphaNone;
+        }
+
+        if ((pf.flags & DDS_RGBA) == DDS_RGBA && pf.RGBBitCount == 32 && pf.ABitMask == 0xff000000)
+            return kAlphaRGBA8;
+        if ((pf.flags & DDS_ALPHA) && pf.RGBBitCount == 8)
+            return kAlpha8;
+
+        return kAlphaNone;
+    }
+
+    size_t GetLevelSize( AlphaFormat Format, uint32_t Width, uint32_t Height )
+    {
+        const size_t BlocksWide = std::max(1u, (Width + 3) / 4);
+        const size_t BlocksHigh = std::max(1u, (Height + 3) / 4);
+        switch (Format)
+        {
+        case kAlphaBC1:   return BlocksWide * BlocksHigh * 8;
+        case kAlphaBC2:   return BlocksWide * BlocksHigh * 16;
+        case kAlphaBC3:   return BlocksWide * BlocksHigh * 16;
+        case kAlpha8:     return (size_t)Width * Height;
+        case kAlphaRGBA8: return (size_t)Width * Height * 4;
+        default:          return 0;
+        }
+    }
+
+    // Writes the 16 alpha values of a block in row major order
+    void DecodeBlockAlpha( AlphaFormat Format, const uint8_t* Block, uint8_t Alpha[16] )
+    {
+        if (Format == kAlphaBC1)
+        {
+            // Index 3 is transparent black only in the three color mode
+            const uint16_t c0 = (uint16_t)(Block[0] | Block[1] << 8);
+            const uint16_t c1 = (uint16_t)(Block[2] | Block[3] << 8);
+            const uint32_t Indices = Block[4] | Block[5] << 8 | Block[6] << 16 | (uint32_t)Block[7] << 24;
+            for (uint32_t i = 0; i < 16; ++i)
+                Alpha[i] = (c0 <= c1 && ((Indices >> (i * 2)) & 3) == 3) ? 0 : 255;
+        }
+        else if (Format == kAlphaBC2)
+        {
+            for (uint32_t i = 0; i < 16; ++i)
+                Alpha[i] = (uint8_t)(((Block[i / 2] >> ((i & 1) * 4)) & 0xF) * 17);
+        }
+        else
+        {
+            const uint32_t a0 = Block[0];
+            const uint32_t a1 = Block[1];
+            uint8_t Palette[8] = { (uint8_t)a0, (uint8_t)a1 };
+            if (a0 > a1)
+            {
+                for (uint32_t k = 1; k < 7; ++k)
+                    Palette[k + 1] = (uint8_t)(((7 - k) * a0 + k * a1) / 7);
+            }
+            else
+            {
+                for (uint32_t k = 1; k < 5; ++k)
+                    Palette[k + 1] = (uint8_t)(((5 - k) * a0 + k * a1) / 5);
+                Palette[6] = 0;
+                Palette[7] = 255;
+            }
+
+            uint64_t Indices = 0;
+            for (uint32_t i = 0; i < 6; ++i)
+                Indices |= (uint64_t)Block[2 + i] << (i * 8);
+            for (uint32_t i = 0; i < 16; ++i)
+                Alpha[i] = Palette[(Indices >> (i * 3)) & 7];
+        }
+    }
+
+    void DecodeLevel( AlphaFormat Format, const uint8_t* Data, uint32_t Width, uint32_t Height, std::vector<uint8_t>& Alpha )
+    {
+        Alpha.resize((size_t)Width * Height);
+
+        if (Format == kAlpha8)
+        {
+            memcpy(Alpha.data(), Data, Alpha.size());
+            return;
+        }
+
+        if (Format == kAlphaRGBA8)
+        {
+            // Alpha is the high byte of both RGBA and BGRA
+            for (size_t i = 0; i < Alpha.size(); ++i)
+                Alpha[i] = Data[i * 4 + 3];
+            return;
+        }
+
+        const uint32_t BlockBytes = Format == kAlphaBC1 ? 8 : 16;
+        const uint32_t BlocksWide = std::max(1u, (Width + 3) / 4);
+        const uint32_t BlocksHigh = std::max(1u, (Height + 3) / 4);
+        for (uint32_t by = 0; by < BlocksHigh; ++by)
+        {
+            for (uint32_t bx = 0; bx < BlocksWide; ++bx)
+            {
+                const uint8_t* Block = Data + (by * BlocksWide + bx) * BlockBytes;
+
+                // BC2 and BC3 keep the alpha in the first eight bytes, ahead of a BC1 color block
+                uint8_t BlockAlpha[16];
+                DecodeBlockAlpha(Format, Block, BlockAlpha);
+
+                for (uint32_t y = 0; y < 4 && by * 4 + y < Height; ++y)
+                {
+                    for (uint32_t x = 0; x < 4 && bx * 4 + x < Width; ++x)
+                        Alpha[(by * 4 + y) * Width + bx * 4 + x] = BlockAlpha[y * 4 + x];
+                }
+            }
+        }
+    }
+}
+
+namespace TriangleOpacity
+{
+    void AlphaMipChain::Create( uint32_t Width, uint32_t Height, const uint8_t* Alpha )
+    {
+        m_Levels.clear();
+
+        std::vector<uint8_t> TopLevel(Alpha, Alpha + (size_t)Width * Height);
+        AddLevel(Width, Height, TopLevel);
+        GenerateMissingLevels();
+        BuildMinMax();
+    }
+
+    bool AlphaMipChain::LoadFromDDSFile( const std::wstring& FileName )
+    {
+        Utility::ByteArray ba = Utility::ReadFileSync(FileName);
+        if (ba->size() == 0)
+            return false;
+
+        return LoadFromDDSMemory(ba->data(), ba->size());
+    }
+
+    bool AlphaMipChain::LoadFromDDSMemory( const void* Data, size_t Size )
+    {
+        m_Levels.clear();
+
+        const uint8_t* Bytes = (const uint8_t*)Data;
+        if (Size < sizeof(uint32_t) + sizeof(DDS_HEADER) || *(const uint32_t*)Bytes != DDS_MAGIC)
+            return false;
+
+        const DDS_HEADER& Header = *(const DDS_HEADER*)(Bytes + sizeof(uint32_t));
+        size_t Offset = sizeof(uint32_t) + sizeof(DDS_HEADER);
+
+        const DDS_HEADER_DXT10* Header10 = nullptr;
+        if ((Header.ddspf.flags & DDS_FOURCC) && Header.ddspf.fourCC == MAKEFOURCC('D','X','1','0'))
+        {
+            if (Size < Offset + sizeof(DDS_HEADER_DXT10))
+                return false;
+            Header10 = (const DDS_HEADER_DXT10*)(Bytes + Offset);
+            Offset += sizeof(DDS_HEADER_DXT10);
+        }
+
+        const AlphaFormat Format = GetAlphaFormat(Header, Header10);
+        if (Format == kAlphaNone || Header.width == 0 || Header.height == 0)
+            return false;
+
+        // Only the first surface of arrays and cube maps is read
+        const uint32_t MipCount = (Header.flags & DDS_HEADER_FLAGS_MIPMAP) ? std::max(1u, Header.mipMapCount) : 1;
+        for (uint32_t Mip = 0; Mip < MipCount; ++Mip)
+        {
+            const uint32_t Width = std::max(1u, Header.width >> Mip);
+            const uint32_t Height = std::max(1u, Header.height >> Mip);
+            const size_t LevelSize = GetLevelSize(Format, Width, Height);
+            if (Offset + LevelSize > Size)
+                break;
+
+            std::vector<uint8_t> Alpha;
+            DecodeLevel(Format, Bytes + Offset, Width, Height, Alpha);
+            AddLevel(Width, Height, Alpha);
+            Offset += LevelSize;
+        }
+
+        if (m_Levels.empty())
+            return false;
+
+        GenerateMissingLevels();
+        BuildMinMax();
+        return true;
+    }
+
+    void AlphaMipChain::AddLevel( uint32_t Width, uint32_t Height, std::vector<uint8_t>& Alpha )
+    {
+        ASSERT(Alpha.size() == (size_t)Width * Height);
+
+        if (m_Levels.empty())
+        {
+            m_Width = Width;
+            m_Height = Height;
+        }
+
+        m_Levels.emplace_back();
+        Level& NewLevel = m_Levels.back();
+        NewLevel.Width = Width;
+        NewLevel.Height = Height;
+        NewLevel.Alpha.swap(Alpha);
+    }
+
+    void AlphaMipChain::GenerateMissingLevels( void )
+    {
+        while (m_Levels.back().Width > 1 || m_Levels.back().Height > 1)
+        {
+            const Level& Src = m_Levels.back();
+            const uint32_t Width = std::max(1u, Src.Width / 2);
+            const uint32_t Height = std::max(1u, Src.Height / 2);
+
+            std::vector<uint8_t> Alpha((size_t)Width * Height);
+            for (uint32_t y = 0; y < Height; ++y)
+            {
+                const uint32_t y0 = std::min(y * 2, Src.Height - 1);
+                const uint32_t y1 = std::min(y * 2 + 1, Src.Height - 1);
+                for (uint32_t x = 0; x < Width; ++x)
+                {
+                    const uint32_t x0 = std::min(x * 2, Src.Width - 1);
+                    const uint32_t x1 = std::min(x * 2 + 1, Src.Width - 1);
+                    const uint32_t Sum = Src.Alpha[y0 * Src.Width + x0] + Src.Alpha[y0 * Src.Width + x1] +
+                        Src.Alpha[y1 * Src.Width + x0] + Src.Alpha[y1 * Src.Width + x1];
+                    Alpha[y * Width + x] = (uint8_t)((Sum + 2) / 4);
+                }
+            }
+
+            AddLevel(Width, Height, Alpha);
+        }
+    }
+
+    void AlphaMipChain::BuildMinMax( void )
+    {
+        m_Levels[0].Min = m_Levels[0].Alpha;
+        m_Levels[0].Max = m_Levels[0].Alpha;
+
+        for (size_t i = 1; i < m_Levels.size(); ++i)
+        {
+            const Level& Fine = m_Levels[i - 1];
+            Level& Coarse = m_Levels[i];
+            Coarse.Min = Coarse.Alpha;
+            Coarse.Max = Coarse.Alpha;
+
+            // The last row and column also cover the leftover texel of odd sized finer levels
+            for (uint32_t y = 0; y < Coarse.Height; ++y)
+            {
+                const uint32_t y0 = std::min(y * 2, Fine.Height - 1);
+                const uint32_t y1 = y == Coarse.Height - 1 ? Fine.Height - 1 : std::min(y * 2 + 1, Fine.Height - 1);
+                for (uint32_t x = 0; x < Coarse.Width; ++x)
+                {
+                    const uint32_t x0 = std::min(x * 2, Fine.Width - 1);
+                    const uint32_t x1 = x == Coarse.Width - 1 ? Fine.Width - 1 : std::min(x * 2 + 1, Fine.Width - 1);
+
+                    uint8_t& MinValue = Coarse.Min[y * Coarse.Width + x];
+                    uint8_t& MaxValue = Coarse.Max[y * Coarse.Width + x];
+                    for (uint32_t fy = y0; fy <= y1; ++fy)
+                    {
+                        for (uint32_t fx = x0; fx <= x1; ++fx)
+                        {
+                            MinValue = std::min(MinValue, Fine.Min[fy * Fine.Width + fx]);
+                            MaxValue = std::max(MaxValue, Fine.Max[fy * Fine.Width + fx]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    Class AlphaMipChain::Classify( const float UV0[2], const float UV1[2], const float UV2[2], float AlphaCutoff ) const
+    {
+        if (!IsValid())
+            return kMixed;
+
+        // One code of slack on either side of the cutoff for hardware that decodes BC alpha with different rounding
+        const float CutoffCode = AlphaCutoff * 255.0f;
+        const int OpaqueMin = (int)ceil(CutoffCode) + 1;
+        const int TransparentMax = (int)floor(CutoffCode) - 1;
+
+        // Find the finest level on which the dilated footprint fits in the budget.  Texel (i, j) is
+        // touched by bilinear filtering when a point of the triangle lies within one texel of its center.
+        uint32_t LevelIndex = 0;
+        float P[3][2];
+        int32_t MinX = 0, MinY = 0, MaxX = 0, MaxY = 0;
+        for (;; ++LevelIndex)
+        {
+            if (LevelIndex == m_Levels.size())
+                return kMixed;
+
+            const Level& L = m_Levels[LevelIndex];
+            const float* UV[3] = { UV0, UV1, UV2 };
+            for (uint32_t v = 0; v < 3; ++v)
+            {
+                P[v][0] = UV[v][0] * L.Width - 0.5f;
+                P[v][1] = UV[v][1] * L.Height - 0.5f;
+            }
+
+            MinX = (int32_t)floor(std::min(P[0][0], std::min(P[1][0], P[2][0])));
+            MinY = (int32_t)floor(std::min(P[0][1], std::min(P[1][1], P[2][1])));
+            MaxX = (int32_t)ceil(std::max(P[0][0], std::max(P[1][0], P[2][0])));
+            MaxY = (int32_t)ceil(std::max(P[0][1], std::max(P[1][1], P[2][1])));
+
+            if ((uint64_t)(MaxX - MinX + 1) * (uint64_t)(MaxY - MinY + 1) <= kMaxFootprintTexels)
+                break;
+        }
+
+        // Counter-clockwise winding so that the inside of every edge is on its left
+        float Area = (P[1][0] - P[0][0]) * (P[2][1] - P[0][1]) - (P[1][1] - P[0][1]) * (P[2][0] - P[0][0]);
+        if (Area < 0.0f)
+        {
+            std::swap(P[1][0], P[2][0]);
+            std::swap(P[1][1], P[2][1]);
+        }
+
+        float EdgeA[3], EdgeB[3], EdgeC[3], EdgeSlack[3];
+        for (uint32_t e = 0; e < 3; ++e)
+        {
+            const float* a = P[e];
+            const float* b = P[(e + 1) % 3];
+            EdgeA[e] = -(b[1] - a[1]);
+            EdgeB[e] = b[0] - a[0];
+            EdgeC[e] = -(EdgeA[e] * a[0] + EdgeB[e] * a[1]);
+
+            // The edge function rises by at most this much anywhere in the box of half extent one texel
+            EdgeSlack[e] = fabs(EdgeA[e]) + fabs(EdgeB[e]);
+        }
+
+        const Level& L = m_Levels[LevelIndex];
+        int MinAlpha = 255;
+        int MaxAlpha = 0;
+        for (int32_t y = MinY; y <= MaxY; ++y)
+        {
+            for (int32_t x = MinX; x <= MaxX; ++x)
+            {
+                bool Touched = true;
+                for (uint32_t e = 0; e < 3; ++e)
+                {
+                    if (EdgeA[e] * x + EdgeB[e] * y + EdgeC[e] + EdgeSlack[e] < 0.0f)
+                        Touched = false;
+                }
+                if (!Touched)
+                    continue;
+
+                const uint32_t WrappedX = (uint32_t)(((x % (int32_t)L.Width) + (int32_t)L.Width) % (int32_t)L.Width);
+                const uint32_t WrappedY = (uint32_t)(((y % (int32_t)L.Height) + (int32_t)L.Height) % (int32_t)L.Height);
+                const uint32_t Index = WrappedY * L.Width + WrappedX;
+                MinAlpha = std::min(MinAlpha, (int)L.Min[Index]);
+                MaxAlpha = std::max(MaxAlpha, (int)L.Max[Index]);
+
+                if (MinAlpha < OpaqueMin && MaxAlpha > TransparentMax)
+                    return kMixed;
+            }
+        }
+
+        if (MinAlpha >= OpaqueMin)
+            return kOpaque;
+        if (MaxAlpha <= TransparentMax)
+            return kTransparent;
+        return kMixed;
+    }
+
+    bool RunSelfTest( void )
+    {
+        bool Passed = true;
+        auto Expect = [&Passed]( const AlphaMipChain& Chain, float u0, float v0, float u1, float v1, float u2, float v2,
+            Class Expected, const char* Name )
+        {
+            const float UV0[2] = { u0, v0 };
+            const float UV1[2] = { u1, v1 };
+            const float UV2[2] = { u2, v2 };
+            const Class Result = Chain.Classify(UV0, UV1, UV2, 0.5f);
+            if (Result != Expected)
+            {
+                Utility::Printf("Triangle opacity self test failed:  %s (got %d, expected %d)\n", Name, Result, Expected);
+                Passed = false;
+            }
+        };
+
+        // Solid textures
+        {
+            std::vector<uint8_t> Alpha(64 * 64, 255);
+            AlphaMipChain Chain;
+            Chain.Create(64, 64, Alpha.data());
+            Expect(Chain, 0.1f, 0.1f, 0.9f, 0.2f, 0.5f, 0.9f, kOpaque, "solid opaque");
+
+            std::fill(Alpha.begin(), Alpha.end(), (uint8_t)0);
+            Chain.Create(64, 64, Alpha.data());
+            Expect(Chain, 0.1f, 0.1f, 0.9f, 0.2f, 0.5f, 0.9f, kTransparent, "solid transparent");
+        }
+
+        // Opaque left half, transparent right half
+        {
+            std::vector<uint8_t> Alpha(64 * 64);
+            for (uint32_t y = 0; y < 64; ++y)
+                for (uint32_t x = 0; x < 64; ++x)
+                    Alpha[y * 64 + x] = x < 32 ? 255 : 0;
+
+            AlphaMipChain Chain;
+            Chain.Create(64, 64, Alpha.data());
+            Expect(Chain, 0.05f, 0.1f, 0.4f, 0.1f, 0.2f, 0.8f, kOpaque, "left half");
+            Expect(Chain, 0.6f, 0.1f, 0.95f, 0.1f, 0.8f, 0.8f, kTransparent, "right half");
+            Expect(Chain, 0.3f, 0.1f, 0.7f, 0.1f, 0.5f, 0.8f, kMixed, "straddling halves");
+            Expect(Chain, 1.05f, -0.9f, 1.4f, -0.9f, 1.2f, -0.2f, kOpaque, "left half wrapped");
+
+            // Within one texel of the boundary, bilinear filtering reaches across it
+            Expect(Chain, 0.3f, 0.1f, 31.8f / 64.0f, 0.1f, 0.3f, 0.8f, kMixed, "bilinear reach");
+
+            // Clockwise winding and degenerate triangles are handled the same way
+            Expect(Chain, 0.05f, 0.1f, 0.2f, 0.8f, 0.4f, 0.1f, kOpaque, "clockwise");
+            Expect(Chain, 0.1f, 0.5f, 0.7f, 0.5f, 0.4f, 0.5f, kMixed, "degenerate");
+        }
+
+        // A single transparent texel in a large opaque texture must be found through the min/max pyramid
+        {
+            std::vector<uint8_t> Alpha(512 * 512, 255);
+            AlphaMipChain Chain;
+            Chain.Create(512, 512, Alpha.data());
+            Expect(Chain, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, kOpaque, "large opaque");
+
+            Alpha[300 * 512 + 100] = 0;
+            Chain.Create(512, 512, Alpha.data());
+            Expect(Chain, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, kMixed, "large with hole");
+            Expect(Chain, 0.6f, 0.0f, 1.0f, 0.0f, 1.0f, 0.4f, kOpaque, "large away from hole");
+
+            // Too many repeats to evaluate even on the coarsest level
+            Expect(Chain, 0.0f, 0.0f, 100.0f, 0.0f, 0.0f, 100.0f, kMixed, "heavily tiled");
+        }
+
+        // BC1 with an opaque block next to a punch-through transparent block
+        {
+            struct
+            {
+                uint32_t Magic;
+                DDS_HEADER Header;
+                uint8_t Blocks[16];
+            } File = {};
+
+            File.Magic = DDS_MAGIC;
+            File.Header.size = sizeof(DDS_HEADER);
+            File.Header.flags = DDS_HEADER_FLAGS_TEXTURE;
+            File.Header.width = 8;
+            File.Header.height = 4;
+            File.Header.ddspf = DDSPF_DXT1;
+
+            const uint8_t Opaque[8] = { 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+            const uint8_t Transparent[8] = { 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+            memcpy(File.Blocks, Opaque, 8);
+            memcpy(File.Blocks + 8, Transparent, 8);
+
+            AlphaMipChain Chain;
+            if (!Chain.LoadFromDDSMemory(&File, sizeof(File)) || Chain.GetNumLevels() != 4)
+            {
+                Utility::Printf("Triangle opacity self test failed:  BC1 decode\n");
+                Passed = false;
+            }
+            else
+            {
+                Expect(Chain, 0.1f, 0.2f, 0.35f, 0.2f, 0.2f, 0.8f, kOpaque, "BC1 opaque block");
+                Expect(Chain, 0.65f, 0.2f, 0.85f, 0.2f, 0.8f, 0.8f, kTransparent, "BC1 transparent block");
+            }
+        }
+
+        return Passed;
+    }
+}
@@ -0,0 +1,75 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+// Classifies the triangles of alpha tested geometry against the alpha channel of their texture.  A
+// triangle whose UV footprint only touches texels that pass the alpha test is opaque and can skip the
+// any-hit shader.  One that only touches failing texels can never be hit and can be left out of the
+// acceleration structure.  Everything else is mixed and must be alpha tested.
+//
+// The footprint is dilated by one texel to account for bilinear filtering of the top level, which is
+// the level the any-hit shader samples.  Large footprints are evaluated on a coarser level of min/max
+// pyramids, where each texel holds the extremes of itself and every finer texel beneath it, so the
+// result stays conservative while the work per triangle is bounded.
+//
+// This is CPU only code with no dependency on D3D12 resources.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace TriangleOpacity
+{
+    enum Class { kOpaque, kTransparent, kMixed };
+
+    class AlphaMipChain
+    {
+    public:
+        AlphaMipChain() : m_Width(0), m_Height(0) {}
+
+        // Builds the chain from a single level.  Coarser levels are box filtered like a typical mip generator.
+        void Create( uint32_t Width, uint32_t Height, const uint8_t* Alpha );
+
+        // Decodes the alpha of every mip level in a DDS file.  Supports BC1-BC3 and 8-bit RGBA/BGRA/A8
+        // formats; other formats return false and should be treated as mixed.
+        bool LoadFromDDSFile( const std::wstring& FileName );
+        bool LoadFromDDSMemory( const void* Data, size_t Size );
+
+        bool IsValid( void ) const { return !m_Levels.empty(); }
+        uint32_t GetWidth( void ) const { return m_Width; }
+        uint32_t GetHeight( void ) const { return m_Height; }
+        uint32_t GetNumLevels( void ) const { return (uint32_t)m_Levels.size(); }
+
+        // UVs wrap, matching the samplers used for material textures.  Alpha passes the test when it is at
+        // least AlphaCutoff.  Triangles too large to evaluate within the texel budget are reported as mixed.
+        Class Classify( const float UV0[2], const float UV1[2], const float UV2[2], float AlphaCutoff ) const;
+
+    private:
+        void AddLevel( uint32_t Width, uint32_t Height, std::vector<uint8_t>& Alpha );
+        void GenerateMissingLevels( void );
+        void BuildMinMax( void );
+
+        struct Level
+        {
+            uint32_t Width;
+            uint32_t Height;
+            std::vector<uint8_t> Alpha;
+            std::vector<uint8_t> Min;   // Minimum of this texel and all finer texels it covers
+            std::vector<uint8_t> Max;   // Maximum of this texel and all finer texels it covers
+        };
+
+        uint32_t m_Width;
+        uint32_t m_Height;
+        std::vector<Level> m_Levels;
+    };
+
+    // Classifies triangles on synthetic alpha textures with known answers
+    bool RunSelfTest( void );
+}
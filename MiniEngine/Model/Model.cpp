@@ -18,6 +18,9 @@
 Model::Model()
     : m_pMesh(nullptr)
     , m_pMaterial(nullptr)
+    , m_pMeshlet(nullptr)
+    , m_pMeshletFirst(nullptr)
+    , m_pLod(nullptr)
     , m_pVertexData(nullptr)
     , m_pIndexData(nullptr)
     , m_pVertexDataDepth(nullptr)
@@ -47,6 +50,17 @@ void Model::Clear()
     m_pMaterial = nullptr;
     m_Header.materialCount = 0;
 
+    delete [] m_pMeshlet;
+    delete [] m_pMeshletFirst;
+    m_pMeshlet = nullptr;
+    m_pMeshletFirst = nullptr;
+    m_MeshletCount = 0;
+
+    delete [] m_pLod;
+    m_pLod = nullptr;
+    m_LodCount = 0;
+    m_LodIndexDataByteSize = 0;
+
     delete [] m_pVertexData;
     delete [] m_pIndexData;
     delete [] m_pVertexDataDepth;
@@ -66,6 +80,20 @@ void Model::Clear()
     m_Header.boundingBox.max = Vector3(0.0f);
 }
 
+void Model::ReleaseCpuGeometry()
+{
+    delete [] m_pVertexData;
+    delete [] m_pIndexData;
+    m_pVertexData = nullptr;
+    m_pIndexData = nullptr;
+}
+
+void Model::UpdateIndexBuffer()
+{
+    ASSERT(m_pIndexData != nullptr, "The CPU index data has already been released");
+    m_IndexBuffer.Create(L"IndexBuffer", (m_Header.indexDataByteSize + m_LodIndexDataByteSize) / sizeof(uint16_t), sizeof(uint16_t), m_pIndexData);
+}
+
 // assuming at least 3 floats for position
 void Model::ComputeMeshBoundingBox(unsigned int meshIndex, BoundingBox &bbox) const
 {
@@ -73,21 +101,17 @@ void Model::ComputeMeshBoundingBox(unsigned int meshIndex, BoundingBox &bbox) co
 
     if (mesh->vertexCount > 0)
     {
-        unsigned int vertexStride = mesh->vertexStride;
-
-        const float *p = (float*)(m_pVertexData + mesh->vertexDataByteOffset + mesh->attrib[attrib_position].offset);
-        const float *pEnd = (float*)(m_pVertexData + mesh->vertexDataByteOffset + mesh->vertexCount * mesh->vertexStride + mesh->attrib[attrib_position].offset);
         bbox.min = Scalar(FLT_MAX);
         bbox.max = Scalar(-FLT_MAX);
 
-        while (p < pEnd)
+        for (uint32_t vertexIndex = 0; vertexIndex < mesh->vertexCount; vertexIndex++)
         {
-            Vector3 pos(*(p + 0), *(p + 1), *(p + 2));
+            FloatVertex vertex;
+            DecodeVertex(*mesh, vertexIndex, vertex);
+            Vector3 pos(vertex.position);
 
             bbox.min = Min(bbox.min, pos);
             bbox.max = Max(bbox.max, pos);
-
-            (*(uint8_t**)&p) += vertexStride;
         }
     }
     else
@@ -123,7 +147,10 @@ void Model::ComputeAllBoundingBoxes()
     for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
     {
         Mesh *mesh = m_pMesh + meshIndex;
-        ComputeMeshBoundingBox(meshIndex, mesh->boundingBox);
+
+        // A quantized mesh's box is the range its positions are quantized to, so it must not move
+        if (mesh->attrib[attrib_position].format != attrib_format_short)
+            ComputeMeshBoundingBox(meshIndex, mesh->boundingBox);
     }
     ComputeGlobalBoundingBox(m_Header.boundingBox);
 }
@@ -93,6 +93,7 @@ public:
         attrib_format_ushort,
         attrib_format_short,
         attrib_format_float,
+        attrib_format_half,
 
         attrib_formats
     };
@@ -169,6 +170,67 @@ public:
     };
     Material *m_pMaterial;
 
+    // Every attribute of a vertex expanded to floats, as the converter lays them out before quantization
+    struct FloatVertex
+    {
+        XMFLOAT3 position;
+        XMFLOAT2 texcoord0;
+        XMFLOAT3 normal;
+        XMFLOAT3 tangent;
+        XMFLOAT3 bitangent;
+    };
+
+    // The layout every loaded model ends up in.  Positions are snorm16 within the mesh's bounding box,
+    // normals and tangents snorm16 with the bitangent's handedness in the tangent's w, and UVs half floats.
+    // The depth-only stream keeps just the position.
+    struct QuantizedVertex
+    {
+        int16_t position[4];
+        uint16_t texcoord0[2];
+        int16_t normal[4];
+        int16_t tangent[4];
+    };
+
+    // Largest difference quantization made to each attribute of one mesh
+    struct QuantizationError
+    {
+        float position;         // Model space distance
+        float texcoord0;
+        float normalDegrees;
+        float tangentDegrees;
+    };
+
+    // A run of triangles of one mesh that touches at most maxMeshletVertices vertices, with the bounds to
+    // cull it by.  Its indices are contiguous in the index data, so it can be drawn on its own.
+    struct Meshlet
+    {
+        float center[3];            // bounding sphere
+        float radius;
+        float coneApex[3];          // every triangle faces away from a viewer at eye when
+        float coneCutoff;           // dot(normalize(coneApex - eye), coneAxis) >= coneCutoff
+        float coneAxis[3];
+        uint32_t meshIndex;
+        uint32_t indexDataByteOffset;
+        uint32_t indexCount;
+    };
+    enum { maxMeshletVertices = 64, maxMeshletTriangles = 124 };
+    Meshlet *m_pMeshlet;
+    uint32_t m_MeshletCount;
+    uint32_t *m_pMeshletFirst;      // meshlets of mesh i are [m_pMeshletFirst[i], m_pMeshletFirst[i + 1])
+
+    // A simplified version of a mesh drawn with the mesh's vertices.  Level 0 is the mesh itself, and a level
+    // the simplifier could not reduce much further repeats the one before it.
+    struct LodLevel
+    {
+        uint32_t indexDataByteOffset;   // into m_pIndexData, after the meshes' own indices for levels above 0
+        uint32_t indexCount;
+        float error;                    // farthest a vertex of the mesh is from the level's surface, in model space
+    };
+    enum { maxLods = 4 };
+    LodLevel *m_pLod;                   // m_LodCount levels of each mesh in turn, coarser as they go
+    uint32_t m_LodCount;                // 0 when the model has no levels
+    uint32_t m_LodIndexDataByteSize;
+
     unsigned char *m_pVertexData;
     unsigned char *m_pIndexData;
     StructuredBuffer m_VertexBuffer;
@@ -187,11 +249,45 @@ public:
         return LoadH3D(filename, mat, invMat, flipUvY, buildBoundingBox);
     }
 
+    // Frees the CPU copies of the vertex and index data once the application is done processing them
+    void ReleaseCpuGeometry();
+
+    // Rewrites the index buffer from the CPU copy of the index data after it was modified
+    void UpdateIndexBuffer();
+
     const BoundingBox& GetBoundingBox() const
     {
         return m_Header.boundingBox;
     }
 
+    bool IsQuantized() const;
+
+    // Splits every mesh into meshlets, reordering its triangles so that each meshlet's are contiguous,
+    // then computes their bounds.  The depth-only indices are reordered the same way.
+    void BuildMeshlets();
+
+    // Refits the meshlet bounds after the positions changed
+    void ComputeMeshletBounds();
+
+    // Simplifies every mesh into maxLods levels and appends their indices to the index data
+    void BuildLods();
+
+    const LodLevel& GetLod(uint32_t meshIndex, uint32_t level) const
+    {
+        ASSERT(level < m_LodCount);
+        return m_pLod[meshIndex * m_LodCount + level];
+    }
+
+    // Position of a quantized vertex in model space is offset + scale * position
+    static void GetPositionDequantization(const Mesh &mesh, float scale[3], float offset[3]);
+
+    // Expands one vertex of m_pVertexData, whichever layout it is in
+    void DecodeVertex(const Mesh &mesh, uint32_t vertexIndex, FloatVertex &vertex) const;
+
+    // The names LoadTextures() tries, first to last and without an extension, for the diffuse, specular
+    // and normal maps of a material in turn
+    static void GetTextureNames(const Material &material, std::string names[3][3]);
+
     D3D12_CPU_DESCRIPTOR_HANDLE* GetSRVs( uint32_t materialIdx ) const
     {
         return m_SRVs + materialIdx * 6;
@@ -206,6 +302,11 @@ protected:
     void ComputeGlobalBoundingBox(BoundingBox &bbox) const;
     void ComputeAllBoundingBoxes();
 
+    // Converts both vertex streams between the float layout and the quantized one.  Quantization fits
+    // every mesh's bounding box to its positions first, and fills one error per mesh when errors is given.
+    void QuantizeVertexData(QuantizationError *errors = nullptr);
+    void ExpandVertexData();
+
     void ReleaseTextures();
     void LoadTextures();
     D3D12_CPU_DESCRIPTOR_HANDLE* m_SRVs;
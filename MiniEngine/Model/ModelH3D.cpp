@@ -19,27 +19,76 @@
 #include "GraphicsCore.h"
 #include "DescriptorHeap.h"
 #include "CommandContext.h"
+#include "SceneArchive.h"
 #include <stdio.h>
+#include <algorithm>
 
 #include "../../HybridVR/HlslCompat.h"
 
+// Optional sections after the depth-only index data, absent from files written before meshlets and LODs
+struct SectionHeader
+{
+	uint32_t magic;
+	uint32_t count;
+};
+static const uint32_t kMeshletSectionMagic = 0x3154454D; // "MET1", count meshlets
+static const uint32_t kLodSectionMagic = 0x31444F4C; // "LOD1", count levels per mesh, then the LOD index data size
+
+// Reads an H3D file like fread() does, from the mounted scene archive in place when it covers the file
+class H3DReader
+{
+public:
+	H3DReader() : m_File(nullptr), m_pData(nullptr), m_Size(0), m_Offset(0) {}
+
+	bool Open(const char *filename)
+	{
+		const std::wstring wideName = MakeWStr(filename);
+		if(SceneArchive::Covers(wideName))
+			return SceneArchive::Find(wideName, m_pData, m_Size);
+
+		return 0 == fopen_s(&m_File, filename, "rb");
+	}
+
+	size_t Read(void *dest, size_t size, size_t count)
+	{
+		if(m_File != nullptr)
+			return fread(dest, size, count, m_File);
+
+		const size_t readCount = size == 0 ? 0 : std::min(count, (m_Size - m_Offset) / size);
+		memcpy(dest, (const unsigned char*)m_pData + m_Offset, readCount * size);
+		m_Offset += readCount * size;
+		return readCount;
+	}
+
+	int Close()
+	{
+		return m_File != nullptr ? fclose(m_File) : 0;
+	}
+
+private:
+	FILE *m_File;
+	const void *m_pData;
+	size_t m_Size;
+	size_t m_Offset;
+};
+
 bool Model::LoadH3D(const char *filename, Matrix4 &mat, Matrix4& invMat, bool flipUvY, bool buildBoundingBox)
 {
-	FILE *file = nullptr;
-	if(0 != fopen_s(&file, filename, "rb"))
+	H3DReader file;
+	if(!file.Open(filename))
 		return false;
 
 	bool ok = false;
 
-	if(1 != fread(&m_Header, sizeof(Header), 1, file)) goto h3d_load_fail;
+	if(1 != file.Read(&m_Header, sizeof(Header), 1)) goto h3d_load_fail;
 
 	m_pMesh = new Mesh [m_Header.meshCount];
 	m_pMaterial = new Material [m_Header.materialCount];
 
 	if(m_Header.meshCount > 0)
-		if(1 != fread(m_pMesh, sizeof(Mesh) * m_Header.meshCount, 1, file)) goto h3d_load_fail;
+		if(1 != file.Read(m_pMesh, sizeof(Mesh) * m_Header.meshCount, 1)) goto h3d_load_fail;
 	if(m_Header.materialCount > 0)
-		if(1 != fread(m_pMaterial, sizeof(Material) * m_Header.materialCount, 1, file)) goto h3d_load_fail;
+		if(1 != file.Read(m_pMaterial, sizeof(Material) * m_Header.materialCount, 1)) goto h3d_load_fail;
 
 	m_VertexStride = m_pMesh[0].vertexStride;
 	m_VertexStrideDepth = m_pMesh[0].vertexStrideDepth;
@@ -54,6 +103,22 @@ bool Model::LoadH3D(const char *filename, Matrix4 &mat, Matrix4& invMat, bool fl
 	{
 		const Mesh &mesh = m_pMesh[meshIndex];
 
+		if(mesh.attrib[0].format == Model::attrib_format_short)
+		{
+			ASSERT(mesh.attribsEnabled ==
+				(attrib_mask_position | attrib_mask_texcoord0 | attrib_mask_normal | attrib_mask_tangent));
+			ASSERT(mesh.vertexStride == sizeof(QuantizedVertex));
+			ASSERT(mesh.attrib[0].components == 4 && mesh.attrib[0].format == Model::attrib_format_short); // position
+			ASSERT(mesh.attrib[1].components == 2 && mesh.attrib[1].format == Model::attrib_format_half); // texcoord0
+			ASSERT(mesh.attrib[2].components == 4 && mesh.attrib[2].format == Model::attrib_format_short); // normal
+			ASSERT(mesh.attrib[3].components == 4 && mesh.attrib[3].format == Model::attrib_format_short); // tangent
+
+			ASSERT(mesh.attribsEnabledDepth ==
+				(attrib_mask_position));
+			ASSERT(mesh.attribDepth[0].components == 4 && mesh.attribDepth[0].format == Model::attrib_format_short); // position
+			continue;
+		}
+
 		ASSERT(mesh.attribsEnabled ==
 			(attrib_mask_position | attrib_mask_texcoord0 | attrib_mask_normal | attrib_mask_tangent |
 				attrib_mask_bitangent));
@@ -65,7 +130,7 @@ bool Model::LoadH3D(const char *filename, Matrix4 &mat, Matrix4& invMat, bool fl
 
 		ASSERT(mesh.attribsEnabledDepth ==
 			(attrib_mask_position));
-		ASSERT(mesh.attrib[0].components == 3 && mesh.attrib[0].format == Model::attrib_format_float); // position
+		ASSERT(mesh.attribDepth[0].components == 3 && mesh.attribDepth[0].format == Model::attrib_format_float); // position
 	}
 #endif
 
@@ -75,50 +140,120 @@ bool Model::LoadH3D(const char *filename, Matrix4 &mat, Matrix4& invMat, bool fl
 	m_pIndexDataDepth = new unsigned char[m_Header.indexDataByteSize];
 
 	if(m_Header.vertexDataByteSize > 0)
-		if(1 != fread(m_pVertexData, m_Header.vertexDataByteSize, 1, file)) goto h3d_load_fail;
+		if(1 != file.Read(m_pVertexData, m_Header.vertexDataByteSize, 1)) goto h3d_load_fail;
 	if(m_Header.indexDataByteSize > 0)
-		if(1 != fread(m_pIndexData, m_Header.indexDataByteSize, 1, file)) goto h3d_load_fail;
+		if(1 != file.Read(m_pIndexData, m_Header.indexDataByteSize, 1)) goto h3d_load_fail;
 
 	if(m_Header.vertexDataByteSizeDepth > 0)
-		if(1 != fread(m_pVertexDataDepth, m_Header.vertexDataByteSizeDepth, 1, file)) goto h3d_load_fail;
+		if(1 != file.Read(m_pVertexDataDepth, m_Header.vertexDataByteSizeDepth, 1)) goto h3d_load_fail;
 	if(m_Header.indexDataByteSize > 0)
-		if(1 != fread(m_pIndexDataDepth, m_Header.indexDataByteSize, 1, file)) goto h3d_load_fail;
+		if(1 != file.Read(m_pIndexDataDepth, m_Header.indexDataByteSize, 1)) goto h3d_load_fail;
 
-	struct Vertex
 	{
-		XMFLOAT3 p;
-		XMFLOAT2 uv;
-		XMFLOAT3 n;
-		XMFLOAT3 t;
-		XMFLOAT3 b;
-	};
+		SectionHeader section;
+		while(1 == file.Read(&section, sizeof(section), 1))
+		{
+			if(section.magic == kMeshletSectionMagic && m_pMeshlet == nullptr && section.count > 0)
+			{
+				m_pMeshlet = new Meshlet[section.count];
+				if(1 != file.Read(m_pMeshlet, sizeof(Meshlet) * section.count, 1)) goto h3d_load_fail;
+				m_MeshletCount = section.count;
+			}
+			else if(section.magic == kLodSectionMagic && m_pLod == nullptr && section.count > 0)
+			{
+				uint32_t lodIndexDataByteSize;
+				if(1 != file.Read(&lodIndexDataByteSize, sizeof(lodIndexDataByteSize), 1)) goto h3d_load_fail;
+				m_pLod = new LodLevel[m_Header.meshCount * section.count];
+				m_LodCount = section.count;
+				if(1 != file.Read(m_pLod, sizeof(LodLevel) * m_Header.meshCount * section.count, 1)) goto h3d_load_fail;
+
+				// The levels' indices go after the meshes' own, where their offsets point
+				unsigned char *indexData = new unsigned char[m_Header.indexDataByteSize + lodIndexDataByteSize];
+				memcpy(indexData, m_pIndexData, m_Header.indexDataByteSize);
+				delete [] m_pIndexData;
+				m_pIndexData = indexData;
+				m_LodIndexDataByteSize = lodIndexDataByteSize;
+				if(lodIndexDataByteSize > 0)
+					if(1 != file.Read(m_pIndexData + m_Header.indexDataByteSize, lodIndexDataByteSize, 1)) goto h3d_load_fail;
+			}
+			else
+			{
+				break;
+			}
+		}
+	}
+
+	// Files written by the converter are already quantized and are uploaded as they are.  Transforming them
+	// means going back to floats, and quantizing again afterwards to fit the new bounding boxes.
+	if(IsQuantized() && (!XMMatrixIsIdentity(mat) || flipUvY))
+		ExpandVertexData();
 
-	const UINT numVertices = m_Header.vertexDataByteSize / m_VertexStride;
-	for(UINT vertexIndex = 0; vertexIndex < numVertices; vertexIndex++)
+	if(!IsQuantized())
 	{
-		Vertex *v = (Vertex*)(m_pVertexData + m_VertexStride * vertexIndex);
+		const UINT numVertices = m_Header.vertexDataByteSize / m_VertexStride;
+		for(UINT vertexIndex = 0; vertexIndex < numVertices; vertexIndex++)
+		{
+			FloatVertex *v = (FloatVertex*)(m_pVertexData + m_VertexStride * vertexIndex);
+
+			XMStoreFloat3(&v->position, mat * Vector4(v->position, 1));
+			XMStoreFloat3(&v->normal, mat * Vector4(v->normal, 0));
+			XMStoreFloat3(&v->tangent, mat * Vector4(v->tangent, 0));
+			XMStoreFloat3(&v->bitangent, mat * Vector4(v->bitangent, 0));
+			if (flipUvY)
+			{
+				v->texcoord0.y = 1.0f - v->texcoord0.y;
+			}
+		}
 
-		XMStoreFloat3(&v->p, mat * Vector4(v->p, 1));
-		XMStoreFloat3(&v->n, mat * Vector4(v->n, 0));
-		XMStoreFloat3(&v->t, mat * Vector4(v->t, 0));
-		XMStoreFloat3(&v->b, mat * Vector4(v->b, 0));
-		if (flipUvY)
+		// The depth-only positions have to match the transformed ones to be quantized in the same box
+		const UINT numVerticesDepth = m_Header.vertexDataByteSizeDepth / m_VertexStrideDepth;
+		for(UINT vertexIndex = 0; vertexIndex < numVerticesDepth; vertexIndex++)
 		{
-			v->uv.y = 1.0 - v->uv.y;
+			XMFLOAT3 *p = (XMFLOAT3*)(m_pVertexDataDepth + m_VertexStrideDepth * vertexIndex);
+			XMStoreFloat3(p, mat * Vector4(*p, 1));
 		}
-	}
 
-	if(buildBoundingBox)
+		QuantizeVertexData();
+		ComputeGlobalBoundingBox(m_Header.boundingBox);
+
+		if(m_MeshletCount > 0)
+			ComputeMeshletBounds();
+
+		// LOD errors are distances, so they grow with the largest scale of the transform
+		const float scale = Max(Max(Length(Vector3(mat.GetX())), Length(Vector3(mat.GetY()))), Length(Vector3(mat.GetZ())));
+		for(uint32_t i = 0; i < m_Header.meshCount * m_LodCount; ++i)
+			m_pLod[i].error *= scale;
+	}
+	else if(buildBoundingBox)
 	{
 		ComputeAllBoundingBoxes();
 	}
 
+	if(m_MeshletCount == 0)
+	{
+		BuildMeshlets();
+	}
+	else
+	{
+		m_pMeshletFirst = new uint32_t[m_Header.meshCount + 1];
+		uint32_t meshletIndex = 0;
+		for(uint32_t meshIndex = 0; meshIndex <= m_Header.meshCount; ++meshIndex)
+		{
+			while(meshletIndex < m_MeshletCount && m_pMeshlet[meshletIndex].meshIndex < meshIndex)
+				++meshletIndex;
+			m_pMeshletFirst[meshIndex] = meshletIndex;
+		}
+	}
+
+	// Files from before the converter simplified the meshes get their levels here
+	if(m_LodCount == 0)
+		BuildLods();
+
 	m_VertexBuffer.Create(L"VertexBuffer", m_Header.vertexDataByteSize / m_VertexStride, m_VertexStride, m_pVertexData);
-	m_IndexBuffer.Create(L"IndexBuffer", m_Header.indexDataByteSize / sizeof(uint16_t), sizeof(uint16_t), m_pIndexData);
-	delete [] m_pVertexData;
-	m_pVertexData = nullptr;
-	delete [] m_pIndexData;
-	m_pIndexData = nullptr;
+	m_IndexBuffer.Create(L"IndexBuffer", (m_Header.indexDataByteSize + m_LodIndexDataByteSize) / sizeof(uint16_t), sizeof(uint16_t), m_pIndexData);
+
+	// The vertex and index data stay in CPU memory until ReleaseCpuGeometry() so that the application
+	// can process the meshes after loading
 
 
 	m_VertexBufferDepth.Create(L"VertexBufferDepth", m_Header.vertexDataByteSizeDepth / m_VertexStrideDepth,
@@ -136,7 +271,7 @@ bool Model::LoadH3D(const char *filename, Matrix4 &mat, Matrix4& invMat, bool fl
 
 h3d_load_fail:
 
-	if(EOF == fclose(file))
+	if(EOF == file.Close())
 		ok = false;
 
 	return ok;
@@ -167,6 +302,23 @@ bool Model::SaveH3D(const char *filename) const
 	if(m_Header.indexDataByteSize > 0)
 		if(1 != fwrite(m_pIndexDataDepth, m_Header.indexDataByteSize, 1, file)) goto h3d_save_fail;
 
+	if(m_MeshletCount > 0)
+	{
+		const SectionHeader meshletSection = { kMeshletSectionMagic, m_MeshletCount };
+		if(1 != fwrite(&meshletSection, sizeof(meshletSection), 1, file)) goto h3d_save_fail;
+		if(1 != fwrite(m_pMeshlet, sizeof(Meshlet) * m_MeshletCount, 1, file)) goto h3d_save_fail;
+	}
+
+	if(m_LodCount > 0)
+	{
+		const SectionHeader lodSection = { kLodSectionMagic, m_LodCount };
+		if(1 != fwrite(&lodSection, sizeof(lodSection), 1, file)) goto h3d_save_fail;
+		if(1 != fwrite(&m_LodIndexDataByteSize, sizeof(m_LodIndexDataByteSize), 1, file)) goto h3d_save_fail;
+		if(1 != fwrite(m_pLod, sizeof(LodLevel) * m_Header.meshCount * m_LodCount, 1, file)) goto h3d_save_fail;
+		if(m_LodIndexDataByteSize > 0)
+			if(1 != fwrite(m_pIndexData + m_Header.indexDataByteSize, m_LodIndexDataByteSize, 1, file)) goto h3d_save_fail;
+	}
+
 	ok = true;
 
 h3d_save_fail:
@@ -214,6 +366,23 @@ Texture *g_CreateDefaultTexture()
 	return result;
 }
 
+void Model::GetTextureNames(const Material &material, std::string names[3][3])
+{
+	const std::string diffusePath = material.texDiffusePath;
+
+	names[0][0] = diffusePath;
+	names[0][1] = diffusePath + "_diffuse";
+	names[0][2] = "default";
+
+	names[1][0] = material.texSpecularPath;
+	names[1][1] = diffusePath + "_specular";
+	names[1][2] = "default_specular";
+
+	names[2][0] = material.texNormalPath;
+	names[2][1] = diffusePath + "_normal";
+	names[2][2] = "default_normal";
+}
+
 void Model::LoadTextures(void)
 {
 	ReleaseTextures();
@@ -226,9 +395,12 @@ void Model::LoadTextures(void)
 
 	const ManagedTexture *MatTextures[6] = {};
 
-	auto load_texture = [&](UINT TexType, const std::string &Primary, const std::string &Second,
-	                        const std::string &Default, bool SRgb)
+	auto load_texture = [&](UINT TexType, const std::string (&Names)[3], bool SRgb)
 	{
+		const std::string &Primary = Names[0];
+		const std::string &Second = Names[1];
+		const std::string &Default = Names[2];
+
 		auto try_load_texture = [&](const std::string &Path)
 		{
 			MatTextures[TexType] = TextureManager::LoadFromFile(Path, SRgb);
@@ -262,22 +434,22 @@ void Model::LoadTextures(void)
 
 		const int base = materialIdx * 6;
 
+		std::string names[3][3];
+		GetTextureNames(pMaterial, names);
+
 		// NOTE: The engine only uses Diffuse, Specular, and Reflection textures, so rest are irrelevant
 
 		// Diffuse
-		m_SRVs[base + 0] = load_texture(0, pMaterial.texDiffusePath, std::string(pMaterial.texDiffusePath) + "_diffuse",
-		                                "default", true);
+		m_SRVs[base + 0] = load_texture(0, names[0], true);
 
 		// Specular
-		m_SRVs[base + 1] = load_texture(1, pMaterial.texSpecularPath,
-		                                std::string(pMaterial.texDiffusePath) + "_specular", "default_specular", true);
+		m_SRVs[base + 1] = load_texture(1, names[1], true);
 
 		// Emissive
 		m_SRVs[base + 2] = MatTextures[0]->GetSRV();
 
 		// Normal
-		m_SRVs[base + 3] = load_texture(3, pMaterial.texNormalPath, std::string(pMaterial.texDiffusePath) + "_normal",
-		                                "default_normal", false);
+		m_SRVs[base + 3] = load_texture(3, names[2], false);
 
 		// Lightmap
 		m_SRVs[base + 4] = MatTextures[0]->GetSRV();
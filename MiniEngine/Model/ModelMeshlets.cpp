@@ -0,0 +1,360 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "Model.h"
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+namespace
+{
+    const uint32_t kNone = 0xFFFFFFFF;
+
+    struct Float3
+    {
+        float x, y, z;
+    };
+
+    Float3 Sub(const Float3 &a, const Float3 &b) { Float3 r = { a.x - b.x, a.y - b.y, a.z - b.z }; return r; }
+    float Dot(const Float3 &a, const Float3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    Float3 Cross(const Float3 &a, const Float3 &b)
+    {
+        Float3 r = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+        return r;
+    }
+
+    // Grows one meshlet at a time from the first triangle not taken yet.  The next triangle is the one sharing
+    // the most vertices with the meshlet, then the closest to its centre.  When nothing connected fits, the
+    // next triangle in index order is taken if it lies within the meshlet's bounds.  Within a meshlet the
+    // triangles keep their order, which the converter optimized for the post-transform cache.
+    void PartitionMesh(const uint16_t *indices, uint32_t triangleCount, uint32_t vertexCount,
+        const std::vector<Float3> &positions, std::vector<uint32_t> &order, std::vector<uint32_t> &meshletSizes)
+    {
+        std::vector<uint32_t> adjacencyFirst(vertexCount + 1, 0);
+        for (uint32_t i = 0; i < triangleCount * 3; i++)
+            adjacencyFirst[indices[i] + 1]++;
+        for (uint32_t v = 0; v < vertexCount; v++)
+            adjacencyFirst[v + 1] += adjacencyFirst[v];
+        std::vector<uint32_t> adjacency(triangleCount * 3);
+        std::vector<uint32_t> fill(adjacencyFirst.begin(), adjacencyFirst.end() - 1);
+        for (uint32_t i = 0; i < triangleCount * 3; i++)
+            adjacency[fill[indices[i]]++] = i / 3;
+
+        std::vector<Float3> centroids(triangleCount);
+        for (uint32_t t = 0; t < triangleCount; t++)
+        {
+            const Float3 &a = positions[indices[t * 3 + 0]];
+            const Float3 &b = positions[indices[t * 3 + 1]];
+            const Float3 &c = positions[indices[t * 3 + 2]];
+            Float3 centroid = { (a.x + b.x + c.x) / 3.0f, (a.y + b.y + c.y) / 3.0f, (a.z + b.z + c.z) / 3.0f };
+            centroids[t] = centroid;
+        }
+
+        std::vector<bool> taken(triangleCount, false);
+        std::vector<uint32_t> vertexMeshlet(vertexCount, kNone);     // last meshlet that took the vertex
+        std::vector<uint32_t> candidateMeshlet(triangleCount, kNone);
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> meshlet;
+        uint32_t nextInOrder = 0;
+
+        order.clear();
+        order.reserve(triangleCount);
+        meshletSizes.clear();
+
+        for (uint32_t meshletIndex = 0; order.size() < triangleCount; meshletIndex++)
+        {
+            while (taken[nextInOrder])
+                nextInOrder++;
+
+            meshlet.clear();
+            candidates.clear();
+            uint32_t meshletVertices = 0;
+            Float3 boxMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+            Float3 boxMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+            uint32_t triangle = nextInOrder;
+            while (triangle != kNone)
+            {
+                taken[triangle] = true;
+                meshlet.push_back(triangle);
+
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    const uint32_t v = indices[triangle * 3 + k];
+                    if (vertexMeshlet[v] == meshletIndex)
+                        continue;
+
+                    vertexMeshlet[v] = meshletIndex;
+                    meshletVertices++;
+
+                    const Float3 &p = positions[v];
+                    boxMin.x = std::min(boxMin.x, p.x); boxMax.x = std::max(boxMax.x, p.x);
+                    boxMin.y = std::min(boxMin.y, p.y); boxMax.y = std::max(boxMax.y, p.y);
+                    boxMin.z = std::min(boxMin.z, p.z); boxMax.z = std::max(boxMax.z, p.z);
+
+                    for (uint32_t a = adjacencyFirst[v]; a < adjacencyFirst[v + 1]; a++)
+                    {
+                        const uint32_t neighbour = adjacency[a];
+                        if (!taken[neighbour] && candidateMeshlet[neighbour] != meshletIndex)
+                        {
+                            candidateMeshlet[neighbour] = meshletIndex;
+                            candidates.push_back(neighbour);
+                        }
+                    }
+                }
+
+                if (meshlet.size() == Model::maxMeshletTriangles)
+                    break;
+
+                const Float3 center = { (boxMin.x + boxMax.x) * 0.5f, (boxMin.y + boxMax.y) * 0.5f, (boxMin.z + boxMax.z) * 0.5f };
+                auto newVertices = [&](uint32_t t)
+                {
+                    uint32_t count = 0;
+                    for (uint32_t k = 0; k < 3; k++)
+                        count += vertexMeshlet[indices[t * 3 + k]] != meshletIndex;
+                    return count;
+                };
+
+                triangle = kNone;
+                uint32_t bestNew = 4;
+                float bestDistance = FLT_MAX;
+                uint32_t kept = 0;
+                for (uint32_t c = 0; c < candidates.size(); c++)
+                {
+                    const uint32_t candidate = candidates[c];
+                    if (taken[candidate])
+                        continue;
+                    candidates[kept++] = candidate;
+
+                    const uint32_t added = newVertices(candidate);
+                    if (meshletVertices + added > Model::maxMeshletVertices)
+                        continue;
+
+                    const Float3 offset = Sub(centroids[candidate], center);
+                    const float distance = Dot(offset, offset);
+                    if (added < bestNew || (added == bestNew && distance < bestDistance))
+                    {
+                        triangle = candidate;
+                        bestNew = added;
+                        bestDistance = distance;
+                    }
+                }
+                candidates.resize(kept);
+
+                if (triangle == kNone)
+                {
+                    while (nextInOrder < triangleCount && taken[nextInOrder])
+                        nextInOrder++;
+                    if (nextInOrder < triangleCount && meshletVertices + newVertices(nextInOrder) <= Model::maxMeshletVertices)
+                    {
+                        const Float3 halfExtent = Sub(boxMax, center);
+                        const Float3 offset = Sub(centroids[nextInOrder], center);
+                        if (Dot(offset, offset) <= Dot(halfExtent, halfExtent))
+                            triangle = nextInOrder;
+                    }
+                }
+            }
+
+            std::sort(meshlet.begin(), meshlet.end());
+            order.insert(order.end(), meshlet.begin(), meshlet.end());
+            meshletSizes.push_back((uint32_t)meshlet.size());
+        }
+    }
+
+    void ReorderTriangles(uint16_t *indices, const std::vector<uint32_t> &order)
+    {
+        std::vector<uint16_t> source(indices, indices + order.size() * 3);
+        for (uint32_t t = 0; t < order.size(); t++)
+            memcpy(indices + t * 3, source.data() + order[t] * 3, 3 * sizeof(uint16_t));
+    }
+}
+
+void Model::BuildMeshlets()
+{
+    ASSERT(m_pVertexData != nullptr && m_pIndexData != nullptr, "Meshlets need the CPU geometry");
+
+    std::vector<Meshlet> meshlets;
+    std::vector<Float3> positions;
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> meshletSizes;
+
+    delete [] m_pMeshletFirst;
+    m_pMeshletFirst = new uint32_t[m_Header.meshCount + 1];
+
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        const Mesh &mesh = m_pMesh[meshIndex];
+        m_pMeshletFirst[meshIndex] = (uint32_t)meshlets.size();
+
+        positions.resize(mesh.vertexCount);
+        for (uint32_t i = 0; i < mesh.vertexCount; i++)
+        {
+            FloatVertex vertex;
+            DecodeVertex(mesh, i, vertex);
+            positions[i].x = vertex.position.x;
+            positions[i].y = vertex.position.y;
+            positions[i].z = vertex.position.z;
+        }
+
+        uint16_t *indices = (uint16_t*)(m_pIndexData + mesh.indexDataByteOffset);
+        PartitionMesh(indices, mesh.indexCount / 3, mesh.vertexCount, positions, order, meshletSizes);
+        ReorderTriangles(indices, order);
+        if (m_pIndexDataDepth != nullptr)
+            ReorderTriangles((uint16_t*)(m_pIndexDataDepth + mesh.indexDataByteOffset), order);
+
+        uint32_t indexDataByteOffset = mesh.indexDataByteOffset;
+        for (uint32_t size : meshletSizes)
+        {
+            Meshlet meshlet = {};
+            meshlet.meshIndex = meshIndex;
+            meshlet.indexDataByteOffset = indexDataByteOffset;
+            meshlet.indexCount = size * 3;
+            meshlets.push_back(meshlet);
+            indexDataByteOffset += size * 3 * sizeof(uint16_t);
+        }
+    }
+    m_pMeshletFirst[m_Header.meshCount] = (uint32_t)meshlets.size();
+
+    delete [] m_pMeshlet;
+    m_MeshletCount = (uint32_t)meshlets.size();
+    m_pMeshlet = new Meshlet[m_MeshletCount];
+    if (m_MeshletCount > 0)
+        memcpy(m_pMeshlet, meshlets.data(), m_MeshletCount * sizeof(Meshlet));
+
+    ComputeMeshletBounds();
+}
+
+void Model::ComputeMeshletBounds()
+{
+    ASSERT(m_pVertexData != nullptr && m_pIndexData != nullptr, "Meshlets need the CPU geometry");
+
+    // The rasterizer decides facing by winding, and the content's winding agrees with its normals, so the
+    // side the vertex normals point to decides which way round each triangle's geometric normal goes
+    float windingAgreement = 0.0f;
+    for (uint32_t m = 0; m < m_MeshletCount; m++)
+    {
+        const Meshlet &meshlet = m_pMeshlet[m];
+        const Mesh &mesh = m_pMesh[meshlet.meshIndex];
+        const uint16_t *indices = (const uint16_t*)(m_pIndexData + meshlet.indexDataByteOffset);
+        for (uint32_t i = 0; i < meshlet.indexCount; i += 3)
+        {
+            FloatVertex v[3];
+            for (uint32_t k = 0; k < 3; k++)
+                DecodeVertex(mesh, indices[i + k], v[k]);
+            const Float3 p0 = { v[0].position.x, v[0].position.y, v[0].position.z };
+            const Float3 p1 = { v[1].position.x, v[1].position.y, v[1].position.z };
+            const Float3 p2 = { v[2].position.x, v[2].position.y, v[2].position.z };
+            const Float3 n = { v[0].normal.x + v[1].normal.x + v[2].normal.x, v[0].normal.y + v[1].normal.y + v[2].normal.y,
+                v[0].normal.z + v[1].normal.z + v[2].normal.z };
+            windingAgreement += Dot(Cross(Sub(p1, p0), Sub(p2, p0)), n) > 0.0f ? 1.0f : -1.0f;
+        }
+    }
+    const float facing = windingAgreement < 0.0f ? -1.0f : 1.0f;
+
+    std::vector<Float3> positions;
+    std::vector<Float3> normals;
+    for (uint32_t m = 0; m < m_MeshletCount; m++)
+    {
+        Meshlet &meshlet = m_pMeshlet[m];
+        const Mesh &mesh = m_pMesh[meshlet.meshIndex];
+        const uint16_t *indices = (const uint16_t*)(m_pIndexData + meshlet.indexDataByteOffset);
+
+        positions.resize(meshlet.indexCount);
+        for (uint32_t i = 0; i < meshlet.indexCount; i++)
+        {
+            FloatVertex vertex;
+            DecodeVertex(mesh, indices[i], vertex);
+            Float3 p = { vertex.position.x, vertex.position.y, vertex.position.z };
+            positions[i] = p;
+        }
+
+        Float3 boxMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+        Float3 boxMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (const Float3 &p : positions)
+        {
+            boxMin.x = std::min(boxMin.x, p.x); boxMax.x = std::max(boxMax.x, p.x);
+            boxMin.y = std::min(boxMin.y, p.y); boxMax.y = std::max(boxMax.y, p.y);
+            boxMin.z = std::min(boxMin.z, p.z); boxMax.z = std::max(boxMax.z, p.z);
+        }
+        const Float3 center = { (boxMin.x + boxMax.x) * 0.5f, (boxMin.y + boxMax.y) * 0.5f, (boxMin.z + boxMax.z) * 0.5f };
+        float radiusSq = 0.0f;
+        for (const Float3 &p : positions)
+        {
+            const Float3 offset = Sub(p, center);
+            radiusSq = std::max(radiusSq, Dot(offset, offset));
+        }
+        meshlet.center[0] = center.x;
+        meshlet.center[1] = center.y;
+        meshlet.center[2] = center.z;
+        meshlet.radius = sqrtf(radiusSq) * 1.0001f;
+
+        // The cone holds every non-degenerate triangle's front facing normal
+        normals.clear();
+        Float3 axis = { 0.0f, 0.0f, 0.0f };
+        for (uint32_t i = 0; i < meshlet.indexCount; i += 3)
+        {
+            Float3 n = Cross(Sub(positions[i + 1], positions[i]), Sub(positions[i + 2], positions[i]));
+            const float length = sqrtf(Dot(n, n));
+            if (length <= 0.0f)
+                continue;
+            n.x *= facing / length;
+            n.y *= facing / length;
+            n.z *= facing / length;
+            normals.push_back(n);
+            axis.x += n.x;
+            axis.y += n.y;
+            axis.z += n.z;
+        }
+
+        const float axisLength = sqrtf(Dot(axis, axis));
+        float minDot = -1.0f;
+        if (axisLength > 0.0f)
+        {
+            axis.x /= axisLength;
+            axis.y /= axisLength;
+            axis.z /= axisLength;
+            minDot = 1.0f;
+            for (const Float3 &n : normals)
+                minDot = std::min(minDot, Dot(n, axis));
+        }
+
+        if (minDot <= 0.0f)
+        {
+            // Some triangle faces every way the cone could, so the meshlet is never back facing
+            memcpy(meshlet.coneApex, meshlet.center, sizeof(meshlet.coneApex));
+            meshlet.coneAxis[0] = meshlet.coneAxis[1] = meshlet.coneAxis[2] = 0.0f;
+            meshlet.coneCutoff = 1.0f;
+            continue;
+        }
+
+        // Back off along the axis until the apex is behind every triangle's plane.  A viewer inside the cone
+        // of half angle 90 degrees minus the normals' spread, opening away from the apex, is then behind all
+        // of them.
+        float apexDistance = 0.0f;
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < meshlet.indexCount; i += 3)
+        {
+            const Float3 edge = Cross(Sub(positions[i + 1], positions[i]), Sub(positions[i + 2], positions[i]));
+            if (Dot(edge, edge) <= 0.0f)
+                continue;
+            const Float3 &normal = normals[n++];
+            const float distance = Dot(Sub(center, positions[i]), normal) / Dot(normal, axis);
+            apexDistance = std::max(apexDistance, distance);
+        }
+        meshlet.coneApex[0] = center.x - axis.x * apexDistance;
+        meshlet.coneApex[1] = center.y - axis.y * apexDistance;
+        meshlet.coneApex[2] = center.z - axis.z * apexDistance;
+        meshlet.coneAxis[0] = axis.x;
+        meshlet.coneAxis[1] = axis.y;
+        meshlet.coneAxis[2] = axis.z;
+        meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+    }
+}
@@ -0,0 +1,256 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "Model.h"
+#include <DirectXPackedVector.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+using namespace DirectX::PackedVector;
+
+namespace
+{
+    const uint32_t kQuantizedStrideDepth = 4 * sizeof(int16_t);
+
+    void SetAttrib(Model::Attrib &attrib, uint16_t offset, uint16_t normalized, uint16_t components, uint16_t format)
+    {
+        attrib.offset = offset;
+        attrib.normalized = normalized;
+        attrib.components = components;
+        attrib.format = format;
+    }
+
+    void ClearAttribs(Model::Attrib *attribs)
+    {
+        memset(attribs, 0, sizeof(Model::Attrib) * Model::maxAttribs);
+    }
+
+    XMFLOAT3 DequantizePosition(const int16_t q[4], const float scale[3], const float offset[3])
+    {
+        XMFLOAT4 p;
+        XMStoreFloat4(&p, XMLoadShortN4((const XMSHORTN4*)q));
+        return XMFLOAT3(offset[0] + scale[0] * p.x, offset[1] + scale[1] * p.y, offset[2] + scale[2] * p.z);
+    }
+
+    void QuantizePosition(const XMFLOAT3 &p, const float scale[3], const float offset[3], int16_t q[4])
+    {
+        // A flat box maps every position on that axis to its center
+        const float pIn[3] = { p.x, p.y, p.z };
+        float unit[3];
+        for (int i = 0; i < 3; ++i)
+            unit[i] = scale[i] > 0.0f ? (pIn[i] - offset[i]) / scale[i] : 0.0f;
+        XMStoreShortN4((XMSHORTN4*)q, XMVectorSet(unit[0], unit[1], unit[2], 0.0f));
+    }
+
+    float AngleDegrees(const XMFLOAT3 &a, const XMFLOAT3 &b)
+    {
+        const XMVECTOR va = XMVector3Normalize(XMLoadFloat3(&a));
+        const XMVECTOR vb = XMVector3Normalize(XMLoadFloat3(&b));
+        const float cosAngle = XMVectorGetX(XMVector3Dot(va, vb));
+        return XMConvertToDegrees(acosf(cosAngle < -1.0f ? -1.0f : cosAngle > 1.0f ? 1.0f : cosAngle));
+    }
+}
+
+bool Model::IsQuantized() const
+{
+    return m_Header.meshCount > 0 && m_pMesh[0].attrib[attrib_position].format == attrib_format_short;
+}
+
+void Model::GetPositionDequantization(const Mesh &mesh, float scale[3], float offset[3])
+{
+    XMStoreFloat3((XMFLOAT3*)offset, (mesh.boundingBox.min + mesh.boundingBox.max) * 0.5f);
+    XMStoreFloat3((XMFLOAT3*)scale, (mesh.boundingBox.max - mesh.boundingBox.min) * 0.5f);
+}
+
+void Model::DecodeVertex(const Mesh &mesh, uint32_t vertexIndex, FloatVertex &vertex) const
+{
+    const unsigned char *v = m_pVertexData + mesh.vertexDataByteOffset + vertexIndex * mesh.vertexStride;
+
+    if (mesh.attrib[attrib_position].format == attrib_format_float)
+    {
+        memcpy(&vertex.position, v + mesh.attrib[attrib_position].offset, sizeof(vertex.position));
+        memcpy(&vertex.texcoord0, v + mesh.attrib[attrib_texcoord0].offset, sizeof(vertex.texcoord0));
+        memcpy(&vertex.normal, v + mesh.attrib[attrib_normal].offset, sizeof(vertex.normal));
+        memcpy(&vertex.tangent, v + mesh.attrib[attrib_tangent].offset, sizeof(vertex.tangent));
+        memcpy(&vertex.bitangent, v + mesh.attrib[attrib_bitangent].offset, sizeof(vertex.bitangent));
+        return;
+    }
+
+    ASSERT(mesh.vertexStride == sizeof(QuantizedVertex));
+    const QuantizedVertex &q = *(const QuantizedVertex*)v;
+
+    float scale[3], offset[3];
+    GetPositionDequantization(mesh, scale, offset);
+    vertex.position = DequantizePosition(q.position, scale, offset);
+
+    XMStoreFloat2(&vertex.texcoord0, XMLoadHalf2((const XMHALF2*)q.texcoord0));
+
+    const XMVECTOR normal = XMLoadShortN4((const XMSHORTN4*)q.normal);
+    const XMVECTOR tangent = XMLoadShortN4((const XMSHORTN4*)q.tangent);
+    XMStoreFloat3(&vertex.normal, normal);
+    XMStoreFloat3(&vertex.tangent, tangent);
+    XMStoreFloat3(&vertex.bitangent, XMVector3Cross(normal, tangent) * XMVectorSplatW(tangent));
+}
+
+void Model::QuantizeVertexData(QuantizationError *errors)
+{
+    ASSERT(!IsQuantized());
+
+    uint32_t vertexCount = 0;
+    uint32_t vertexCountDepth = 0;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        vertexCount += m_pMesh[meshIndex].vertexCount;
+        vertexCountDepth += m_pMesh[meshIndex].vertexCountDepth;
+    }
+
+    QuantizedVertex *vertexData = new QuantizedVertex[vertexCount];
+    int16_t *vertexDataDepth = new int16_t[vertexCountDepth * 4];
+    uint32_t vertexOffset = 0;
+    uint32_t vertexOffsetDepth = 0;
+
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        Mesh &mesh = m_pMesh[meshIndex];
+
+        ComputeMeshBoundingBox(meshIndex, mesh.boundingBox);
+        float scale[3], offset[3];
+        GetPositionDequantization(mesh, scale, offset);
+
+        QuantizationError error = {};
+        for (uint32_t i = 0; i < mesh.vertexCount; i++)
+        {
+            FloatVertex source;
+            DecodeVertex(mesh, i, source);
+
+            const XMVECTOR normal = XMVector3Normalize(XMLoadFloat3(&source.normal));
+            const XMVECTOR tangent = XMVector3Normalize(XMLoadFloat3(&source.tangent));
+            const float handedness =
+                XMVectorGetX(XMVector3Dot(XMVector3Cross(normal, tangent), XMLoadFloat3(&source.bitangent))) < 0.0f ? -1.0f : 1.0f;
+
+            QuantizedVertex &q = vertexData[vertexOffset + i];
+            QuantizePosition(source.position, scale, offset, q.position);
+            XMStoreHalf2((XMHALF2*)q.texcoord0, XMLoadFloat2(&source.texcoord0));
+            XMStoreShortN4((XMSHORTN4*)q.normal, XMVectorSetW(normal, 0.0f));
+            XMStoreShortN4((XMSHORTN4*)q.tangent, XMVectorSetW(tangent, handedness));
+
+            // Measured against what DecodeVertex() will return
+            const XMFLOAT3 position = DequantizePosition(q.position, scale, offset);
+            XMFLOAT2 texcoord0;
+            XMStoreFloat2(&texcoord0, XMLoadHalf2((const XMHALF2*)q.texcoord0));
+            XMFLOAT3 quantizedNormal, quantizedTangent;
+            XMStoreFloat3(&quantizedNormal, XMLoadShortN4((const XMSHORTN4*)q.normal));
+            XMStoreFloat3(&quantizedTangent, XMLoadShortN4((const XMSHORTN4*)q.tangent));
+
+            error.position = XMMax(error.position,
+                XMVectorGetX(XMVector3Length(XMLoadFloat3(&position) - XMLoadFloat3(&source.position))));
+            error.texcoord0 = XMMax(error.texcoord0, XMMax(fabsf(texcoord0.x - source.texcoord0.x), fabsf(texcoord0.y - source.texcoord0.y)));
+            error.normalDegrees = XMMax(error.normalDegrees, AngleDegrees(quantizedNormal, source.normal));
+            error.tangentDegrees = XMMax(error.tangentDegrees, AngleDegrees(quantizedTangent, source.tangent));
+        }
+
+        // The depth-only positions are the same points, so they fit the same box
+        const unsigned char *depthPositions = m_pVertexDataDepth + mesh.vertexDataByteOffsetDepth + mesh.attribDepth[attrib_position].offset;
+        for (uint32_t i = 0; i < mesh.vertexCountDepth; i++)
+        {
+            XMFLOAT3 p;
+            memcpy(&p, depthPositions + i * mesh.vertexStrideDepth, sizeof(p));
+            QuantizePosition(p, scale, offset, vertexDataDepth + (vertexOffsetDepth + i) * 4);
+        }
+
+        if (errors)
+            errors[meshIndex] = error;
+
+        mesh.attribsEnabled = attrib_mask_position | attrib_mask_texcoord0 | attrib_mask_normal | attrib_mask_tangent;
+        ClearAttribs(mesh.attrib);
+        SetAttrib(mesh.attrib[attrib_position], offsetof(QuantizedVertex, position), 1, 4, attrib_format_short);
+        SetAttrib(mesh.attrib[attrib_texcoord0], offsetof(QuantizedVertex, texcoord0), 0, 2, attrib_format_half);
+        SetAttrib(mesh.attrib[attrib_normal], offsetof(QuantizedVertex, normal), 1, 4, attrib_format_short);
+        SetAttrib(mesh.attrib[attrib_tangent], offsetof(QuantizedVertex, tangent), 1, 4, attrib_format_short);
+        mesh.vertexStride = sizeof(QuantizedVertex);
+        mesh.vertexDataByteOffset = vertexOffset * sizeof(QuantizedVertex);
+
+        ClearAttribs(mesh.attribDepth);
+        SetAttrib(mesh.attribDepth[attrib_position], 0, 1, 4, attrib_format_short);
+        mesh.vertexStrideDepth = kQuantizedStrideDepth;
+        mesh.vertexDataByteOffsetDepth = vertexOffsetDepth * kQuantizedStrideDepth;
+
+        vertexOffset += mesh.vertexCount;
+        vertexOffsetDepth += mesh.vertexCountDepth;
+    }
+
+    delete [] m_pVertexData;
+    delete [] m_pVertexDataDepth;
+    m_pVertexData = (unsigned char*)vertexData;
+    m_pVertexDataDepth = (unsigned char*)vertexDataDepth;
+    m_Header.vertexDataByteSize = vertexCount * sizeof(QuantizedVertex);
+    m_Header.vertexDataByteSizeDepth = vertexCountDepth * kQuantizedStrideDepth;
+    m_VertexStride = sizeof(QuantizedVertex);
+    m_VertexStrideDepth = kQuantizedStrideDepth;
+}
+
+void Model::ExpandVertexData()
+{
+    ASSERT(IsQuantized());
+
+    uint32_t vertexCount = 0;
+    uint32_t vertexCountDepth = 0;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        vertexCount += m_pMesh[meshIndex].vertexCount;
+        vertexCountDepth += m_pMesh[meshIndex].vertexCountDepth;
+    }
+
+    FloatVertex *vertexData = new FloatVertex[vertexCount];
+    XMFLOAT3 *vertexDataDepth = new XMFLOAT3[vertexCountDepth];
+    uint32_t vertexOffset = 0;
+    uint32_t vertexOffsetDepth = 0;
+
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        Mesh &mesh = m_pMesh[meshIndex];
+
+        for (uint32_t i = 0; i < mesh.vertexCount; i++)
+            DecodeVertex(mesh, i, vertexData[vertexOffset + i]);
+
+        float scale[3], offset[3];
+        GetPositionDequantization(mesh, scale, offset);
+        const int16_t *depthPositions = (const int16_t*)(m_pVertexDataDepth + mesh.vertexDataByteOffsetDepth);
+        for (uint32_t i = 0; i < mesh.vertexCountDepth; i++)
+            vertexDataDepth[vertexOffsetDepth + i] = DequantizePosition(depthPositions + i * 4, scale, offset);
+
+        mesh.attribsEnabled = attrib_mask_position | attrib_mask_texcoord0 | attrib_mask_normal | attrib_mask_tangent | attrib_mask_bitangent;
+        ClearAttribs(mesh.attrib);
+        SetAttrib(mesh.attrib[attrib_position], offsetof(FloatVertex, position), 0, 3, attrib_format_float);
+        SetAttrib(mesh.attrib[attrib_texcoord0], offsetof(FloatVertex, texcoord0), 0, 2, attrib_format_float);
+        SetAttrib(mesh.attrib[attrib_normal], offsetof(FloatVertex, normal), 0, 3, attrib_format_float);
+        SetAttrib(mesh.attrib[attrib_tangent], offsetof(FloatVertex, tangent), 0, 3, attrib_format_float);
+        SetAttrib(mesh.attrib[attrib_bitangent], offsetof(FloatVertex, bitangent), 0, 3, attrib_format_float);
+        mesh.vertexStride = sizeof(FloatVertex);
+        mesh.vertexDataByteOffset = vertexOffset * sizeof(FloatVertex);
+
+        ClearAttribs(mesh.attribDepth);
+        SetAttrib(mesh.attribDepth[attrib_position], 0, 0, 3, attrib_format_float);
+        mesh.vertexStrideDepth = sizeof(XMFLOAT3);
+        mesh.vertexDataByteOffsetDepth = vertexOffsetDepth * sizeof(XMFLOAT3);
+
+        vertexOffset += mesh.vertexCount;
+        vertexOffsetDepth += mesh.vertexCountDepth;
+    }
+
+    delete [] m_pVertexData;
+    delete [] m_pVertexDataDepth;
+    m_pVertexData = (unsigned char*)vertexData;
+    m_pVertexDataDepth = (unsigned char*)vertexDataDepth;
+    m_Header.vertexDataByteSize = vertexCount * sizeof(FloatVertex);
+    m_Header.vertexDataByteSizeDepth = vertexCountDepth * sizeof(XMFLOAT3);
+    m_VertexStride = sizeof(FloatVertex);
+    m_VertexStrideDepth = sizeof(XMFLOAT3);
+}
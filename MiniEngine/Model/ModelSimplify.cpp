@@ -0,0 +1,656 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "Model.h"
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+namespace
+{
+    const uint32_t kNone = 0xFFFFFFFF;
+
+    // Weight of the planes that hold borders and seams in place, relative to the triangles' own planes
+    const float kBoundaryWeight = 10.0f;
+
+    // Coarsest error a level may reach, relative to the diagonal of the mesh's bounding box
+    const float kMaxRelativeError = 0.05f;
+
+    // A level that removes less than this share of the previous level's triangles is not worth storing
+    const float kMinReduction = 0.1f;
+
+    struct Float3
+    {
+        float x, y, z;
+    };
+
+    Float3 Sub(const Float3 &a, const Float3 &b) { Float3 r = { a.x - b.x, a.y - b.y, a.z - b.z }; return r; }
+    float Dot(const Float3 &a, const Float3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    Float3 Cross(const Float3 &a, const Float3 &b)
+    {
+        Float3 r = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+        return r;
+    }
+    Float3 Scale(const Float3 &a, float s) { Float3 r = { a.x * s, a.y * s, a.z * s }; return r; }
+    Float3 MulAdd(const Float3 &a, const Float3 &b, float s) { Float3 r = { a.x + b.x * s, a.y + b.y * s, a.z + b.z * s }; return r; }
+
+    // Squared distance from p to the closest point of triangle abc
+    float DistanceSquared(const Float3 &p, const Float3 &a, const Float3 &b, const Float3 &c)
+    {
+        const Float3 ab = Sub(b, a), ac = Sub(c, a), ap = Sub(p, a);
+        const float d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+        Float3 closest;
+        if (d1 <= 0.0f && d2 <= 0.0f)
+        {
+            closest = a;
+        }
+        else
+        {
+            const Float3 bp = Sub(p, b);
+            const float d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+            const Float3 cp = Sub(p, c);
+            const float d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+            const float va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+            if (d3 >= 0.0f && d4 <= d3)
+                closest = b;
+            else if (d6 >= 0.0f && d5 <= d6)
+                closest = c;
+            else if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+                closest = MulAdd(a, ab, d1 / (d1 - d3));
+            else if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+                closest = MulAdd(a, ac, d2 / (d2 - d6));
+            else if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+                closest = MulAdd(b, Sub(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6)));
+            else
+            {
+                const float denominator = va + vb + vc;
+                closest = MulAdd(MulAdd(a, ab, vb / denominator), ac, vc / denominator);
+            }
+        }
+        const Float3 d = Sub(p, closest);
+        return Dot(d, d);
+    }
+
+    // Sum of weighted squared distances to a set of planes, as the upper half of a symmetric 4x4 matrix, and
+    // the area of the triangles the planes came from
+    struct Quadric
+    {
+        double a00, a11, a22, a01, a02, a12;
+        double b0, b1, b2;
+        double c;
+        double area;
+    };
+
+    // The planes of borders and seams add no area, so they raise the error without diluting the triangles'
+    void AddPlane(Quadric &q, const Float3 &normal, float distance, float weight, float area)
+    {
+        const double nx = normal.x, ny = normal.y, nz = normal.z, d = distance, w = weight;
+        q.a00 += w * nx * nx; q.a11 += w * ny * ny; q.a22 += w * nz * nz;
+        q.a01 += w * nx * ny; q.a02 += w * nx * nz; q.a12 += w * ny * nz;
+        q.b0 += w * nx * d; q.b1 += w * ny * d; q.b2 += w * nz * d;
+        q.c += w * d * d;
+        q.area += area;
+    }
+
+    void AddQuadric(Quadric &q, const Quadric &other)
+    {
+        q.a00 += other.a00; q.a11 += other.a11; q.a22 += other.a22;
+        q.a01 += other.a01; q.a02 += other.a02; q.a12 += other.a12;
+        q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+        q.c += other.c;
+        q.area += other.area;
+    }
+
+    // Squared distance from p to the planes per unit of area
+    float Evaluate(const Quadric &q, const Float3 &p)
+    {
+        const double x = p.x, y = p.y, z = p.z;
+        const double r = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+            2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+            2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+        return q.area > 0.0 ? (float)(fabs(r) / q.area) : 0.0f;
+    }
+
+    // What a vertex may collapse onto.  Vertices of a seam come in pairs with the same position and collapse
+    // together along the seam, and border vertices collapse along the border, so both stay where they are
+    // on the surface and keep their texture coordinates and normals.  Anything more complicated is locked.
+    enum VertexKind
+    {
+        kManifold,
+        kBorder,
+        kSeam,
+        kLocked
+    };
+
+    // Lays out the items of each key contiguously, like PartitionMesh()'s vertex to triangle adjacency
+    struct Adjacency
+    {
+        std::vector<uint32_t> first;
+        std::vector<uint32_t> items;
+
+        template <typename KeyFn>
+        void Build(uint32_t keyCount, uint32_t itemCount, KeyFn key)
+        {
+            first.assign(keyCount + 1, 0);
+            for (uint32_t i = 0; i < itemCount; i++)
+                first[key(i) + 1]++;
+            for (uint32_t k = 0; k < keyCount; k++)
+                first[k + 1] += first[k];
+            items.resize(itemCount);
+            std::vector<uint32_t> fill(first.begin(), first.end() - 1);
+            for (uint32_t i = 0; i < itemCount; i++)
+                items[fill[key(i)]++] = i;
+        }
+    };
+
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        float cost;
+    };
+
+    // Quadric error metric edge collapse [Garland and Heckbert 1997] onto existing vertices, so a level
+    // reuses the mesh's vertex data and only needs indices of its own.  Levels are simplified one after
+    // another from the same state, so each is a coarser version of the last and every error is measured
+    // against the original mesh.
+    class Simplifier
+    {
+    public:
+        Simplifier(const uint16_t *indices, uint32_t indexCount, const std::vector<Float3> &positions);
+
+        // Collapses edges until at most targetTriangles are left or the cheapest collapse costs more than maxError
+        void Simplify(uint32_t targetTriangles, float maxError);
+
+        const std::vector<uint32_t> &GetIndices() const { return m_Indices; }
+
+        // Largest distance from a vertex of the original mesh to the triangles around the vertex it was collapsed
+        // into, which bounds its distance to the simplified surface
+        float MeasureError();
+
+    private:
+        void BuildAdjacency();
+        bool HasEdge(uint32_t a, uint32_t b) const;
+        bool HasPositionEdge(uint32_t a, uint32_t b) const;     // from any vertex at a's position to b's
+        bool IsOpen(uint32_t a, uint32_t b) const;
+        uint32_t FindSibling(uint32_t from, uint32_t to) const;
+        bool HasTriangleFlip(uint32_t from, uint32_t to, const std::vector<uint32_t> &collapseRemap) const;
+        uint32_t GetRoot(uint32_t vertex);
+
+        const std::vector<Float3> &m_Positions;
+        std::vector<uint32_t> m_Indices;
+        std::vector<uint32_t> m_Position;       // first vertex with the same position
+        std::vector<uint32_t> m_Wedge;          // next vertex with the same position, in a loop
+        std::vector<unsigned char> m_Kind;
+        std::vector<Quadric> m_Quadrics;        // by position
+        std::vector<uint32_t> m_Parent;         // vertex each vertex was collapsed into
+        std::vector<bool> m_Referenced;
+
+        Adjacency m_Edges;                      // half edges by the vertex they leave
+        Adjacency m_Triangles;                  // triangles by the positions of their corners
+    };
+
+    Simplifier::Simplifier(const uint16_t *indices, uint32_t indexCount, const std::vector<Float3> &positions)
+        : m_Positions(positions)
+    {
+        const uint32_t vertexCount = (uint32_t)positions.size();
+
+        struct PositionHash
+        {
+            size_t operator()(const Float3 &p) const
+            {
+                uint32_t bits[3];
+                memcpy(bits, &p, sizeof(bits));
+                return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+            }
+        };
+        struct PositionEqual
+        {
+            bool operator()(const Float3 &a, const Float3 &b) const { return memcmp(&a, &b, sizeof(Float3)) == 0; }
+        };
+        std::unordered_map<Float3, uint32_t, PositionHash, PositionEqual> firstByPosition;
+
+        m_Position.resize(vertexCount);
+        m_Wedge.resize(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; v++)
+        {
+            auto inserted = firstByPosition.insert(std::make_pair(positions[v], v));
+            const uint32_t first = inserted.first->second;
+            m_Position[v] = first;
+            m_Wedge[v] = v;
+            if (first != v)
+            {
+                m_Wedge[v] = m_Wedge[first];
+                m_Wedge[first] = v;
+            }
+        }
+
+        // Triangles with two corners at the same position cover nothing and only get in the way
+        m_Indices.reserve(indexCount);
+        for (uint32_t i = 0; i < indexCount; i += 3)
+        {
+            const uint32_t a = m_Position[indices[i]], b = m_Position[indices[i + 1]], c = m_Position[indices[i + 2]];
+            if (a != b && a != c && b != c)
+                m_Indices.insert(m_Indices.end(), indices + i, indices + i + 3);
+        }
+
+        m_Referenced.assign(vertexCount, false);
+        for (uint32_t index : m_Indices)
+            m_Referenced[index] = true;
+
+        m_Parent.resize(vertexCount);
+        for (uint32_t v = 0; v < vertexCount; v++)
+            m_Parent[v] = v;
+
+        BuildAdjacency();
+
+        // openIn and openOut hold the single open edge's other vertex, or the vertex itself when there are several
+        std::vector<uint32_t> openIn(vertexCount, kNone), openOut(vertexCount, kNone);
+        for (uint32_t v = 0; v < vertexCount; v++)
+        {
+            for (uint32_t e = m_Edges.first[v]; e < m_Edges.first[v + 1]; e++)
+            {
+                const uint32_t corner = m_Edges.items[e];
+                const uint32_t target = m_Indices[corner % 3 == 2 ? corner - 2 : corner + 1];
+                if (IsOpen(v, target))
+                {
+                    openIn[target] = openIn[target] == kNone ? v : target;
+                    openOut[v] = openOut[v] == kNone ? target : v;
+                }
+            }
+        }
+
+        m_Kind.assign(vertexCount, kLocked);
+        for (uint32_t v = 0; v < vertexCount; v++)
+        {
+            if (m_Position[v] != v)
+                continue;
+
+            const uint32_t w = m_Wedge[v];
+            if (w == v)
+            {
+                if (openIn[v] == kNone && openOut[v] == kNone)
+                    m_Kind[v] = kManifold;
+                else if (openIn[v] != kNone && openIn[v] != v && openOut[v] != kNone && openOut[v] != v)
+                    m_Kind[v] = kBorder;
+            }
+            else if (m_Wedge[w] == v)
+            {
+                // Each side of a seam is a border in index space that runs the opposite way to the other side
+                const uint32_t inV = openIn[v], outV = openOut[v], inW = openIn[w], outW = openOut[w];
+                if (inV != kNone && inV != v && outV != kNone && outV != v &&
+                    inW != kNone && inW != w && outW != kNone && outW != w &&
+                    m_Position[inV] == m_Position[outW] && m_Position[outV] == m_Position[inW] &&
+                    m_Position[inV] != m_Position[outV])
+                {
+                    m_Kind[v] = kSeam;
+                }
+            }
+        }
+        for (uint32_t v = 0; v < vertexCount; v++)
+            m_Kind[v] = m_Kind[m_Position[v]];
+
+        Quadric zero = {};
+        m_Quadrics.assign(vertexCount, zero);
+        for (uint32_t i = 0; i < m_Indices.size(); i += 3)
+        {
+            const Float3 &p0 = positions[m_Indices[i]];
+            const Float3 &p1 = positions[m_Indices[i + 1]];
+            const Float3 &p2 = positions[m_Indices[i + 2]];
+            Float3 normal = Cross(Sub(p1, p0), Sub(p2, p0));
+            const float length = sqrtf(Dot(normal, normal));
+            if (length == 0.0f)
+                continue;
+            normal = Scale(normal, 1.0f / length);
+            for (uint32_t k = 0; k < 3; k++)
+                AddPlane(m_Quadrics[m_Position[m_Indices[i + k]]], normal, -Dot(normal, p0), length * 0.5f, length * 0.5f);
+
+            // Planes through open edges, at right angles to the triangle, keep borders and seams from moving
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                const uint32_t a = m_Indices[i + k], b = m_Indices[i + (k + 1) % 3];
+                if ((m_Kind[a] != kBorder && m_Kind[a] != kSeam && m_Kind[b] != kBorder && m_Kind[b] != kSeam) || !IsOpen(a, b))
+                    continue;
+
+                const Float3 edge = Sub(positions[b], positions[a]);
+                Float3 edgeNormal = Cross(edge, normal);
+                const float edgeLength = sqrtf(Dot(edgeNormal, edgeNormal));
+                if (edgeLength == 0.0f)
+                    continue;
+                edgeNormal = Scale(edgeNormal, 1.0f / edgeLength);
+                const float distance = -Dot(edgeNormal, positions[a]);
+                const float weight = Dot(edge, edge) * kBoundaryWeight;
+                AddPlane(m_Quadrics[m_Position[a]], edgeNormal, distance, weight, 0.0f);
+                AddPlane(m_Quadrics[m_Position[b]], edgeNormal, distance, weight, 0.0f);
+            }
+        }
+    }
+
+    void Simplifier::BuildAdjacency()
+    {
+        const uint32_t vertexCount = (uint32_t)m_Positions.size();
+        const uint32_t indexCount = (uint32_t)m_Indices.size();
+        m_Edges.Build(vertexCount, indexCount, [&](uint32_t corner) { return m_Indices[corner]; });
+        m_Triangles.Build(vertexCount, indexCount, [&](uint32_t corner) { return m_Position[m_Indices[corner]]; });
+        for (uint32_t &corner : m_Triangles.items)
+            corner /= 3;
+    }
+
+    // An open half edge has no twin going the other way.  An edge that only lacks a twin in index space is a
+    // seam when both its ends have other vertices at the same position, and otherwise just meets split
+    // vertices, like the many at the pole of a sphere, so it is not open.
+    bool Simplifier::IsOpen(uint32_t a, uint32_t b) const
+    {
+        if (HasEdge(b, a))
+            return false;
+        return (m_Wedge[a] != a && m_Wedge[b] != b) || !HasPositionEdge(b, a);
+    }
+
+    bool Simplifier::HasPositionEdge(uint32_t a, uint32_t b) const
+    {
+        uint32_t wedge = a;
+        do
+        {
+            for (uint32_t e = m_Edges.first[wedge]; e < m_Edges.first[wedge + 1]; e++)
+            {
+                const uint32_t corner = m_Edges.items[e];
+                if (m_Position[m_Indices[corner % 3 == 2 ? corner - 2 : corner + 1]] == m_Position[b])
+                    return true;
+            }
+            wedge = m_Wedge[wedge];
+        }
+        while (wedge != a);
+        return false;
+    }
+
+    bool Simplifier::HasEdge(uint32_t a, uint32_t b) const
+    {
+        for (uint32_t e = m_Edges.first[a]; e < m_Edges.first[a + 1]; e++)
+        {
+            const uint32_t corner = m_Edges.items[e];
+            if (m_Indices[corner % 3 == 2 ? corner - 2 : corner + 1] == b)
+                return true;
+        }
+        return false;
+    }
+
+    // The vertex on the other side of the seam that goes with collapsing from onto to
+    uint32_t Simplifier::FindSibling(uint32_t from, uint32_t to) const
+    {
+        const uint32_t sibling = m_Wedge[from];
+        for (uint32_t candidate = m_Wedge[to]; candidate != to; candidate = m_Wedge[candidate])
+        {
+            if (HasEdge(sibling, candidate) || HasEdge(candidate, sibling))
+                return candidate;
+        }
+        return kNone;
+    }
+
+    bool Simplifier::HasTriangleFlip(uint32_t from, uint32_t to, const std::vector<uint32_t> &collapseRemap) const
+    {
+        const uint32_t fromPosition = m_Position[from], toPosition = m_Position[to];
+        const Float3 &target = m_Positions[to];
+
+        for (uint32_t t = m_Triangles.first[fromPosition]; t < m_Triangles.first[fromPosition + 1]; t++)
+        {
+            const uint32_t triangle = m_Triangles.items[t];
+            uint32_t corners[3];
+            uint32_t moving = kNone;
+            bool degenerate = false;
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                corners[k] = collapseRemap[m_Indices[triangle * 3 + k]];
+                if (m_Position[corners[k]] == fromPosition)
+                    moving = k;
+                degenerate |= m_Position[corners[k]] == toPosition;
+            }
+            if (degenerate || moving == kNone || m_Position[corners[0]] == m_Position[corners[1]] ||
+                m_Position[corners[0]] == m_Position[corners[2]] || m_Position[corners[1]] == m_Position[corners[2]])
+            {
+                continue;
+            }
+
+            const Float3 &p0 = m_Positions[corners[0]], &p1 = m_Positions[corners[1]], &p2 = m_Positions[corners[2]];
+            const Float3 before = Cross(Sub(p1, p0), Sub(p2, p0));
+            const Float3 &q0 = moving == 0 ? target : p0, &q1 = moving == 1 ? target : p1, &q2 = moving == 2 ? target : p2;
+            const Float3 after = Cross(Sub(q1, q0), Sub(q2, q0));
+            if (Dot(before, after) <= 0.0f)
+                return true;
+        }
+        return false;
+    }
+
+    uint32_t Simplifier::GetRoot(uint32_t vertex)
+    {
+        uint32_t root = vertex;
+        while (m_Parent[root] != root)
+            root = m_Parent[root];
+        while (m_Parent[vertex] != root)
+        {
+            const uint32_t next = m_Parent[vertex];
+            m_Parent[vertex] = root;
+            vertex = next;
+        }
+        return root;
+    }
+
+    void Simplifier::Simplify(uint32_t targetTriangles, float maxError)
+    {
+        const uint32_t vertexCount = (uint32_t)m_Positions.size();
+        const float maxCost = maxError * maxError;
+        std::vector<Collapse> collapses;
+        std::vector<uint32_t> collapseRemap(vertexCount);
+        std::vector<bool> collapseLocked(vertexCount);
+
+        while (m_Indices.size() / 3 > targetTriangles)
+        {
+            // Each edge collapses the cheaper way round it may
+            collapses.clear();
+            for (uint32_t i = 0; i < m_Indices.size(); i++)
+            {
+                const uint32_t a = m_Indices[i], b = m_Indices[i % 3 == 2 ? i - 2 : i + 1];
+                const bool open = IsOpen(a, b);
+                if ((!open && a > b) || m_Position[a] == m_Position[b])
+                    continue;
+
+                Collapse best = { kNone, kNone, FLT_MAX };
+                const uint32_t ends[2][2] = { { a, b }, { b, a } };
+                for (const auto &end : ends)
+                {
+                    const uint32_t from = end[0], to = end[1];
+                    const unsigned char fromKind = m_Kind[from], toKind = m_Kind[to];
+                    const bool allowed =
+                        fromKind == kManifold ||
+                        (fromKind == kBorder && open && (toKind == kBorder || toKind == kLocked)) ||
+                        (fromKind == kSeam && open && (toKind == kSeam || toKind == kLocked) && FindSibling(from, to) != kNone);
+                    if (!allowed)
+                        continue;
+
+                    const float cost = Evaluate(m_Quadrics[m_Position[from]], m_Positions[to]);
+                    if (cost < best.cost)
+                    {
+                        best.from = from;
+                        best.to = to;
+                        best.cost = cost;
+                    }
+                }
+                if (best.from != kNone && best.cost <= maxCost)
+                    collapses.push_back(best);
+            }
+
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &x, const Collapse &y)
+            {
+                if (x.cost != y.cost)
+                    return x.cost < y.cost;
+                return x.from != y.from ? x.from < y.from : x.to < y.to;
+            });
+
+            // A vertex moves at most once per pass, so the flip tests see every earlier collapse of the pass
+            for (uint32_t v = 0; v < vertexCount; v++)
+                collapseRemap[v] = v;
+            std::fill(collapseLocked.begin(), collapseLocked.end(), false);
+
+            // An edge collapse removes about two triangles.  Collapses much dearer than the cheapest ones that
+            // could reach the target wait for a later pass, where cheaper ones may have come up around them,
+            // unless none of the cheap ones could be made.
+            const uint32_t triangleCount = (uint32_t)m_Indices.size() / 3;
+            if (collapses.empty())
+                break;
+            const size_t goal = std::min<size_t>((triangleCount - targetTriangles) / 2, collapses.size() - 1);
+            const float passCost = collapses[goal].cost * 1.5f;
+            uint32_t removed = 0;
+            uint32_t performed = 0;
+            for (const Collapse &collapse : collapses)
+            {
+                if (removed >= triangleCount - targetTriangles || (collapse.cost > passCost && performed > 0))
+                    break;
+
+                const uint32_t fromPosition = m_Position[collapse.from], toPosition = m_Position[collapse.to];
+                if (collapseLocked[fromPosition] || collapseLocked[toPosition])
+                    continue;
+                if (HasTriangleFlip(collapse.from, collapse.to, collapseRemap))
+                    continue;
+
+                collapseRemap[collapse.from] = collapse.to;
+                m_Parent[collapse.from] = collapse.to;
+                if (m_Kind[collapse.from] == kSeam)
+                {
+                    const uint32_t sibling = m_Wedge[collapse.from];
+                    const uint32_t siblingTarget = FindSibling(collapse.from, collapse.to);
+                    collapseRemap[sibling] = siblingTarget;
+                    m_Parent[sibling] = siblingTarget;
+                }
+                AddQuadric(m_Quadrics[toPosition], m_Quadrics[fromPosition]);
+                collapseLocked[fromPosition] = true;
+                collapseLocked[toPosition] = true;
+
+                for (uint32_t t = m_Triangles.first[fromPosition]; t < m_Triangles.first[fromPosition + 1]; t++)
+                {
+                    const uint32_t triangle = m_Triangles.items[t];
+                    for (uint32_t k = 0; k < 3; k++)
+                        removed += m_Position[m_Indices[triangle * 3 + k]] == toPosition;
+                }
+                performed++;
+            }
+
+            if (performed == 0)
+                break;
+
+            uint32_t kept = 0;
+            for (uint32_t i = 0; i < m_Indices.size(); i += 3)
+            {
+                const uint32_t a = collapseRemap[m_Indices[i]], b = collapseRemap[m_Indices[i + 1]], c = collapseRemap[m_Indices[i + 2]];
+                if (m_Position[a] == m_Position[b] || m_Position[a] == m_Position[c] || m_Position[b] == m_Position[c])
+                    continue;
+                m_Indices[kept++] = a;
+                m_Indices[kept++] = b;
+                m_Indices[kept++] = c;
+            }
+            m_Indices.resize(kept);
+            BuildAdjacency();
+        }
+    }
+
+    float Simplifier::MeasureError()
+    {
+        float maxDistanceSquared = 0.0f;
+        for (uint32_t v = 0; v < m_Positions.size(); v++)
+        {
+            if (!m_Referenced[v])
+                continue;
+
+            const uint32_t root = GetRoot(v);
+            const uint32_t rootPosition = m_Position[root];
+            const Float3 &p = m_Positions[v];
+            const Float3 offset = Sub(p, m_Positions[root]);
+            float distanceSquared = Dot(offset, offset);
+            for (uint32_t t = m_Triangles.first[rootPosition]; t < m_Triangles.first[rootPosition + 1]; t++)
+            {
+                const uint32_t triangle = m_Triangles.items[t];
+                distanceSquared = std::min(distanceSquared, DistanceSquared(p, m_Positions[m_Indices[triangle * 3]],
+                    m_Positions[m_Indices[triangle * 3 + 1]], m_Positions[m_Indices[triangle * 3 + 2]]));
+            }
+            maxDistanceSquared = std::max(maxDistanceSquared, distanceSquared);
+        }
+        return sqrtf(maxDistanceSquared);
+    }
+}
+
+void Model::BuildLods()
+{
+    ASSERT(m_pVertexData != nullptr && m_pIndexData != nullptr, "LODs need the CPU geometry");
+
+    std::vector<LodLevel> lods(m_Header.meshCount * maxLods);
+    std::vector<uint16_t> lodIndices;
+    std::vector<Float3> positions;
+
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        const Mesh &mesh = m_pMesh[meshIndex];
+
+        Float3 boxMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+        Float3 boxMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        positions.resize(mesh.vertexCount);
+        for (uint32_t i = 0; i < mesh.vertexCount; i++)
+        {
+            FloatVertex vertex;
+            DecodeVertex(mesh, i, vertex);
+            positions[i].x = vertex.position.x;
+            positions[i].y = vertex.position.y;
+            positions[i].z = vertex.position.z;
+            boxMin.x = std::min(boxMin.x, positions[i].x); boxMax.x = std::max(boxMax.x, positions[i].x);
+            boxMin.y = std::min(boxMin.y, positions[i].y); boxMax.y = std::max(boxMax.y, positions[i].y);
+            boxMin.z = std::min(boxMin.z, positions[i].z); boxMax.z = std::max(boxMax.z, positions[i].z);
+        }
+        const Float3 diagonal = Sub(boxMax, boxMin);
+        const float maxError = mesh.vertexCount > 0 ? sqrtf(Dot(diagonal, diagonal)) * kMaxRelativeError : 0.0f;
+
+        LodLevel *meshLods = &lods[meshIndex * maxLods];
+        meshLods[0].indexDataByteOffset = mesh.indexDataByteOffset;
+        meshLods[0].indexCount = mesh.indexCount;
+        meshLods[0].error = 0.0f;
+
+        Simplifier simplifier((const uint16_t*)(m_pIndexData + mesh.indexDataByteOffset), mesh.indexCount, positions);
+        for (uint32_t level = 1; level < maxLods; level++)
+        {
+            const LodLevel &previous = meshLods[level - 1];
+            simplifier.Simplify((mesh.indexCount / 3) >> level, maxError);
+
+            const std::vector<uint32_t> &indices = simplifier.GetIndices();
+            if (indices.empty() || indices.size() > previous.indexCount * (1.0f - kMinReduction))
+            {
+                meshLods[level] = previous;
+                continue;
+            }
+
+            meshLods[level].indexDataByteOffset = m_Header.indexDataByteSize + (uint32_t)(lodIndices.size() * sizeof(uint16_t));
+            meshLods[level].indexCount = (uint32_t)indices.size();
+            meshLods[level].error = std::max(previous.error, simplifier.MeasureError());
+            for (uint32_t index : indices)
+                lodIndices.push_back((uint16_t)index);
+        }
+    }
+
+    // The levels' indices follow the meshes' own, so one index buffer holds every level
+    m_LodIndexDataByteSize = (uint32_t)(lodIndices.size() * sizeof(uint16_t));
+    unsigned char *indexData = new unsigned char[m_Header.indexDataByteSize + m_LodIndexDataByteSize];
+    memcpy(indexData, m_pIndexData, m_Header.indexDataByteSize);
+    if (m_LodIndexDataByteSize > 0)
+        memcpy(indexData + m_Header.indexDataByteSize, lodIndices.data(), m_LodIndexDataByteSize);
+    delete [] m_pIndexData;
+    m_pIndexData = indexData;
+
+    delete [] m_pLod;
+    m_LodCount = maxLods;
+    m_pLod = new LodLevel[lods.size()];
+    memcpy(m_pLod, lods.data(), lods.size() * sizeof(LodLevel));
+}
@@ -17,6 +17,8 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <math.h>
+
 const char* AssimpModel::s_FormatString[] =
 {
     "none",
@@ -404,3 +406,104 @@ bool AssimpModel::LoadAssimp(const char *filename)
 
     return true;
 }
+
+void AssimpModel::GenerateTestModel()
+{
+    Clear();
+
+    // the header is written out whole, padding included, so the files of two conversions can be compared
+    memset(&m_Header, 0, sizeof(m_Header));
+
+    const unsigned int meshCount = 3;
+    const unsigned int gridSize = 16; // quads along each side, enough triangles for several meshlets
+    const unsigned int quadCount = gridSize * gridSize;
+
+    m_Header.materialCount = 1;
+    m_pMaterial = new Material [m_Header.materialCount];
+    memset(m_pMaterial, 0, sizeof(Material) * m_Header.materialCount);
+
+    m_Header.meshCount = meshCount;
+    m_pMesh = new Mesh [m_Header.meshCount];
+    memset(m_pMesh, 0, sizeof(Mesh) * m_Header.meshCount);
+
+    const unsigned int attribs[] = { attrib_position, attrib_texcoord0, attrib_normal, attrib_tangent, attrib_bitangent };
+    const unsigned int components[] = { 3, 2, 3, 3, 3 };
+    for (unsigned int meshIndex = 0; meshIndex < meshCount; meshIndex++)
+    {
+        Mesh *mesh = m_pMesh + meshIndex;
+
+        for (unsigned int n = 0; n < _countof(attribs); n++)
+        {
+            mesh->attribsEnabled |= 1 << attribs[n];
+            mesh->attrib[attribs[n]].offset = mesh->vertexStride;
+            mesh->attrib[attribs[n]].components = components[n];
+            mesh->attrib[attribs[n]].format = attrib_format_float;
+            mesh->vertexStride += sizeof(float) * components[n];
+        }
+
+        mesh->attribsEnabledDepth |= attrib_mask_position;
+        mesh->attribDepth[attrib_position].components = 3;
+        mesh->attribDepth[attrib_position].format = attrib_format_float;
+        mesh->vertexStrideDepth += sizeof(float) * 3;
+
+        // four vertices of its own for each quad, which leaves duplicates to remove
+        mesh->vertexDataByteOffset = m_Header.vertexDataByteSize;
+        mesh->vertexCount = quadCount * 4;
+        mesh->indexDataByteOffset = m_Header.indexDataByteSize;
+        mesh->indexCount = quadCount * 6;
+        mesh->vertexDataByteOffsetDepth = m_Header.vertexDataByteSizeDepth;
+        mesh->vertexCountDepth = mesh->vertexCount;
+
+        m_Header.vertexDataByteSize += mesh->vertexStride * mesh->vertexCount;
+        m_Header.indexDataByteSize += sizeof(uint16_t) * mesh->indexCount;
+        m_Header.vertexDataByteSizeDepth += mesh->vertexStrideDepth * mesh->vertexCountDepth;
+    }
+
+    m_pVertexData = new unsigned char [m_Header.vertexDataByteSize];
+    m_pIndexData = new unsigned char [m_Header.indexDataByteSize];
+    m_pVertexDataDepth = new unsigned char [m_Header.vertexDataByteSizeDepth];
+    m_pIndexDataDepth = new unsigned char [m_Header.indexDataByteSize];
+
+    for (unsigned int meshIndex = 0; meshIndex < meshCount; meshIndex++)
+    {
+        const Mesh *mesh = m_pMesh + meshIndex;
+        float *dstVertex = (float*)(m_pVertexData + mesh->vertexDataByteOffset);
+        float *dstVertexDepth = (float*)(m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth);
+        uint16_t *dstIndex = (uint16_t*)(m_pIndexData + mesh->indexDataByteOffset);
+        uint16_t *dstIndexDepth = (uint16_t*)(m_pIndexDataDepth + mesh->indexDataByteOffset);
+
+        for (unsigned int quad = 0; quad < quadCount; quad++)
+        {
+            for (unsigned int corner = 0; corner < 4; corner++)
+            {
+                // side by side, and wavy so that simplifying them has some error
+                const float x = (float)(quad % gridSize + (corner & 1));
+                const float z = (float)(quad / gridSize + (corner >> 1));
+                const float y = 0.5f * sinf(0.7f * x + (float)meshIndex) * cosf(0.4f * z);
+                const float vertex[] =
+                {
+                    x + (float)(meshIndex * gridSize), y, z,    // position
+                    x / gridSize, z / gridSize,                 // texcoord0
+                    0.0f, 1.0f, 0.0f,                           // normal
+                    1.0f, 0.0f, 0.0f,                           // tangent
+                    0.0f, 0.0f, 1.0f,                           // bitangent
+                };
+                memcpy(dstVertex, vertex, sizeof(vertex));
+                memcpy(dstVertexDepth, vertex, sizeof(float) * 3);
+                dstVertex += _countof(vertex);
+                dstVertexDepth += 3;
+            }
+
+            const uint16_t first = (uint16_t)(quad * 4);
+            const uint16_t indices[] = { first, (uint16_t)(first + 2), (uint16_t)(first + 1),
+                (uint16_t)(first + 1), (uint16_t)(first + 2), (uint16_t)(first + 3) };
+            memcpy(dstIndex, indices, sizeof(indices));
+            memcpy(dstIndexDepth, indices, sizeof(indices));
+            dstIndex += _countof(indices);
+            dstIndexDepth += _countof(indices);
+        }
+    }
+
+    ComputeAllBoundingBoxes();
+    Optimize();
+}
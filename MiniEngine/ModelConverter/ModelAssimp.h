@@ -30,11 +30,28 @@ public:
     virtual bool Load(const char* filename) override;
     bool Save(const char* filename) const;
 
+    // Optimizes on a single thread, to check that the parallel passes give the same file
+    void SetSerial(bool serial) { m_Serial = serial; }
+
+    // Splits meshes whose bounds have a longer diagonal or that have more triangles than this into pieces of
+    // the same material, 0 for no limit
+    void SetSplitLimits(float maxDiagonal, uint32_t maxTriangles) { m_SplitMaxDiagonal = maxDiagonal; m_SplitMaxTriangles = maxTriangles; }
+
+    // Builds a few grid meshes in place of Load(), laid out as LoadAssimp() does, and optimizes them the same
+    // way, for the self test to convert without a model on disk
+    void GenerateTestModel();
+
 private:
 
+    bool m_Serial = false;
+    float m_SplitMaxDiagonal = 0.0f;
+    uint32_t m_SplitMaxTriangles = 0;
+
     bool LoadAssimp(const char *filename);
 
     void Optimize();
+    void OptimizeSplitMeshes();
+    void PrintMeshBounds(const char *title) const;
     void OptimizeRemoveDuplicateVertices(bool depth);
     void OptimizePostTransform(bool depth);
     void OptimizePreTransform(bool depth);
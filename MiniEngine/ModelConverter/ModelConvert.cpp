@@ -12,15 +12,241 @@
 //
 
 #include "ModelAssimp.h"
+#include "ChunkedFile.h"
+#include "SceneArchive.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
 
 void PrintHelp()
 {
     printf("model_convert\n");
 
     printf("usage:\n");
-    printf("model_convert input_file output_file\n");
+    printf("model_convert input_file output_file [-split max_diagonal max_triangles] [-verify]\n");
+    printf("-split cuts meshes larger than either limit into pieces, 0 for no limit\n");
+    printf("-verify converts a second time on one thread and checks that both files hash the same\n");
+    printf("model_convert -pack input_file output_file [zlib|lz]\n");
+    printf("-pack compresses any file into 256 KB blocks that inflate in parallel, zlib by default\n");
+    printf("name the output input_file.chunked for the engine to read it in place of input_file\n");
+    printf("model_convert -scene model_file texture_folder output_file\n");
+    printf("-scene packs an h3d model and every texture it may load into one archive\n");
+    printf("name the output after the model with a .scene extension for the engine to load from it\n");
+    printf("model_convert -selftest\n");
+    printf("-selftest checks that a generated model converts the same in parallel and on one thread, and the packed formats\n");
+}
+
+// Packs an H3D model and every texture Model::LoadTextures() may try into a scene archive, see SceneArchive.h
+int PackScene(const char *model_file, const char *texture_folder, const char *output_file)
+{
+    FILE *file = nullptr;
+    if (0 != fopen_s(&file, model_file, "rb"))
+    {
+        printf("failed to open: %s\n", model_file);
+        return -1;
+    }
+
+    // Only the materials are needed, after the header and the meshes
+    Model::Header header;
+    std::vector<Model::Material> materials;
+    bool ok = 1 == fread(&header, sizeof(header), 1, file) &&
+        0 == _fseeki64(file, (int64_t)sizeof(Model::Mesh) * header.meshCount, SEEK_CUR);
+    if (ok && header.materialCount > 0)
+    {
+        materials.resize(header.materialCount);
+        ok = 1 == fread(materials.data(), sizeof(Model::Material) * header.materialCount, 1, file);
+    }
+    fclose(file);
+    if (!ok)
+    {
+        printf("failed to read the materials of: %s\n", model_file);
+        return -1;
+    }
+
+    std::wstring textureFolder = MakeWStr(texture_folder);
+    if (!textureFolder.empty() && textureFolder.back() != L'/' && textureFolder.back() != L'\\')
+        textureFolder += L'/';
+
+    // Every name the engine may look for, including the ones it falls back to.  Those that do not exist
+    // are left out of the archive, and the engine then knows they are missing without asking the disk.
+    std::vector<std::wstring> files(1, MakeWStr(model_file));
+    for (const Model::Material &material : materials)
+    {
+        std::string names[3][3];
+        Model::GetTextureNames(material, names);
+        for (const std::string (&textureNames)[3] : names)
+        {
+            for (const std::string &name : textureNames)
+            {
+                files.push_back(textureFolder + MakeWStr(name) + L".dds");
+                files.push_back(textureFolder + MakeWStr(name) + L".tga");
+            }
+        }
+    }
+
+    if (!SceneArchive::Write(MakeWStr(output_file), files))
+    {
+        printf("failed to write: %s\n", output_file);
+        return -1;
+    }
+
+    printf("packed %s and its textures into %s\n", model_file, output_file);
+    return 0;
+}
+
+// Packs any file into a chunked file, see ChunkedFile.h
+int PackFile(const char *input_file, const char *output_file, ChunkedFile::Codec codec)
+{
+    FILE *file = nullptr;
+    if (0 != fopen_s(&file, input_file, "rb"))
+    {
+        printf("failed to open: %s\n", input_file);
+        return -1;
+    }
+    _fseeki64(file, 0, SEEK_END);
+    std::vector<uint8_t> data((size_t)_ftelli64(file));
+    _fseeki64(file, 0, SEEK_SET);
+    const size_t readSize = fread(data.data(), 1, data.size(), file);
+    fclose(file);
+    if (readSize != data.size())
+    {
+        printf("failed to read: %s\n", input_file);
+        return -1;
+    }
+
+    const std::vector<uint8_t> packed = ChunkedFile::Pack(data.data(), data.size(), codec);
+
+    std::vector<uint8_t> unpacked;
+    if (!ChunkedFile::Unpack(packed.data(), packed.size(), unpacked) || unpacked != data)
+    {
+        printf("packed file does not unpack to the input\n");
+        return -1;
+    }
+
+    if (0 != fopen_s(&file, output_file, "wb"))
+    {
+        printf("failed to open: %s\n", output_file);
+        return -1;
+    }
+    const size_t writeSize = fwrite(packed.data(), 1, packed.size(), file);
+    fclose(file);
+    if (writeSize != packed.size())
+    {
+        printf("failed to write: %s\n", output_file);
+        return -1;
+    }
+
+    printf("packed %zu bytes into %zu\n", data.size(), packed.size());
+    return 0;
+}
+
+// FNV-1a of a whole file, 0 when it cannot be read
+uint64_t HashFile(const char *filename)
+{
+    FILE *file = nullptr;
+    if (0 != fopen_s(&file, filename, "rb"))
+        return 0;
+
+    uint64_t hash = 14695981039346656037ull;
+    unsigned char buffer[64 * 1024];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        for (size_t n = 0; n < count; n++)
+        {
+            hash ^= buffer[n];
+            hash *= 1099511628211ull;
+        }
+    }
+    fclose(file);
+    return hash;
+}
+
+bool VerifySerialConversion(const char *input_file, const char *output_file, float splitMaxDiagonal, uint32_t splitMaxTriangles)
+{
+    // next to the output, with the extension Save() expects
+    std::string serial_file = output_file;
+    const size_t extension = serial_file.find_last_of('.');
+    serial_file.insert(extension == std::string::npos ? serial_file.size() : extension, "_serial");
+
+    printf("verifying against a serial conversion in %s...\n", serial_file.c_str());
+    AssimpModel model;
+    model.SetSerial(true);
+    model.SetSplitLimits(splitMaxDiagonal, splitMaxTriangles);
+    if (!model.Load(input_file) || !model.Save(serial_file.c_str()))
+    {
+        printf("failed to convert serially: %s\n", input_file);
+        return false;
+    }
+
+    const uint64_t parallelHash = HashFile(output_file);
+    const uint64_t serialHash = HashFile(serial_file.c_str());
+    printf("output hash %016llx, serial hash %016llx\n", parallelHash, serialHash);
+    remove(serial_file.c_str());
+
+    if (parallelHash == 0 || parallelHash != serialHash)
+    {
+        printf("parallel and serial conversions differ\n");
+        return false;
+    }
+    return true;
+}
+
+// -verify without a model on disk, on one that AssimpModel generates
+bool TestSerialConversion()
+{
+    char temp_path[MAX_PATH];
+    GetTempPathA(MAX_PATH, temp_path);
+    const std::string parallel_file = std::string(temp_path) + "ModelConvertSelfTest.h3d";
+    const std::string serial_file = std::string(temp_path) + "ModelConvertSelfTest_serial.h3d";
+
+    bool saved = true;
+    for (int serial = 0; serial < 2; serial++)
+    {
+        AssimpModel model;
+        model.SetSerial(serial != 0);
+        model.GenerateTestModel();
+        saved = model.Save(serial ? serial_file.c_str() : parallel_file.c_str()) && saved;
+    }
+
+    const uint64_t parallelHash = HashFile(parallel_file.c_str());
+    const uint64_t serialHash = HashFile(serial_file.c_str());
+    printf("output hash %016llx, serial hash %016llx\n", parallelHash, serialHash);
+    remove(parallel_file.c_str());
+    remove(serial_file.c_str());
+
+    return saved && parallelHash != 0 && parallelHash == serialHash;
+}
+
+struct SelfTest
+{
+    const char *name;
+    bool (*run)(void);
+};
+
+const SelfTest kSelfTests[] =
+{
+    { "Serial and parallel conversion", TestSerialConversion },
+    { "Chunked file packing", ChunkedFile::RunSelfTest },
+    { "Scene archive lookup", SceneArchive::RunSelfTest },
+};
+
+int RunSelfTests()
+{
+    const uint32_t testCount = _countof(kSelfTests);
+    uint32_t failedCount = 0;
+    for (const SelfTest &test : kSelfTests)
+    {
+        const bool passed = test.run();
+        printf("%s:  %s\n", test.name, passed ? "passed" : "FAILED");
+        failedCount += passed ? 0 : 1;
+    }
+
+    printf("%u of %u self tests passed\n", testCount - failedCount, testCount);
+    return failedCount == 0 ? 0 : -1;
 }
 
 void PrintModelStats(const Model *model)
@@ -65,6 +291,10 @@ void PrintModelStats(const Model *model)
             case Model::attrib_format_float:
                 printf("float");
                 break;
+
+            case Model::attrib_format_half:
+                printf("half");
+                break;
             }
         };
 
@@ -94,7 +324,7 @@ void PrintModelStats(const Model *model)
             printf("attrib %d: offset %u, normalized %u, components %u, format "
                 , n, mesh->attribDepth[n].offset, mesh->attribDepth[n].normalized
                 , mesh->attribDepth[n].components);
-            printAttribFormat(mesh->attrib[n].format);
+            printAttribFormat(mesh->attribDepth[n].format);
             printf("\n");
         }
     }
@@ -112,12 +342,56 @@ void PrintModelStats(const Model *model)
 
 int main(int argc, char **argv)
 {
-    if (argc != 3)
+    if (argc == 2 && 0 == strcmp(argv[1], "-selftest"))
+        return RunSelfTests();
+
+    if (argc < 3)
     {
         PrintHelp();
         return -1;
     }
 
+    if (0 == strcmp(argv[1], "-scene"))
+    {
+        if (argc != 5)
+        {
+            PrintHelp();
+            return -1;
+        }
+        return PackScene(argv[2], argv[3], argv[4]);
+    }
+
+    if (0 == strcmp(argv[1], "-pack"))
+    {
+        if (argc < 4 || argc > 5 || (argc == 5 && 0 != strcmp(argv[4], "zlib") && 0 != strcmp(argv[4], "lz")))
+        {
+            PrintHelp();
+            return -1;
+        }
+        return PackFile(argv[2], argv[3], argc == 5 && 0 == strcmp(argv[4], "lz") ? ChunkedFile::kLZ : ChunkedFile::kZlib);
+    }
+
+    bool verify = false;
+    float splitMaxDiagonal = 0.0f;
+    uint32_t splitMaxTriangles = 0;
+    for (int arg = 3; arg < argc; arg++)
+    {
+        if (0 == strcmp(argv[arg], "-verify"))
+        {
+            verify = true;
+        }
+        else if (0 == strcmp(argv[arg], "-split") && arg + 2 < argc)
+        {
+            splitMaxDiagonal = (float)atof(argv[++arg]);
+            splitMaxTriangles = (uint32_t)atoi(argv[++arg]);
+        }
+        else
+        {
+            PrintHelp();
+            return -1;
+        }
+    }
+
     const char *input_file = argv[1];
     const char *output_file = argv[2];
 
@@ -125,6 +399,7 @@ int main(int argc, char **argv)
     printf("output file %s\n", output_file);
 
     AssimpModel model;
+    model.SetSplitLimits(splitMaxDiagonal, splitMaxTriangles);
 
     printf("loading...\n");
     if (!model.Load(input_file))
@@ -140,6 +415,9 @@ int main(int argc, char **argv)
         return -1;
     }
 
+    if (verify && !VerifySerialConversion(input_file, output_file, splitMaxDiagonal, splitMaxTriangles))
+        return -1;
+
     printf("done\n");
 
     PrintModelStats(&model);
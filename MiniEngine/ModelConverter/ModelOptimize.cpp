@@ -15,19 +15,55 @@
 #include "IndexOptimizePostTransform.h"
 
 #include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <ppl.h>
+
+// Every pass below only touches the vertex and index data of the mesh it works on, so meshes run on the
+// concurrency runtime's threads, and the main and depth-only streams side by side.  Anything that depends
+// on the meshes before it is done in mesh order afterwards, which keeps the output byte for byte the same as
+// a serial run.
+template <typename Work>
+static void ForEachMesh(unsigned int meshCount, bool serial, Work work)
+{
+    if (serial)
+    {
+        for (unsigned int meshIndex = 0; meshIndex < meshCount; meshIndex++)
+            work(meshIndex);
+    }
+    else
+    {
+        concurrency::parallel_for(0u, meshCount, work);
+    }
+}
+
+template <typename Work>
+static void ForEachStream(bool serial, Work work)
+{
+    if (serial)
+    {
+        work(false);
+        work(true);
+    }
+    else
+    {
+        concurrency::parallel_invoke([&] { work(false); }, [&] { work(true); });
+    }
+}
 
 void AssimpModel::OptimizeRemoveDuplicateVertices(bool depth)
 {
     unsigned char *deduplicatedVertexData = new unsigned char [depth ? m_Header.vertexDataByteSizeDepth : m_Header.vertexDataByteSize];
-    uint32_t deduplicatedVertexDataSize = 0;
 
-    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    // each mesh's unique vertices go where its vertices were, there are never more of them
+    ForEachMesh(m_Header.meshCount, m_Serial, [&](unsigned int meshIndex)
     {
         Mesh *mesh = m_pMesh + meshIndex;
         unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
-        unsigned char *meshVertexData = depth ? (m_pVertexDataDepth + mesh->vertexDataByteOffsetDepth) : (m_pVertexData + mesh->vertexDataByteOffset);
+        unsigned int vertexDataByteOffset = depth ? mesh->vertexDataByteOffsetDepth : mesh->vertexDataByteOffset;
+        unsigned char *meshVertexData = (depth ? m_pVertexDataDepth : m_pVertexData) + vertexDataByteOffset;
 
-        unsigned char *meshDeduplicatedVertexData = deduplicatedVertexData + deduplicatedVertexDataSize;
+        unsigned char *meshDeduplicatedVertexData = deduplicatedVertexData + vertexDataByteOffset;
         unsigned int deduplicatedCount = 0;
 
         unsigned int vertexCount = depth ? mesh->vertexCountDepth : mesh->vertexCount;
@@ -72,16 +108,23 @@ void AssimpModel::OptimizeRemoveDuplicateVertices(bool depth)
         delete [] vertexRemap;
 
         if (depth)
-        {
             mesh->vertexCountDepth = deduplicatedCount;
-            mesh->vertexDataByteOffsetDepth = deduplicatedVertexDataSize;
-        }
         else
-        {
             mesh->vertexCount = deduplicatedCount;
-            mesh->vertexDataByteOffset = deduplicatedVertexDataSize;
-        }
-        deduplicatedVertexDataSize += deduplicatedCount * vertexStride;
+    });
+
+    // then close the gaps in mesh order, the offsets only increase so each move is towards the front
+    uint32_t deduplicatedVertexDataSize = 0;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        Mesh *mesh = m_pMesh + meshIndex;
+        unsigned int vertexStride = depth ? mesh->vertexStrideDepth : mesh->vertexStride;
+        unsigned int vertexCount = depth ? mesh->vertexCountDepth : mesh->vertexCount;
+        uint32_t &vertexDataByteOffset = depth ? mesh->vertexDataByteOffsetDepth : mesh->vertexDataByteOffset;
+
+        memmove(deduplicatedVertexData + deduplicatedVertexDataSize, deduplicatedVertexData + vertexDataByteOffset, vertexCount * vertexStride);
+        vertexDataByteOffset = deduplicatedVertexDataSize;
+        deduplicatedVertexDataSize += vertexCount * vertexStride;
     }
 
     if (depth)
@@ -102,7 +145,7 @@ void AssimpModel::OptimizePostTransform(bool depth)
 {
     enum {lruCacheSize = 64};
 
-    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    ForEachMesh(m_Header.meshCount, m_Serial, [&](unsigned int meshIndex)
     {
         Mesh *mesh = m_pMesh + meshIndex;
 
@@ -113,14 +156,14 @@ void AssimpModel::OptimizePostTransform(bool depth)
         OptimizeFaces<uint16_t>(srcIndices, mesh->indexCount, dstIndices, lruCacheSize);
 
         delete [] srcIndices;
-    }
+    });
 }
 
 void AssimpModel::OptimizePreTransform(bool depth)
 {
     unsigned char *reorderedVertexData = new unsigned char [depth ? m_Header.vertexDataByteSizeDepth : m_Header.vertexDataByteSize];
 
-    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    ForEachMesh(m_Header.meshCount, m_Serial, [&](unsigned int meshIndex)
     {
         Mesh *mesh = m_pMesh + meshIndex;
         unsigned int indexCount = mesh->indexCount;
@@ -153,7 +196,7 @@ void AssimpModel::OptimizePreTransform(bool depth)
         }
 
         delete [] vertexRemap;
-    }
+    });
 
     if (depth)
     {
@@ -169,16 +212,51 @@ void AssimpModel::OptimizePreTransform(bool depth)
 
 void AssimpModel::Optimize()
 {
-    // TODO: quantize/compress vertex data
+    // split first, the passes below work within meshes
+    if (m_SplitMaxDiagonal > 0.0f || m_SplitMaxTriangles > 0)
+        OptimizeSplitMeshes();
 
-    OptimizeRemoveDuplicateVertices(false);
-    OptimizeRemoveDuplicateVertices(true);
+    ForEachStream(m_Serial, [this](bool depth) { OptimizeRemoveDuplicateVertices(depth); });
 
     // re-order indices for post transform cache
-    OptimizePostTransform(false);
-    OptimizePostTransform(true);
+    ForEachStream(m_Serial, [this](bool depth) { OptimizePostTransform(depth); });
+
+    // split into meshlets, keeping the post transform order within each one
+    BuildMeshlets();
+    printf("%u meshlets of up to %u vertices and %u triangles\n", m_MeshletCount, maxMeshletVertices, maxMeshletTriangles);
 
     // re-order vertices for linear memory access
-    OptimizePreTransform(false);
-    OptimizePreTransform(true);
+    ForEachStream(m_Serial, [this](bool depth) { OptimizePreTransform(depth); });
+
+    // simplify once the vertices are where they stay, the levels index them
+    BuildLods();
+    for (uint32_t level = 0; level < m_LodCount; level++)
+    {
+        uint32_t triangleCount = 0;
+        float maxError = 0.0f;
+        for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+        {
+            triangleCount += GetLod(meshIndex, level).indexCount / 3;
+            maxError = std::max(maxError, GetLod(meshIndex, level).error);
+        }
+        printf("LOD %u: %u triangles, error up to %f\n", level, triangleCount, maxError);
+    }
+
+    // quantize last, the passes above expect float positions
+    const uint32_t floatByteSize = m_Header.vertexDataByteSize + m_Header.vertexDataByteSizeDepth;
+    QuantizationError *errors = new QuantizationError [m_Header.meshCount];
+    QuantizeVertexData(errors);
+
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        const QuantizationError &error = errors[meshIndex];
+        printf("mesh %u quantization error: position %f, texcoord0 %f, normal %f deg, tangent %f deg\n",
+            meshIndex, error.position, error.texcoord0, error.normalDegrees, error.tangentDegrees);
+    }
+    printf("vertex data quantized from %u to %u bytes\n", floatByteSize,
+        m_Header.vertexDataByteSize + m_Header.vertexDataByteSizeDepth);
+    delete [] errors;
+
+    // fit the meshlet bounds to the quantized positions
+    ComputeMeshletBounds();
 }
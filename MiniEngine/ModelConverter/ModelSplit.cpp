@@ -0,0 +1,345 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+
+#include "ModelAssimp.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    // A piece with fewer triangles costs more as a draw call than culling it saves
+    const uint32_t kMinSplitTriangles = 128;
+
+    // Candidate planes per axis, between equal slices of the triangle centroids' bounds
+    const uint32_t kSplitBins = 16;
+
+    struct Bounds
+    {
+        float min[3];
+        float max[3];
+
+        void Reset()
+        {
+            min[0] = min[1] = min[2] = FLT_MAX;
+            max[0] = max[1] = max[2] = -FLT_MAX;
+        }
+
+        void Grow(const float p[3])
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                min[k] = std::min(min[k], p[k]);
+                max[k] = std::max(max[k], p[k]);
+            }
+        }
+
+        void Grow(const Bounds &b)
+        {
+            Grow(b.min);
+            Grow(b.max);
+        }
+
+        float Diagonal() const
+        {
+            if (min[0] > max[0])
+                return 0.0f;
+            const float d[3] = { max[0] - min[0], max[1] - min[1], max[2] - min[2] };
+            return sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        }
+
+        float HalfArea() const
+        {
+            if (min[0] > max[0])
+                return 0.0f;
+            const float d[3] = { max[0] - min[0], max[1] - min[1], max[2] - min[2] };
+            return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+        }
+    };
+
+    struct Triangle
+    {
+        Bounds bounds;
+        float centroid[3];
+    };
+
+    // Reorders the count triangles listed in order so that each piece is contiguous, splitting along the plane
+    // with the lowest surface area heuristic cost until every piece is within the limits, and appends the
+    // pieces' triangle counts to pieces
+    void SplitTriangles(const std::vector<Triangle> &triangles, uint32_t *order, uint32_t count,
+        float maxDiagonal, uint32_t maxTriangles, std::vector<uint32_t> &pieces)
+    {
+        Bounds bounds, centroidBounds;
+        bounds.Reset();
+        centroidBounds.Reset();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            bounds.Grow(triangles[order[i]].bounds);
+            centroidBounds.Grow(triangles[order[i]].centroid);
+        }
+
+        const bool tooLarge = maxDiagonal > 0.0f && bounds.Diagonal() > maxDiagonal;
+        const bool tooMany = maxTriangles > 0 && count > maxTriangles;
+        if ((!tooLarge && !tooMany) || count < 2 * kMinSplitTriangles)
+        {
+            pieces.push_back(count);
+            return;
+        }
+
+        int bestAxis = -1;
+        uint32_t bestBin = 0;
+        float bestCost = FLT_MAX;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+            if (extent <= 0.0f)
+                continue;
+            const float binScale = kSplitBins / extent;
+
+            Bounds binBounds[kSplitBins];
+            uint32_t binCounts[kSplitBins] = {};
+            for (uint32_t b = 0; b < kSplitBins; b++)
+                binBounds[b].Reset();
+            for (uint32_t i = 0; i < count; i++)
+            {
+                const Triangle &triangle = triangles[order[i]];
+                const uint32_t b = std::min((uint32_t)((triangle.centroid[axis] - centroidBounds.min[axis]) * binScale), kSplitBins - 1);
+                binBounds[b].Grow(triangle.bounds);
+                binCounts[b]++;
+            }
+
+            // sweep from the right to know every split's right side, then from the left to cost them
+            float rightAreas[kSplitBins];
+            uint32_t rightCounts[kSplitBins];
+            Bounds right;
+            right.Reset();
+            uint32_t rightCount = 0;
+            for (uint32_t b = kSplitBins - 1; b > 0; b--)
+            {
+                right.Grow(binBounds[b]);
+                rightCount += binCounts[b];
+                rightAreas[b] = right.HalfArea();
+                rightCounts[b] = rightCount;
+            }
+
+            Bounds left;
+            left.Reset();
+            uint32_t leftCount = 0;
+            for (uint32_t b = 1; b < kSplitBins; b++)
+            {
+                left.Grow(binBounds[b - 1]);
+                leftCount += binCounts[b - 1];
+                if (leftCount < kMinSplitTriangles || rightCounts[b] < kMinSplitTriangles)
+                    continue;
+
+                const float cost = left.HalfArea() * leftCount + rightAreas[b] * rightCounts[b];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        if (bestAxis < 0)
+        {
+            pieces.push_back(count);
+            return;
+        }
+
+        // stable, so each piece keeps its triangles in the order the mesh had them
+        const float binScale = kSplitBins / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+        uint32_t *middle = std::stable_partition(order, order + count, [&](uint32_t t)
+        {
+            const float offset = triangles[t].centroid[bestAxis] - centroidBounds.min[bestAxis];
+            return std::min((uint32_t)(offset * binScale), kSplitBins - 1) < bestBin;
+        });
+        const uint32_t leftCount = (uint32_t)(middle - order);
+
+        SplitTriangles(triangles, order, leftCount, maxDiagonal, maxTriangles, pieces);
+        SplitTriangles(triangles, middle, count - leftCount, maxDiagonal, maxTriangles, pieces);
+    }
+
+    // Copies the vertices that the triangles use, in the order they are first used, and rewrites the indices
+    uint32_t CompactVertices(const unsigned char *vertexData, uint32_t vertexStride, const uint16_t *srcIndices,
+        const uint32_t *order, uint32_t triangleCount, std::vector<uint32_t> &remap,
+        unsigned char *dstVertexData, uint16_t *dstIndices)
+    {
+        uint32_t vertexCount = 0;
+        for (uint32_t i = 0; i < triangleCount; i++)
+        {
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                const uint16_t index = srcIndices[order[i] * 3 + k];
+                if (remap[index] == (uint32_t)-1)
+                {
+                    memcpy(dstVertexData + vertexCount * vertexStride, vertexData + index * vertexStride, vertexStride);
+                    remap[index] = vertexCount++;
+                }
+                dstIndices[i * 3 + k] = (uint16_t)remap[index];
+            }
+        }
+
+        // leave the remap clear for the next piece
+        for (uint32_t i = 0; i < triangleCount; i++)
+        {
+            for (uint32_t k = 0; k < 3; k++)
+                remap[srcIndices[order[i] * 3 + k]] = (uint32_t)-1;
+        }
+        return vertexCount;
+    }
+}
+
+void AssimpModel::OptimizeSplitMeshes()
+{
+    PrintMeshBounds("before splitting");
+
+    // every piece, in mesh order
+    std::vector<Mesh> meshes;
+    std::vector<std::vector<uint32_t>> orders(m_Header.meshCount);
+    std::vector<std::vector<uint32_t>> pieces(m_Header.meshCount);
+    uint32_t vertexDataByteSize = 0;
+    uint32_t vertexDataByteSizeDepth = 0;
+
+    std::vector<Triangle> triangles;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        const Mesh &mesh = m_pMesh[meshIndex];
+        const unsigned char *positions = m_pVertexData + mesh.vertexDataByteOffset + mesh.attrib[attrib_position].offset;
+        const uint16_t *indices = (const uint16_t*)(m_pIndexData + mesh.indexDataByteOffset);
+        const uint32_t triangleCount = mesh.indexCount / 3;
+
+        triangles.resize(triangleCount);
+        for (uint32_t t = 0; t < triangleCount; t++)
+        {
+            Triangle &triangle = triangles[t];
+            triangle.bounds.Reset();
+            for (uint32_t k = 0; k < 3; k++)
+                triangle.bounds.Grow((const float*)(positions + indices[t * 3 + k] * mesh.vertexStride));
+            for (int k = 0; k < 3; k++)
+                triangle.centroid[k] = (triangle.bounds.min[k] + triangle.bounds.max[k]) * 0.5f;
+        }
+
+        orders[meshIndex].resize(triangleCount);
+        for (uint32_t t = 0; t < triangleCount; t++)
+            orders[meshIndex][t] = t;
+        SplitTriangles(triangles, orders[meshIndex].data(), triangleCount, m_SplitMaxDiagonal, m_SplitMaxTriangles, pieces[meshIndex]);
+
+        // a piece needs at most every vertex of the mesh or three per triangle, reserve that much for each
+        for (uint32_t pieceTriangles : pieces[meshIndex])
+        {
+            meshes.push_back(mesh);
+            vertexDataByteSize += std::min(mesh.vertexCount, pieceTriangles * 3) * mesh.vertexStride;
+            vertexDataByteSizeDepth += std::min(mesh.vertexCountDepth, pieceTriangles * 3) * mesh.vertexStrideDepth;
+        }
+    }
+
+    if (meshes.size() == m_Header.meshCount)
+    {
+        printf("no mesh needed splitting\n");
+        return;
+    }
+
+    unsigned char *vertexData = new unsigned char [vertexDataByteSize];
+    unsigned char *vertexDataDepth = new unsigned char [vertexDataByteSizeDepth];
+    unsigned char *indexData = new unsigned char [m_Header.indexDataByteSize];
+    unsigned char *indexDataDepth = new unsigned char [m_Header.indexDataByteSize];
+    vertexDataByteSize = 0;
+    vertexDataByteSizeDepth = 0;
+    uint32_t indexDataByteSize = 0;
+
+    std::vector<uint32_t> remap;
+    uint32_t pieceIndex = 0;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        const Mesh &mesh = m_pMesh[meshIndex];
+        remap.assign(std::max(mesh.vertexCount, mesh.vertexCountDepth), (uint32_t)-1);
+
+        const uint32_t *order = orders[meshIndex].data();
+        for (uint32_t triangleCount : pieces[meshIndex])
+        {
+            Mesh &piece = meshes[pieceIndex++];
+            piece.indexDataByteOffset = indexDataByteSize;
+            piece.indexCount = triangleCount * 3;
+
+            piece.vertexDataByteOffset = vertexDataByteSize;
+            piece.vertexCount = CompactVertices(m_pVertexData + mesh.vertexDataByteOffset, mesh.vertexStride,
+                (const uint16_t*)(m_pIndexData + mesh.indexDataByteOffset), order, triangleCount, remap,
+                vertexData + vertexDataByteSize, (uint16_t*)(indexData + indexDataByteSize));
+
+            piece.vertexDataByteOffsetDepth = vertexDataByteSizeDepth;
+            piece.vertexCountDepth = CompactVertices(m_pVertexDataDepth + mesh.vertexDataByteOffsetDepth, mesh.vertexStrideDepth,
+                (const uint16_t*)(m_pIndexDataDepth + mesh.indexDataByteOffset), order, triangleCount, remap,
+                vertexDataDepth + vertexDataByteSizeDepth, (uint16_t*)(indexDataDepth + indexDataByteSize));
+
+            vertexDataByteSize += piece.vertexCount * piece.vertexStride;
+            vertexDataByteSizeDepth += piece.vertexCountDepth * piece.vertexStrideDepth;
+            indexDataByteSize += piece.indexCount * sizeof(uint16_t);
+            order += triangleCount;
+        }
+    }
+
+    delete [] m_pVertexData;
+    delete [] m_pVertexDataDepth;
+    delete [] m_pIndexData;
+    delete [] m_pIndexDataDepth;
+    m_pVertexData = vertexData;
+    m_pVertexDataDepth = vertexDataDepth;
+    m_pIndexData = indexData;
+    m_pIndexDataDepth = indexDataDepth;
+    m_Header.vertexDataByteSize = vertexDataByteSize;
+    m_Header.vertexDataByteSizeDepth = vertexDataByteSizeDepth;
+
+    delete [] m_pMesh;
+    m_Header.meshCount = (uint32_t)meshes.size();
+    m_pMesh = new Mesh [m_Header.meshCount];
+    memcpy(m_pMesh, meshes.data(), sizeof(Mesh) * m_Header.meshCount);
+    ComputeAllBoundingBoxes();
+
+    PrintMeshBounds("after splitting");
+}
+
+void AssimpModel::PrintMeshBounds(const char *title) const
+{
+    // meshes by the diagonal of their bounds, bucket n holding those up to 1/2^(bucketCount-1-n) of the scene's
+    enum { bucketCount = 8 };
+    uint32_t meshCounts[bucketCount] = {};
+    uint32_t triangleCounts[bucketCount] = {};
+
+    const float sceneDiagonal = Length(m_Header.boundingBox.max - m_Header.boundingBox.min);
+    float summedArea = 0.0f;
+    for (unsigned int meshIndex = 0; meshIndex < m_Header.meshCount; meshIndex++)
+    {
+        const BoundingBox &bbox = m_pMesh[meshIndex].boundingBox;
+        const Vector3 extent = bbox.max - bbox.min;
+        const float diagonal = Length(extent);
+        summedArea += extent.GetX() * extent.GetY() + extent.GetY() * extent.GetZ() + extent.GetZ() * extent.GetX();
+
+        uint32_t bucket = bucketCount - 1;
+        while (bucket > 0 && diagonal * (float)(1u << (bucketCount - bucket)) <= sceneDiagonal)
+            bucket--;
+        meshCounts[bucket]++;
+        triangleCounts[bucket] += m_pMesh[meshIndex].indexCount / 3;
+    }
+
+    const Vector3 sceneExtent = m_Header.boundingBox.max - m_Header.boundingBox.min;
+    const float sceneArea = sceneExtent.GetX() * sceneExtent.GetY() + sceneExtent.GetY() * sceneExtent.GetZ() + sceneExtent.GetZ() * sceneExtent.GetX();
+    printf("mesh bounds %s: %u meshes, summed surface area %.2f times the scene's\n", title, m_Header.meshCount,
+        sceneArea > 0.0f ? summedArea / sceneArea : 0.0f);
+    for (uint32_t bucket = 0; bucket < bucketCount; bucket++)
+    {
+        printf("  diagonal up to 1/%u of the scene's: %u meshes, %u triangles\n", 1u << (bucketCount - 1 - bucket),
+            meshCounts[bucket], triangleCounts[bucket]);
+    }
+}